@@ -17,6 +17,11 @@
 #include "SCRSceneManager.h"
 #include "TeleImmersionSceneManager.h"
 
+#include <KeyframeIndex.h>
+
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
+
 
 IMPLEMENT_APP(Collage)
 
@@ -80,6 +85,12 @@ bool Collage::OnInit() {
     // Want to be able to load all supported image formats
     wxInitAllImageHandlers();
 
+    // Cache video keyframe indices in the user's data directory
+    wxString cacheDirectory = wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "cache";
+    if (wxFileName::Mkdir(cacheDirectory, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+        KeyframeIndex::SetCacheDirectory(std::string(cacheDirectory.mb_str()));
+    }
+
     // Open initial images
     int w, h;
     frame->GetSize(&w, &h);
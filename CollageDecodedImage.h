@@ -0,0 +1,35 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        CollageDecodedImage.h
+//
+// Author:      David Borland
+//
+// Description: RGBA pixels and metadata for an image decoded off the GL thread, waiting
+//              to be uploaded as a texture
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef COLLAGEDECODEDIMAGE_H
+#define COLLAGEDECODEDIMAGE_H
+
+
+#include "CollageItemMetadata.h"
+
+#include <vector>
+
+
+struct CollageDecodedImage {
+    CollageDecodedImage() : width(0), height(0) {}
+
+    int width;
+    int height;
+
+    // RGBA, bottom row first
+    std::vector<unsigned char> data;
+
+    CollageItemMetadata metadata;
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,391 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        CollageFolderWatcher.cpp
+//
+// Author:      David Borland
+//
+// Description: Watches a directory for new, changed and removed images.  New images are
+//              decoded on a thread pool and handed to the GL thread through GetChanges().
+//              Uses inotify on Linux and polls the directory elsewhere.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "CollageFolderWatcher.h"
+
+#include "CollageGraphics.h"
+#include "CollageMetadataReader.h"
+
+#include <wx/dir.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Not defined by the Windows headers
+#ifndef S_ISREG
+#define S_ISREG(mode) (((mode) & S_IFMT) == S_IFREG)
+#endif
+
+
+// A file is considered complete once its size has not changed for this long
+static const std::chrono::milliseconds debounceInterval(250);
+
+// How often to scan the directory when inotify is not available
+static const std::chrono::milliseconds pollInterval(250);
+
+#ifdef _WIN32
+static const char pathSeparator = '\\';
+#else
+static const char pathSeparator = '/';
+#endif
+
+
+CollageFolderWatcher::CollageFolderWatcher() : stopping(true) {
+#ifdef __linux__
+    inotifyFd = -1;
+    watchDescriptor = -1;
+#endif
+}
+
+CollageFolderWatcher::~CollageFolderWatcher() {
+    Stop();
+}
+
+
+bool CollageFolderWatcher::Watch(const std::string& watchDirectory) {
+    Stop();
+
+    if (!wxDir::Exists(watchDirectory.c_str())) {
+        std::cout << "CollageFolderWatcher::Watch() : " << watchDirectory << " is not a directory." << std::endl;
+        return false;
+    }
+
+    // Store without a trailing separator
+    directory = watchDirectory;
+    while (directory.size() > 1 &&
+           (directory[directory.size() - 1] == '/' || directory[directory.size() - 1] == '\\')) {
+        directory.erase(directory.size() - 1);
+    }
+
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0) {
+        watchDescriptor = inotify_add_watch(inotifyFd, directory.c_str(),
+                                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY |
+                                            IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF);
+        if (watchDescriptor < 0) {
+            close(inotifyFd);
+            inotifyFd = -1;
+        }
+    }
+
+    if (inotifyFd < 0) {
+        std::cout << "CollageFolderWatcher::Watch() : inotify not available, polling " << directory << std::endl;
+    }
+#endif
+
+    std::cout << "CollageFolderWatcher::Watch() : Watching " << directory << std::endl;
+
+    stopping = false;
+    thread = std::thread(&CollageFolderWatcher::WatchLoop, this);
+
+    return true;
+}
+
+void CollageFolderWatcher::Stop() {
+    if (thread.joinable()) {
+        stopping = true;
+        thread.join();
+    }
+    stopping = true;
+
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+        watchDescriptor = -1;
+    }
+#endif
+
+    // Let running decodes finish so they don't outlive the directory they came from
+    pool.Wait();
+
+    pending.clear();
+    known.clear();
+
+    // Changes not yet collected are from the old directory
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (int i = 0; i < (int)added.size(); i++) {
+        delete added[i];
+    }
+
+    added.clear();
+    removed.clear();
+}
+
+
+bool CollageFolderWatcher::IsWatching() const {
+    return !stopping;
+}
+
+const std::string& CollageFolderWatcher::GetDirectory() const {
+    return directory;
+}
+
+
+void CollageFolderWatcher::GetChanges(std::vector<CollageDecodedImage*>& addedImages, std::vector<std::string>& removedFiles) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        addedImages.swap(added);
+        removedFiles.swap(removed);
+    }
+
+    // A file can be removed while it is being decoded, in which case the removal arrives first
+    for (int i = 0; i < (int)addedImages.size(); i++) {
+        FileState state;
+        if (!GetFileState(addedImages[i]->metadata.path, state)) {
+            delete addedImages[i];
+            addedImages.erase(addedImages.begin() + i);
+            i--;
+        }
+    }
+}
+
+
+void CollageFolderWatcher::WatchLoop() {
+    // Pick up anything already in the directory
+    Poll();
+
+    while (!stopping) {
+#ifdef __linux__
+        if (inotifyFd >= 0) {
+            ReadEvents();
+        }
+        else {
+            std::this_thread::sleep_for(pollInterval);
+            Poll();
+        }
+#else
+        std::this_thread::sleep_for(pollInterval);
+        Poll();
+#endif
+
+        CheckPending();
+    }
+}
+
+
+#ifdef __linux__
+void CollageFolderWatcher::ReadEvents() {
+    // Wake up regularly to check pending files and the stop flag
+    pollfd fd;
+    fd.fd = inotifyFd;
+    fd.events = POLLIN;
+    if (poll(&fd, 1, 50) <= 0) return;
+
+    char buffer[4096] __attribute__((aligned(__alignof__(inotify_event))));
+    while (true) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            if (length < 0 && errno != EAGAIN) {
+                std::cout << "CollageFolderWatcher::ReadEvents() : Error reading inotify events." << std::endl;
+            }
+            return;
+        }
+
+        for (char* p = buffer; p < buffer + length; ) {
+            const inotify_event* event = (const inotify_event*)p;
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                std::cout << "CollageFolderWatcher::ReadEvents() : " << directory << " was removed." << std::endl;
+
+                std::vector<std::string> names;
+                for (std::map<std::string, FileState>::iterator it = known.begin(); it != known.end(); it++) {
+                    names.push_back(it->first);
+                }
+                for (int i = 0; i < (int)names.size(); i++) {
+                    FileRemoved(names[i]);
+                }
+                pending.clear();
+
+                stopping = true;
+                return;
+            }
+
+            if (event->len == 0 || (event->mask & IN_ISDIR)) continue;
+
+            std::string name = event->name;
+            if (!IsSupported(name)) continue;
+
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                // The writer is done with it
+                Decode(name);
+            }
+            else if (event->mask & (IN_CREATE | IN_MODIFY)) {
+                FileChanged(name);
+            }
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                FileRemoved(name);
+            }
+        }
+    }
+}
+#endif
+
+void CollageFolderWatcher::Poll() {
+    wxDir dir(directory.c_str());
+    if (!dir.IsOpened()) return;
+
+    std::map<std::string, FileState> seen;
+
+    wxString fileName;
+    bool more = dir.GetFirst(&fileName, wxEmptyString, wxDIR_FILES);
+    while (more) {
+        std::string name = fileName.c_str();
+
+        FileState state;
+        if (IsSupported(name) && GetFileState(FullPath(name), state)) {
+            seen[name] = state;
+
+            std::map<std::string, FileState>::iterator it = known.find(name);
+            if (it == known.end()) {
+                if (pending.find(name) == pending.end()) FileChanged(name);
+            }
+            else if ((it->second.size != state.size || it->second.modified != state.modified) &&
+                     pending.find(name) == pending.end()) {
+                FileChanged(name);
+            }
+        }
+
+        more = dir.GetNext(&fileName);
+    }
+
+    // Anything known that is no longer there has been removed
+    std::vector<std::string> missing;
+    for (std::map<std::string, FileState>::iterator it = known.begin(); it != known.end(); it++) {
+        if (seen.find(it->first) == seen.end()) missing.push_back(it->first);
+    }
+    for (int i = 0; i < (int)missing.size(); i++) {
+        FileRemoved(missing[i]);
+    }
+}
+
+
+void CollageFolderWatcher::CheckPending() {
+    Clock::time_point now = Clock::now();
+
+    std::vector<std::string> ready;
+    for (std::map<std::string, PendingFile>::iterator it = pending.begin(); it != pending.end(); ) {
+        FileState state;
+        if (!GetFileState(FullPath(it->first), state)) {
+            // Gone before it was finished
+            pending.erase(it++);
+            continue;
+        }
+
+        if (state.size != it->second.size) {
+            it->second.size = state.size;
+            it->second.lastChange = now;
+        }
+        else if (state.size > 0 && now - it->second.lastChange >= debounceInterval) {
+            ready.push_back(it->first);
+        }
+
+        it++;
+    }
+
+    for (int i = 0; i < (int)ready.size(); i++) {
+        Decode(ready[i]);
+    }
+}
+
+
+void CollageFolderWatcher::FileChanged(const std::string& name) {
+    PendingFile file;
+    FileState state;
+    file.size = GetFileState(FullPath(name), state) ? state.size : 0;
+    file.lastChange = Clock::now();
+
+    pending[name] = file;
+}
+
+void CollageFolderWatcher::FileRemoved(const std::string& name) {
+    pending.erase(name);
+
+    if (known.erase(name) > 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        removed.push_back(FullPath(name));
+    }
+}
+
+void CollageFolderWatcher::Decode(const std::string& name) {
+    pending.erase(name);
+
+    std::string path = FullPath(name);
+
+    FileState state;
+    if (!GetFileState(path, state)) return;
+    known[name] = state;
+
+    pool.Enqueue([this, path]() {
+        CollageItemMetadata header;
+        CollageMetadataReader::ReadFile(path, header);
+
+        CollageDecodedImage* image = new CollageDecodedImage();
+        if (!CollageGraphics::DecodeImage(path, header, *image)) {
+            delete image;
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        added.push_back(image);
+    });
+}
+
+
+std::string CollageFolderWatcher::FullPath(const std::string& name) const {
+    return directory + pathSeparator + name;
+}
+
+
+bool CollageFolderWatcher::IsSupported(const std::string& name) {
+    // Skip hidden and temporary files written by copy tools
+    if (name.empty() || name[0] == '.') return false;
+
+    std::string::size_type dot = name.rfind('.');
+    if (dot == std::string::npos) return false;
+
+    std::string extension = name.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    return extension == "bmp" ||
+           extension == "gif" ||
+           extension == "jpg" ||
+           extension == "jpeg" ||
+           extension == "png" ||
+           extension == "tga" ||
+           extension == "tif" ||
+           extension == "tiff";
+}
+
+bool CollageFolderWatcher::GetFileState(const std::string& path, FileState& state) {
+    struct stat s;
+    if (stat(path.c_str(), &s) != 0) return false;
+    if (!S_ISREG(s.st_mode)) return false;
+
+    state.size = s.st_size;
+    state.modified = s.st_mtime;
+
+    return true;
+}
\ No newline at end of file
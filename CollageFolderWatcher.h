@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        CollageFolderWatcher.h
+//
+// Author:      David Borland
+//
+// Description: Watches a directory for new, changed and removed images.  New images are
+//              decoded on a thread pool and handed to the GL thread through GetChanges().
+//              Uses inotify on Linux and polls the directory elsewhere.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef COLLAGEFOLDERWATCHER_H
+#define COLLAGEFOLDERWATCHER_H
+
+
+#include "CollageDecodedImage.h"
+
+#include <ThreadPool.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class CollageFolderWatcher {
+public:
+    CollageFolderWatcher();
+    ~CollageFolderWatcher();
+
+    // Start watching a directory.  Images already in the directory are loaded as well.
+    bool Watch(const std::string& directory);
+    void Stop();
+
+    bool IsWatching() const;
+    const std::string& GetDirectory() const;
+
+    // Called from the GL thread.  Ownership of the decoded images passes to the caller.
+    // A file that is rewritten is returned as added again, and should replace the old image.
+    void GetChanges(std::vector<CollageDecodedImage*>& added, std::vector<std::string>& removed);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // A file that has been created or written to, but may still be being written
+    struct PendingFile {
+        long long size;
+        Clock::time_point lastChange;
+    };
+
+    // Last seen state of a file, for polling
+    struct FileState {
+        long long size;
+        time_t modified;
+    };
+
+    std::string directory;
+
+    std::thread thread;
+    std::atomic<bool> stopping;
+
+    // Accessed only from the watch thread
+    std::map<std::string, PendingFile> pending;
+    std::map<std::string, FileState> known;
+
+#ifdef __linux__
+    int inotifyFd;
+    int watchDescriptor;
+#endif
+
+    // Results waiting for the GL thread
+    std::mutex mutex;
+    std::vector<CollageDecodedImage*> added;
+    std::vector<std::string> removed;
+
+    // Destroyed before the results above, so running decodes can finish
+    ThreadPool pool;
+
+    void WatchLoop();
+
+#ifdef __linux__
+    void ReadEvents();
+#endif
+    void Poll();
+
+    // Move pending files whose size has stopped changing to the decode queue
+    void CheckPending();
+
+    void FileChanged(const std::string& name);
+    void FileRemoved(const std::string& name);
+    void Decode(const std::string& name);
+
+    std::string FullPath(const std::string& name) const;
+
+    static bool IsSupported(const std::string& name);
+    static bool GetFileState(const std::string& path, FileState& state);
+};
+
+
+#endif
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include "CollageGraphics.h"
 
 #include <wx/colordlg.h>
+#include <wx/dirdlg.h>
 
 #include <string>
 #include <vector>
@@ -46,6 +47,14 @@ void CollageFrame::OnKey(wxKeyEvent& e) {
         // Open media
         ChooseMedia(e.GetX(), e.GetY());
     }
+    else if (c == 'w') {
+        // Watch a folder
+        ChooseWatchFolder(e.GetX(), e.GetY());
+    }
+    else if (c == 'i') {
+        // Play a directory of numbered images as a video
+        ChooseImageSequence(e.GetX(), e.GetY());
+    }
     else if (c == 'b') {
         // Select background color
         ChooseBackgroundColor(e.GetX(), e.GetY());
@@ -109,6 +118,11 @@ WMV files (*.wmv)|*.wmv",
         // Pass to the graphics
         CollageGraphics* cg = static_cast<CollageGraphics*>(graphics);
         int startImage = cg->GetImages().size();
+
+        // Read all of the headers up front, in parallel
+        std::vector<CollageItemMetadata> metadata;
+        cg->ReadMetadata(paths, metadata);
+
         for (int i = 0; i < (int)paths.size(); i++) {
             std::string extension = paths[i].substr(paths[i].rfind('.') + 1);
             if (extension.compare("avi") == 0 ||
@@ -121,7 +135,7 @@ WMV files (*.wmv)|*.wmv",
                 cg->LoadVideo(paths[i], true);
             }
             else {
-                cg->LoadImage(paths[i]);
+                cg->LoadImage(paths[i], &metadata[i]);
             }
             cg->DoLayout(startImage);
 
@@ -131,6 +145,34 @@ WMV files (*.wmv)|*.wmv",
 }
 
 
+void CollageFrame::ChooseWatchFolder(wxCoord x, wxCoord y) {
+    // Dialogs can be created on the stack
+    wxDirDialog dirDialog(this, "Watch folder", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+
+    // Set the position
+    dirDialog.SetPosition(wxPoint(x, y));
+
+    if (dirDialog.ShowModal() == wxID_OK) {
+        // Images already in the folder and any that show up later are loaded from the Update() loop
+        std::string directory = dirDialog.GetPath().c_str();
+        static_cast<CollageGraphics*>(graphics)->WatchFolder(directory);
+    }
+}
+
+void CollageFrame::ChooseImageSequence(wxCoord x, wxCoord y) {
+    // Dialogs can be created on the stack
+    wxDirDialog dirDialog(this, "Image sequence", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+
+    // Set the position
+    dirDialog.SetPosition(wxPoint(x, y));
+
+    if (dirDialog.ShowModal() == wxID_OK) {
+        std::string directory = dirDialog.GetPath().c_str();
+        static_cast<CollageGraphics*>(graphics)->LoadImageSequence(directory);
+    }
+}
+
+
 void CollageFrame::ChooseBackgroundColor(wxCoord x, wxCoord y) {
     // Dialogs can be created on the stack
     wxColourDialog colorDialog;
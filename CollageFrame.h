@@ -26,6 +26,8 @@ public:
     void OnMouse(wxMouseEvent& e);
 
     void ChooseMedia(wxCoord x, wxCoord y);
+    void ChooseWatchFolder(wxCoord x, wxCoord y);
+    void ChooseImageSequence(wxCoord x, wxCoord y);
     void ChooseBackgroundColor(wxCoord x, wxCoord y);
 
 protected:
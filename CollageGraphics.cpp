@@ -10,11 +10,19 @@
 
 
 #include "CollageGraphics.h"
+#include "CollageFolderWatcher.h"
+#ifdef _WIN32
 #include <VideoFile.h>
+#else
+#include <FFmpegVideoFile.h>
+#endif
+#include <ImageSequenceVideo.h>
+#include <VideoPoster.h>
 #include <iostream>
 #include <fstream>
 #include <time.h>
 #include <algorithm>
+#include <wx/filefn.h>
 
 
 CollageGraphics::CollageGraphics(Image::Behavior imageBehaviorType) 
@@ -22,6 +30,7 @@ CollageGraphics::CollageGraphics(Image::Behavior imageBehaviorType)
 	layoutManagerFactory = NULL;
 	layoutManager = NULL;
     sceneManager = NULL;
+	folderWatcher = NULL;
 	imageLoadCounter = 0;
 
     // OpenGL attributes
@@ -43,17 +52,20 @@ CollageGraphics::CollageGraphics(Image::Behavior imageBehaviorType)
 }
 
 CollageGraphics::~CollageGraphics() {
-	// Clean up
-	for (int i = 0; i < (int)images.size(); i++) {
-		delete images[i];
-	}
-
+	// Clean up.  Videos first, as they may be decoding into their images' buffers.
 	for (int i = 0; i < (int)videos.size(); i++) {
+		videoScheduler.RemoveStream(videos[i]);
 		delete videos[i];
 	}
 
+	for (int i = 0; i < (int)images.size(); i++) {
+		delete images[i];
+	}
+
 	if (sceneManager) delete sceneManager;
 
+	if (folderWatcher) delete folderWatcher;
+
     delete attribList;
 
 //	delete font;
@@ -75,9 +87,18 @@ int* CollageGraphics::GetAttribList() {
 
 
 void CollageGraphics::Update() {
-    for (int i = 0; i < (int)videos.size(); i++) {
-		videos[i]->Update();
+	// Decode videos at the size they are shown
+	for (int i = 0; i < (int)videos.size(); i++) {
+		CollageImage* image = static_cast<CollageImage*>(videos[i]->GetImage());
+		if (image) videos[i]->SetTargetHeight(image->GetScreenHeight());
 	}
+
+	StartVisibleVideos();
+
+	// Present all videos against the same clock
+	videoScheduler.Update();
+
+	if (folderWatcher) UpdateWatchedFolder();
 }
 
 
@@ -273,6 +294,38 @@ void CollageGraphics::OnKey(wxKeyEvent& e) {
 		SortDisplay(metadataSortPath);
 		DoLayout();
 	}
+	else if (c == ';') {
+		// sort by title
+		SortDisplay(metadataSortTitle);
+		DoLayout();
+	}
+	else if (c == '\'') {
+		// sort by capture time
+		SortDisplay(metadataSortCaptureTimestamp);
+		DoLayout();
+	}
+	else if (c == 'v') {
+		// print video frame counts
+		for (int i = 0; i < (int)videos.size(); i++) {
+			VideoStream::FrameStats stats = videos[i]->GetFrameStats();
+			std::cout << "CollageGraphics::OnKey() : " << videos[i]->GetName() 
+			          << " decoded " << stats.decoded 
+			          << " uploaded " << stats.uploaded 
+			          << " skipped " << stats.skipped 
+			          << " dropped " << stats.dropped 
+			          << " drift " << stats.drift 
+			          << " max drift " << stats.maxDrift << std::endl;
+		}
+
+		VideoScheduler::Stats schedulerStats = videoScheduler.GetStats();
+		std::cout << "CollageGraphics::OnKey() : " << schedulerStats.streams << " videos" 
+		          << " presented " << schedulerStats.presented 
+		          << " dropped " << schedulerStats.dropped 
+		          << " mean drift " << schedulerStats.meanDrift 
+		          << " max drift " << schedulerStats.maxDrift 
+		          << " skew " << schedulerStats.skew << std::endl;
+		videoScheduler.ResetStats();
+	}
 	// ************** end test keys *************************
 	else if (c == 'l') {
 		DoLayout();
@@ -376,14 +429,35 @@ void CollageGraphics::DoLayout(unsigned int start) {
 }
 
 
-void CollageGraphics::LoadImage(const std::string& fileName) {
+void CollageGraphics::ReadMetadata(const std::vector<std::string>& fileNames, std::vector<CollageItemMetadata>& metadata) {
+	metadataReader.Read(fileNames, metadata);
+}
+
+
+void CollageGraphics::LoadImage(const std::string& fileName, const CollageItemMetadata* headerMetadata) {
 
 	std::cout << "CollageGraphics::LoadImage() : Loading " << fileName << std::endl;
 
+	// Read the header if it hasn't been read already
+	CollageItemMetadata header;
+	if (headerMetadata) {
+		header = *headerMetadata;
+	}
+	else {
+		CollageMetadataReader::ReadFile(fileName, header);
+	}
+
+	CollageDecodedImage decoded;
+	if (!DecodeImage(fileName, header, decoded)) return;
+
+	AddImage(decoded);
+}
+
+bool CollageGraphics::DecodeImage(const std::string& fileName, const CollageItemMetadata& header, CollageDecodedImage& decoded) {
 	// Check to see if we can load this image type
 	if (!wxImage::CanRead(fileName)) {
-		std::cout << "CollageGraphics::LoadImage() : Cannot load this image type." << std::endl;
-		return;
+		std::cout << "CollageGraphics::DecodeImage() : Cannot load this image type." << std::endl;
+		return false;
 	}
 
 	// Load the image
@@ -391,14 +465,14 @@ void CollageGraphics::LoadImage(const std::string& fileName) {
 
 	// Check for validity
 	if (!image.IsOk()) {
-		std::cout << "CollageGraphics::LoadImage() : Could not load image." << std::endl;
-		return;
+		std::cout << "CollageGraphics::DecodeImage() : Could not load image." << std::endl;
+		return false;
 	}
 
 	// get the file name and parse out parts
 
 	int posDot = fileName.find_last_of('.');
-	int posFileSlash = fileName.find_last_of('\\');
+	int posFileSlash = fileName.find_last_of("\\/");
 
 	// extension is backwards to the '.'
 	// file name is between the . and the first '\'
@@ -409,9 +483,33 @@ void CollageGraphics::LoadImage(const std::string& fileName) {
 	// need to trim off the slash(start at next pos)
 	//std::string filePathPart = fileName.substr(0, posFileSlash + 1);
 
-	// get the file timestamp
-	wxFSFile* file = fs.OpenFile(wxString(fileName));
-	wxDateTime fileTime = file->GetModificationTime();
+	// get the file timestamp, without wxFileSystem so this can run off the main thread
+	time_t fileTime = wxFileModificationTime(fileName.c_str());
+
+	// Apply the EXIF orientation
+	switch (header.orientation) {
+		case 2:
+			image = image.Mirror(true);
+			break;
+		case 3:
+			image = image.Mirror(true).Mirror(false);
+			break;
+		case 4:
+			image = image.Mirror(false);
+			break;
+		case 5:
+			image = image.Rotate90(true).Mirror(true);
+			break;
+		case 6:
+			image = image.Rotate90(true);
+			break;
+		case 7:
+			image = image.Rotate90(false).Mirror(true);
+			break;
+		case 8:
+			image = image.Rotate90(false);
+			break;
+	}
 
 	// Flip the image
 	image = image.Mirror(false);
@@ -422,118 +520,271 @@ void CollageGraphics::LoadImage(const std::string& fileName) {
 	int height = image.GetHeight();
 
 
-	// Check the pixel format
-	Image::PixelFormat pixelFormat;
-	unsigned char* imageData;
-	if (image.HasAlpha()) {
-		// wxImage does not store alpha along with RGB, so need to insert it
-		imageData = new unsigned char[width * height * 4];
-		unsigned char* tempRGB = image.GetData();
-		unsigned char* tempAlpha = image.GetAlpha();
-		for (int i = 0; i < height; i++) {
-			for (int j = 0; j < width; j++) {
-				imageData[i * width * 4 + j * 4 + 0] = tempRGB[i * width * 3 + j * 3 + 0];      // Red
-				imageData[i * width * 4 + j * 4 + 1] = tempRGB[i * width * 3 + j * 3 + 1];      // Green
-				imageData[i * width * 4 + j * 4 + 2] = tempRGB[i * width * 3 + j * 3 + 2];      // Blue
-				imageData[i * width * 4 + j * 4 + 3] = tempAlpha[i * width + j];                // Alpha
-			}
-		}        
-		pixelFormat = Image::RGBA;
-	}
-	else {
-		// GL_TEXTURE_RECTANGLE_ARB does not appear to work correctly for non-RGBA images with odd dimensions, so pad with an alpha channel.
-		imageData = new unsigned char[width * height * 4];
-		unsigned char* tempRGB = image.GetData();
-		for (int i = 0; i < height; i++) {
-			for (int j = 0; j < width; j++) {
-				imageData[i * width * 4 + j * 4 + 0] = tempRGB[i * width * 3 + j * 3 + 0];      // Red
-				imageData[i * width * 4 + j * 4 + 1] = tempRGB[i * width * 3 + j * 3 + 1];      // Green
-				imageData[i * width * 4 + j * 4 + 2] = tempRGB[i * width * 3 + j * 3 + 2];      // Blue
-				imageData[i * width * 4 + j * 4 + 3] = 255;                                     // Alpha
-			}
-		}        
-		pixelFormat = Image::RGBA;
+	// GL_TEXTURE_RECTANGLE_ARB does not appear to work correctly for non-RGBA images with odd dimensions, 
+	// so always use RGBA.  wxImage does not store alpha along with RGB, so need to insert it
+	decoded.data.resize(width * height * 4);
+	unsigned char* imageData = &decoded.data[0];
+	unsigned char* tempRGB = image.GetData();
+	unsigned char* tempAlpha = image.HasAlpha() ? image.GetAlpha() : NULL;
+	for (int i = 0; i < height; i++) {
+		for (int j = 0; j < width; j++) {
+			imageData[i * width * 4 + j * 4 + 0] = tempRGB[i * width * 3 + j * 3 + 0];                  // Red
+			imageData[i * width * 4 + j * 4 + 1] = tempRGB[i * width * 3 + j * 3 + 1];                  // Green
+			imageData[i * width * 4 + j * 4 + 2] = tempRGB[i * width * 3 + j * 3 + 2];                  // Blue
+			imageData[i * width * 4 + j * 4 + 3] = tempAlpha ? tempAlpha[i * width + j] : 255;          // Alpha
+		}
 	}
 
+	decoded.width = width;
+	decoded.height = height;
+
+	// initialize image metadata
+	decoded.metadata = header;
+	decoded.metadata.fileName = fileNamePart;
+	decoded.metadata.fileNameExtension = extension;
+	decoded.metadata.path = fileName;
+	decoded.metadata.itemSetOrder = 0;
+	decoded.metadata.itemTimestamp = fileTime;
+	decoded.metadata.width = width;
+	decoded.metadata.height = height;
+
+	return true;
+}
+
+bool CollageGraphics::AddImage(CollageDecodedImage& decoded) {
 	// Create the image
     images.push_back(new CollageImage(imageBehavior));
-	if (!images.back()->SetTextureInfo(width, height, pixelFormat)) {
-		std::cout << "CollageGraphics::LoadImage() : Could not create texture." << std::endl;
+	if (!images.back()->SetTextureInfo(decoded.width, decoded.height, Image::RGBA)) {
+		std::cout << "CollageGraphics::AddImage() : Could not create texture." << std::endl;
 
 		delete images.back();
 		images.pop_back();
 
-		delete imageData;
-
-		return;
+		return false;
 	}
 
-	if (!images.back()->SetTextureData(imageData)) {
-		std::cout << "CollageGraphics::LoadImage() : Could not set texture data." << std::endl;
-
+	if (!images.back()->SetTextureData(&decoded.data[0])) {
+		std::cout << "CollageGraphics::AddImage() : Could not set texture data." << std::endl;
 
 		delete images.back();
 		images.pop_back();
 
-		delete imageData;
-
-		return;
-
+		return false;
 	}
 
 	images.back()->SetViewExtents(0.0, viewWidth, 0.0, viewHeight);
     images.back()->SetWindowHeight(windowHeight);
 	images.back()->NativeResolution();
 
-	// initialize image metadata
 	CollageItemMetadata* metadata = images.back()->GetCollageItemMetadata();
-	metadata->fileName = fileNamePart;
-	metadata->fileNameExtension = extension;
-	metadata->path = fileName;
-	metadata->itemSetOrder = 0;
+	*metadata = decoded.metadata;
 	metadata->itemLoadOrder = imageLoadCounter++;
-	metadata->itemTimestamp = fileTime.GetTicks();
 
 	// add a reference to CollageGraphics to the image
 	images.back()->SetCollageGraphics(this);
 
-	delete imageData;
+	return true;
 }
 
 void CollageGraphics::LoadVideo(const std::string& fileName, bool quickTime) {
 	std::cout << "CollageGraphics::LoadVideo() : Loading " << fileName << std::endl;
 
 
-	// Create an image
-	images.push_back(new CollageImage(imageBehavior));
+	// Show the poster frame right away.  The video is only opened once it is shown large enough
+	// to be worth playing.
+	VideoPoster poster;
+	if (poster.Load(fileName)) {
+		CollageDecodedImage decoded;
+		decoded.width = poster.GetWidth();
+		decoded.height = poster.GetHeight();
+		decoded.data = poster.GetData();
+
+		SetFileMetadata(fileName, decoded.metadata);
+		decoded.metadata.width = poster.GetVideoWidth();
+		decoded.metadata.height = poster.GetVideoHeight();
+		decoded.metadata.duration = poster.GetDuration();
+
+		if (AddImage(decoded)) {
+			// Native size of the video rather than the poster
+			images.back()->SetScale((float)poster.GetVideoHeight() / (float)windowHeight);
+
+			PendingVideo pending = { fileName, quickTime, images.back() };
+			pendingVideos.push_back(pending);
 
-	// TODO:  add code to insert metadata
+			return;
+		}
+	}
 
-	// Create the video
-	videos.push_back(new VideoFile());
+	StartVideo(fileName, quickTime);
+}
+
+void CollageGraphics::StartVideo(const std::string& fileName, bool quickTime, CollageImage* image) {
+	// Create the video.  DirectShow on Windows, FFmpeg elsewhere.
+#ifdef _WIN32
+	VideoFile* video = new VideoFile();
 	VideoStream::VideoType videoType = quickTime ? VideoStream::RGBA : VideoStream::RGB;
-	if (!videos.back()->Initialize(fileName, images.back(), videoType)) {
-		std::cout << "CollageGraphics::LoadVideo() : Video initialization failed." << std::endl;
+#else
+	// Planar YUV cuts the upload to less than half of RGBA.  Converted to RGB when rendered.
+	FFmpegVideoFile* video = new FFmpegVideoFile();
+	VideoStream::VideoType videoType = VideoStream::YUV420;
+#endif
+	video->SetLoop(true);
+
+	AddVideo(video, fileName, videoType, image);
+}
+
+void CollageGraphics::LoadImageSequence(const std::string& path, double frameRate) {
+	std::cout << "CollageGraphics::LoadImageSequence() : Loading " << path << std::endl;
 
-		delete images.back();
-		images.pop_back();
+
+	ImageSequenceVideo* video = new ImageSequenceVideo();
+	video->SetFrameRate(frameRate);
+	video->SetLoop(true);
+
+	// RGB keeps full color resolution for the sharp edges in rendered frames
+	AddVideo(video, path, VideoStream::RGB);
+}
+
+bool CollageGraphics::AddVideo(VideoStream* video, const std::string& name, VideoStream::VideoType videoType, CollageImage* image) {
+	// Create an image unless there is one showing the poster, which stays until the first
+	// frame is uploaded
+	bool newImage = image == NULL;
+	if (newImage) {
+		images.push_back(new CollageImage(imageBehavior));
+		image = images.back();
+	}
+	else {
+		image->KeepTextureUntilData();
+	}
+
+	videos.push_back(video);
+	if (!videos.back()->Initialize(name, image, videoType)) {
+		std::cout << "CollageGraphics::AddVideo() : Video initialization failed." << std::endl;
+
+		if (newImage) {
+			delete images.back();
+			images.pop_back();
+		}
 
 		delete videos.back();
 		videos.pop_back();
 
-		return;
+		return false;
 	}
-	static_cast<VideoFile*>(videos.back())->SetLoop(true);
 
 
 	// Finish image setup
-	images.back()->SetViewExtents(0.0, viewWidth, 0.0, viewHeight);    
-    images.back()->SetWindowHeight(windowHeight);
-	images.back()->NativeResolution();  
+	if (newImage) {
+		image->SetViewExtents(0.0, viewWidth, 0.0, viewHeight);    
+		image->SetWindowHeight(windowHeight);
+		image->NativeResolution();  
+
+		CollageItemMetadata* metadata = image->GetCollageItemMetadata();
+		SetFileMetadata(name, *metadata);
+		metadata->width = video->GetWidth();
+		metadata->height = video->GetHeight();
+		metadata->itemLoadOrder = imageLoadCounter++;
+
+		image->SetCollageGraphics(this);
+	}
+
+
+	// Play the image on the shared clock
+	videoScheduler.AddStream(video);
+	video->Play();
+
+	return true;
+}
+
+
+void CollageGraphics::StartVisibleVideos() {
+	// Posters shown smaller than this stay still
+	const int minHeight = 64;
+
+	for (int i = 0; i < (int)pendingVideos.size(); i++) {
+		CollageImage* image = pendingVideos[i].image;
+		if (image->GetVisibleFraction() <= 0.0f || image->GetScreenHeight() < minHeight) continue;
+
+		PendingVideo pending = pendingVideos[i];
+		pendingVideos.erase(pendingVideos.begin() + i);
+		i--;
+
+		// The poster stays if the video can't be played
+		std::cout << "CollageGraphics::StartVisibleVideos() : Starting " << pending.fileName << std::endl;
+		StartVideo(pending.fileName, pending.quickTime, pending.image);
+	}
+}
+
+void CollageGraphics::RemovePendingVideo(CollageImage* image) {
+	for (int i = 0; i < (int)pendingVideos.size(); i++) {
+		if (pendingVideos[i].image == image) {
+			pendingVideos.erase(pendingVideos.begin() + i);
+			return;
+		}
+	}
+}
+
 
+void CollageGraphics::SetFileMetadata(const std::string& fileName, CollageItemMetadata& metadata) {
+	std::string::size_type posDot = fileName.find_last_of('.');
+	std::string::size_type posFileSlash = fileName.find_last_of("\\/");
+	std::string::size_type start = posFileSlash == std::string::npos ? 0 : posFileSlash + 1;
 
-	// Play the image
-	videos.back()->Play();
+	if (posDot == std::string::npos || posDot < start) posDot = fileName.size();
+
+	metadata.fileName = fileName.substr(start, posDot - start);
+	metadata.fileNameExtension = posDot < fileName.size() ? fileName.substr(posDot + 1) : "";
+	metadata.path = fileName;
+	metadata.itemSetOrder = 0;
+	metadata.itemTimestamp = wxFileModificationTime(fileName.c_str());
+}
+
+
+void CollageGraphics::WatchFolder(const std::string& directory) {
+	if (!folderWatcher) folderWatcher = new CollageFolderWatcher();
+
+	folderWatcher->Watch(directory);
+}
+
+void CollageGraphics::UpdateWatchedFolder() {
+	std::vector<CollageDecodedImage*> added;
+	std::vector<std::string> removed;
+	folderWatcher->GetChanges(added, removed);
+
+	for (int i = 0; i < (int)removed.size(); i++) {
+		std::cout << "CollageGraphics::UpdateWatchedFolder() : Removing " << removed[i] << std::endl;
+		RemoveImage(removed[i]);
+	}
+
+	if (added.empty()) return;
+
+	unsigned int start = images.size();
+	for (int i = 0; i < (int)added.size(); i++) {
+		std::cout << "CollageGraphics::UpdateWatchedFolder() : Adding " << added[i]->metadata.path << std::endl;
+
+		// A rewritten file replaces the old image
+		RemoveImage(added[i]->metadata.path);
+		if (images.size() < start) start = images.size();
+
+		AddImage(*added[i]);
+		delete added[i];
+	}
+
+	// Only place the new images
+	DoLayout(start);
+}
+
+void CollageGraphics::RemoveImage(const std::string& path) {
+	for (int i = 0; i < (int)images.size(); i++) {
+		if (images[i]->GetCollageItemMetadata()->path == path) {
+			RemoveFromCurrent(images[i]);
+			RemovePendingVideo(images[i]);
+
+			delete images[i];
+			images.erase(images.begin() + i);
+			return;
+		}
+	}
 }
 
 
@@ -585,11 +836,13 @@ void CollageGraphics::Delete() {
 				for (int k = 0; k < (int)videos.size(); k++) {
 					if (videos[k]->GetImage() == images[i]) {
 						// Remove video
+						videoScheduler.RemoveStream(videos[k]);
 						delete videos[k];
 						videos.erase(videos.begin() + k);
 						break;
 					}
 				}
+				RemovePendingVideo(images[i]);
 
 				delete images[i];
 				images.erase(images.begin() + i);
@@ -691,6 +944,12 @@ void CollageGraphics::SortDisplay(MetadataSortOption option) {
 		case metadataSortPath:
 			std::sort(images.begin(), images.end(), ComparePath);
 			break;
+		case metadataSortTitle:
+			std::sort(images.begin(), images.end(), CompareTitle);
+			break;
+		case metadataSortCaptureTimestamp:
+			std::sort(images.begin(), images.end(), CompareCaptureTimestamp);
+			break;
 	}
 
 }
@@ -749,4 +1008,19 @@ bool ComparePath(CollageImage* imageA, CollageImage* imageB) {
 
 bool CompareTimestamp(CollageImage* imageA, CollageImage* imageB) {
 	return (imageA->GetCollageItemMetadata()->itemTimestamp < imageB->GetCollageItemMetadata()->itemTimestamp);
+}
+
+bool CompareTitle(CollageImage* imageA, CollageImage* imageB) {
+	return (imageA->GetCollageItemMetadata()->title < imageB->GetCollageItemMetadata()->title);
+}
+
+// Fall back to the file timestamp for images without a capture time
+bool CompareCaptureTimestamp(CollageImage* imageA, CollageImage* imageB) {
+	CollageItemMetadata* a = imageA->GetCollageItemMetadata();
+	CollageItemMetadata* b = imageB->GetCollageItemMetadata();
+
+	time_t timeA = a->captureTimestamp != 0 ? a->captureTimestamp : a->itemTimestamp;
+	time_t timeB = b->captureTimestamp != 0 ? b->captureTimestamp : b->itemTimestamp;
+
+	return timeA < timeB;
 }
\ No newline at end of file
@@ -22,12 +22,15 @@
 #define COLLAGEGRAPHICS_H
 
 #include <RenciGraphics.h>
+#include <VideoScheduler.h>
 #include <VideoStream.h>
 
 #include "CollageImage.h"
 #include "CollageLayoutManagerFactory.h"
 #include "SceneManager.h"
 #include "CollageItemMetadata.h"
+#include "CollageMetadataReader.h"
+#include "CollageDecodedImage.h"
 
 #include <string>
 #include <vector>
@@ -38,6 +41,7 @@
 
 // Forward declarations
 class CollageLayoutManager;
+class CollageFolderWatcher;
 
 
 class CollageGraphics : public RenciGraphics {
@@ -61,8 +65,22 @@ public:
     virtual void OnKey(wxKeyEvent& e);
     virtual void OnMouse(wxMouseEvent& e);
 
-    void LoadImage(const std::string& fileName);
+    // Read header metadata for a set of files in parallel, before any of them are decoded
+    void ReadMetadata(const std::vector<std::string>& fileNames, std::vector<CollageItemMetadata>& metadata);
+
+    // If no header metadata is given, the header will be read here
+    void LoadImage(const std::string& fileName, const CollageItemMetadata* headerMetadata = NULL);
     void LoadVideo(const std::string& fileName, bool quickTime = false);
+
+    // Play a directory of numbered image files, or the sequence a numbered file belongs to
+    void LoadImageSequence(const std::string& path, double frameRate = 30.0);
+
+    // Decode an image into RGBA without touching OpenGL, so it can be called from any thread
+    static bool DecodeImage(const std::string& fileName, const CollageItemMetadata& header, CollageDecodedImage& decoded);
+
+    // Watch a directory, adding new images and removing deleted ones as they change
+    void WatchFolder(const std::string& directory);
+
 	bool IsShowTitle();
 	bool IsRenderLeft();
 
@@ -83,10 +101,22 @@ private:
     std::vector<CollageImage*> images;
     std::vector<CollageImage*> currentImages;
     std::vector<VideoStream*> videos;
+    VideoScheduler videoScheduler;
+
+    // Videos shown as a poster frame until they are worth playing
+    struct PendingVideo {
+        std::string fileName;
+        bool quickTime;
+        CollageImage* image;
+    };
+    std::vector<PendingVideo> pendingVideos;
 	wxFileSystem fs;
 //    FTFont* font;
 	unsigned int imageLoadCounter;
 
+    CollageMetadataReader metadataReader;
+    CollageFolderWatcher* folderWatcher;
+
     Image::Behavior imageBehavior;
 
     // For wxGLCanvas
@@ -113,6 +143,25 @@ private:
     void RemoveFromCurrent(CollageImage* image);
     void Delete();
 
+    // Upload a decoded image as a new CollageImage
+    bool AddImage(CollageDecodedImage& decoded);
+    void RemoveImage(const std::string& path);
+
+    // Start a video on the shared clock, in the given image or a new one.  Deletes the video 
+    // on failure.
+    bool AddVideo(VideoStream* video, const std::string& name, VideoStream::VideoType videoType, 
+                  CollageImage* image = NULL);
+    void StartVideo(const std::string& fileName, bool quickTime, CollageImage* image = NULL);
+
+    // Start the videos shown as posters once they are visible and large enough to matter
+    void StartVisibleVideos();
+    void RemovePendingVideo(CollageImage* image);
+
+    static void SetFileMetadata(const std::string& fileName, CollageItemMetadata& metadata);
+
+    // Apply changes from the folder watcher
+    void UpdateWatchedFolder();
+
 	void SortDisplay(MetadataSortOption option);
 
 	// methods are called by collage when rendering the left and right screens, facilitating any code that 
@@ -125,6 +174,8 @@ private:
 bool CompareFileName(CollageImage* imageA, CollageImage* imageB);
 bool ComparePath(CollageImage* imageA, CollageImage* imageB);
 bool CompareTimestamp(CollageImage* imageA, CollageImage* imageB);
+bool CompareTitle(CollageImage* imageA, CollageImage* imageB);
+bool CompareCaptureTimestamp(CollageImage* imageA, CollageImage* imageB);
 
 
 #endif
\ No newline at end of file
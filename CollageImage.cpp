@@ -99,6 +99,10 @@ void CollageImage::NativeResolution() {
     SetScale((float)resolution[1] / (float)windowHeight);
 }
 
+int CollageImage::GetScreenHeight() {
+    return (int)(scale * windowHeight + 0.5);
+}
+
 
 void CollageImage::GetExtent(float& left, float& right, float& bottom, float& top) {
 	left = position.X() - aspectRatio * scale * 0.5;
@@ -40,6 +40,9 @@ public:
     void FitToScreen();
     void NativeResolution();
 
+    // Height in pixels on screen
+    int GetScreenHeight();
+
     void GetExtent(float& left, float& right, float& bottom, float& top);
 	CollageItemMetadata* GetCollageItemMetadata(void);
 
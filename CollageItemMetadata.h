@@ -17,11 +17,19 @@
 #include <time.h>
 
 struct CollageItemMetadata {
+	CollageItemMetadata() : itemTimestamp(0), captureTimestamp(0), orientation(1), width(0), height(0),
+	                        duration(0.0), itemLoadOrder(0), itemSetOrder(0) {}
+
 	std::string fileName;				// file name after the slash and before the .
 	std::string fileNameExtension;		// extension after the .
 	std::string path;					// file path up to the last slash
-	std::string title;					// free form title of the image (not yet implemented)
+	std::string title;					// free form title of the image, from EXIF, XMP or PNG text
 	time_t itemTimestamp;				// file timestamp
+	time_t captureTimestamp;			// EXIF DateTimeOriginal, 0 if not present
+	int orientation;					// EXIF orientation, 1 is upright
+	unsigned int width;					// width in pixels as displayed, from the file header
+	unsigned int height;				// height in pixels as displayed, from the file header
+	double duration;					// length in seconds for videos, 0 for images
 	unsigned int itemLoadOrder;			// order this image was loaded into collage
 	unsigned int itemSetOrder;			// order of the image after taking a snapshot (not yet implemented)
 };
@@ -29,7 +37,8 @@ struct CollageItemMetadata {
 // enumeration gives various sorting options, used to sort images based on their
 
 enum MetadataSortOption {
-	metadataSortFilename, metadataSortExtension, metadataSortPath, metadataSortTimestamp, metadataSortLoadOrder, metadataSortTitle
+	metadataSortFilename, metadataSortExtension, metadataSortPath, metadataSortTimestamp, metadataSortLoadOrder, metadataSortTitle,
+	metadataSortCaptureTimestamp
 };
 
 #endif
@@ -0,0 +1,465 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        CollageMetadataReader.cpp
+//
+// Author:      David Borland
+//
+// Description: Reads capture time, orientation, dimensions and title from JPEG, TIFF and
+//              PNG headers without decoding the pixel data
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "CollageMetadataReader.h"
+
+#include <MappedFile.h>
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// Bounds-checked big and little endian reads
+static bool InBounds(size_t size, size_t offset, size_t length) {
+    return offset <= size && length <= size - offset;
+}
+
+static unsigned int Get16(const unsigned char* p, bool bigEndian) {
+    if (bigEndian) return (p[0] << 8) | p[1];
+    else return (p[1] << 8) | p[0];
+}
+
+static unsigned int Get32(const unsigned char* p, bool bigEndian) {
+    if (bigEndian) return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    else return ((unsigned int)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+
+// Convert a UCS-2 little endian string, as used by the Windows XP* EXIF tags, to UTF-8
+static std::string UCS2ToUTF8(const unsigned char* p, size_t length) {
+    std::string s;
+    for (size_t i = 0; i + 1 < length; i += 2) {
+        unsigned int c = p[i] | (p[i + 1] << 8);
+        if (c == 0) break;
+
+        if (c < 0x80) {
+            s += (char)c;
+        }
+        else if (c < 0x800) {
+            s += (char)(0xC0 | (c >> 6));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+        else {
+            s += (char)(0xE0 | (c >> 12));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return s;
+}
+
+
+// Strip trailing nulls and whitespace
+static std::string Trim(const std::string& s) {
+    std::string::size_type end = s.find_last_not_of(std::string(" \t\r\n\0", 5));
+    if (end == std::string::npos) return "";
+    std::string::size_type begin = s.find_first_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+
+// Replace the predefined XML entities
+static std::string DecodeXMLEntities(const std::string& s) {
+    std::string out;
+    for (std::string::size_type i = 0; i < s.size(); i++) {
+        if (s[i] == '&') {
+            std::string::size_type end = s.find(';', i);
+            if (end != std::string::npos) {
+                std::string entity = s.substr(i + 1, end - i - 1);
+                if (entity == "amp") { out += '&'; i = end; continue; }
+                if (entity == "lt") { out += '<'; i = end; continue; }
+                if (entity == "gt") { out += '>'; i = end; continue; }
+                if (entity == "quot") { out += '"'; i = end; continue; }
+                if (entity == "apos") { out += '\''; i = end; continue; }
+            }
+        }
+        out += s[i];
+    }
+    return out;
+}
+
+
+// Find an XMP property, stored either as an attribute or as a simple element
+static bool GetXMPProperty(const std::string& xmp, const std::string& name, std::string& value) {
+    std::string::size_type pos = xmp.find(name + "=\"");
+    if (pos != std::string::npos) {
+        pos += name.size() + 2;
+        std::string::size_type end = xmp.find('"', pos);
+        if (end == std::string::npos) return false;
+
+        value = DecodeXMLEntities(xmp.substr(pos, end - pos));
+        return true;
+    }
+
+    pos = xmp.find("<" + name + ">");
+    if (pos != std::string::npos) {
+        pos += name.size() + 2;
+        std::string::size_type end = xmp.find('<', pos);
+        if (end == std::string::npos) return false;
+
+        value = DecodeXMLEntities(xmp.substr(pos, end - pos));
+        return true;
+    }
+
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+CollageMetadataReader::CollageMetadataReader() {
+}
+
+CollageMetadataReader::~CollageMetadataReader() {
+}
+
+
+void CollageMetadataReader::Read(const std::vector<std::string>& fileNames, std::vector<CollageItemMetadata>& metadata) {
+    metadata.clear();
+    metadata.resize(fileNames.size());
+
+    // Each task writes to its own entry, so no locking is needed
+    for (int i = 0; i < (int)fileNames.size(); i++) {
+        const std::string* fileName = &fileNames[i];
+        CollageItemMetadata* itemMetadata = &metadata[i];
+
+        pool.Enqueue([fileName, itemMetadata]() {
+            ReadFile(*fileName, *itemMetadata);
+        });
+    }
+
+    pool.Wait();
+}
+
+
+bool CollageMetadataReader::ReadFile(const std::string& fileName, CollageItemMetadata& metadata) {
+    MappedFile file;
+    if (!file.Open(fileName)) {
+        std::cout << "CollageMetadataReader::ReadFile() : Couldn't open " << fileName << std::endl;
+        return false;
+    }
+
+    const unsigned char* data = (const unsigned char*)file.GetData();
+    size_t size = file.GetSize();
+
+    // Identify the format from the magic number rather than the extension
+    bool success = false;
+    if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+        success = ParseJPEG(data, size, metadata);
+    }
+    else if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1A\n", 8) == 0) {
+        success = ParsePNG(data, size, metadata);
+    }
+    else if (size >= 4 && (memcmp(data, "II*\0", 4) == 0 || memcmp(data, "MM\0*", 4) == 0)) {
+        success = ParseTIFF(data, size, metadata);
+    }
+
+    // Report dimensions as displayed
+    if (metadata.orientation >= 5 && metadata.orientation <= 8) {
+        unsigned int temp = metadata.width;
+        metadata.width = metadata.height;
+        metadata.height = temp;
+    }
+
+    return success;
+}
+
+
+bool CollageMetadataReader::ParseJPEG(const unsigned char* data, size_t size, CollageItemMetadata& metadata) {
+    static const char exifHeader[] = "Exif\0\0";
+    static const char xmpHeader[] = "http://ns.adobe.com/xap/1.0/";
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        // Markers start with 0xFF, possibly padded with extra 0xFF fill bytes
+        if (data[pos] != 0xFF) return false;
+        while (pos < size && data[pos] == 0xFF) pos++;
+        if (pos >= size) break;
+
+        unsigned char marker = data[pos++];
+
+        // End of image or start of scan:  no more header segments
+        if (marker == 0xD9 || marker == 0xDA) break;
+
+        // Standalone markers have no length
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+
+        if (!InBounds(size, pos, 2)) break;
+        size_t length = Get16(data + pos, true);
+        if (length < 2 || !InBounds(size, pos, length)) break;
+
+        const unsigned char* segment = data + pos + 2;
+        size_t segmentSize = length - 2;
+
+        if (marker == 0xE1) {
+            if (segmentSize > 6 && memcmp(segment, exifHeader, 6) == 0) {
+                ParseTIFF(segment + 6, segmentSize - 6, metadata);
+            }
+            else if (segmentSize > sizeof(xmpHeader) && memcmp(segment, xmpHeader, sizeof(xmpHeader)) == 0) {
+                ParseXMP((const char*)segment + sizeof(xmpHeader), segmentSize - sizeof(xmpHeader), metadata);
+            }
+        }
+        else if (marker >= 0xC0 && marker <= 0xCF &&
+                 marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            // Start of frame.  Takes precedence over any dimensions in the EXIF data.
+            if (segmentSize >= 5) {
+                metadata.height = Get16(segment + 1, true);
+                metadata.width = Get16(segment + 3, true);
+            }
+        }
+
+        pos += length;
+    }
+
+    return true;
+}
+
+
+bool CollageMetadataReader::ParsePNG(const unsigned char* data, size_t size, CollageItemMetadata& metadata) {
+    size_t pos = 8;
+    while (InBounds(size, pos, 8)) {
+        size_t length = Get32(data + pos, true);
+        const unsigned char* type = data + pos + 4;
+        const unsigned char* chunk = data + pos + 8;
+
+        if (!InBounds(size, pos + 8, length)) break;
+
+        // Metadata after the image data would require walking the entire file
+        if (memcmp(type, "IDAT", 4) == 0 || memcmp(type, "IEND", 4) == 0) break;
+
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 8) {
+            metadata.width = Get32(chunk, true);
+            metadata.height = Get32(chunk + 4, true);
+        }
+        else if (memcmp(type, "tEXt", 4) == 0) {
+            // keyword\0text
+            const unsigned char* separator = (const unsigned char*)memchr(chunk, 0, length);
+            if (separator) {
+                std::string keyword((const char*)chunk, separator - chunk);
+                std::string text((const char*)separator + 1, chunk + length - separator - 1);
+
+                if (keyword == "Title") metadata.title = Trim(text);
+                else if (keyword == "Creation Time" && metadata.captureTimestamp == 0) {
+                    metadata.captureTimestamp = ParseDateTime(text);
+                }
+            }
+        }
+        else if (memcmp(type, "iTXt", 4) == 0) {
+            // keyword\0 compressionFlag compressionMethod languageTag\0 translatedKeyword\0 text
+            const char* p = (const char*)chunk;
+            const char* end = p + length;
+
+            const char* keywordEnd = (const char*)memchr(p, 0, end - p);
+            if (keywordEnd && keywordEnd + 3 < end && keywordEnd[1] == 0) {
+                std::string keyword(p, keywordEnd - p);
+
+                const char* language = keywordEnd + 3;
+                const char* languageEnd = (const char*)memchr(language, 0, end - language);
+                const char* translated = languageEnd ? languageEnd + 1 : end;
+                const char* translatedEnd = translated < end ? (const char*)memchr(translated, 0, end - translated) : NULL;
+
+                if (translatedEnd) {
+                    const char* text = translatedEnd + 1;
+
+                    if (keyword == "Title") metadata.title = Trim(std::string(text, end - text));
+                    else if (keyword == "XML:com.adobe.xmp") ParseXMP(text, end - text, metadata);
+                }
+            }
+        }
+        else if (memcmp(type, "eXIf", 4) == 0) {
+            // IHDR is authoritative for the dimensions
+            unsigned int width = metadata.width;
+            unsigned int height = metadata.height;
+
+            ParseTIFF(chunk, length, metadata);
+
+            metadata.width = width;
+            metadata.height = height;
+        }
+
+        // Length, type, data and CRC
+        pos += 12 + length;
+    }
+
+    return true;
+}
+
+
+bool CollageMetadataReader::ParseTIFF(const unsigned char* data, size_t size, CollageItemMetadata& metadata) {
+    if (size < 8) return false;
+
+    bool bigEndian;
+    if (data[0] == 'I' && data[1] == 'I') bigEndian = false;
+    else if (data[0] == 'M' && data[1] == 'M') bigEndian = true;
+    else return false;
+
+    if (Get16(data + 2, bigEndian) != 42) return false;
+
+    // Number of bytes for each TIFF field type
+    static const unsigned int typeSizes[] = { 0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8 };
+
+    // Walk IFD0, then the EXIF sub-IFD if there is one
+    size_t ifdOffset = Get32(data + 4, bigEndian);
+    size_t exifOffset = 0;
+    std::string dateTime;
+
+    for (int ifd = 0; ifd < 2; ifd++) {
+        if (!InBounds(size, ifdOffset, 2)) break;
+
+        unsigned int numEntries = Get16(data + ifdOffset, bigEndian);
+        if (!InBounds(size, ifdOffset + 2, numEntries * 12)) break;
+
+        for (unsigned int i = 0; i < numEntries; i++) {
+            const unsigned char* entry = data + ifdOffset + 2 + i * 12;
+
+            unsigned int tag = Get16(entry, bigEndian);
+            unsigned int type = Get16(entry + 2, bigEndian);
+            size_t count = Get32(entry + 4, bigEndian);
+
+            if (type == 0 || type >= sizeof(typeSizes) / sizeof(typeSizes[0])) continue;
+
+            // Values of 4 bytes or less are stored in the entry itself
+            size_t valueSize = typeSizes[type] * count;
+            if (count != 0 && valueSize / count != typeSizes[type]) continue;
+            size_t valueOffset = valueSize <= 4 ? (entry + 8) - data : Get32(entry + 8, bigEndian);
+            if (!InBounds(size, valueOffset, valueSize)) continue;
+
+            const unsigned char* value = data + valueOffset;
+
+            // Integer value, for SHORT and LONG types
+            unsigned int integer = 0;
+            if (type == 3) integer = Get16(value, bigEndian);
+            else if (type == 4) integer = Get32(value, bigEndian);
+
+            // String value, for ASCII type
+            std::string string;
+            if (type == 2) string = Trim(std::string((const char*)value, valueSize));
+
+            switch (tag) {
+            case 0x0100:
+            case 0xA002:
+                // Image width
+                if (integer > 0) metadata.width = integer;
+                break;
+
+            case 0x0101:
+            case 0xA003:
+                // Image height
+                if (integer > 0) metadata.height = integer;
+                break;
+
+            case 0x010E:
+                // Image description
+                if (metadata.title.empty()) metadata.title = string;
+                break;
+
+            case 0x0112:
+                // Orientation
+                if (integer >= 1 && integer <= 8) metadata.orientation = integer;
+                break;
+
+            case 0x0132:
+                // Modification date, used if there is no DateTimeOriginal
+                dateTime = string;
+                break;
+
+            case 0x8769:
+                // EXIF sub-IFD
+                exifOffset = integer;
+                break;
+
+            case 0x9003:
+                // DateTimeOriginal
+                metadata.captureTimestamp = ParseDateTime(string);
+                break;
+
+            case 0x9C9B:
+                // XPTitle, always little endian UCS-2
+                metadata.title = UCS2ToUTF8(value, valueSize);
+                break;
+            }
+        }
+
+        if (exifOffset == 0 || exifOffset == ifdOffset) break;
+        ifdOffset = exifOffset;
+    }
+
+    if (metadata.captureTimestamp == 0 && !dateTime.empty()) {
+        metadata.captureTimestamp = ParseDateTime(dateTime);
+    }
+
+    return true;
+}
+
+
+void CollageMetadataReader::ParseXMP(const char* data, size_t size, CollageItemMetadata& metadata) {
+    std::string xmp(data, size);
+    std::string value;
+
+    // The title is a language alternative array.  Use the first entry.
+    if (metadata.title.empty()) {
+        std::string::size_type pos = xmp.find("<dc:title");
+        if (pos != std::string::npos) {
+            pos = xmp.find("<rdf:li", pos);
+            if (pos != std::string::npos) pos = xmp.find('>', pos);
+            if (pos != std::string::npos) {
+                std::string::size_type end = xmp.find("</rdf:li>", pos);
+                if (end != std::string::npos) {
+                    metadata.title = Trim(DecodeXMLEntities(xmp.substr(pos + 1, end - pos - 1)));
+                }
+            }
+        }
+    }
+
+    if (metadata.captureTimestamp == 0) {
+        if (GetXMPProperty(xmp, "exif:DateTimeOriginal", value) ||
+            GetXMPProperty(xmp, "photoshop:DateCreated", value) ||
+            GetXMPProperty(xmp, "xmp:CreateDate", value)) {
+            metadata.captureTimestamp = ParseDateTime(value);
+        }
+    }
+
+    if (GetXMPProperty(xmp, "tiff:Orientation", value)) {
+        int orientation = atoi(value.c_str());
+        if (orientation >= 1 && orientation <= 8) metadata.orientation = orientation;
+    }
+}
+
+
+time_t CollageMetadataReader::ParseDateTime(const std::string& dateTime) {
+    // Handles both EXIF "YYYY:MM:DD HH:MM:SS" and ISO 8601 "YYYY-MM-DDTHH:MM:SS"
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    int n = sscanf(dateTime.c_str(), "%d%*[:-]%d%*[:-]%d%*[ T]%d:%d:%d",
+                   &year, &month, &day, &hour, &minute, &second);
+
+    // Unknown dates are often written as all zeros
+    if (n < 3 || year < 1900 || month < 1 || month > 12 || day < 1 || day > 31) return 0;
+
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year = year - 1900;
+    t.tm_mon = month - 1;
+    t.tm_mday = day;
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_sec = second;
+    t.tm_isdst = -1;
+
+    time_t time = mktime(&t);
+    return time == (time_t)-1 ? 0 : time;
+}
\ No newline at end of file
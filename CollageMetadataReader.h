@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        CollageMetadataReader.h
+//
+// Author:      David Borland
+//
+// Description: Reads capture time, orientation, dimensions and title from JPEG, TIFF and
+//              PNG headers without decoding the pixel data
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef COLLAGEMETADATAREADER_H
+#define COLLAGEMETADATAREADER_H
+
+
+#include "CollageItemMetadata.h"
+
+#include <ThreadPool.h>
+
+#include <string>
+#include <vector>
+
+
+class CollageMetadataReader {
+public:
+    CollageMetadataReader();
+    ~CollageMetadataReader();
+
+    // Read the headers of all files on the thread pool.  The metadata is returned in the
+    // same order as the file names.
+    void Read(const std::vector<std::string>& fileNames, std::vector<CollageItemMetadata>& metadata);
+
+    // Read the header of a single file.  Returns false if the format is not recognized.
+    static bool ReadFile(const std::string& fileName, CollageItemMetadata& metadata);
+
+private:
+    ThreadPool pool;
+
+    static bool ParseJPEG(const unsigned char* data, size_t size, CollageItemMetadata& metadata);
+    static bool ParsePNG(const unsigned char* data, size_t size, CollageItemMetadata& metadata);
+    static bool ParseTIFF(const unsigned char* data, size_t size, CollageItemMetadata& metadata);
+    static void ParseXMP(const char* data, size_t size, CollageItemMetadata& metadata);
+
+    static time_t ParseDateTime(const std::string& dateTime);
+};
+
+
+#endif
\ No newline at end of file
@@ -11,6 +11,7 @@
 
 #include "Interactor.h"
 
+#include <glut.h>
 #include <iostream>
 
 
@@ -160,6 +161,37 @@ void Interactor::SetRotateSensitivity(double sensitivity) {
     rotateSensitivity = sensitivity;
 }
 
+bool Interactor::GetPickRay(int x, int y, Vec3& origin, Vec3& direction) {
+    GLdouble modelView[16];
+    GLdouble projection[16];
+    GLint viewport[4];
+
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Window coordinates start at the top left, and OpenGL's at the bottom left of the
+    // viewport.  Each stereo view has half the window.
+    if (useHalfWindow) x %= windowWidth;
+
+    double windowX = viewport[0] + (x + 0.5) * viewport[2] / windowWidth;
+    double windowY = viewport[1] + (windowHeight - y - 0.5) * viewport[3] / windowHeight;
+
+    double nearX, nearY, nearZ;
+    double farX, farY, farZ;
+
+    if (gluUnProject(windowX, windowY, 0.0, modelView, projection, viewport, &nearX, &nearY, &nearZ) != GL_TRUE ||
+        gluUnProject(windowX, windowY, 1.0, modelView, projection, viewport, &farX, &farY, &farZ) != GL_TRUE) {
+        return false;
+    }
+
+    origin.Set(nearX, nearY, nearZ);
+    direction.Set(farX - nearX, farY - nearY, farZ - nearZ);
+
+    return true;
+}
+
+
 void Interactor::UseHalfWindow() {
     if (!useHalfWindow) {
         windowWidth /= 2;
@@ -41,6 +41,13 @@ public:
     void SetZoomSensitivity(double sensitivity);
     void SetRotateSensitivity(double sensitivity);
 
+    // Ray through a window position, as given to the mouse events, in the space of the 
+    // current OpenGL modelview matrix.  Call with the view set up as for drawing, and pass
+    // the ray to OBJObject::Pick() to find the point under the mouse.  The direction reaches
+    // from the near clipping plane to the far one.  Returns false if the matrices cannot be
+    // inverted.
+    bool GetPickRay(int x, int y, Vec3& origin, Vec3& direction);
+
     // Use half window when both stereo views are rendered to the window
     void UseWholeWindow();
     void UseHalfWindow();
@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioDecoder.cpp
+//
+// Author:      David Borland
+//
+// Description: Decodes the audio of a file with FFmpeg into interleaved float samples at a
+//              given sample rate and number of channels.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "AudioDecoder.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+}
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+
+AudioDecoder::AudioDecoder() {
+    formatContext = NULL;
+    codecContext = NULL;
+    swrContext = NULL;
+    frame = NULL;
+    packet = NULL;
+
+    streamIndex = -1;
+    timeBase = 0.0;
+    startTime = 0.0;
+    duration = 0.0;
+
+    sampleRate = 0;
+    numChannels = 0;
+
+    draining = false;
+    flushed = false;
+
+    pendingStart = 0;
+    pendingFrames = 0;
+
+    skipUntil = 0.0;
+}
+
+AudioDecoder::~AudioDecoder() {
+    Close();
+}
+
+
+bool AudioDecoder::Open(const std::string& fileName, int sampleRate, int numChannels) {
+    Close();
+
+    this->sampleRate = sampleRate;
+    this->numChannels = numChannels;
+
+    // Open the file and read the stream information
+    if (avformat_open_input(&formatContext, fileName.c_str(), NULL, NULL) != 0) {
+        std::cout << "AudioDecoder::Open() : Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    if (avformat_find_stream_info(formatContext, NULL) < 0) {
+        std::cout << "AudioDecoder::Open() : Could not find stream information." << std::endl;
+        return false;
+    }
+
+    streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (streamIndex < 0) {
+        std::cout << "AudioDecoder::Open() : No audio stream in " << fileName << std::endl;
+        return false;
+    }
+
+    AVStream* stream = formatContext->streams[streamIndex];
+
+    // Only read the audio
+    for (int i = 0; i < (int)formatContext->nb_streams; i++) {
+        if (i != streamIndex) formatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+
+    // Timing
+    timeBase = av_q2d(stream->time_base);
+    startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time * timeBase : 0.0;
+
+    if (stream->duration != AV_NOPTS_VALUE) {
+        duration = stream->duration * timeBase;
+    }
+    else if (formatContext->duration != AV_NOPTS_VALUE) {
+        duration = (double)formatContext->duration / AV_TIME_BASE;
+    }
+
+
+    // Decoder
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        std::cout << "AudioDecoder::Open() : Unsupported codec." << std::endl;
+        return false;
+    }
+
+    codecContext = avcodec_alloc_context3(codec);
+    if (!codecContext || avcodec_parameters_to_context(codecContext, stream->codecpar) < 0 ||
+        avcodec_open2(codecContext, codec, NULL) < 0) {
+        std::cout << "AudioDecoder::Open() : Could not open codec." << std::endl;
+        return false;
+    }
+
+
+    // Convert to interleaved float at the output rate, mixing down or up to the output channels
+    AVChannelLayout outputLayout;
+    av_channel_layout_default(&outputLayout, numChannels);
+
+    int result = swr_alloc_set_opts2(&swrContext,
+                                     &outputLayout, AV_SAMPLE_FMT_FLT, sampleRate,
+                                     &codecContext->ch_layout, codecContext->sample_fmt, codecContext->sample_rate,
+                                     0, NULL);
+    av_channel_layout_uninit(&outputLayout);
+
+    if (result < 0 || swr_init(swrContext) < 0) {
+        std::cout << "AudioDecoder::Open() : Could not create resampler." << std::endl;
+        return false;
+    }
+
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (!frame || !packet) {
+        std::cout << "AudioDecoder::Open() : Could not allocate frame." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void AudioDecoder::Close() {
+    if (swrContext) swr_free(&swrContext);
+    if (packet) av_packet_free(&packet);
+    if (frame) av_frame_free(&frame);
+    if (codecContext) avcodec_free_context(&codecContext);
+    if (formatContext) avformat_close_input(&formatContext);
+
+    streamIndex = -1;
+    duration = 0.0;
+
+    draining = false;
+    flushed = false;
+
+    pendingFrames = 0;
+    skipUntil = 0.0;
+}
+
+
+int AudioDecoder::Decode(float* samples, int numFrames) {
+    if (!swrContext) return -1;
+
+    int decoded = 0;
+    while (decoded < numFrames) {
+        if (pendingFrames == 0) {
+            int result = DecodeFrame();
+            if (result <= 0) return decoded > 0 ? decoded : result;
+        }
+
+        int count = std::min(numFrames - decoded, pendingFrames);
+        memcpy(samples + decoded * numChannels, &pending[pendingStart * numChannels],
+               count * numChannels * sizeof(float));
+
+        pendingStart += count;
+        pendingFrames -= count;
+        decoded += count;
+    }
+
+    return decoded;
+}
+
+
+bool AudioDecoder::Seek(double seconds) {
+    if (!formatContext) return false;
+
+    int64_t timestamp = (int64_t)((seconds + startTime) / timeBase);
+    if (av_seek_frame(formatContext, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        std::cout << "AudioDecoder::Seek() : Could not seek." << std::endl;
+        return false;
+    }
+
+    // Drop everything buffered from before the seek
+    avcodec_flush_buffers(codecContext);
+    swr_init(swrContext);
+
+    draining = false;
+    flushed = false;
+    pendingFrames = 0;
+
+    // Decoding starts at the packet before the time
+    skipUntil = seconds;
+
+    return true;
+}
+
+
+int AudioDecoder::GetNumChannels() const {
+    return numChannels;
+}
+
+double AudioDecoder::GetDuration() const {
+    return duration;
+}
+
+
+int AudioDecoder::DecodeFrame() {
+    while (true) {
+        int result = avcodec_receive_frame(codecContext, frame);
+        if (result == 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            if (pts == AV_NOPTS_VALUE) pts = frame->pts;
+
+            int maxFrames = swr_get_out_samples(swrContext, frame->nb_samples);
+            pending.resize(std::max(maxFrames, 1) * numChannels);
+
+            uint8_t* output = (uint8_t*)&pending[0];
+            int converted = swr_convert(swrContext, &output, maxFrames,
+                                        (const uint8_t**)frame->extended_data, frame->nb_samples);
+            if (converted < 0) return -1;
+
+            pendingStart = 0;
+            pendingFrames = converted;
+
+            // Trim to the seek time, to the nearest sample
+            if (skipUntil > 0.0 && pts != AV_NOPTS_VALUE) {
+                double time = pts * timeBase - startTime;
+                int skip = (int)((skipUntil - time) * sampleRate + 0.5);
+
+                if (skip >= pendingFrames) {
+                    pendingFrames = 0;
+                    continue;
+                }
+
+                if (skip > 0) {
+                    pendingStart = skip;
+                    pendingFrames -= skip;
+                }
+                skipUntil = 0.0;
+            }
+
+            if (pendingFrames > 0) return 1;
+        }
+        else if (result == AVERROR_EOF) {
+            // Samples still held by the resampler
+            if (!flushed) {
+                flushed = true;
+
+                int maxFrames = swr_get_out_samples(swrContext, 0);
+                if (maxFrames > 0) {
+                    pending.resize(maxFrames * numChannels);
+
+                    uint8_t* output = (uint8_t*)&pending[0];
+                    int converted = swr_convert(swrContext, &output, maxFrames, NULL, 0);
+                    if (converted > 0) {
+                        pendingStart = 0;
+                        pendingFrames = converted;
+                        return 1;
+                    }
+                }
+            }
+
+            return 0;
+        }
+        else if (result != AVERROR(EAGAIN)) {
+            return -1;
+        }
+        else if (!draining) {
+            // The decoder needs more input
+            if (av_read_frame(formatContext, packet) < 0) {
+                // End of file, so flush the frames buffered in the decoder
+                avcodec_send_packet(codecContext, NULL);
+                draining = true;
+                continue;
+            }
+
+            if (packet->stream_index == streamIndex) {
+                avcodec_send_packet(codecContext, packet);
+            }
+            av_packet_unref(packet);
+        }
+    }
+}
\ No newline at end of file
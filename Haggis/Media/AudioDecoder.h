@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioDecoder.h
+//
+// Author:      David Borland
+//
+// Description: Decodes the audio of a file with FFmpeg into interleaved float samples at a
+//              given sample rate and number of channels.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef AUDIODECODER_H
+#define AUDIODECODER_H
+
+
+#include <string>
+#include <vector>
+
+
+// Forward declarations
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct SwrContext;
+
+
+class AudioDecoder {
+public:
+    AudioDecoder();
+    ~AudioDecoder();
+
+    // Open the best audio stream.  One channel is a mono downmix.
+    bool Open(const std::string& fileName, int sampleRate, int numChannels);
+    void Close();
+
+    // Decode up to numFrames.  Returns the number of frames decoded, 0 at the end of the
+    // stream, or -1 on error.
+    int Decode(float* samples, int numFrames);
+
+    // Decoding continues from the first sample at or after the time
+    bool Seek(double seconds);
+
+    int GetNumChannels() const;
+
+    // Length in seconds, or 0 if not known
+    double GetDuration() const;
+
+private:
+    AVFormatContext* formatContext;
+    AVCodecContext* codecContext;
+    SwrContext* swrContext;
+    AVFrame* frame;
+    AVPacket* packet;
+
+    int streamIndex;
+    double timeBase;
+    double startTime;
+    double duration;
+
+    int sampleRate;
+    int numChannels;
+
+    // Set once the decoder has sent its last buffered frame
+    bool draining;
+    bool flushed;
+
+    // Converted samples not returned yet
+    std::vector<float> pending;
+    int pendingStart;
+    int pendingFrames;
+
+    // Samples before this are dropped after a seek
+    double skipUntil;
+
+    // Decode and convert the next frame into pending.  Returns 1 for a frame, 0 at the end 
+    // of the stream, or -1 on error.
+    int DecodeFrame();
+};
+
+
+#endif
\ No newline at end of file
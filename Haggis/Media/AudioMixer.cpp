@@ -0,0 +1,645 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioMixer.cpp
+//
+// Author:      David Borland
+//
+// Description: Portable audio engine.  A decode thread fills a lock-free ring buffer per
+//              channel, and a mix thread sums the channels into multichannel output for an
+//              AudioSink, with per-sample volume ramps.  The samples mixed so far give an
+//              audio clock that video can follow.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "AudioMixer.h"
+
+#include "AudioDecoder.h"
+#include "AudioRing.h"
+#include "AudioSink.h"
+#include "VideoStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AUDIOMIXER_SSE
+#include <xmmintrin.h>
+#endif
+
+
+namespace {
+    // Frames per block written to the sink, and per decode
+    const int mixFrames = 512;
+    const int decodeFrames = 1024;
+
+    // Decoded audio buffered per channel, in seconds
+    const double ringSeconds = 0.5;
+
+    // Add the input to the output with a gain per output channel and a volume per frame.  The
+    // input has the same channels as the output, or one channel to spread with the gains.
+    void MixInto(float* output, const float* input, int numFrames, int outputChannels, int inputChannels,
+                 const float* gains, float volume, float step) {
+        int f = 0;
+
+#ifdef AUDIOMIXER_SSE
+        if (outputChannels % 4 == 0) {
+            // Groups of four channels in a frame share the volume
+            for (; f < numFrames; f++) {
+                __m128 v = _mm_set1_ps(volume + step * f);
+                float* out = output + f * outputChannels;
+
+                if (inputChannels == 1) {
+                    __m128 in = _mm_mul_ps(_mm_set1_ps(input[f]), v);
+                    for (int c = 0; c < outputChannels; c += 4) {
+                        __m128 sum = _mm_add_ps(_mm_loadu_ps(out + c), _mm_mul_ps(in, _mm_loadu_ps(gains + c)));
+                        _mm_storeu_ps(out + c, sum);
+                    }
+                }
+                else {
+                    const float* in = input + f * outputChannels;
+                    for (int c = 0; c < outputChannels; c += 4) {
+                        __m128 gain = _mm_mul_ps(v, _mm_loadu_ps(gains + c));
+                        __m128 sum = _mm_add_ps(_mm_loadu_ps(out + c), _mm_mul_ps(_mm_loadu_ps(in + c), gain));
+                        _mm_storeu_ps(out + c, sum);
+                    }
+                }
+            }
+        }
+        else if (outputChannels == 2) {
+            // Two frames per vector
+            __m128 gain = _mm_setr_ps(gains[0], gains[1], gains[0], gains[1]);
+
+            for (; f + 2 <= numFrames; f += 2) {
+                float v0 = volume + step * f;
+                float v1 = volume + step * (f + 1);
+                __m128 v = _mm_mul_ps(_mm_setr_ps(v0, v0, v1, v1), gain);
+
+                __m128 in = inputChannels == 1 ? _mm_setr_ps(input[f], input[f], input[f + 1], input[f + 1]) :
+                                                 _mm_loadu_ps(input + f * 2);
+
+                float* out = output + f * 2;
+                _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(in, v)));
+            }
+        }
+        else if (outputChannels == 1) {
+            // Four frames per vector
+            __m128 ramp = _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+            __m128 gain = _mm_set1_ps(gains[0]);
+
+            for (; f + 4 <= numFrames; f += 4) {
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(volume + step * f), ramp), gain);
+                _mm_storeu_ps(output + f, _mm_add_ps(_mm_loadu_ps(output + f), _mm_mul_ps(_mm_loadu_ps(input + f), v)));
+            }
+        }
+#endif
+
+        // Remaining frames, or all of them without SSE
+        for (; f < numFrames; f++) {
+            float v = volume + step * f;
+            float* out = output + f * outputChannels;
+
+            for (int c = 0; c < outputChannels; c++) {
+                float in = inputChannels == 1 ? input[f] : input[f * outputChannels + c];
+                out[c] += in * gains[c] * v;
+            }
+        }
+    }
+}
+
+
+struct AudioMixer::Channel {
+    enum State {
+        Playing,
+        Paused,
+        Stopped
+    };
+
+    std::string fileName;
+    bool loop;
+    double duration;
+
+    AudioDecoder decoder;
+    AudioRing ring;
+
+    std::atomic<int> state;
+
+    // Set by the decode thread after writing the last samples
+    std::atomic<bool> ended;
+
+    // Seeks and speaker changes are requested by bumping the generation.  The decode thread
+    // seeks, then has the mix thread drop the samples in the ring before decoding on.
+    std::atomic<int> seekGeneration;
+    std::atomic<double> seekTime;
+    std::atomic<int> speaker;
+    std::atomic<int> flushGeneration;
+    std::atomic<int> flushedGeneration;
+
+    // Decode thread.  The ring layout is published with flushGeneration, and only changed
+    // again once the mix thread has acknowledged it with flushedGeneration.
+    int decodeGeneration;
+    int ringChannels;
+    int ringSpeaker;
+    double ringStart;
+    long long loopFrames;
+
+    // Mix thread
+    int mixGeneration;
+    int mixChannels;
+    std::vector<float> gains;
+    double startPosition;
+    long long framesPlayed;
+    std::atomic<double> position;
+
+    // Volume ramps, requested by bumping the generation
+    std::atomic<float> targetVolume;
+    std::atomic<long long> rampFrames;
+    std::atomic<int> volumeGeneration;
+
+    int mixVolumeGeneration;
+    float volume;
+    float volumeStep;
+    float rampTarget;
+    long long rampRemaining;
+
+    Channel()
+    : state(Stopped), ended(false), seekGeneration(0), seekTime(0.0), speaker(0), flushGeneration(0),
+      flushedGeneration(0), position(0.0), targetVolume(1.0f), rampFrames(0), volumeGeneration(0) {
+        loop = false;
+        duration = 0.0;
+
+        decodeGeneration = 0;
+        ringChannels = 0;
+        ringSpeaker = 0;
+        ringStart = 0.0;
+        loopFrames = 0;
+
+        mixGeneration = 0;
+        mixChannels = 0;
+        startPosition = 0.0;
+        framesPlayed = 0;
+
+        mixVolumeGeneration = 0;
+        volume = 1.0f;
+        volumeStep = 0.0f;
+        rampTarget = 1.0f;
+        rampRemaining = 0;
+    }
+};
+
+
+AudioMixer::AudioMixer()
+: running(false), quit(false), mixPasses(0), decodePasses(0), framesMixed(0), blockTime(0.0),
+  blocks(0), underruns(0), mixSeconds(0.0) {
+    sink = NULL;
+
+    sampleRate = 0;
+    numChannels = 0;
+    blockFrames = mixFrames;
+}
+
+AudioMixer::~AudioMixer() {
+    Shutdown();
+
+    for (int i = 0; i < (int)channels.size(); i++) {
+        delete channels[i];
+    }
+}
+
+
+bool AudioMixer::Start(AudioSink* audioSink, int rate, int channelCount) {
+    if (running) {
+        std::cout << "AudioMixer::Start() : Already running." << std::endl;
+        delete audioSink;
+        return false;
+    }
+
+    if (!audioSink || rate <= 0 || channelCount <= 0 || !audioSink->Open(rate, channelCount)) {
+        std::cout << "AudioMixer::Start() : Could not open the audio sink." << std::endl;
+        delete audioSink;
+        return false;
+    }
+
+    sink = audioSink;
+    sampleRate = rate;
+    numChannels = channelCount;
+
+    framesMixed = 0;
+    blockTime = VideoStream::GetSystemTime();
+    blocks = 0;
+    underruns = 0;
+    mixSeconds = 0.0;
+
+    quit = false;
+    running = true;
+
+    mixThread = std::thread(&AudioMixer::MixLoop, this);
+    decodeThread = std::thread(&AudioMixer::DecodeLoop, this);
+
+    return true;
+}
+
+void AudioMixer::Shutdown() {
+    if (!running) return;
+
+    quit = true;
+    mixThread.join();
+    decodeThread.join();
+
+    sink->Close();
+    delete sink;
+    sink = NULL;
+
+    running = false;
+}
+
+bool AudioMixer::Running() const {
+    return running;
+}
+
+
+AudioMixer::Channel* AudioMixer::CreateChannel(const std::string& fileName, bool loop, int speaker) {
+    if (!running) {
+        std::cout << "AudioMixer::CreateChannel() : The mixer has not been started." << std::endl;
+        return NULL;
+    }
+
+    Channel* channel = new Channel();
+    channel->fileName = fileName;
+    channel->loop = loop;
+    channel->speaker = speaker;
+
+    channel->ringChannels = speaker > 0 ? 1 : numChannels;
+    channel->ringSpeaker = speaker;
+
+    if (!channel->decoder.Open(fileName, sampleRate, channel->ringChannels)) {
+        delete channel;
+        return NULL;
+    }
+
+    channel->duration = channel->decoder.GetDuration();
+    size_t ringFrames = std::max((size_t)(sampleRate * ringSeconds), (size_t)(decodeFrames + mixFrames) * 2);
+    channel->ring.Allocate(ringFrames * numChannels);
+
+    // The first samples need no flush
+    channel->mixChannels = channel->ringChannels;
+    channel->gains.assign(numChannels, speaker > 0 ? 0.0f : 1.0f);
+    if (speaker > 0) channel->gains[GetSpeakerIndex(speaker)] = 1.0f;
+
+    std::lock_guard<std::mutex> lock(channelMutex);
+    channels.push_back(channel);
+
+    return channel;
+}
+
+void AudioMixer::FreeChannel(Channel* channel) {
+    if (!channel) return;
+
+    {
+        std::lock_guard<std::mutex> lock(channelMutex);
+
+        std::vector<Channel*>::iterator it = std::find(channels.begin(), channels.end(), channel);
+        if (it != channels.end()) channels.erase(it);
+    }
+
+    // Wait for both threads to start a new pass without it
+    unsigned int mix = mixPasses.load();
+    unsigned int decode = decodePasses.load();
+    while (running && (mixPasses.load() - mix < 2 || decodePasses.load() - decode < 2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    delete channel;
+}
+
+
+void AudioMixer::Play(Channel* channel) {
+    // Start again once the end has been reached, as BASS does
+    if (channel->state == Channel::Stopped && channel->ended &&
+        channel->flushedGeneration == channel->seekGeneration) {
+        Seek(channel, 0.0);
+    }
+
+    channel->state = Channel::Playing;
+}
+
+void AudioMixer::Pause(Channel* channel) {
+    if (channel->state == Channel::Playing) channel->state = Channel::Paused;
+}
+
+void AudioMixer::Stop(Channel* channel) {
+    channel->state = Channel::Stopped;
+}
+
+bool AudioMixer::Stopped(Channel* channel) const {
+    return channel->state == Channel::Stopped;
+}
+
+
+void AudioMixer::Seek(Channel* channel, double seconds) {
+    if (seconds < 0.0) seconds = 0.0;
+
+    channel->seekTime.store(seconds);
+    channel->position.store(seconds);
+    channel->seekGeneration.fetch_add(1, std::memory_order_release);
+}
+
+double AudioMixer::GetPosition(Channel* channel) const {
+    double position = channel->position.load();
+
+    // Looping channels keep counting
+    if (channel->loop && channel->duration > 0.0) position = fmod(position, channel->duration);
+
+    return position;
+}
+
+
+void AudioMixer::SetSpeaker(Channel* channel, int speaker) {
+    // The decoder is reopened for the new layout at the current position
+    channel->speaker.store(speaker);
+    Seek(channel, GetPosition(channel));
+}
+
+
+void AudioMixer::SetVolume(Channel* channel, float volume, float seconds) {
+    channel->targetVolume.store(std::max(volume, 0.0f));
+    channel->rampFrames.store((long long)(std::max(seconds, 0.0f) * sampleRate + 0.5f));
+    channel->volumeGeneration.fetch_add(1, std::memory_order_release);
+}
+
+
+int AudioMixer::GetSampleRate() const {
+    return sampleRate;
+}
+
+int AudioMixer::GetNumChannels() const {
+    return numChannels;
+}
+
+
+double AudioMixer::GetClockTime() const {
+    if (sampleRate == 0) return 0.0;
+
+    double time = (double)framesMixed.load() / sampleRate;
+
+    // A real time sink is playing the last block written, so interpolate within it
+    if (running && sink->IsRealTime()) {
+        double blockSeconds = (double)blockFrames / sampleRate;
+        double elapsed = VideoStream::GetSystemTime() - blockTime.load();
+
+        time -= blockSeconds;
+        time += std::min(std::max(elapsed, 0.0), blockSeconds);
+        time -= sink->GetLatency();
+    }
+
+    return std::max(time, 0.0);
+}
+
+
+AudioMixer::Stats AudioMixer::GetStats() const {
+    Stats stats;
+    stats.blocks = blocks.load();
+    stats.underruns = underruns.load();
+    stats.mixSeconds = mixSeconds.load();
+
+    return stats;
+}
+
+
+void AudioMixer::MixLoop() {
+    std::vector<float> output(blockFrames * numChannels);
+    std::vector<float> scratch(blockFrames * numChannels);
+    std::vector<Channel*> list;
+
+    while (!quit) {
+        GetChannels(list);
+
+        for (int i = 0; i < (int)list.size(); i++) {
+            ApplySeek(list[i]);
+        }
+
+        // Without a device to keep time, wait for decoding rather than dropping out, and
+        // only write audio while something is playing
+        if (!sink->IsRealTime()) {
+            bool playing = false;
+            bool ready = true;
+            for (int i = 0; i < (int)list.size(); i++) {
+                if (list[i]->state != Channel::Playing) continue;
+
+                playing = true;
+                if (!Ready(list[i])) ready = false;
+            }
+
+            if (!playing || !ready) {
+                mixPasses++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+        }
+
+        double start = VideoStream::GetSystemTime();
+
+        std::fill(output.begin(), output.end(), 0.0f);
+
+        bool underrun = false;
+        for (int i = 0; i < (int)list.size(); i++) {
+            if (MixChannel(list[i], &output[0], scratch)) underrun = true;
+        }
+        if (underrun) underruns++;
+
+        mixSeconds = mixSeconds.load() + VideoStream::GetSystemTime() - start;
+
+        sink->Write(&output[0], blockFrames);
+
+        framesMixed += blockFrames;
+        blockTime = VideoStream::GetSystemTime();
+        blocks++;
+
+        mixPasses++;
+    }
+}
+
+void AudioMixer::DecodeLoop() {
+    std::vector<float> scratch(decodeFrames * numChannels);
+    std::vector<Channel*> list;
+
+    while (!quit) {
+        GetChannels(list);
+
+        bool decoded = false;
+        for (int i = 0; i < (int)list.size(); i++) {
+            if (DecodeChannel(list[i], scratch)) decoded = true;
+        }
+
+        decodePasses++;
+
+        // Rings are full, or nothing is playing
+        if (!decoded) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+
+void AudioMixer::GetChannels(std::vector<Channel*>& list) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    list = channels;
+}
+
+
+void AudioMixer::ApplySeek(Channel* channel) {
+    int flush = channel->flushGeneration.load(std::memory_order_acquire);
+    if (flush == channel->mixGeneration) return;
+
+    // Drop the samples from before the seek.  The decode thread waits for this.
+    channel->ring.Discard();
+
+    channel->mixGeneration = flush;
+    channel->mixChannels = channel->ringChannels;
+
+    channel->gains.assign(numChannels, channel->ringSpeaker > 0 ? 0.0f : 1.0f);
+    if (channel->ringSpeaker > 0) channel->gains[GetSpeakerIndex(channel->ringSpeaker)] = 1.0f;
+
+    channel->startPosition = channel->ringStart;
+    channel->framesPlayed = 0;
+
+    channel->flushedGeneration.store(flush, std::memory_order_release);
+}
+
+bool AudioMixer::Ready(Channel* channel) const {
+    // Wait for a pending seek
+    if (channel->seekGeneration.load(std::memory_order_acquire) != channel->mixGeneration) return false;
+
+    return channel->ended.load(std::memory_order_acquire) ||
+           channel->ring.GetReadable() >= (size_t)(blockFrames * channel->mixChannels);
+}
+
+bool AudioMixer::MixChannel(Channel* channel, float* output, std::vector<float>& scratch) {
+    // Pick up volume changes
+    int volumeGeneration = channel->volumeGeneration.load(std::memory_order_acquire);
+    if (volumeGeneration != channel->mixVolumeGeneration) {
+        channel->mixVolumeGeneration = volumeGeneration;
+
+        float target = channel->targetVolume.load();
+        long long frames = channel->rampFrames.load();
+
+        if (frames > 0) {
+            channel->rampTarget = target;
+            channel->rampRemaining = frames;
+            channel->volumeStep = (target - channel->volume) / frames;
+        }
+        else {
+            channel->volume = target;
+            channel->rampRemaining = 0;
+        }
+    }
+
+    if (channel->state != Channel::Playing) return false;
+
+    // An end flag from before a pending seek doesn't count.  Check before reading, so the
+    // last samples are not missed.
+    bool seekPending = channel->seekGeneration.load(std::memory_order_acquire) != channel->mixGeneration;
+    bool ended = !seekPending && channel->ended.load(std::memory_order_acquire);
+
+    int inputChannels = channel->mixChannels;
+    int count = (int)(channel->ring.Read(&scratch[0], blockFrames * inputChannels) / inputChannels);
+
+    // Mix in segments, so ramps end on the exact sample
+    int done = 0;
+    while (done < count) {
+        int frames = count - done;
+        float step = 0.0f;
+        if (channel->rampRemaining > 0) {
+            frames = (int)std::min((long long)frames, channel->rampRemaining);
+            step = channel->volumeStep;
+        }
+
+        MixInto(output + done * numChannels, &scratch[done * inputChannels], frames, numChannels, inputChannels,
+                &channel->gains[0], channel->volume, step);
+
+        if (channel->rampRemaining > 0) {
+            channel->rampRemaining -= frames;
+            channel->volume = channel->rampRemaining > 0 ? channel->volume + step * frames : channel->rampTarget;
+        }
+
+        done += frames;
+    }
+
+    channel->framesPlayed += count;
+    channel->position.store(channel->startPosition + (double)channel->framesPlayed / sampleRate);
+
+    if (ended && channel->ring.GetReadable() == 0) {
+        channel->state = Channel::Stopped;
+        return false;
+    }
+
+    return count < blockFrames && !seekPending;
+}
+
+
+bool AudioMixer::DecodeChannel(Channel* channel, std::vector<float>& scratch) {
+    // The mix thread reads the ring layout until it has flushed for the last seek, so a
+    // newer seek waits for that
+    bool flushed = channel->flushedGeneration.load(std::memory_order_acquire) == channel->decodeGeneration;
+
+    int requested = channel->seekGeneration.load(std::memory_order_acquire);
+    if (flushed && requested != channel->decodeGeneration) {
+        int speaker = channel->speaker.load();
+        int ringChannels = speaker > 0 ? 1 : numChannels;
+        double seconds = channel->seekTime.load();
+
+        // Reopen for a new speaker layout
+        bool success = true;
+        if (ringChannels != channel->decoder.GetNumChannels()) {
+            success = channel->decoder.Open(channel->fileName, sampleRate, ringChannels);
+        }
+        if (success) success = channel->decoder.Seek(seconds);
+
+        channel->decodeGeneration = requested;
+        channel->ringChannels = ringChannels;
+        channel->ringSpeaker = speaker;
+        channel->ringStart = seconds;
+        channel->loopFrames = 0;
+
+        // Publish the new layout with the flush
+        channel->ended.store(!success, std::memory_order_relaxed);
+        channel->flushGeneration.store(requested, std::memory_order_release);
+    }
+
+    // Wait for the mix thread to drop the samples from before the seek
+    if (channel->flushedGeneration.load(std::memory_order_acquire) != channel->decodeGeneration) return false;
+    if (channel->ended.load(std::memory_order_relaxed)) return false;
+
+    int ringChannels = channel->ringChannels;
+    if (channel->ring.GetWritable() < (size_t)(decodeFrames * ringChannels)) return false;
+
+    int count = channel->decoder.Decode(&scratch[0], decodeFrames);
+    if (count > 0) {
+        channel->ring.Write(&scratch[0], count * ringChannels);
+        channel->loopFrames += count;
+        return true;
+    }
+
+    // Loop unless the file has no samples at all
+    if (count == 0 && channel->loop && channel->loopFrames > 0 && channel->decoder.Seek(0.0)) {
+        channel->loopFrames = 0;
+        return true;
+    }
+
+    channel->ended.store(true, std::memory_order_release);
+
+    return false;
+}
+
+
+int AudioMixer::GetSpeakerIndex(int speaker) const {
+    // BASS speaker numbers in WAV channel order
+    static const int indices[8] = { 0, 1, 4, 5, 2, 3, 6, 7 };
+
+    int index = speaker >= 1 && speaker <= 8 ? indices[speaker - 1] : speaker - 1;
+
+    // Fold onto the speakers there are
+    if (index < 0 || index >= numChannels) index = (speaker - 1 + numChannels) % numChannels;
+
+    return index;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioMixer.h
+//
+// Author:      David Borland
+//
+// Description: Portable audio engine.  A decode thread fills a lock-free ring buffer per
+//              channel, and a mix thread sums the channels into multichannel output for an
+//              AudioSink, with per-sample volume ramps.  The samples mixed so far give an
+//              audio clock that video can follow.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class AudioSink;
+
+
+class AudioMixer {
+public:
+    AudioMixer();
+    ~AudioMixer();
+
+    // Start mixing into the sink, which is deleted by the mixer.  Speakers are in WAV order,
+    // e.g. front left, front right, center, LFE, back left, back right, side left and side
+    // right for 8 channels.
+    bool Start(AudioSink* sink, int sampleRate = 44100, int numChannels = 2);
+    void Shutdown();
+
+    bool Running() const;
+
+    // A playing file.  Speaker 0 plays on all speakers, otherwise a mono downmix plays on
+    // one speaker, numbered as for BASS: front left, front right, rear left, rear right,
+    // center, LFE, rear 2 left and rear 2 right.
+    struct Channel;
+
+    Channel* CreateChannel(const std::string& fileName, bool loop = false, int speaker = 0);
+    void FreeChannel(Channel* channel);
+
+    void Play(Channel* channel);
+    void Pause(Channel* channel);
+    void Stop(Channel* channel);
+
+    bool Stopped(Channel* channel) const;
+
+    // Position in seconds of the next sample to be mixed
+    void Seek(Channel* channel, double seconds);
+    double GetPosition(Channel* channel) const;
+
+    void SetSpeaker(Channel* channel, int speaker);
+
+    // Ramp linearly from the current volume to the new one over the given time, starting
+    // with the next sample mixed
+    void SetVolume(Channel* channel, float volume, float seconds);
+
+    int GetSampleRate() const;
+    int GetNumChannels() const;
+
+    // Seconds of audio heard since Start().  Advances smoothly between mixed blocks.
+    double GetClockTime() const;
+
+    struct Stats {
+        unsigned int blocks;        // Blocks written to the sink
+        unsigned int underruns;     // Blocks where a playing channel ran out of samples
+        double mixSeconds;          // Time spent mixing, not including waiting for the sink
+    };
+
+    Stats GetStats() const;
+
+private:
+    AudioSink* sink;
+
+    int sampleRate;
+    int numChannels;
+    int blockFrames;
+
+    std::vector<Channel*> channels;
+    std::mutex channelMutex;
+
+    std::thread mixThread;
+    std::thread decodeThread;
+
+    std::atomic<bool> running;
+    std::atomic<bool> quit;
+
+    // Count the passes of each thread, so a freed channel is only deleted once neither
+    // thread can be using it
+    std::atomic<unsigned int> mixPasses;
+    std::atomic<unsigned int> decodePasses;
+
+    // Audio clock
+    std::atomic<long long> framesMixed;
+    std::atomic<double> blockTime;
+
+    std::atomic<unsigned int> blocks;
+    std::atomic<unsigned int> underruns;
+    std::atomic<double> mixSeconds;
+
+    void MixLoop();
+    void DecodeLoop();
+
+    void GetChannels(std::vector<Channel*>& list);
+
+    // Mix thread
+    void ApplySeek(Channel* channel);
+    bool Ready(Channel* channel) const;
+    // Returns true if the channel ran out of samples
+    bool MixChannel(Channel* channel, float* output, std::vector<float>& scratch);
+
+    // Decode thread.  Returns true if any samples were decoded.
+    bool DecodeChannel(Channel* channel, std::vector<float>& scratch);
+
+    int GetSpeakerIndex(int speaker) const;
+
+    // Not copyable
+    AudioMixer(const AudioMixer&);
+    AudioMixer& operator=(const AudioMixer&);
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioRing.cpp
+//
+// Author:      David Borland
+//
+// Description: Lock-free ring buffer of interleaved float samples, for one thread writing
+//              and one thread reading.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "AudioRing.h"
+
+#include <algorithm>
+#include <string.h>
+
+
+AudioRing::AudioRing() : writeCount(0), readCount(0) {
+}
+
+
+void AudioRing::Allocate(size_t numSamples) {
+    buffer.assign(numSamples, 0.0f);
+
+    writeCount = 0;
+    readCount = 0;
+}
+
+
+size_t AudioRing::GetCapacity() const {
+    return buffer.size();
+}
+
+
+size_t AudioRing::GetReadable() const {
+    return writeCount.load(std::memory_order_acquire) - readCount.load(std::memory_order_relaxed);
+}
+
+size_t AudioRing::GetWritable() const {
+    return buffer.size() - (writeCount.load(std::memory_order_relaxed) - readCount.load(std::memory_order_acquire));
+}
+
+
+size_t AudioRing::Write(const float* samples, size_t count) {
+    size_t written = writeCount.load(std::memory_order_relaxed);
+    count = std::min(count, GetWritable());
+    if (count == 0) return 0;
+
+    // Copy in up to two pieces, around the end of the buffer
+    size_t start = written % buffer.size();
+    size_t first = std::min(count, buffer.size() - start);
+
+    memcpy(&buffer[start], samples, first * sizeof(float));
+    if (count > first) memcpy(&buffer[0], samples + first, (count - first) * sizeof(float));
+
+    // Publish the samples
+    writeCount.store(written + count, std::memory_order_release);
+
+    return count;
+}
+
+size_t AudioRing::Read(float* samples, size_t count) {
+    size_t read = readCount.load(std::memory_order_relaxed);
+    count = std::min(count, GetReadable());
+    if (count == 0) return 0;
+
+    size_t start = read % buffer.size();
+    size_t first = std::min(count, buffer.size() - start);
+
+    memcpy(samples, &buffer[start], first * sizeof(float));
+    if (count > first) memcpy(samples + first, &buffer[0], (count - first) * sizeof(float));
+
+    // Hand the space back to the writer
+    readCount.store(read + count, std::memory_order_release);
+
+    return count;
+}
+
+
+void AudioRing::Discard() {
+    readCount.store(writeCount.load(std::memory_order_acquire), std::memory_order_release);
+}
\ No newline at end of file
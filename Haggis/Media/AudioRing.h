@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioRing.h
+//
+// Author:      David Borland
+//
+// Description: Lock-free ring buffer of interleaved float samples, for one thread writing
+//              and one thread reading.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef AUDIORING_H
+#define AUDIORING_H
+
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+
+class AudioRing {
+public:
+    AudioRing();
+
+    // Not thread safe.  Call before either thread uses the ring.
+    void Allocate(size_t numSamples);
+
+    size_t GetCapacity() const;
+
+    // Samples that can be read or written now
+    size_t GetReadable() const;
+    size_t GetWritable() const;
+
+    // Writer thread.  Returns the number of samples written.
+    size_t Write(const float* samples, size_t count);
+
+    // Reader thread.  Returns the number of samples read.
+    size_t Read(float* samples, size_t count);
+
+    // Reader thread.  Drop everything written so far.
+    void Discard();
+
+private:
+    std::vector<float> buffer;
+
+    // Total samples written and read.  Each is only changed by its own thread.
+    std::atomic<size_t> writeCount;
+    std::atomic<size_t> readCount;
+};
+
+
+#endif
\ No newline at end of file
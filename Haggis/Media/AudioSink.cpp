@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioSink.cpp
+//
+// Author:      David Borland
+//
+// Description: Destinations for the output of AudioMixer.  The null and WAV file sinks let
+//              the mixer run without an audio device, e.g. for testing and benchmarking.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "AudioSink.h"
+
+#include "VideoStream.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+
+AudioSink::AudioSink() {
+    sampleRate = 0;
+    numChannels = 0;
+}
+
+AudioSink::~AudioSink() {
+}
+
+
+void AudioSink::Close() {
+}
+
+
+bool AudioSink::IsRealTime() const {
+    return true;
+}
+
+double AudioSink::GetLatency() const {
+    return 0.0;
+}
+
+
+NullAudioSink::NullAudioSink(bool realTime) : AudioSink() {
+    this->realTime = realTime;
+
+    startTime = 0.0;
+    framesWritten = 0;
+}
+
+
+bool NullAudioSink::Open(int sampleRate, int numChannels) {
+    this->sampleRate = sampleRate;
+    this->numChannels = numChannels;
+
+    startTime = VideoStream::GetSystemTime();
+    framesWritten = 0;
+
+    return true;
+}
+
+bool NullAudioSink::Write(const float* /*samples*/, int numFrames) {
+    if (!realTime) return true;
+
+    // Wait until a device would have played everything before this block
+    double due = startTime + (double)framesWritten / sampleRate;
+    double wait = due - VideoStream::GetSystemTime();
+    if (wait > 0.0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+
+    framesWritten += numFrames;
+
+    return true;
+}
+
+bool NullAudioSink::IsRealTime() const {
+    return realTime;
+}
+
+
+WavFileSink::WavFileSink(const std::string& fileName, bool realTime)
+: AudioSink(), clock(realTime) {
+    this->fileName = fileName;
+
+    framesWritten = 0;
+}
+
+WavFileSink::~WavFileSink() {
+    Close();
+}
+
+
+bool WavFileSink::Open(int sampleRate, int numChannels) {
+    this->sampleRate = sampleRate;
+    this->numChannels = numChannels;
+
+    file.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "WavFileSink::Open() : Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    // The sizes are filled in on closing
+    framesWritten = 0;
+    WriteHeader();
+
+    return clock.Open(sampleRate, numChannels);
+}
+
+void WavFileSink::Close() {
+    if (!file.is_open()) return;
+
+    file.seekp(0);
+    WriteHeader();
+    file.close();
+}
+
+bool WavFileSink::Write(const float* samples, int numFrames) {
+    if (!file) return false;
+
+    int count = numFrames * numChannels;
+    buffer.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        float sample = samples[i];
+        if (sample > 1.0f) sample = 1.0f;
+        else if (sample < -1.0f) sample = -1.0f;
+
+        buffer[i] = (int16_t)(sample * 32767.0f);
+    }
+
+    file.write((const char*)&buffer[0], count * sizeof(int16_t));
+    framesWritten += numFrames;
+
+    return clock.Write(samples, numFrames) && (bool)file;
+}
+
+bool WavFileSink::IsRealTime() const {
+    return clock.IsRealTime();
+}
+
+
+void WavFileSink::WriteHeader() {
+    // Canonical 44 byte header, little endian
+    uint32_t dataSize = (uint32_t)(framesWritten * numChannels * sizeof(int16_t));
+    uint32_t riffSize = 36 + dataSize;
+    uint32_t formatSize = 16;
+    uint16_t format = 1;
+    uint16_t channels = (uint16_t)numChannels;
+    uint32_t rate = (uint32_t)sampleRate;
+    uint32_t byteRate = rate * channels * sizeof(int16_t);
+    uint16_t blockAlign = (uint16_t)(channels * sizeof(int16_t));
+    uint16_t bitsPerSample = 16;
+
+    file.write("RIFF", 4);
+    file.write((const char*)&riffSize, 4);
+    file.write("WAVE", 4);
+    file.write("fmt ", 4);
+    file.write((const char*)&formatSize, 4);
+    file.write((const char*)&format, 2);
+    file.write((const char*)&channels, 2);
+    file.write((const char*)&rate, 4);
+    file.write((const char*)&byteRate, 4);
+    file.write((const char*)&blockAlign, 2);
+    file.write((const char*)&bitsPerSample, 2);
+    file.write("data", 4);
+    file.write((const char*)&dataSize, 4);
+}
\ No newline at end of file
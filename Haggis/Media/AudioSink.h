@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        AudioSink.h
+//
+// Author:      David Borland
+//
+// Description: Destinations for the output of AudioMixer.  The null and WAV file sinks let
+//              the mixer run without an audio device, e.g. for testing and benchmarking.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+class AudioSink {
+public:
+    AudioSink();
+    virtual ~AudioSink();
+
+    virtual bool Open(int sampleRate, int numChannels) = 0;
+    virtual void Close();
+
+    // Interleaved samples.  Real time sinks block until there is room.
+    virtual bool Write(const float* samples, int numFrames) = 0;
+
+    // Real time sinks consume audio at the sample rate.  Others take it as fast as it is
+    // mixed, and the mixer waits for decoding rather than dropping out.
+    virtual bool IsRealTime() const;
+
+    // Seconds between writing audio and hearing it
+    virtual double GetLatency() const;
+
+protected:
+    int sampleRate;
+    int numChannels;
+};
+
+
+// Throws the audio away, optionally at the rate a device would play it
+class NullAudioSink : public AudioSink {
+public:
+    NullAudioSink(bool realTime = true);
+
+    virtual bool Open(int sampleRate, int numChannels);
+    virtual bool Write(const float* samples, int numFrames);
+    virtual bool IsRealTime() const;
+
+protected:
+    bool realTime;
+
+    double startTime;
+    int64_t framesWritten;
+};
+
+
+// Writes 16 bit PCM to a WAV file
+class WavFileSink : public AudioSink {
+public:
+    WavFileSink(const std::string& fileName, bool realTime = false);
+    virtual ~WavFileSink();
+
+    virtual bool Open(int sampleRate, int numChannels);
+    virtual void Close();
+    virtual bool Write(const float* samples, int numFrames);
+    virtual bool IsRealTime() const;
+
+protected:
+    std::string fileName;
+    std::ofstream file;
+
+    NullAudioSink clock;
+
+    int64_t framesWritten;
+    std::vector<int16_t> buffer;
+
+    void WriteHeader();
+};
+
+
+#endif
\ No newline at end of file
@@ -4,13 +4,17 @@
 //
 // Author:      David Borland
 //
-// Description: Plays back audio file using DirectShow
+// Description: Plays back audio file using BASS, or the built in AudioMixer
 //
 /////////////////////////////////////////////////////////////////////////////////////////////// 
 
 
 #include "AudioStream.h"
 
+#ifndef HAGGIS_USE_BASS
+#include "AudioSink.h"
+#endif
+
 #include <iostream>
 
 
@@ -18,10 +22,8 @@ bool AudioStream::initializedLibrary = false;
 
 
 AudioStream::AudioStream() {
-}
-
-AudioStream::~AudioStream() {
-    BASS_StreamFree(stream);
+    stream = 0;
+    loop = false;
 }
 
 
@@ -30,6 +32,13 @@ void AudioStream::SetFileName(const std::string& name) {
 }
 
 
+#ifdef HAGGIS_USE_BASS
+
+AudioStream::~AudioStream() {
+    BASS_StreamFree(stream);
+}
+
+
 bool AudioStream::Initialize(bool doLoop, unsigned int channel) {
     // Check to see if BASS has been initialized.
     if (!initializedLibrary) {
@@ -233,4 +242,115 @@ bool AudioStream::InitializeLibrary(HWND win, bool speakerAssignment) {
 
 void AudioStream::FreeLibrary() {
     BASS_Free();
-}
\ No newline at end of file
+}
+
+
+#else
+
+AudioSink* AudioStream::sink = NULL;
+
+
+AudioStream::~AudioStream() {
+    if (stream) GetMixer()->FreeChannel(stream);
+}
+
+
+bool AudioStream::Initialize(bool doLoop, unsigned int channel) {
+    // Check to see if the mixer has been started
+    if (!initializedLibrary) {
+        std::cout << "AudioStream::Initialize() : Library has not been initialized." << std::endl;
+        return false;
+    }
+
+
+    loop = doLoop;
+
+    if (stream) {
+        GetMixer()->FreeChannel(stream);
+        stream = NULL;
+    }
+
+
+    // Initialize the file
+    if (!(stream = GetMixer()->CreateChannel(fileName, loop, channel))) {
+        std::cout << "AudioStream::Initialize() : Can't play file " << fileName << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+void AudioStream::Play() {
+    if (stream) GetMixer()->Play(stream);
+}
+
+void AudioStream::Pause() {
+    if (stream) GetMixer()->Pause(stream);
+}
+
+void AudioStream::Stop() {
+    if (stream) GetMixer()->Stop(stream);
+}
+
+void AudioStream::Rewind() {
+    if (stream) GetMixer()->Seek(stream, 0.0);
+}
+
+void AudioStream::Jump(float seconds) {
+    if (stream) GetMixer()->Seek(stream, GetMixer()->GetPosition(stream) + seconds);
+}
+
+
+bool AudioStream::Stopped() {
+    return !stream || GetMixer()->Stopped(stream);
+}
+
+
+void AudioStream::SetChannel(unsigned int channel) {
+    if (stream) GetMixer()->SetSpeaker(stream, channel);
+}
+
+
+void AudioStream::SetVolume(float volume, float seconds) {
+    if (stream) GetMixer()->SetVolume(stream, volume, seconds);
+}
+
+
+bool AudioStream::InitializeLibrary(void* win, bool speakerAssignment) {
+    if (initializedLibrary) return true;
+
+    // Discard the mix in real time if no sink was given
+    AudioSink* audioSink = sink ? sink : new NullAudioSink();
+    sink = NULL;
+
+    if (!GetMixer()->Start(audioSink, 44100, speakerAssignment ? 8 : 2)) {
+        std::cout << "AudioStream::InitializeLibrary() : Mixer initialization failed" << std::endl;
+        return false;
+    }
+
+
+    initializedLibrary = true;
+
+    return true;
+}
+
+
+void AudioStream::SetSink(AudioSink* audioSink) {
+    delete sink;
+    sink = audioSink;
+}
+
+AudioMixer* AudioStream::GetMixer() {
+    static AudioMixer mixer;
+    return &mixer;
+}
+
+
+void AudioStream::FreeLibrary() {
+    GetMixer()->Shutdown();
+
+    initializedLibrary = false;
+}
+
+#endif
\ No newline at end of file
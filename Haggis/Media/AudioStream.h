@@ -4,7 +4,7 @@
 //
 // Author:      David Borland
 //
-// Description: Plays back audio file using BASS
+// Description: Plays back audio file using BASS, or the built in AudioMixer
 //
 /////////////////////////////////////////////////////////////////////////////////////////////// 
 
@@ -13,9 +13,16 @@
 #define AUDIOSTREAM_H
 
 
-#include <bass.h>
 #include <string>
 
+#ifdef HAGGIS_USE_BASS
+#include <bass.h>
+#else
+#include "AudioMixer.h"
+
+class AudioSink;
+#endif
+
 
 class AudioStream {
 public:
@@ -39,11 +46,29 @@ public:
     // Set the volume (0...1) and the amount of time in seconds to reach that volume
     void SetVolume(float volume, float seconds);
 
+#ifdef HAGGIS_USE_BASS
     static bool InitializeLibrary(HWND win = 0, bool speakerAssignment = false);
+#else
+    // The window is not used.  Speaker assignment mixes 8 channels rather than stereo.
+    static bool InitializeLibrary(void* win = NULL, bool speakerAssignment = false);
+
+    // Mix into this sink, which is deleted by the mixer.  Call before InitializeLibrary().
+    // Without a sink the mix is timed in real time and discarded.
+    static void SetSink(AudioSink* audioSink);
+
+    // The mixer's clock can drive a VideoScheduler
+    static AudioMixer* GetMixer();
+#endif
     static void FreeLibrary();
 
 protected:
+#ifdef HAGGIS_USE_BASS
     DWORD stream;
+#else
+    AudioMixer::Channel* stream;
+
+    static AudioSink* sink;
+#endif
 
     std::string fileName;
 
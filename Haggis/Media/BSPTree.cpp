@@ -0,0 +1,619 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        BSPTree.cpp
+//
+// Author:      David Borland
+//
+// Description: Binary space partitioning tree of polygons, for drawing transparent geometry
+//              back to front from any point of view without sorting.  Polygons crossing a
+//              splitting plane are split, so the order is exact for intersecting and long
+//              polygons.  The tree is built once, and large subtrees are built in parallel.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "BSPTree.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <stdlib.h>
+#include <utility>
+
+
+namespace {
+    const int vertexSize = BSPTree::vertexSize;
+
+    // Splitting planes tried per node, and polygons used to score them
+    const int numCandidates = 16;
+    const int numScored = 2000;
+
+    // Spanning polygons are split in two, so cost more than imbalance
+    const int splitCost = 8;
+
+    // Both children of a node at least this big are built in parallel
+    const int parallelSize = 16384;
+
+
+    struct BuildPolygon {
+        std::vector<float> vertices;
+        float plane[4];
+        int tag;
+    };
+
+    struct Subtree {
+        std::vector<BSPTree::Node> nodes;
+        std::vector<BuildPolygon> polygons;
+    };
+
+    // Shared by the subtrees being built
+    struct BuildState {
+        float epsilon;
+
+        // Pieces added by splitting, and the most allowed
+        std::atomic<long long> added;
+        long long maxAdded;
+    };
+
+    enum Side {
+        Front,
+        Back,
+        OnPlane,
+        Spanning
+    };
+
+
+    // Newell's method, which is robust for non-planar polygons.  A zero normal marks a
+    // degenerate polygon.
+    void CalculatePlane(BuildPolygon& polygon) {
+        const std::vector<float>& v = polygon.vertices;
+        int n = (int)v.size() / vertexSize;
+
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double center[3] = { 0.0, 0.0, 0.0 };
+        for (int i = 0; i < n; i++) {
+            const float* a = &v[i * vertexSize];
+            const float* b = &v[((i + 1) % n) * vertexSize];
+
+            normal[0] += ((double)a[1] - b[1]) * ((double)a[2] + b[2]);
+            normal[1] += ((double)a[2] - b[2]) * ((double)a[0] + b[0]);
+            normal[2] += ((double)a[0] - b[0]) * ((double)a[1] + b[1]);
+
+            center[0] += a[0];
+            center[1] += a[1];
+            center[2] += a[2];
+        }
+
+        double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length > 0.0) {
+            for (int i = 0; i < 3; i++) normal[i] /= length;
+        }
+
+        polygon.plane[0] = (float)normal[0];
+        polygon.plane[1] = (float)normal[1];
+        polygon.plane[2] = (float)normal[2];
+        polygon.plane[3] = (float)(-(normal[0] * center[0] + normal[1] * center[1] + normal[2] * center[2]) / n);
+    }
+
+    bool Degenerate(const float plane[4]) {
+        return plane[0] == 0.0f && plane[1] == 0.0f && plane[2] == 0.0f;
+    }
+
+    float Distance(const float plane[4], const float* point) {
+        return plane[0] * point[0] + plane[1] * point[1] + plane[2] * point[2] + plane[3];
+    }
+
+    Side Classify(const BuildPolygon& polygon, const float plane[4], float epsilon) {
+        bool front = false;
+        bool back = false;
+        float sum = 0.0f;
+
+        for (int i = 0; i < (int)polygon.vertices.size(); i += vertexSize) {
+            float distance = Distance(plane, &polygon.vertices[i]);
+
+            if (distance > epsilon) front = true;
+            else if (distance < -epsilon) back = true;
+
+            sum += distance;
+        }
+
+        if (front && back) return Spanning;
+        if (front) return Front;
+        if (back) return Back;
+
+        // A sliver within epsilon of the plane but at an angle to it, e.g. sharing an edge
+        // with the splitter, goes to the side it leans towards so it is still ordered
+        float cosine = polygon.plane[0] * plane[0] + polygon.plane[1] * plane[1] + polygon.plane[2] * plane[2];
+        if (!Degenerate(polygon.plane) && fabsf(cosine) < 0.9999f && sum != 0.0f) {
+            return sum > 0.0f ? Front : Back;
+        }
+
+        return OnPlane;
+    }
+
+    // Split into the parts in front of and behind the plane, interpolating the vertices
+    void Split(const BuildPolygon& polygon, const float plane[4], float epsilon,
+               BuildPolygon& front, BuildPolygon& back) {
+        const std::vector<float>& v = polygon.vertices;
+        int n = (int)v.size() / vertexSize;
+
+        for (int i = 0; i < n; i++) {
+            const float* a = &v[i * vertexSize];
+            const float* b = &v[((i + 1) % n) * vertexSize];
+
+            float da = Distance(plane, a);
+            float db = Distance(plane, b);
+
+            int sideA = da > epsilon ? 1 : (da < -epsilon ? -1 : 0);
+            int sideB = db > epsilon ? 1 : (db < -epsilon ? -1 : 0);
+
+            if (sideA >= 0) front.vertices.insert(front.vertices.end(), a, a + vertexSize);
+            if (sideA <= 0) back.vertices.insert(back.vertices.end(), a, a + vertexSize);
+
+            if (sideA * sideB < 0) {
+                float t = da / (da - db);
+
+                float vertex[vertexSize];
+                for (int j = 0; j < vertexSize; j++) {
+                    vertex[j] = a[j] + (b[j] - a[j]) * t;
+                }
+
+                float length = sqrtf(vertex[3] * vertex[3] + vertex[4] * vertex[4] + vertex[5] * vertex[5]);
+                if (length > 0.0f) {
+                    vertex[3] /= length;
+                    vertex[4] /= length;
+                    vertex[5] /= length;
+                }
+
+                front.vertices.insert(front.vertices.end(), vertex, vertex + vertexSize);
+                back.vertices.insert(back.vertices.end(), vertex, vertex + vertexSize);
+            }
+        }
+
+        for (int i = 0; i < 4; i++) {
+            front.plane[i] = polygon.plane[i];
+            back.plane[i] = polygon.plane[i];
+        }
+
+        front.tag = polygon.tag;
+        back.tag = polygon.tag;
+    }
+
+
+    // True if no polygon is in front of another's plane.  Seen from any point, such polygons
+    // facing away never hide those facing the point, and polygons facing the same way never
+    // hide each other.
+    bool Convex(const std::vector<BuildPolygon>& polygons, float epsilon) {
+        for (int i = 0; i < (int)polygons.size(); i++) {
+            const float* plane = polygons[i].plane;
+            if (Degenerate(plane)) continue;
+
+            for (int j = 0; j < (int)polygons.size(); j++) {
+                const std::vector<float>& v = polygons[j].vertices;
+                for (int k = 0; k < (int)v.size(); k += vertexSize) {
+                    if (Distance(plane, &v[k]) > epsilon) return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Choose the candidate plane with the fewest splits and the best balance.  Returns -1 if
+    // every candidate is degenerate.
+    int ChooseSplitter(const std::vector<BuildPolygon>& polygons, float epsilon, bool& allBehind) {
+        int n = (int)polygons.size();
+        int candidateStep = std::max(n / numCandidates, 1);
+        int scoreStep = std::max(n / numScored, 1);
+
+        int best = -1;
+        int bestScore = 0;
+        allBehind = false;
+
+        for (int i = 0; i < n; i += candidateStep) {
+            const float* plane = polygons[i].plane;
+            if (Degenerate(plane)) continue;
+
+            int front = 0;
+            int back = 0;
+            int spanning = 0;
+            for (int j = 0; j < n; j += scoreStep) {
+                Side side = Classify(polygons[j], plane, epsilon);
+
+                if (side == Front) front++;
+                else if (side == Back) back++;
+                else if (side == Spanning) spanning++;
+            }
+
+            int score = splitCost * spanning + abs(front - back);
+            if (best < 0 || score < bestScore) {
+                best = i;
+                bestScore = score;
+                allBehind = front == 0 && spanning == 0;
+            }
+        }
+
+        return best;
+    }
+
+
+    void BuildSubtree(std::vector<BuildPolygon>& polygons, Subtree& tree, BuildState& state, ThreadPool& pool);
+
+    // Append a subtree built separately, and return the index of its root
+    int Append(Subtree& tree, Subtree& subtree) {
+        int nodeOffset = (int)tree.nodes.size();
+        int polygonOffset = (int)tree.polygons.size();
+
+        for (int i = 0; i < (int)subtree.nodes.size(); i++) {
+            BSPTree::Node node = subtree.nodes[i];
+
+            if (node.front >= 0) node.front += nodeOffset;
+            if (node.back >= 0) node.back += nodeOffset;
+            node.firstPolygon += polygonOffset;
+
+            tree.nodes.push_back(node);
+        }
+
+        for (int i = 0; i < (int)subtree.polygons.size(); i++) {
+            tree.polygons.push_back(BuildPolygon());
+            std::swap(tree.polygons.back(), subtree.polygons[i]);
+        }
+
+        return nodeOffset;
+    }
+
+    void BuildSubtree(std::vector<BuildPolygon>& polygons, Subtree& tree, BuildState& state, ThreadPool& pool) {
+        float epsilon = state.epsilon;
+
+        // Nodes left to build.  Parent -1 is the root.  Sets found not to be convex are only
+        // checked again once they have halved, so chains of nodes peeling single polygons off
+        // a set that is nearly convex stay linear.
+        struct Work {
+            std::vector<BuildPolygon> polygons;
+            int parent;
+            bool front;
+            int notConvexSize;
+        };
+
+        std::vector<Work> stack(1);
+        stack.back().polygons.swap(polygons);
+        stack.back().parent = -1;
+        stack.back().front = false;
+        stack.back().notConvexSize = 0;
+
+        while (!stack.empty()) {
+            // Give up once there are too many pieces
+            if (state.added.load(std::memory_order_relaxed) > state.maxAdded) return;
+
+            Work work;
+            work.polygons.swap(stack.back().polygons);
+            work.parent = stack.back().parent;
+            work.front = stack.back().front;
+            work.notConvexSize = stack.back().notConvexSize;
+            stack.pop_back();
+
+            int index = (int)tree.nodes.size();
+            if (work.parent >= 0) {
+                if (work.front) tree.nodes[work.parent].front = index;
+                else tree.nodes[work.parent].back = index;
+            }
+
+            BSPTree::Node node;
+            node.plane[0] = node.plane[1] = node.plane[2] = node.plane[3] = 0.0f;
+            node.front = -1;
+            node.back = -1;
+            node.firstPolygon = (int)tree.polygons.size();
+            node.numPolygons = 0;
+            node.convex = 0;
+
+            std::vector<BuildPolygon>& set = work.polygons;
+            int n = (int)set.size();
+
+            bool allBehind = false;
+            int splitter = ChooseSplitter(set, epsilon, allBehind);
+
+            bool convex = splitter < 0;
+            if (!convex && allBehind && (work.notConvexSize == 0 || n * 2 <= work.notConvexSize)) {
+                convex = Convex(set, epsilon);
+                if (!convex) work.notConvexSize = n;
+            }
+
+            if (convex) {
+                node.convex = 1;
+                node.numPolygons = n;
+
+                for (int i = 0; i < n; i++) {
+                    tree.polygons.push_back(BuildPolygon());
+                    std::swap(tree.polygons.back(), set[i]);
+                }
+
+                tree.nodes.push_back(node);
+                continue;
+            }
+
+
+            // Partition.  The splitter stays in the node even if it is not quite planar.
+            for (int i = 0; i < 4; i++) node.plane[i] = set[splitter].plane[i];
+
+            std::vector<BuildPolygon> front;
+            std::vector<BuildPolygon> back;
+
+            for (int i = 0; i < n; i++) {
+                Side side = i == splitter ? OnPlane : Classify(set[i], node.plane, epsilon);
+
+                if (side == OnPlane) {
+                    tree.polygons.push_back(BuildPolygon());
+                    std::swap(tree.polygons.back(), set[i]);
+                    node.numPolygons++;
+                }
+                else if (side == Front) {
+                    front.push_back(BuildPolygon());
+                    std::swap(front.back(), set[i]);
+                }
+                else if (side == Back) {
+                    back.push_back(BuildPolygon());
+                    std::swap(back.back(), set[i]);
+                }
+                else {
+                    BuildPolygon frontPart;
+                    BuildPolygon backPart;
+                    Split(set[i], node.plane, epsilon, frontPart, backPart);
+
+                    if (frontPart.vertices.size() >= 3 * vertexSize) {
+                        front.push_back(BuildPolygon());
+                        std::swap(front.back(), frontPart);
+                    }
+                    if (backPart.vertices.size() >= 3 * vertexSize) {
+                        back.push_back(BuildPolygon());
+                        std::swap(back.back(), backPart);
+                    }
+
+                    state.added.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            std::vector<BuildPolygon>().swap(set);
+
+            tree.nodes.push_back(node);
+
+
+            if ((int)front.size() >= parallelSize && (int)back.size() >= parallelSize) {
+                // Build both sides at once, then append them
+                Subtree subtrees[2];
+                std::vector<BuildPolygon>* sides[2] = { &front, &back };
+
+                pool.ParallelFor(2, 1, [&](int begin, int end) {
+                    for (int i = begin; i < end; i++) {
+                        BuildSubtree(*sides[i], subtrees[i], state, pool);
+                    }
+                });
+
+                tree.nodes[index].front = Append(tree, subtrees[0]);
+                tree.nodes[index].back = Append(tree, subtrees[1]);
+            }
+            else {
+                if (!back.empty()) {
+                    stack.push_back(Work());
+                    stack.back().polygons.swap(back);
+                    stack.back().parent = index;
+                    stack.back().front = false;
+                    stack.back().notConvexSize = work.notConvexSize;
+                }
+                if (!front.empty()) {
+                    stack.push_back(Work());
+                    stack.back().polygons.swap(front);
+                    stack.back().parent = index;
+                    stack.back().front = true;
+                    stack.back().notConvexSize = work.notConvexSize;
+                }
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+BSPTree::BSPTree() {
+}
+
+
+bool BSPTree::Build(const std::vector<float>& polygonVertices, const std::vector<int>& starts,
+                    const std::vector<int>& polygonTags, ThreadPool& pool, int maxGrowth) {
+    Clear();
+
+    int numInput = (int)polygonTags.size();
+
+    std::vector<BuildPolygon> polygons;
+    polygons.reserve(numInput);
+
+    float minimum[3] = { 0.0f, 0.0f, 0.0f };
+    float maximum[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 0; i < numInput; i++) {
+        if (starts[i + 1] - starts[i] < 3) continue;
+
+        polygons.push_back(BuildPolygon());
+        BuildPolygon& polygon = polygons.back();
+
+        polygon.vertices.assign(polygonVertices.begin() + starts[i] * vertexSize,
+                                polygonVertices.begin() + starts[i + 1] * vertexSize);
+        polygon.tag = polygonTags[i];
+
+        for (int j = 0; j < (int)polygon.vertices.size(); j += vertexSize) {
+            for (int k = 0; k < 3; k++) {
+                float value = polygon.vertices[j + k];
+                if (polygons.size() == 1 && j == 0) minimum[k] = maximum[k] = value;
+
+                minimum[k] = std::min(minimum[k], value);
+                maximum[k] = std::max(maximum[k], value);
+            }
+        }
+    }
+
+    if (polygons.empty()) return true;
+
+    pool.ParallelFor((int)polygons.size(), 4096, [&polygons](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            CalculatePlane(polygons[i]);
+        }
+    });
+
+    // Distances within this of a plane are on it
+    float dx = maximum[0] - minimum[0];
+    float dy = maximum[1] - minimum[1];
+    float dz = maximum[2] - minimum[2];
+    BuildState state;
+    state.epsilon = std::max(sqrtf(dx * dx + dy * dy + dz * dz) * 1e-5f, 1e-12f);
+    state.added = 0;
+    state.maxAdded = (long long)polygons.size() * (maxGrowth - 1);
+
+    Subtree tree;
+    BuildSubtree(polygons, tree, state, pool);
+
+    if (state.added.load() > state.maxAdded) return false;
+
+
+    // Flatten
+    nodes.swap(tree.nodes);
+
+    int numPolygons = (int)tree.polygons.size();
+    polygonStarts.resize(numPolygons + 1);
+    planes.resize(numPolygons * 4);
+    tags.resize(numPolygons);
+
+    polygonStarts[0] = 0;
+    for (int i = 0; i < numPolygons; i++) {
+        polygonStarts[i + 1] = polygonStarts[i] + (int)tree.polygons[i].vertices.size() / vertexSize;
+    }
+
+    vertices.resize(polygonStarts[numPolygons] * vertexSize);
+
+    pool.ParallelFor(numPolygons, 4096, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const BuildPolygon& polygon = tree.polygons[i];
+
+            std::copy(polygon.vertices.begin(), polygon.vertices.end(), vertices.begin() + polygonStarts[i] * vertexSize);
+            std::copy(polygon.plane, polygon.plane + 4, planes.begin() + i * 4);
+            tags[i] = polygon.tag;
+        }
+    });
+
+    return true;
+}
+
+
+void BSPTree::Clear() {
+    nodes.clear();
+    vertices.clear();
+    polygonStarts.clear();
+    planes.clear();
+    tags.clear();
+}
+
+bool BSPTree::Empty() const {
+    return nodes.empty();
+}
+
+
+int BSPTree::NumNodes() const {
+    return (int)nodes.size();
+}
+
+int BSPTree::NumPolygons() const {
+    return (int)tags.size();
+}
+
+
+void BSPTree::GetBackToFront(const float eye[3], std::vector<int>& order) const {
+    order.clear();
+    if (nodes.empty()) return;
+
+    order.reserve(tags.size());
+
+    // Nodes to visit, or the complement of a node whose polygons are next
+    std::vector<int> stack;
+    stack.push_back(0);
+
+    while (!stack.empty()) {
+        int entry = stack.back();
+        stack.pop_back();
+
+        if (entry < 0) {
+            const Node& node = nodes[~entry];
+            for (int i = node.firstPolygon; i < node.firstPolygon + node.numPolygons; i++) {
+                order.push_back(i);
+            }
+            continue;
+        }
+
+        const Node& node = nodes[entry];
+
+        if (node.convex) {
+            // Facing away first
+            int end = node.firstPolygon + node.numPolygons;
+            for (int i = node.firstPolygon; i < end; i++) {
+                if (Distance(&planes[i * 4], eye) < 0.0f) order.push_back(i);
+            }
+            for (int i = node.firstPolygon; i < end; i++) {
+                if (Distance(&planes[i * 4], eye) >= 0.0f) order.push_back(i);
+            }
+            continue;
+        }
+
+        // The far side, then the node, then the near side
+        bool inFront = Distance(node.plane, eye) >= 0.0f;
+        int nearChild = inFront ? node.front : node.back;
+        int farChild = inFront ? node.back : node.front;
+
+        if (nearChild >= 0) stack.push_back(nearChild);
+        stack.push_back(~entry);
+        if (farChild >= 0) stack.push_back(farChild);
+    }
+}
+
+
+bool BSPTree::Validate() const {
+    int numPolygons = (int)tags.size();
+    int numVertices = (int)vertices.size() / vertexSize;
+
+    if ((int)polygonStarts.size() != numPolygons + 1 || (int)planes.size() != numPolygons * 4 ||
+        (int)vertices.size() != numVertices * vertexSize) {
+        return false;
+    }
+
+    if (polygonStarts[0] != 0 || polygonStarts[numPolygons] != numVertices) return false;
+    for (int i = 0; i < numPolygons; i++) {
+        if (polygonStarts[i] > polygonStarts[i + 1]) return false;
+    }
+
+    // Children after their parents, so there are no cycles
+    int numNodes = (int)nodes.size();
+    for (int i = 0; i < numNodes; i++) {
+        const Node& node = nodes[i];
+
+        if ((node.front != -1 && (node.front <= i || node.front >= numNodes)) ||
+            (node.back != -1 && (node.back <= i || node.back >= numNodes))) {
+            return false;
+        }
+
+        if (node.firstPolygon < 0 || node.numPolygons < 0 ||
+            node.numPolygons > numPolygons - node.firstPolygon) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+size_t BSPTree::GetMemoryUsage() const {
+    return nodes.capacity() * sizeof(Node) +
+           vertices.capacity() * sizeof(float) +
+           polygonStarts.capacity() * sizeof(int) +
+           planes.capacity() * sizeof(float) +
+           tags.capacity() * sizeof(int);
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        BSPTree.h
+//
+// Author:      David Borland
+//
+// Description: Binary space partitioning tree of polygons, for drawing transparent geometry
+//              back to front from any point of view without sorting.  Polygons crossing a
+//              splitting plane are split, so the order is exact for intersecting and long
+//              polygons.  The tree is built once, and large subtrees are built in parallel.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef BSPTREE_H
+#define BSPTREE_H
+
+
+#include <stddef.h>
+#include <vector>
+
+
+class ThreadPool;
+
+
+class BSPTree {
+public:
+    BSPTree();
+
+    // Values per polygon vertex: position, normal and texture coordinate
+    static const int vertexSize = 9;
+
+    // Build from polygons in the form stored below, without planes.  Tags are copied to the
+    // pieces of split polygons.  Polygons with fewer than three vertices are left out.  Fails,
+    // leaving the tree empty, if splitting would make more than maxGrowth times as many 
+    // polygons, as for a soup of random intersecting triangles.
+    bool Build(const std::vector<float>& polygonVertices, const std::vector<int>& starts,
+               const std::vector<int>& polygonTags, ThreadPool& pool, int maxGrowth = 8);
+
+    void Clear();
+    bool Empty() const;
+
+    int NumNodes() const;
+    int NumPolygons() const;
+
+    // Polygon indices in back to front order as seen from the point
+    void GetBackToFront(const float eye[3], std::vector<int>& order) const;
+
+    // Check the indices, e.g. after reading the arrays from a file
+    bool Validate() const;
+
+    // Bytes allocated for the arrays
+    size_t GetMemoryUsage() const;
+
+    struct Node {
+        float plane[4];         // Unit normal and offset
+
+        int front;              // Child nodes, or -1.  Children come after their parent.
+        int back;
+
+        // Polygons in the node's plane.  For a convex node, which has no plane or children,
+        // polygons that never hide each other, drawn facing away from the eye first.
+        int firstPolygon;
+        int numPolygons;
+        int convex;
+    };
+
+    std::vector<Node> nodes;
+
+    // Polygons in compressed sparse row form, with the polygons of each node together.  The
+    // vertices of polygon i are vertexSize values each from polygonStarts[i] * vertexSize up
+    // to polygonStarts[i + 1] * vertexSize.
+    std::vector<float> vertices;
+    std::vector<int> polygonStarts;
+
+    // Four per polygon, as for nodes
+    std::vector<float> planes;
+
+    std::vector<int> tags;
+};
+
+
+#endif
\ No newline at end of file
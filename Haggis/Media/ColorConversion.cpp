@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        ColorConversion.cpp
+//
+// Author:      David Borland
+//
+// Description: CPU color conversion for video frames.  Uses AVX2 when the processor
+//              supports it.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "ColorConversion.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define COLORCONVERSION_X86
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+namespace {
+    // BT.601 video range, 8 bits of fraction:
+    //     R = 1.164 (Y - 16) + 1.596 (V - 128)
+    //     G = 1.164 (Y - 16) - 0.391 (U - 128) - 0.813 (V - 128)
+    //     B = 1.164 (Y - 16) + 2.018 (U - 128)
+    const int yScale = 298;
+    const int vToR = 409;
+    const int uToG = -100;
+    const int vToG = -208;
+    const int uToB = 516;
+
+    inline unsigned char Clamp(int value) {
+        return value < 0 ? 0 : (value > 255 ? 255 : (unsigned char)value);
+    }
+
+    void ConvertRowScalar(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+                          unsigned int start, unsigned int width, unsigned char* rgba) {
+        for (unsigned int x = start; x < width; x++) {
+            int c = (y[x] - 16) * yScale + 128;
+            int d = u[x / 2] - 128;
+            int e = v[x / 2] - 128;
+
+            unsigned char* p = rgba + x * 4;
+            p[0] = Clamp((c + vToR * e) >> 8);
+            p[1] = Clamp((c + uToG * d + vToG * e) >> 8);
+            p[2] = Clamp((c + uToB * d) >> 8);
+            p[3] = 255;
+        }
+    }
+
+#ifdef COLORCONVERSION_X86
+    // Eight pixels per iteration in 32 bit lanes.  Returns the number of pixels converted.
+    TARGET_AVX2
+    unsigned int ConvertRowAVX2(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+                                unsigned int width, unsigned char* rgba) {
+        const __m256i yOffset = _mm256_set1_epi32(16);
+        const __m256i uvOffset = _mm256_set1_epi32(128);
+        const __m256i round = _mm256_set1_epi32(128);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i max = _mm256_set1_epi32(255);
+        const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+        const __m256i yScaleV = _mm256_set1_epi32(yScale);
+        const __m256i vToRV = _mm256_set1_epi32(vToR);
+        const __m256i uToGV = _mm256_set1_epi32(uToG);
+        const __m256i vToGV = _mm256_set1_epi32(vToG);
+        const __m256i uToBV = _mm256_set1_epi32(uToB);
+
+        // Each chroma sample covers two pixels
+        const __m256i duplicate = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+
+        unsigned int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m256i yv = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(y + x)));
+
+            int uBytes = u[x / 2] | (u[x / 2 + 1] << 8) | (u[x / 2 + 2] << 16) | (u[x / 2 + 3] << 24);
+            int vBytes = v[x / 2] | (v[x / 2 + 1] << 8) | (v[x / 2 + 2] << 16) | (v[x / 2 + 3] << 24);
+
+            __m256i uv = _mm256_permutevar8x32_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi32_si128(uBytes)), duplicate);
+            __m256i vv = _mm256_permutevar8x32_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi32_si128(vBytes)), duplicate);
+
+            __m256i c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(yv, yOffset), yScaleV), round);
+            __m256i d = _mm256_sub_epi32(uv, uvOffset);
+            __m256i e = _mm256_sub_epi32(vv, uvOffset);
+
+            __m256i r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, vToRV));
+            __m256i g = _mm256_add_epi32(c, _mm256_add_epi32(_mm256_mullo_epi32(d, uToGV),
+                                                             _mm256_mullo_epi32(e, vToGV)));
+            __m256i b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, uToBV));
+
+            r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 8), zero), max);
+            g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 8), zero), max);
+            b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 8), zero), max);
+
+            // Pack into RGBA bytes, little endian
+            __m256i pixels = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                                             _mm256_or_si256(_mm256_slli_epi32(b, 16), alpha));
+
+            _mm256_storeu_si256((__m256i*)(rgba + x * 4), pixels);
+        }
+
+        return x;
+    }
+
+    bool DetectAVX2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+
+        // The OS must save the AVX registers
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+#endif
+}
+
+
+unsigned int ColorConversion::YUV420Size(unsigned int width, unsigned int height) {
+    unsigned int chromaWidth = (width + 1) / 2;
+    unsigned int chromaHeight = (height + 1) / 2;
+
+    return width * height + 2 * chromaWidth * chromaHeight;
+}
+
+
+void ColorConversion::YUV420ToRGBA(const unsigned char* yuv, unsigned int width, unsigned int height,
+                                   unsigned char* rgba) {
+    unsigned int chromaWidth = (width + 1) / 2;
+    unsigned int chromaHeight = (height + 1) / 2;
+
+    const unsigned char* yPlane = yuv;
+    const unsigned char* uPlane = yPlane + width * height;
+    const unsigned char* vPlane = uPlane + chromaWidth * chromaHeight;
+
+#ifdef COLORCONVERSION_X86
+    static const bool avx2 = HasAVX2();
+#endif
+
+    for (unsigned int row = 0; row < height; row++) {
+        const unsigned char* y = yPlane + row * width;
+        const unsigned char* u = uPlane + (row / 2) * chromaWidth;
+        const unsigned char* v = vPlane + (row / 2) * chromaWidth;
+        unsigned char* dest = rgba + row * width * 4;
+
+        unsigned int start = 0;
+#ifdef COLORCONVERSION_X86
+        if (avx2) start = ConvertRowAVX2(y, u, v, width, dest);
+#endif
+
+        // Remainder of the row, or all of it without AVX2
+        ConvertRowScalar(y, u, v, start, width, dest);
+    }
+}
+
+
+bool ColorConversion::HasAVX2() {
+#ifdef COLORCONVERSION_X86
+    return DetectAVX2();
+#else
+    return false;
+#endif
+}
\ No newline at end of file
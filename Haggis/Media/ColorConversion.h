@@ -0,0 +1,31 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        ColorConversion.h
+//
+// Author:      David Borland
+//
+// Description: CPU color conversion for video frames.  Uses AVX2 when the processor
+//              supports it.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef COLORCONVERSION_H
+#define COLORCONVERSION_H
+
+
+namespace ColorConversion {
+    // Size in bytes of a planar YUV 4:2:0 frame.  The chroma planes are half the width and
+    // height, rounded up, and the planes are packed without padding.
+    unsigned int YUV420Size(unsigned int width, unsigned int height);
+
+    // Convert a packed planar YUV 4:2:0 frame, BT.601 video range, to RGBA.  Row order is
+    // preserved.
+    void YUV420ToRGBA(const unsigned char* yuv, unsigned int width, unsigned int height,
+                      unsigned char* rgba);
+
+    bool HasAVX2();
+}
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        DirectShowVideoStream.h
+//
+// Author:      David Borland
+//
+// Description: Abstract class for playing a video stream using DirectShow
+//
+/////////////////////////////////////////////////////////////////////////////////////////////// 
+
+
+#ifndef DIRECTSHOWVIDEOSTREAM_H
+#define DIRECTSHOWVIDEOSTREAM_H
+
+
+#include "VideoStream.h"
+
+// Hack to deal with the fact that qedit.h is not included in recent versions of the Windows or DirectX SDK
+#pragma include_alias( "dxtrans.h", "qedit.h" )
+#define __IDxtCompositor_INTERFACE_DEFINED__
+#define __IDxtAlphaSetter_INTERFACE_DEFINED__
+#define __IDxtJpeg_INTERFACE_DEFINED__
+#define __IDxtKey_INTERFACE_DEFINED__
+#include "qedit.h"
+
+#include <DShow.h>
+
+
+// Sample grabber callback that counts the samples passing through the graph, so that 
+// Update() can tell whether the buffer holds a new frame without copying it
+class SampleCounterCB : public ISampleGrabberCB {
+public:
+    SampleCounterCB() : count(0) {}
+    virtual ~SampleCounterCB() {}
+
+    unsigned int GetCount() const { return (unsigned int)count; }
+
+    // Counted in SampleCB, which is given the sample without copying its buffer
+    STDMETHODIMP SampleCB(double SampleTime, IMediaSample* pSample) { 
+        InterlockedIncrement(&count);
+        return S_OK;
+    }
+    STDMETHODIMP BufferCB(double SampleTime, BYTE* pBuffer, long BufferLen) { return S_OK; }
+
+    // Owned by the video stream, so no reference counting
+    STDMETHODIMP_(ULONG) AddRef() { return 2; }
+    STDMETHODIMP_(ULONG) Release() { return 1; }
+
+    // Implement COM querying
+    STDMETHODIMP QueryInterface(REFIID riid, void ** ppv) {
+        if (riid == IID_ISampleGrabberCB || riid == IID_IUnknown) {
+            *ppv = (void*)static_cast<ISampleGrabberCB*>(this);
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+private:
+    volatile LONG count;
+};
+
+
+class DirectShowVideoStream : public VideoStream {
+public:
+    DirectShowVideoStream();
+    virtual ~DirectShowVideoStream();
+
+    // Copy the current sample from the sample grabber
+    const unsigned char* GetBuffer();
+
+    virtual void Play();
+    virtual void Stop();
+
+protected:
+    IGraphBuilder* filterGraph;
+    IBaseFilter* sampleGrabber;
+    ISampleGrabber* sampleGrabberInterface;
+    IBaseFilter* nullRenderer;
+    IMediaControl* mediaControl;
+    IMediaSeeking* mediaSeeking;
+
+    unsigned char* buffer;
+
+    SampleCounterCB sampleCounter;
+
+    // Pure virtual function that must be implemented by base classes
+    virtual bool CreateVideoStream() = 0;
+
+    virtual bool OpenStream();
+    virtual Image::PixelFormat GetPixelFormat() const;
+    virtual const unsigned char* AcquireFrame(unsigned int& sequence, double& frameTime);
+    virtual unsigned int GetDecodedFrames() const;
+
+    bool AddSampleGrabber();
+    bool AddNullRenderer();
+    bool InsertFilters();
+    IPin* GetPin(IBaseFilter* filter, PIN_DIRECTION pinDir);
+
+    bool SetDimensions();
+};
+
+
+#endif
\ No newline at end of file
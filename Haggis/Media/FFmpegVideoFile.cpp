@@ -0,0 +1,639 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        FFmpegVideoFile.cpp
+//
+// Author:      David Borland
+//
+// Description: Class for playing video from a file using FFmpeg.  Frames are decoded into a
+//              ring buffer by tasks on the decode pool shared by all streams, and Update()
+//              uploads the frame that is due, so decoding is independent of the render 
+//              timer.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "FFmpegVideoFile.h"
+
+#include "ColorConversion.h"
+
+#include <ThreadPool.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+
+FFmpegVideoFile::FFmpegVideoFile(int numRingFrames)
+: VideoStream(), requestedScale(1), decodeQueued(false), indexQueued(false), indexReady(false), quit(false), loop(false), endOfStream(false), decodedFrames(0), generation(0), seekTime(0.0), loopLength(0.0) {
+    formatContext = NULL;
+    codecContext = NULL;
+    swsContext = NULL;
+    frame = NULL;
+    packet = NULL;
+
+    streamIndex = -1;
+    timeBase = 0.0;
+    startTime = 0.0;
+    duration = 0.0;
+
+    draining = false;
+
+    scale = 1;
+    scaleChangeTime = -1.0e9;
+    decodeScale = 1;
+    decoderReset = false;
+
+    numFrames = numRingFrames;
+
+    decoderThreads = 1;
+
+    decodePaused = false;
+    pauseStart = 0.0;
+
+    playStart = 0.0;
+    playOffset = 0.0;
+
+    decodeGeneration = 0;
+    loopOffset = 0.0;
+    skipUntil = 0.0;
+    lastTime = 0.0;
+    frameDuration = 0.0;
+}
+
+FFmpegVideoFile::~FFmpegVideoFile() {
+    CleanUp();
+}
+
+
+void FFmpegVideoFile::Update() {
+    // Stop once the last frame has been shown
+    if (!stopped && endOfStream && !loop && ring.Empty()) {
+        Stop();
+    }
+
+    UpdateScale();
+
+    VideoStream::Update();
+
+    // Refill the frames just used
+    ScheduleDecode();
+}
+
+
+void FFmpegVideoFile::Play() {
+    if (!stopped) return;
+
+    playStart = GetClockTime();
+    stopped = false;
+}
+
+void FFmpegVideoFile::Stop() {
+    if (stopped) return;
+
+    playOffset = GetPlaybackTime();
+    stopped = true;
+}
+
+
+void FFmpegVideoFile::SetLoop(bool doLoop) {
+    loop = doLoop;
+}
+
+void FFmpegVideoFile::SetDecoderThreads(int numThreads) {
+    decoderThreads = numThreads < 0 ? 0 : numThreads;
+}
+
+
+void FFmpegVideoFile::Rewind() {
+    Seek(0.0);
+}
+
+void FFmpegVideoFile::Jump(float seconds) {
+    // The playback clock keeps running across loops
+    double length = loopLength > 0.0 ? loopLength.load() : duration;
+
+    double position = GetPlaybackTime();
+    if (length > 0.0) position = fmod(position, length);
+
+    position += seconds;
+    if (position < 0.0) position = 0.0;
+    if (length > 0.0 && position > length) position = length;
+
+    Seek(position);
+}
+
+
+double FFmpegVideoFile::GetDuration() const {
+    return duration;
+}
+
+
+bool FFmpegVideoFile::OpenStream() {
+    // Open the file and read the stream information
+    if (avformat_open_input(&formatContext, name.c_str(), NULL, NULL) != 0) {
+        std::cout << "FFmpegVideoFile::OpenStream() : Could not open " << name << std::endl;
+        return false;
+    }
+
+    if (avformat_find_stream_info(formatContext, NULL) < 0) {
+        std::cout << "FFmpegVideoFile::OpenStream() : Could not find stream information." << std::endl;
+        return false;
+    }
+
+
+    // Find the video stream and its decoder
+    streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (streamIndex < 0) {
+        std::cout << "FFmpegVideoFile::OpenStream() : No video stream in " << name << std::endl;
+        return false;
+    }
+
+    AVStream* stream = formatContext->streams[streamIndex];
+
+    if (!OpenCodec(0)) return false;
+
+
+    // Timing
+    timeBase = av_q2d(stream->time_base);
+    startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time * timeBase : 0.0;
+
+    if (stream->duration != AV_NOPTS_VALUE) {
+        duration = stream->duration * timeBase;
+    }
+    else if (formatContext->duration != AV_NOPTS_VALUE) {
+        duration = (double)formatContext->duration / AV_TIME_BASE;
+    }
+
+
+    // Dimensions
+    width = codecContext->width;
+    height = codecContext->height;
+    if (videoType == YUV420) {
+        bufferSize = ColorConversion::YUV420Size(width, height);
+    }
+    else {
+        bufferSize = width * height * (videoType == RGBA ? 4 : 3);
+    }
+
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (!frame || !packet) {
+        std::cout << "FFmpegVideoFile::OpenStream() : Could not allocate frame." << std::endl;
+        return false;
+    }
+
+    // One pixel buffer object per ring frame
+    if (image) image->SetNumStreamBuffers(numFrames);
+
+    return true;
+}
+
+bool FFmpegVideoFile::StartStream() {
+    // Decode straight into the image's mapped pixel buffer objects if there are any
+    std::vector<unsigned char*> buffers;
+    if (image) {
+        for (int i = 0; i < image->GetNumStreamBuffers(); i++) {
+            unsigned char* buffer = image->GetStreamBuffer(i);
+            if (buffer) buffers.push_back(buffer);
+        }
+    }
+
+    if (!buffers.empty() && (int)buffers.size() == image->GetNumStreamBuffers()) {
+        ring.Allocate((int)buffers.size(), bufferSize, &buffers[0]);
+    }
+    else {
+        ring.Allocate(numFrames, bufferSize);
+    }
+
+    // Index the keyframes for seeking in the background
+    indexQueued = true;
+    GetIndexPool().Enqueue(std::bind(&FFmpegVideoFile::BuildIndex, this));
+
+    // Start decoding so the first frames are ready when Play() is called
+    ScheduleDecode();
+
+    return true;
+}
+
+
+Image::PixelFormat FFmpegVideoFile::GetPixelFormat() const {
+    if (videoType == YUV420) return Image::YUV420;
+
+    return videoType == RGBA ? Image::RGBA : Image::RGB;
+}
+
+
+const unsigned char* FFmpegVideoFile::AcquireFrame(unsigned int& sequence, double& frameTime) {
+    // Frames are released once uploaded, so any frame returned by the ring is new
+    const unsigned char* data = ring.Acquire(GetPlaybackTime(), generation.load(std::memory_order_acquire), maxLag, 
+                                             &sequence, &frameTime);
+
+    // Only frames decoded since the last scale change are of the current generation
+    if (data && image) image->SetContentSize(ScaledSize(width, scale), ScaledSize(height, scale));
+
+    return data;
+}
+
+void FFmpegVideoFile::ReleaseFrame() {
+    ring.Release();
+}
+
+unsigned int FFmpegVideoFile::GetDecodedFrames() const {
+    return decodedFrames.load(std::memory_order_relaxed);
+}
+
+
+bool FFmpegVideoFile::OpenCodec(int lowres) {
+    AVStream* stream = formatContext->streams[streamIndex];
+
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        std::cout << "FFmpegVideoFile::OpenCodec() : Unsupported codec." << std::endl;
+        return false;
+    }
+
+    if (codecContext) avcodec_free_context(&codecContext);
+
+    codecContext = avcodec_alloc_context3(codec);
+    if (!codecContext || avcodec_parameters_to_context(codecContext, stream->codecpar) < 0) {
+        std::cout << "FFmpegVideoFile::OpenCodec() : Could not create codec context." << std::endl;
+        return false;
+    }
+
+    codecContext->thread_count = decoderThreads;
+    codecContext->lowres = lowres;
+
+    if (avcodec_open2(codecContext, codec, NULL) < 0) {
+        std::cout << "FFmpegVideoFile::OpenCodec() : Could not open codec." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+double FFmpegVideoFile::GetPlaybackTime() const {
+    if (stopped) return playOffset;
+
+    return playOffset + (GetClockTime() - playStart);
+}
+
+void FFmpegVideoFile::Seek(double seconds) {
+    // Restart the clock at the new position
+    playOffset = seconds;
+    playStart = GetClockTime();
+
+    // Hand the seek to the decode thread
+    seekTime.store(seconds);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+
+void FFmpegVideoFile::UpdateScale() {
+    const int maxScale = 8;
+
+    int target = targetHeight > 0 ? targetHeight : (int)height;
+
+    int newScale = scale;
+    if (ScaledSize(height, scale) < target) {
+        // Not enough resolution, so switch up right away
+        newScale = 1;
+        while (newScale < maxScale && ScaledSize(height, newScale * 2) >= target) newScale *= 2;
+    }
+    else {
+        // Switching costs a seek, so only switch down with some margin and not too often
+        int candidate = scale;
+        while (candidate < maxScale && ScaledSize(height, candidate * 2) >= target * 1.25) candidate *= 2;
+
+        if (candidate > scale && GetClockTime() - scaleChangeTime > 1.0) newScale = candidate;
+    }
+
+    if (newScale == scale) return;
+
+    scale = newScale;
+    scaleChangeTime = GetClockTime();
+
+    // Restart decoding at the current position with the new scale.  Frames already decoded
+    // at the old scale are dropped with the old generation.
+    requestedScale.store(scale);
+    Jump(0.0f);
+}
+
+int FFmpegVideoFile::ScaledSize(int size, int divisor) const {
+    return std::max(1, (size + divisor / 2) / divisor);
+}
+
+
+void FFmpegVideoFile::ScheduleDecode() {
+    if (quit || decodeQueued.load(std::memory_order_acquire)) return;
+
+    // Pause while offscreen
+    if (priority <= 0.0f) {
+        if (!decodePaused) {
+            decodePaused = true;
+            pauseStart = GetClockTime();
+        }
+        return;
+    }
+
+    if (decodePaused) {
+        decodePaused = false;
+
+        // The ring only holds a few frames, so after a longer pause catch up with the clock
+        if (!stopped && GetClockTime() - pauseStart > 0.5) Jump(0.0f);
+    }
+
+    // No decode task is running, so the decode state can be read here
+    bool seekPending = generation.load(std::memory_order_acquire) != decodeGeneration;
+
+    if (ring.Full()) return;
+    if (endOfStream && !seekPending) return;
+
+    decodeQueued.store(true, std::memory_order_release);
+    GetDecodePool().Enqueue(std::bind(&FFmpegVideoFile::DecodeFrames, this));
+}
+
+
+void FFmpegVideoFile::DecodeFrames() {
+    while (!quit) {
+        // Check for a seek
+        int requested = generation.load(std::memory_order_acquire);
+        if (requested != decodeGeneration) {
+            ApplyScale(requestedScale.load());
+
+            skipUntil = seekTime.load();
+            SeekStream(skipUntil);
+
+            decodeGeneration = requested;
+            loopOffset = 0.0;
+            endOfStream = false;
+        }
+
+        // Nothing to do at the end of the stream unless there is a seek
+        if (endOfStream) break;
+
+        // Done when the ring is full.  Update() queues another task once frames are used.
+        unsigned char* dest = ring.BeginWrite();
+        if (!dest) break;
+
+        double time;
+        int result = DecodeFrame(time);
+        if (result > 0) {
+            if (time > lastTime) frameDuration = time - lastTime;
+            lastTime = time;
+
+            // Decode forward to the seek position without converting
+            if (time < skipUntil - frameDuration * 0.5) continue;
+            skipUntil = 0.0;
+
+            ConvertFrame(dest);
+            ring.EndWrite(time + loopOffset, decodeGeneration);
+
+            decodedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (result == 0 && loop) {
+            // Loop on the frame timestamps rather than the container duration, which can be
+            // rounded or include other streams, so the first frame follows the last exactly
+            // one frame later
+            if (loopLength == 0.0) loopLength = lastTime + frameDuration;
+
+            SeekStream(0.0);
+            loopOffset += loopLength;
+        }
+        else {
+            if (result < 0) {
+                std::cout << "FFmpegVideoFile::DecodeFrames() : Error decoding " << name << std::endl;
+            }
+            endOfStream = true;
+        }
+    }
+
+    // Must be last, as the stream can be deleted once this is cleared
+    decodeQueued.store(false, std::memory_order_release);
+}
+
+void FFmpegVideoFile::BuildIndex() {
+    if (!quit && keyframeIndex.Build(name, streamIndex, &quit)) {
+        indexReady.store(true, std::memory_order_release);
+    }
+
+    // Must be last, as the stream can be deleted once this is cleared
+    indexQueued.store(false, std::memory_order_release);
+}
+
+ThreadPool& FFmpegVideoFile::GetIndexPool() {
+    static ThreadPool pool(1);
+    return pool;
+}
+
+
+int FFmpegVideoFile::DecodeFrame(double& time) {
+    while (true) {
+        int result = avcodec_receive_frame(codecContext, frame);
+        if (result == 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            if (pts == AV_NOPTS_VALUE) pts = frame->pts;
+            time = pts != AV_NOPTS_VALUE ? pts * timeBase - startTime : 0.0;
+            return 1;
+        }
+        else if (result == AVERROR_EOF) {
+            return 0;
+        }
+        else if (result != AVERROR(EAGAIN)) {
+            return -1;
+        }
+
+        // The decoder needs more input
+        if (draining) continue;
+
+        if (av_read_frame(formatContext, packet) < 0) {
+            // End of file, so flush the frames buffered in the decoder
+            avcodec_send_packet(codecContext, NULL);
+            draining = true;
+            continue;
+        }
+
+        if (packet->stream_index == streamIndex) {
+            avcodec_send_packet(codecContext, packet);
+        }
+        av_packet_unref(packet);
+    }
+}
+
+
+void FFmpegVideoFile::ApplyScale(int newScale) {
+    if (newScale == decodeScale) return;
+
+    decodeScale = newScale;
+
+    // Use the decoder's reduced resolution output if it has one, e.g. for JPEG based codecs
+    int lowres = 0;
+    while ((1 << (lowres + 1)) <= decodeScale && lowres < codecContext->codec->max_lowres) lowres++;
+
+    if (lowres != codecContext->lowres) {
+        if (!OpenCodec(lowres)) {
+            std::cout << "FFmpegVideoFile::ApplyScale() : Error.  Could not reopen codec." << std::endl;
+            endOfStream = true;
+        }
+
+        // The new decoder has no reference frames, so the next seek can't decode on
+        decoderReset = true;
+    }
+}
+
+
+void FFmpegVideoFile::ConvertFrame(unsigned char* dest) {
+    // Size of the frames at the current scale
+    ConvertFrame(swsContext, frame, videoType, ScaledSize(width, decodeScale), ScaledSize(height, decodeScale), dest);
+}
+
+bool FFmpegVideoFile::ConvertFrame(SwsContext*& context, const AVFrame* source, VideoType type,
+                                   int destWidth, int destHeight, unsigned char* dest) {
+    AVPixelFormat destFormat = AV_PIX_FMT_RGB24;
+    if (type == RGBA) destFormat = AV_PIX_FMT_RGBA;
+    else if (type == YUV420) destFormat = AV_PIX_FMT_YUV420P;
+
+    // Area averaging gives a fast, alias free downscale
+    int flags = destWidth < source->width ? SWS_AREA : SWS_BILINEAR;
+
+    context = sws_getCachedContext(context,
+                                   source->width, source->height, (AVPixelFormat)source->format,
+                                   destWidth, destHeight, destFormat,
+                                   flags, NULL, NULL, NULL);
+    if (!context) return false;
+
+    // Textures are bottom row first, so write the rows upside down
+    uint8_t* destData[4] = { NULL, NULL, NULL, NULL };
+    int destStride[4] = { 0, 0, 0, 0 };
+
+    if (type == YUV420) {
+        // Packed Y, U and V planes
+        int chromaWidth = (destWidth + 1) / 2;
+        int chromaHeight = (destHeight + 1) / 2;
+
+        uint8_t* u = dest + destWidth * destHeight;
+        uint8_t* v = u + chromaWidth * chromaHeight;
+
+        destData[0] = dest + (destHeight - 1) * destWidth;
+        destData[1] = u + (chromaHeight - 1) * chromaWidth;
+        destData[2] = v + (chromaHeight - 1) * chromaWidth;
+
+        destStride[0] = -destWidth;
+        destStride[1] = -chromaWidth;
+        destStride[2] = -chromaWidth;
+    }
+    else {
+        int stride = destWidth * (type == RGBA ? 4 : 3);
+
+        destData[0] = dest + (destHeight - 1) * stride;
+        destStride[0] = -stride;
+    }
+
+    sws_scale(context, source->data, source->linesize, 0, source->height, destData, destStride);
+
+    return true;
+}
+
+AVFrame* FFmpegVideoFile::ReadImage(const std::string& fileName) {
+    // Each call has its own demuxer and decoder, so images can be read in parallel
+    AVFormatContext* formatContext = NULL;
+    if (avformat_open_input(&formatContext, fileName.c_str(), NULL, NULL) != 0) {
+        std::cout << "FFmpegVideoFile::ReadImage() : Could not open " << fileName << std::endl;
+        return NULL;
+    }
+
+    AVFrame* frame = NULL;
+    AVCodecContext* codecContext = NULL;
+    AVPacket* packet = NULL;
+
+    const AVCodec* codec = formatContext->nb_streams > 0 ?
+                           avcodec_find_decoder(formatContext->streams[0]->codecpar->codec_id) : NULL;
+    if (codec) codecContext = avcodec_alloc_context3(codec);
+
+    if (codecContext &&
+        avcodec_parameters_to_context(codecContext, formatContext->streams[0]->codecpar) >= 0 &&
+        avcodec_open2(codecContext, codec, NULL) >= 0) {
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+
+        // One packet per image, but flush the decoder in case it holds the frame back
+        bool decoded = false;
+        while (!decoded && av_read_frame(formatContext, packet) >= 0) {
+            if (packet->stream_index == 0) avcodec_send_packet(codecContext, packet);
+            av_packet_unref(packet);
+
+            decoded = avcodec_receive_frame(codecContext, frame) == 0;
+        }
+
+        if (!decoded) {
+            avcodec_send_packet(codecContext, NULL);
+            decoded = avcodec_receive_frame(codecContext, frame) == 0;
+        }
+
+        if (!decoded) av_frame_free(&frame);
+    }
+
+    if (!frame) {
+        std::cout << "FFmpegVideoFile::ReadImage() : Could not decode " << fileName << std::endl;
+    }
+
+    if (packet) av_packet_free(&packet);
+    if (codecContext) avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+
+    return frame;
+}
+
+
+void FFmpegVideoFile::SeekStream(double seconds) {
+    int64_t timestamp = (int64_t)((seconds + startTime) / timeBase);
+
+    // Go to the keyframe before the requested time.  DecodeFrames() decodes forward from 
+    // there, while the last frame uploaded stays on screen.
+    if (indexReady.load(std::memory_order_acquire)) {
+        int keyframe = keyframeIndex.Find(seconds);
+        if (keyframe >= 0) {
+            // No keyframe between the decoder and the target, e.g. when scrubbing forward in
+            // small steps, so decoding on is quicker than seeking
+            if (!draining && !decoderReset && 
+                lastTime >= keyframeIndex.GetTime(keyframe) && lastTime < seconds) return;
+
+            // Seeking to the exact timestamp of a keyframe lands on it without searching
+            timestamp = keyframeIndex.GetTimestamp(keyframe);
+        }
+    }
+
+    if (av_seek_frame(formatContext, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        std::cout << "FFmpegVideoFile::SeekStream() : Could not seek " << name << std::endl;
+    }
+
+    avcodec_flush_buffers(codecContext);
+    draining = false;
+    decoderReset = false;
+}
+
+
+void FFmpegVideoFile::CleanUp() {
+    // Wait for queued or running tasks to finish
+    quit = true;
+    while (decodeQueued.load(std::memory_order_acquire) || indexQueued.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (swsContext) sws_freeContext(swsContext);
+    if (packet) av_packet_free(&packet);
+    if (frame) av_frame_free(&frame);
+    if (codecContext) avcodec_free_context(&codecContext);
+    if (formatContext) avformat_close_input(&formatContext);
+
+    swsContext = NULL;
+}
\ No newline at end of file
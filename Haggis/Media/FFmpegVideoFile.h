@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        FFmpegVideoFile.h
+//
+// Author:      David Borland
+//
+// Description: Class for playing video from a file using FFmpeg.  Frames are decoded into a
+//              ring buffer by tasks on the decode pool shared by all streams, and Update()
+//              uploads the frame that is due, so decoding is independent of the render 
+//              timer.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef FFMPEGVIDEOFILE_H
+#define FFMPEGVIDEOFILE_H
+
+
+#include "VideoStream.h"
+#include "VideoFrameRing.h"
+#include "KeyframeIndex.h"
+
+#include <atomic>
+
+
+// Forward declarations
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+
+class FFmpegVideoFile : public VideoStream {
+public:
+    FFmpegVideoFile(int numRingFrames = 4);
+    virtual ~FFmpegVideoFile();
+
+    virtual void Update();
+
+    virtual void Play();
+    virtual void Stop();
+
+    void SetLoop(bool doLoop);
+
+    // Threads used by FFmpeg within each decoder, set before Initialize().  Defaults to 1, as
+    // streams already decode in parallel on the shared decode pool.  0 lets FFmpeg choose.
+    void SetDecoderThreads(int numThreads);
+
+    void Rewind();
+    void Jump(float seconds);
+
+    // Length of the video in seconds
+    double GetDuration() const;
+
+    // Convert a decoded frame to the layout of the given video type at the given size, 
+    // bottom row first.  The context is created or updated as needed.
+    static bool ConvertFrame(SwsContext*& context, const AVFrame* source, VideoType type,
+                             int destWidth, int destHeight, unsigned char* dest);
+
+    // Decode a single image file, or NULL on failure.  Free with av_frame_free().  Each call
+    // has its own demuxer and decoder, so images can be read in parallel.
+    static AVFrame* ReadImage(const std::string& fileName);
+
+protected:
+    AVFormatContext* formatContext;
+    AVCodecContext* codecContext;
+    SwsContext* swsContext;
+    AVFrame* frame;
+    AVPacket* packet;
+
+    int streamIndex;
+    double timeBase;
+    double startTime;
+    double duration;
+
+    // Set once the decoder has sent its last buffered frame
+    bool draining;
+
+    // Frames are decoded at the full size divided by a power of two, matched to the target
+    // height.  The decoder's reduced resolution output is used if it has one, otherwise
+    // frames are downscaled when converted.  A new scale takes effect at the next seek.
+    int scale;                          // Render thread
+    double scaleChangeTime;
+    std::atomic<int> requestedScale;
+    int decodeScale;                    // Decode task
+    bool decoderReset;
+
+    VideoFrameRing ring;
+    int numFrames;
+
+    int decoderThreads;
+
+    // Set while a decode task is queued or running.  Only one runs at a time per stream.
+    std::atomic<bool> decodeQueued;
+
+    // Built on the index pool after opening.  Seeks use the container's own seeking until 
+    // it is ready.
+    KeyframeIndex keyframeIndex;
+    std::atomic<bool> indexQueued;
+    std::atomic<bool> indexReady;
+
+    // Decoding pauses while the stream is offscreen
+    bool decodePaused;
+    double pauseStart;
+
+    std::atomic<bool> quit;
+    std::atomic<bool> loop;
+    std::atomic<bool> endOfStream;
+    std::atomic<unsigned int> decodedFrames;
+
+    // Seeks are requested by bumping the generation.  Frames decoded before the seek have
+    // an old generation and are dropped by the ring.
+    std::atomic<int> generation;
+    std::atomic<double> seekTime;
+
+    // Time from the first frame to the end of the last one, measured when the decoder first
+    // reaches the end.  Loops restart after exactly this long.
+    std::atomic<double> loopLength;
+
+    // Playback clock, in seconds.  The start is a time on the clock given by GetClockTime().
+    double playStart;
+    double playOffset;
+
+    // Decode state, only used by the decode task
+    int decodeGeneration;
+    double loopOffset;          // Added to frame times so the clock keeps running when looping
+    double skipUntil;           // Frames before this are decoded but not shown, after a seek
+    double lastTime;            // Time of the last frame decoded and the spacing between
+    double frameDuration;       //      frames, to find the end of streams without a duration
+
+    virtual bool OpenStream();
+    virtual bool StartStream();
+    virtual Image::PixelFormat GetPixelFormat() const;
+    virtual const unsigned char* AcquireFrame(unsigned int& sequence, double& frameTime);
+    virtual void ReleaseFrame();
+    virtual unsigned int GetDecodedFrames() const;
+
+    virtual double GetPlaybackTime() const;
+    void Seek(double seconds);
+
+    // Pick the scale for the target height
+    void UpdateScale();
+    int ScaledSize(int size, int divisor) const;
+
+    // Open the decoder, at a reduced resolution of 1 / 2^lowres if lowres is not zero
+    bool OpenCodec(int lowres);
+
+    // Queue a decode task if there is space in the ring
+    void ScheduleDecode();
+
+    // Run on the decode pool.  Decodes until the ring is full or the stream ends.
+    void DecodeFrames();
+
+    // Run on the index pool, a single thread shared by all streams, so scanning whole files
+    // never holds up decoding the first frames of other streams
+    void BuildIndex();
+    static ThreadPool& GetIndexPool();
+    int DecodeFrame(double& time);
+    void ApplyScale(int newScale);
+    void ConvertFrame(unsigned char* dest);
+    void SeekStream(double seconds);
+
+    void CleanUp();
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        FrameBufferArena.cpp
+//
+// Author:      David Borland
+//
+// Description: Pool of frame buffers shared by the video streams.  Released buffers are kept
+//              by size, i.e. by resolution and pixel format, and handed out again instead of
+//              being freed.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "FrameBufferArena.h"
+
+
+FrameBufferArena::FrameBufferArena(size_t maxIdleBytes) {
+    idleBytes = 0;
+    maxIdle = maxIdleBytes;
+}
+
+FrameBufferArena::~FrameBufferArena() {
+    Trim();
+}
+
+
+unsigned char* FrameBufferArena::Acquire(size_t size) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        std::map<size_t, std::vector<unsigned char*> >::iterator it = idleBuffers.find(size);
+        if (it != idleBuffers.end() && !it->second.empty()) {
+            unsigned char* buffer = it->second.back();
+            it->second.pop_back();
+            idleBytes -= size;
+
+            return buffer;
+        }
+    }
+
+    return new unsigned char[size];
+}
+
+void FrameBufferArena::Release(unsigned char* buffer, size_t size) {
+    if (!buffer) return;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (idleBytes + size <= maxIdle) {
+            idleBuffers[size].push_back(buffer);
+            idleBytes += size;
+
+            return;
+        }
+    }
+
+    delete [] buffer;
+}
+
+
+void FrameBufferArena::Trim() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    std::map<size_t, std::vector<unsigned char*> >::iterator it;
+    for (it = idleBuffers.begin(); it != idleBuffers.end(); it++) {
+        for (int i = 0; i < (int)it->second.size(); i++) {
+            delete [] it->second[i];
+        }
+    }
+
+    idleBuffers.clear();
+    idleBytes = 0;
+}
+
+
+size_t FrameBufferArena::GetIdleBytes() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return idleBytes;
+}
+
+
+FrameBufferArena& FrameBufferArena::GetShared() {
+    static FrameBufferArena arena;
+    return arena;
+}
\ No newline at end of file
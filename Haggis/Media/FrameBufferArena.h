@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        FrameBufferArena.h
+//
+// Author:      David Borland
+//
+// Description: Pool of frame buffers shared by the video streams.  Released buffers are kept
+//              by size, i.e. by resolution and pixel format, and handed out again instead of
+//              being freed.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef FRAMEBUFFERARENA_H
+#define FRAMEBUFFERARENA_H
+
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+
+class FrameBufferArena {
+public:
+    // Idle buffers beyond the limit are freed when released
+    FrameBufferArena(size_t maxIdleBytes = 256 * 1024 * 1024);
+    ~FrameBufferArena();
+
+    unsigned char* Acquire(size_t size);
+    void Release(unsigned char* buffer, size_t size);
+
+    // Free all idle buffers
+    void Trim();
+
+    size_t GetIdleBytes() const;
+
+    // Arena shared by all video streams
+    static FrameBufferArena& GetShared();
+
+private:
+    std::map<size_t, std::vector<unsigned char*> > idleBuffers;
+    size_t idleBytes;
+    size_t maxIdle;
+
+    mutable std::mutex mutex;
+
+    // Not copyable
+    FrameBufferArena(const FrameBufferArena&);
+    FrameBufferArena& operator=(const FrameBufferArena&);
+};
+
+
+#endif
\ No newline at end of file
@@ -11,25 +11,47 @@
 
 #include "Image.h"
 
+#include "ColorConversion.h"
+
+#include <algorithm>
+#include <string.h>
+#include <string>
+
+
+GLuint Image::yuvPrograms[2] = { 0, 0 };
+
 
 Image::Image(Behavior imageBehavior) : RenderObject(), behavior(imageBehavior) {
     texture = -1;
-    pbo = -1;
+
+    keepTexture = false;
+    keptTexture = 0;
+
+    chromaTextures[0] = chromaTextures[1] = 0;
+    yuvShader = false;
+
+    numStreamBuffers = 3;
+    currentStreamBuffer = 0;
+    persistentBuffers = false;
 
     resolution[0] = resolution[1] = 0;
     aspectRatio = 1.0;
 
+    contentSize[0] = contentSize[1] = 0;
+
     SetPixelFormats(RGBA);
     textureType = TEXTURE_2D_MIPMAP;
     textureTarget = GL_TEXTURE_2D;
 
     bufferSize = 0;
+    dataSize = 0;
 
     textureCreated = false;
 }
  
 Image::~Image() {
     if (textureCreated) CleanUp();
+    DeleteKeptTexture();
 }
 
 
@@ -37,12 +59,16 @@ void Image::SetTexture(GLuint textureMap, unsigned int width, unsigned int heigh
     if (textureCreated) {
         CleanUp();
     }
+    DeleteKeptTexture();
 
     resolution[0] = width;
     resolution[1] = height;
     aspectRatio = (float)resolution[0] / (float)resolution[1];
     SetPixelFormats(type);
 
+    contentSize[0] = width;
+    contentSize[1] = height;
+
     texture = textureMap;
 
     textureCreated = false;
@@ -51,11 +77,20 @@ void Image::SetTexture(GLuint textureMap, unsigned int width, unsigned int heigh
 
 bool Image::SetTextureInfo(unsigned int width, unsigned int height, 
                            PixelFormat format, TextureType type) {
+    // Mipmaps are not built for video
+    if (format == YUV420 && type == TEXTURE_2D_MIPMAP) type = TEXTURE_2D;
+
     // Check texture info
     if (!textureCreated || 
         resolution[0] != width || resolution[1] != height ||
         pixelFormat != format || textureType != type) {
-        // Delete old texture
+        // Delete old texture, unless it is kept until there is data for the new one
+        if (textureCreated && keepTexture && !keptTexture && textureTarget == GL_TEXTURE_2D && !yuvShader) {
+            keptTexture = texture;
+            texture = 0;
+        }
+        keepTexture = false;
+
         if (textureCreated) CleanUp();
 
         // Set new texture information
@@ -98,7 +133,13 @@ bool Image::SetTextureData(const unsigned char* data) {
 
     // Set the texture data
     if (textureType == TEXTURE_2D || textureType == TEXTURE_RECTANGLE) {
-        glTexSubImage2D(textureTarget, 0, 0, 0, resolution[0], resolution[1], glPixelFormat, GL_UNSIGNED_BYTE, data);
+        const unsigned char* pixels = data;
+        if (ConvertYUVOnCPU()) {
+            CopyPixels(&convertBuffer[0], data);
+            pixels = &convertBuffer[0];
+        }
+
+        UploadPixels(pixels);
     }
     else if (textureType == TEXTURE_2D_MIPMAP) {
         if (gluBuild2DMipmaps(textureTarget, glInternalPixelFormat, resolution[0], resolution[1], glPixelFormat, GL_UNSIGNED_BYTE, data) != 0) {
@@ -106,21 +147,43 @@ bool Image::SetTextureData(const unsigned char* data) {
             return false;
         }
     }
-    else if (textureType == TEXTURE_2D_PBO || textureType == TEXTURE_RECTANGLE_PBO) {
+    else if (IsPBO()) {
+        // Use the next buffer, so the GPU can still be reading the previous ones
+        currentStreamBuffer = (currentStreamBuffer + 1) % numStreamBuffers;
+
+        if (persistentBuffers) {
+            // Already mapped, so just wait for the GPU to finish with it and copy
+            WaitForStreamBuffer(currentStreamBuffer);
+            CopyPixels(mappedBuffers[currentStreamBuffer], data);
+
+            if (!UploadStreamBuffer(currentStreamBuffer)) return false;
+
+            DeleteKeptTexture();
+
+            return true;
+        }
+
         // Bind the pbo
-        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbos[currentStreamBuffer]);
 
-        // Copy the data to the pbo
-        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, GL_STATIC_DRAW_ARB);
+        // Orphan the old storage so mapping does not wait for the GPU, then copy the data
+        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, GL_STREAM_DRAW_ARB);
         unsigned char* pixels = (unsigned char*)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-        memcpy(pixels, data, bufferSize);
-        glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+        if (pixels) {
+            CopyPixels(pixels, data);
+            glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
 
-        // Copy from the pbo to the texture
-        glTexSubImage2D(textureTarget, 0, 0, 0, resolution[0], resolution[1], glPixelFormat, GL_UNSIGNED_BYTE, NULL);
+            // Copy from the pbo to the texture
+            UploadPixels(NULL);
+        }
 
         // Unbind the pbo
         glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0); 
+
+        if (!pixels) {
+            std::cout << "Image::SetTextureData() : Error.  Could not map pixel buffer object." << std::endl;
+            return false;
+        }
     }
     else {
         // Should never be here, but just in case...
@@ -128,6 +191,91 @@ bool Image::SetTextureData(const unsigned char* data) {
         return false;
     }
 
+    DeleteKeptTexture();
+
+    return true;
+}
+
+
+void Image::KeepTextureUntilData() {
+    keepTexture = true;
+}
+
+bool Image::KeepingTexture() const {
+    return keptTexture != 0;
+}
+
+
+void Image::SetContentSize(unsigned int width, unsigned int height) {
+    contentSize[0] = std::max(1u, std::min(width, resolution[0]));
+    contentSize[1] = std::max(1u, std::min(height, resolution[1]));
+}
+
+
+void Image::SetNumStreamBuffers(int num) {
+    numStreamBuffers = num < 1 ? 1 : num;
+}
+
+
+int Image::GetNumStreamBuffers() const {
+    return (int)pbos.size();
+}
+
+unsigned char* Image::GetStreamBuffer(int index) {
+    // The buffers hold RGBA when converting on the CPU, so frames cannot be written directly
+    if (!persistentBuffers || ConvertYUVOnCPU() || index < 0 || index >= (int)mappedBuffers.size()) return NULL;
+
+    return mappedBuffers[index];
+}
+
+int Image::GetStreamBufferIndex(const unsigned char* data) const {
+    if (!persistentBuffers || ConvertYUVOnCPU()) return -1;
+
+    for (int i = 0; i < (int)mappedBuffers.size(); i++) {
+        if (mappedBuffers[i] == data) return i;
+    }
+
+    return -1;
+}
+
+bool Image::StreamBufferReady(int index) {
+    if (index < 0 || index >= (int)fences.size() || !fences[index]) return true;
+
+    // Poll without waiting
+    GLenum result = glClientWaitSync(fences[index], 0, 0);
+    if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+        glDeleteSync(fences[index]);
+        fences[index] = NULL;
+        return true;
+    }
+
+    return false;
+}
+
+bool Image::UploadStreamBuffer(int index) {
+    if (!textureCreated || !IsPBO() || index < 0 || index >= (int)pbos.size()) {
+        std::cout << "Image::UploadStreamBuffer() : Error.  Invalid stream buffer." << std::endl;
+        return false;
+    }
+
+    glBindTexture(textureTarget, texture);
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbos[index]);
+
+    // Copy from the pbo to the texture
+    UploadPixels(NULL);
+
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0); 
+
+    // Mark when the GPU is done reading the buffer
+    if (persistentBuffers) {
+        if (fences[index]) glDeleteSync(fences[index]);
+        fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    currentStreamBuffer = index;
+
+    DeleteKeptTexture();
+
     return true;
 }
 
@@ -216,12 +364,32 @@ float Image::GetAspectRatio() {
 }
 
 
+float Image::GetVisibleFraction() {
+    float viewArea = (xMax - xMin) * (yMax - yMin);
+    if (viewArea <= 0.0f) return 0.0f;
+
+    // The quad is centered on the position
+    float w = GetWidth() * 0.5f;
+    float h = GetHeight() * 0.5f;
+
+    float left = std::max((float)position.X() - w, xMin);
+    float right = std::min((float)position.X() + w, xMax);
+    float bottom = std::max((float)position.Y() - h, yMin);
+    float top = std::min((float)position.Y() + h, yMax);
+
+    if (right <= left || top <= bottom) return 0.0f;
+
+    return (right - left) * (top - bottom) / viewArea;
+}
+
+
 void Image::PreRender() {
     // Enable texturing
-    glEnable(textureTarget);
+    GLenum target = keptTexture ? GL_TEXTURE_2D : textureTarget;
+    glEnable(target);
 
     // Bind the texture
-    glBindTexture(textureTarget, texture);
+    glBindTexture(target, keptTexture ? keptTexture : texture);
 }
 
 void Image::DoRender() {
@@ -275,29 +443,49 @@ void Image::DoRender() {
 
 void Image::PostRender() {
     // Disable texturing
-    glDisable(textureTarget);
+    glDisable(keptTexture ? GL_TEXTURE_2D : textureTarget);
 }
 
 
 bool Image::CreateTexture() {
     textureCreated = false;
 
+    contentSize[0] = resolution[0];
+    contentSize[1] = resolution[1];
+
+    // YUV420 is converted in a fragment shader if possible, otherwise on the CPU to RGBA
+    yuvShader = false;
+    if (pixelFormat == YUV420) {
+        yuvShader = GetYUVProgram(textureTarget) != 0;
+
+        glInternalPixelFormat = yuvShader ? GL_LUMINANCE : GL_RGBA;
+        glPixelFormat = yuvShader ? GL_LUMINANCE : GL_RGBA;
+    }
+
+
     // Set the buffer size
-    int numComponents;
+    int numComponents = 4;
     if (pixelFormat == LUMINANCE) numComponents = 1;
     else if (pixelFormat == RGB || pixelFormat == BGR) numComponents = 3;
-    else if (pixelFormat == RGBA || pixelFormat == BGRA) numComponents = 4;
 
     bufferSize = resolution[0] * resolution[1] * numComponents;
+    dataSize = bufferSize;
 
+    if (pixelFormat == YUV420) {
+        dataSize = ColorConversion::YUV420Size(resolution[0], resolution[1]);
+        if (yuvShader) bufferSize = dataSize;
+    }
 
-    // Create the pixel buffer object for fast texture download to the graphics card.
-    if (textureType == TEXTURE_2D_PBO || textureType == TEXTURE_RECTANGLE_PBO) {
-        glGenBuffersARB(1, &pbo);
-        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
-        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, GL_STATIC_DRAW_ARB);
+    convertBuffer.clear();
+    if (ConvertYUVOnCPU() && !IsPBO()) convertBuffer.resize(bufferSize);
 
-        // XXX : Check for success here?
+
+    // Create the pixel buffer objects for fast texture download to the graphics card.
+    if (IsPBO()) {
+        if (!CreateStreamBuffers()) {
+            std::cout << "Image::CreateTexture() : Error.  Pixel buffer object creation failed." << std::endl; 
+            return false;
+        }
     }
 
 
@@ -329,9 +517,21 @@ bool Image::CreateTexture() {
     }
 
 
-    // Unbind the pixel buffer object
-    if (textureType == TEXTURE_2D_PBO || textureType == TEXTURE_RECTANGLE_PBO) {
-        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    // Half resolution U and V planes
+    if (yuvShader) {
+        glGenTextures(2, chromaTextures);
+
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(textureTarget, chromaTextures[i]);
+            glTexParameteri(textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(textureTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(textureTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(textureTarget, 0, GL_LUMINANCE, (resolution[0] + 1) / 2, (resolution[1] + 1) / 2, 0, 
+                         GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+        }
+
+        glBindTexture(textureTarget, texture);
     }
 
 
@@ -341,6 +541,42 @@ bool Image::CreateTexture() {
 }
 
 
+bool Image::CreateStreamBuffers() {
+    pbos.assign(numStreamBuffers, 0);
+    mappedBuffers.assign(numStreamBuffers, (unsigned char*)NULL);
+    fences.assign(numStreamBuffers, (GLsync)NULL);
+    currentStreamBuffer = 0;
+
+    // Keep the buffers mapped if possible
+    persistentBuffers = GLEW_ARB_buffer_storage && GLEW_ARB_sync;
+
+    glGenBuffersARB(numStreamBuffers, &pbos[0]);
+
+    for (int i = 0; i < numStreamBuffers; i++) {
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbos[i]);
+
+        if (persistentBuffers) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, flags);
+            mappedBuffers[i] = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, bufferSize, flags);
+
+            if (!mappedBuffers[i]) {
+                std::cout << "Image::CreateStreamBuffers() : Error.  Could not map pixel buffer object." << std::endl;
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                return false;
+            }
+        }
+        else {
+            glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, GL_STREAM_DRAW_ARB);
+        }
+    }
+
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+    return true;
+}
+
+
 bool Image::CheckTextureCreation() {
     glTexImage2D(GL_PROXY_TEXTURE_2D, 0, glInternalPixelFormat, resolution[0], resolution[1], 0, glPixelFormat, GL_UNSIGNED_BYTE, NULL);
 
@@ -359,34 +595,83 @@ bool Image::CheckTextureCreation() {
 void Image::CleanUp() {
     glDeleteTextures(1, &texture);
 
-    if (textureType == TEXTURE_2D_PBO || textureType == TEXTURE_RECTANGLE_PBO) {
-        glDeleteBuffersARB(1, &pbo);
+    if (chromaTextures[0]) {
+        glDeleteTextures(2, chromaTextures);
+        chromaTextures[0] = chromaTextures[1] = 0;
+    }
+
+    if (IsPBO() && !pbos.empty()) {
+        for (int i = 0; i < (int)pbos.size(); i++) {
+            if (fences[i]) glDeleteSync(fences[i]);
+
+            if (mappedBuffers[i]) {
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbos[i]);
+                glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+            }
+        }
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+        glDeleteBuffersARB((GLsizei)pbos.size(), &pbos[0]);
+    }
+
+    pbos.clear();
+    mappedBuffers.clear();
+    fences.clear();
+}
+
+
+void Image::DeleteKeptTexture() {
+    if (keptTexture) {
+        glDeleteTextures(1, &keptTexture);
+        keptTexture = 0;
     }
 }
 
 
 void Image::RenderQuad() {
+    // The kept texture is a whole GL_TEXTURE_2D texture
+    if (keptTexture) {
+        RenderQuadTexture2D();
+        return;
+    }
+
+    // Convert YUV420 in the shader, with the U and V planes on texture units 1 and 2
+    if (yuvShader) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(textureTarget, chromaTextures[0]);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(textureTarget, chromaTextures[1]);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUseProgram(GetYUVProgram(textureTarget));
+    }
+
     if (textureType == TEXTURE_RECTANGLE || textureType == TEXTURE_RECTANGLE_PBO) {
         RenderQuadTextureRectangle();
     }
     else {
         RenderQuadTexture2D();
     }
+
+    if (yuvShader) glUseProgram(0);
 }
 
 void Image::RenderQuadTexture2D() {
     // Draw the textured quad with a height of 1.0, preserving the aspect ratio
+    double s = keptTexture ? 1.0 : (double)contentSize[0] / resolution[0];
+    double t = keptTexture ? 1.0 : (double)contentSize[1] / resolution[1];
+
     glBegin(GL_QUADS);
         glTexCoord2d(0, 0);
         glVertex2d(-0.5 * aspectRatio, -0.5);
 
-        glTexCoord2d(1, 0);
+        glTexCoord2d(s, 0);
         glVertex2d(0.5 * aspectRatio, -0.5);
 
-        glTexCoord2d(1, 1);
+        glTexCoord2d(s, t);
         glVertex2d(0.5 * aspectRatio, 0.5);
 
-        glTexCoord2d(0, 1);
+        glTexCoord2d(0, t);
         glVertex2d(-0.5 * aspectRatio, 0.5);
     glEnd();
 }
@@ -397,13 +682,13 @@ void Image::RenderQuadTextureRectangle() {
         glTexCoord2d(0, 0);
         glVertex2d(-0.5 * aspectRatio, -0.5);
 
-        glTexCoord2d(resolution[0], 0);
+        glTexCoord2d(contentSize[0], 0);
         glVertex2d(0.5 * aspectRatio, -0.5);
 
-        glTexCoord2d(resolution[0], resolution[1]);
+        glTexCoord2d(contentSize[0], contentSize[1]);
         glVertex2d(0.5 * aspectRatio, 0.5);
 
-        glTexCoord2d(0, resolution[1]);
+        glTexCoord2d(0, contentSize[1]);
         glVertex2d(-0.5 * aspectRatio, 0.5);
     glEnd();
 }
@@ -432,7 +717,147 @@ void Image::SetPixelFormats(PixelFormat format) {
         glInternalPixelFormat = GL_RGBA;
         glPixelFormat = GL_BGRA;
     }
+    else if (pixelFormat == YUV420) {
+        // The Y plane.  CreateTexture() switches to RGBA if converting on the CPU.
+        glInternalPixelFormat = GL_LUMINANCE;
+        glPixelFormat = GL_LUMINANCE;
+    }
     else {
         std::cout << "Image::SetPixelFormats() : Error.  Invalid pixel format." << std::endl;
     }
+}
+
+
+bool Image::IsPBO() const {
+    return textureType == TEXTURE_2D_PBO || textureType == TEXTURE_RECTANGLE_PBO;
+}
+
+void Image::WaitForStreamBuffer(int index) {
+    if (!fences[index]) return;
+
+    // Should only block if more uploads are queued than there are buffers
+    glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(fences[index]);
+    fences[index] = NULL;
+}
+
+
+void Image::CopyPixels(unsigned char* dest, const unsigned char* data) {
+    if (ConvertYUVOnCPU()) {
+        ColorConversion::YUV420ToRGBA(data, contentSize[0], contentSize[1], dest);
+    }
+    else if (pixelFormat == YUV420) {
+        memcpy(dest, data, ColorConversion::YUV420Size(contentSize[0], contentSize[1]));
+    }
+    else {
+        unsigned int bytesPerPixel = bufferSize / (resolution[0] * resolution[1]);
+        memcpy(dest, data, contentSize[0] * contentSize[1] * bytesPerPixel);
+    }
+}
+
+void Image::UploadPixels(const unsigned char* pixels) {
+    // Rows are packed, so are not aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (!yuvShader) {
+        glTexSubImage2D(textureTarget, 0, 0, 0, contentSize[0], contentSize[1], glPixelFormat, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return;
+    }
+
+    unsigned int chromaWidth = (contentSize[0] + 1) / 2;
+    unsigned int chromaHeight = (contentSize[1] + 1) / 2;
+    unsigned int uOffset = contentSize[0] * contentSize[1];
+    unsigned int vOffset = uOffset + chromaWidth * chromaHeight;
+
+    glBindTexture(textureTarget, texture);
+    glTexSubImage2D(textureTarget, 0, 0, 0, contentSize[0], contentSize[1], GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels);
+
+    glBindTexture(textureTarget, chromaTextures[0]);
+    glTexSubImage2D(textureTarget, 0, 0, 0, chromaWidth, chromaHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels + uOffset);
+
+    glBindTexture(textureTarget, chromaTextures[1]);
+    glTexSubImage2D(textureTarget, 0, 0, 0, chromaWidth, chromaHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels + vOffset);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindTexture(textureTarget, texture);
+}
+
+
+bool Image::ConvertYUVOnCPU() const {
+    return pixelFormat == YUV420 && !yuvShader;
+}
+
+
+GLuint Image::GetYUVProgram(GLenum target) {
+    bool rectangle = target == GL_TEXTURE_RECTANGLE_ARB;
+
+    GLuint& program = yuvPrograms[rectangle ? 1 : 0];
+    if (program || !GLEW_VERSION_2_0) return program;
+
+    // BT.601 video range to RGB.  Rectangle texture coordinates are in pixels, so halve them
+    // for the chroma planes.
+    std::string sampler = rectangle ? "sampler2DRect" : "sampler2D";
+    std::string lookup = rectangle ? "texture2DRect" : "texture2D";
+    std::string chromaScale = rectangle ? "0.5" : "1.0";
+
+    std::string source = 
+        std::string(rectangle ? "#extension GL_ARB_texture_rectangle : enable\n" : "") +
+        "uniform " + sampler + " yTexture;\n"
+        "uniform " + sampler + " uTexture;\n"
+        "uniform " + sampler + " vTexture;\n"
+        "void main() {\n"
+        "    vec2 lumaCoord = gl_TexCoord[0].st;\n"
+        "    vec2 chromaCoord = lumaCoord * " + chromaScale + ";\n"
+        "    float y = 1.1644 * (" + lookup + "(yTexture, lumaCoord).r - 0.0627);\n"
+        "    float u = " + lookup + "(uTexture, chromaCoord).r - 0.5;\n"
+        "    float v = " + lookup + "(vTexture, chromaCoord).r - 0.5;\n"
+        "    vec3 rgb = vec3(y + 1.596 * v, y - 0.391 * u - 0.813 * v, y + 2.018 * u);\n"
+        "    gl_FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0) * gl_Color;\n"
+        "}\n";
+
+    const char* sourceString = source.c_str();
+
+    GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(shader, 1, &sourceString, NULL);
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        std::cout << "Image::GetYUVProgram() : Error.  Could not compile shader.\n" << log << std::endl;
+
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+
+    // Freed with the program
+    glDeleteShader(shader);
+
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        std::cout << "Image::GetYUVProgram() : Error.  Could not link shader.\n" << log << std::endl;
+
+        glDeleteProgram(program);
+        program = 0;
+        return 0;
+    }
+
+    // Y, U and V on texture units 0, 1 and 2
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "yTexture"), 0);
+    glUniform1i(glGetUniformLocation(program, "uTexture"), 1);
+    glUniform1i(glGetUniformLocation(program, "vTexture"), 2);
+    glUseProgram(0);
+
+    return program;
 }
\ No newline at end of file
@@ -15,6 +15,8 @@
 
 #include "RenderObject.h"
 
+#include <vector>
+
 
 class Image : public RenderObject {
 public:   
@@ -37,6 +39,8 @@ public:
         BGR,        // Direct show RGB video
         RGBA,
         BGRA,       // Direct show RGBA video
+        YUV420      // Planar Y, U and V, with chroma at half resolution.  Converted to RGB by a
+                    //      fragment shader, or on the CPU if shaders are not available.
     };
 
     // Various types of textures
@@ -52,6 +56,11 @@ public:
     };
 
 
+    // Number of pixel buffer objects used round-robin by the PBO texture types.  Takes effect
+    // the next time the texture is created.
+    void SetNumStreamBuffers(int num);
+
+
     // Set the texture to use
     virtual void SetTexture(GLuint textureMap, unsigned int width, unsigned int height, PixelFormat format);
 
@@ -63,6 +72,29 @@ public:
     // Set the texture data using the current texture informaton
     bool SetTextureData(const unsigned char* data);
 
+    // Keep drawing the current texture when SetTextureInfo() next replaces it, until data is
+    // first uploaded to the new one, e.g. a poster frame while its video starts.  Only 
+    // GL_TEXTURE_2D textures not converted from YUV420 are kept.
+    void KeepTextureUntilData();
+    bool KeepingTexture() const;
+
+    // Upload and show only the lower left part of the texture, e.g. for video decoded at a
+    // reduced resolution.  The data passed in is packed at this size.  Reset to the full 
+    // resolution when the texture is created.  Not used with mipmapping.
+    void SetContentSize(unsigned int width, unsigned int height);
+
+
+    // With GL_ARB_buffer_storage the pixel buffer objects stay mapped, so a decoder on any 
+    // thread can write a frame directly into one.  UploadStreamBuffer() then copies it to the
+    // texture on the OpenGL thread, and StreamBufferReady() reports when the copy is done and
+    // the buffer can be written again.  GetStreamBuffer() returns NULL without persistent 
+    // mapping, or when YUV420 is converted on the CPU, in which case use SetTextureData().
+    int GetNumStreamBuffers() const;
+    unsigned char* GetStreamBuffer(int index);
+    int GetStreamBufferIndex(const unsigned char* data) const;
+    bool StreamBufferReady(int index);
+    bool UploadStreamBuffer(int index);
+
     // Include different behaviors
     virtual void SetPosition(const Vec2& pos);
     virtual void SetScale(double scaleValue);
@@ -77,17 +109,43 @@ public:
     // Get the aspect ratio of the image
     float GetAspectRatio();
 
+    // Fraction of the view extents covered by the image, ignoring rotation.  Zero when the 
+    // image is out of view.
+    float GetVisibleFraction();
+
 protected:
     // The texture
     GLuint texture;
 
-    // The pixel buffer object used for copying data to the texture
-    GLuint pbo;
+    // Previous texture drawn until data is uploaded to the current one
+    bool keepTexture;
+    GLuint keptTexture;
+
+    // U and V planes for YUV420 textures when converting in the shader
+    GLuint chromaTextures[2];
+    bool yuvShader;
+
+    // RGBA frame for YUV420 textures when converting on the CPU
+    std::vector<unsigned char> convertBuffer;
+
+    // The pixel buffer objects used for copying data to the texture, used round-robin so
+    // the CPU can fill one while the GPU reads another
+    std::vector<GLuint> pbos;
+    int numStreamBuffers;
+    int currentStreamBuffer;
+
+    // Persistently mapped pointers, and fences set when each upload is issued
+    bool persistentBuffers;
+    std::vector<unsigned char*> mappedBuffers;
+    std::vector<GLsync> fences;
 
     // Resolution and aspect ratio
     unsigned int resolution[2];
     float aspectRatio;
 
+    // Part of the texture in use
+    unsigned int contentSize[2];
+
     // View Extents
     float xMin, xMax, yMin, yMax;
 
@@ -108,6 +166,10 @@ protected:
     // Size of the buffer for copying data
     unsigned int bufferSize;
 
+    // Size of the data passed to SetTextureData().  Differs from the buffer size when
+    // converting YUV420 on the CPU.
+    unsigned int dataSize;
+
     // Was the texture created here or not
     bool textureCreated;
 
@@ -116,14 +178,31 @@ protected:
     virtual void PostRender();
 
     virtual bool CreateTexture();
+    bool CreateStreamBuffers();
     bool CheckTextureCreation();
     virtual void CleanUp();
+    void DeleteKeptTexture();
 
     void RenderQuad();
     void RenderQuadTexture2D();
     void RenderQuadTextureRectangle();
 
     void SetPixelFormats(PixelFormat format);
+
+    // Copy data in the pixel format given to SetTextureInfo() to a buffer for upload
+    void CopyPixels(unsigned char* dest, const unsigned char* data);
+
+    // Upload from client memory or, with a pixel buffer object bound, from an offset into it
+    void UploadPixels(const unsigned char* pixels);
+
+    bool ConvertYUVOnCPU() const;
+
+    // Shared YUV to RGB programs for GL_TEXTURE_2D and GL_TEXTURE_RECTANGLE_ARB
+    static GLuint yuvPrograms[2];
+    static GLuint GetYUVProgram(GLenum target);
+
+    bool IsPBO() const;
+    void WaitForStreamBuffer(int index);
 };
 
 
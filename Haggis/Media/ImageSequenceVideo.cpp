@@ -0,0 +1,490 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        ImageSequenceVideo.cpp
+//
+// Author:      David Borland
+//
+// Description: Class for playing a sequence of numbered image files, e.g. PNG or JPEG
+//              frames written by a simulation, as a video.  Frames are decoded ahead of the
+//              playback position by tasks on the shared decode pool into a bounded cache.
+//              Sequences that fit in the cache are kept in memory once decoded.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "ImageSequenceVideo.h"
+
+#include "ColorConversion.h"
+#include "FFmpegVideoFile.h"
+#include "FrameBufferArena.h"
+
+#include <ThreadPool.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// Not defined by the Windows headers
+#ifndef S_ISDIR
+#define S_ISDIR(mode) (((mode) & S_IFMT) == S_IFDIR)
+#endif
+
+
+namespace {
+    bool IsDirectory(const std::string& path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+
+    bool ListFiles(const std::string& directory, std::vector<std::string>& fileNames) {
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE) return false;
+
+        do {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) fileNames.push_back(data.cFileName);
+        } while (FindNextFileA(find, &data));
+
+        FindClose(find);
+#else
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) return false;
+
+        while (dirent* entry = readdir(dir)) {
+            fileNames.push_back(entry->d_name);
+        }
+
+        closedir(dir);
+#endif
+        return true;
+    }
+
+    // Split a file name such as "frame_0042.png" into the name before the frame number, the
+    // frame number and the extension.  False if the name is not a numbered image.
+    bool SplitFileName(const std::string& fileName, std::string& prefix, long& number, std::string& extension) {
+        std::string::size_type dot = fileName.rfind('.');
+        if (dot == std::string::npos || dot == 0) return false;
+
+        extension = fileName.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        if (extension != "png" && extension != "jpg" && extension != "jpeg" && extension != "bmp" &&
+            extension != "tga" && extension != "tif" && extension != "tiff") {
+            return false;
+        }
+
+        std::string::size_type start = dot;
+        while (start > 0 && isdigit((unsigned char)fileName[start - 1])) start--;
+        if (start == dot) return false;
+
+        prefix = fileName.substr(0, start);
+        number = strtol(fileName.substr(start, dot - start).c_str(), NULL, 10);
+
+        return true;
+    }
+}
+
+
+ImageSequenceVideo::ImageSequenceVideo()
+: VideoStream(), tasksQueued(0), quit(false), decodedFrames(0) {
+    frameRate = 30.0;
+    cacheSize = 512 * 1024 * 1024;
+    readAhead = 0;
+
+    loop = false;
+
+    playStart = 0.0;
+    playOffset = 0.0;
+}
+
+ImageSequenceVideo::~ImageSequenceVideo() {
+    CleanUp();
+}
+
+
+void ImageSequenceVideo::Update() {
+    VideoStream::Update();
+
+    // Stop once the last frame has been shown
+    if (!stopped && !loop && GetPlaybackTime() >= GetDuration()) {
+        Stop();
+    }
+
+    // Read ahead from the new position
+    ScheduleDecode();
+}
+
+
+void ImageSequenceVideo::Play() {
+    if (!stopped) return;
+
+    playStart = GetClockTime();
+    stopped = false;
+}
+
+void ImageSequenceVideo::Stop() {
+    if (stopped) return;
+
+    playOffset = GetPlaybackTime();
+    stopped = true;
+}
+
+
+void ImageSequenceVideo::SetLoop(bool doLoop) {
+    loop = doLoop;
+}
+
+
+void ImageSequenceVideo::SetFrameRate(double framesPerSecond) {
+    if (framesPerSecond <= 0.0) return;
+
+    // Stay on the same frame
+    double position = GetPlaybackTime() * frameRate;
+
+    frameRate = framesPerSecond;
+
+    Seek(position / frameRate);
+}
+
+double ImageSequenceVideo::GetFrameRate() const {
+    return frameRate;
+}
+
+
+void ImageSequenceVideo::SetCacheSize(size_t bytes) {
+    cacheSize = bytes;
+}
+
+
+void ImageSequenceVideo::Rewind() {
+    Seek(0.0);
+}
+
+void ImageSequenceVideo::Jump(float seconds) {
+    // The playback clock keeps running across loops
+    double length = GetDuration();
+
+    double position = GetPlaybackTime();
+    if (length > 0.0) position = fmod(position, length);
+
+    position += seconds;
+    if (position < 0.0) position = 0.0;
+    if (position > length) position = length;
+
+    Seek(position);
+}
+
+
+double ImageSequenceVideo::GetDuration() const {
+    return files.size() / frameRate;
+}
+
+int ImageSequenceVideo::GetNumFrames() const {
+    return (int)files.size();
+}
+
+bool ImageSequenceVideo::FullyCached() const {
+    return bufferSize > 0 && files.size() * (size_t)bufferSize <= cacheSize;
+}
+
+
+bool ImageSequenceVideo::OpenStream() {
+    if (!FindFiles()) {
+        std::cout << "ImageSequenceVideo::OpenStream() : No numbered images in " << name << std::endl;
+        return false;
+    }
+
+    // The first frame sets the size.  Later frames of a different size are scaled to it.
+    AVFrame* frame = FFmpegVideoFile::ReadImage(files[0]);
+    if (!frame) return false;
+
+    width = frame->width;
+    height = frame->height;
+    if (videoType == YUV420) {
+        bufferSize = ColorConversion::YUV420Size(width, height);
+    }
+    else {
+        bufferSize = width * height * (videoType == RGBA ? 4 : 3);
+    }
+
+    CachedFrame empty = { NULL, false, false };
+    cache.assign(files.size(), empty);
+
+    // Keep the first frame, as it has already been read
+    SwsContext* swsContext = NULL;
+    unsigned char* data = FrameBufferArena::GetShared().Acquire(bufferSize);
+    if (FFmpegVideoFile::ConvertFrame(swsContext, frame, videoType, width, height, data)) {
+        cache[0].data = data;
+        decodedFrames++;
+    }
+    else {
+        FrameBufferArena::GetShared().Release(data, bufferSize);
+    }
+
+    sws_freeContext(swsContext);
+    av_frame_free(&frame);
+
+    return true;
+}
+
+bool ImageSequenceVideo::StartStream() {
+    // Decode as far ahead as the cache allows, or everything if it fits
+    if (FullyCached()) {
+        readAhead = (int)files.size();
+    }
+    else {
+        readAhead = std::max((int)(cacheSize / bufferSize), 2);
+    }
+
+    std::cout << "ImageSequenceVideo::StartStream() : " << files.size() << " frames, "
+              << (FullyCached() ? "fully cached" : "streamed from disk") << std::endl;
+
+    // Start decoding so the first frames are ready when Play() is called
+    ScheduleDecode();
+
+    return true;
+}
+
+
+Image::PixelFormat ImageSequenceVideo::GetPixelFormat() const {
+    if (videoType == YUV420) return Image::YUV420;
+
+    return videoType == RGBA ? Image::RGBA : Image::RGB;
+}
+
+
+const unsigned char* ImageSequenceVideo::AcquireFrame(unsigned int& sequence, double& frameTime) {
+    int playbackFrame = GetPlaybackFrame();
+    if (!loop) playbackFrame = std::min(playbackFrame, (int)files.size() - 1);
+
+    // Already shown
+    if ((unsigned int)playbackFrame + 1 == uploadedSequence) return NULL;
+
+    // Frames are only freed from this thread, so the data stays valid after unlocking
+    const unsigned char* data;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        data = cache[GetFrameIndex(playbackFrame)].data;
+    }
+
+    // Not decoded yet, so the last frame stays on screen
+    if (!data) return NULL;
+
+    sequence = playbackFrame + 1;
+    frameTime = playbackFrame / frameRate;
+
+    return data;
+}
+
+unsigned int ImageSequenceVideo::GetDecodedFrames() const {
+    return decodedFrames.load(std::memory_order_relaxed);
+}
+
+
+double ImageSequenceVideo::GetPlaybackTime() const {
+    if (stopped) return playOffset;
+
+    return playOffset + (GetClockTime() - playStart);
+}
+
+void ImageSequenceVideo::Seek(double seconds) {
+    // Restart the clock at the new position.  ScheduleDecode() reads ahead from there.
+    playOffset = seconds;
+    playStart = GetClockTime();
+}
+
+
+int ImageSequenceVideo::GetPlaybackFrame() const {
+    // Allow for rounding when seeking to the time of a frame
+    return std::max((int)floor(GetPlaybackTime() * frameRate + 1.0e-6), 0);
+}
+
+int ImageSequenceVideo::GetFrameIndex(int playbackFrame) const {
+    int numFrames = (int)files.size();
+
+    return loop ? playbackFrame % numFrames : std::min(playbackFrame, numFrames - 1);
+}
+
+
+bool ImageSequenceVideo::FindFiles() {
+    // Use the directory's longest sequence, or the sequence the named file belongs to
+    std::string directory = name;
+    std::string sequenceKey;
+
+    if (!IsDirectory(name)) {
+        std::string::size_type slash = name.find_last_of("/\\");
+        directory = slash != std::string::npos ? name.substr(0, slash) : ".";
+
+        std::string prefix, extension;
+        long number;
+        if (!SplitFileName(name.substr(slash + 1), prefix, number, extension)) return false;
+
+        sequenceKey = prefix + "." + extension;
+    }
+
+    std::vector<std::string> fileNames;
+    if (!ListFiles(directory, fileNames)) return false;
+
+    // Group the numbered images by name and extension
+    std::map<std::string, std::vector<std::pair<long, std::string> > > sequences;
+    for (int i = 0; i < (int)fileNames.size(); i++) {
+        std::string prefix, extension;
+        long number;
+        if (SplitFileName(fileNames[i], prefix, number, extension)) {
+            sequences[prefix + "." + extension].push_back(std::make_pair(number, fileNames[i]));
+        }
+    }
+
+    if (sequenceKey.empty()) {
+        for (std::map<std::string, std::vector<std::pair<long, std::string> > >::const_iterator it = sequences.begin(); it != sequences.end(); it++) {
+            if (sequenceKey.empty() || it->second.size() > sequences[sequenceKey].size()) {
+                sequenceKey = it->first;
+            }
+        }
+    }
+
+    if (sequences.find(sequenceKey) == sequences.end()) return false;
+
+    // Sort by number rather than name, as the numbers are not always padded
+    std::vector<std::pair<long, std::string> >& sequence = sequences[sequenceKey];
+    std::sort(sequence.begin(), sequence.end());
+
+    files.clear();
+    for (int i = 0; i < (int)sequence.size(); i++) {
+        files.push_back(directory + "/" + sequence[i].second);
+    }
+
+    return !files.empty();
+}
+
+
+void ImageSequenceVideo::ScheduleDecode() {
+    if (quit || files.empty() || readAhead == 0) return;
+
+    // Pause while offscreen
+    if (priority <= 0.0f) return;
+
+    int numFrames = (int)files.size();
+    bool fullyCached = FullyCached();
+
+    // Once the end is reached, a sequence that doesn't loop keeps showing its last frame
+    int current = GetPlaybackFrame();
+    int first = GetFrameIndex(current);
+
+    // The window of frames to keep wraps around when looping, or if everything is kept anyway
+    bool wrap = loop || fullyCached;
+    int windowSize = wrap ? readAhead : std::min(readAhead, numFrames - first);
+
+    int maxQueued = std::max(GetDecodePool().NumThreads(), 2);
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    // Free frames outside the window.  Frames still decoding are freed once done.
+    if (!fullyCached) {
+        for (int i = 0; i < numFrames; i++) {
+            CachedFrame& cached = cache[i];
+            if (!cached.data) continue;
+
+            int distance = i - first;
+            if (wrap && distance < 0) distance += numFrames;
+
+            if (distance < 0 || distance >= windowSize) {
+                FrameBufferArena::GetShared().Release(cached.data, bufferSize);
+                cached.data = NULL;
+            }
+        }
+    }
+
+    // Queue the frames due soonest first
+    for (int i = 0; i < windowSize && tasksQueued.load() < maxQueued; i++) {
+        int index = (first + i) % numFrames;
+
+        CachedFrame& cached = cache[index];
+        if (cached.data || cached.decoding || cached.failed) continue;
+
+        cached.decoding = true;
+        tasksQueued.fetch_add(1);
+        GetDecodePool().Enqueue(std::bind(&ImageSequenceVideo::DecodeTask, this, index));
+    }
+}
+
+
+void ImageSequenceVideo::DecodeTask(int index) {
+    if (!quit) {
+        unsigned char* data = FrameBufferArena::GetShared().Acquire(bufferSize);
+        bool decoded = DecodeImage(files[index], data);
+
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+
+            CachedFrame& cached = cache[index];
+            cached.decoding = false;
+
+            if (decoded) {
+                cached.data = data;
+            }
+            else {
+                // Don't try again
+                cached.failed = true;
+            }
+        }
+
+        if (decoded) {
+            decodedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            FrameBufferArena::GetShared().Release(data, bufferSize);
+        }
+    }
+
+    // Must be last, as the stream can be deleted once this is cleared
+    tasksQueued.fetch_sub(1, std::memory_order_release);
+}
+
+bool ImageSequenceVideo::DecodeImage(const std::string& fileName, unsigned char* dest) {
+    AVFrame* frame = FFmpegVideoFile::ReadImage(fileName);
+    if (!frame) return false;
+
+    SwsContext* swsContext = NULL;
+    bool converted = FFmpegVideoFile::ConvertFrame(swsContext, frame, videoType, width, height, dest);
+
+    sws_freeContext(swsContext);
+    av_frame_free(&frame);
+
+    return converted;
+}
+
+
+void ImageSequenceVideo::CleanUp() {
+    // Wait for queued or running tasks to finish
+    quit = true;
+    while (tasksQueued.load(std::memory_order_acquire) > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    for (int i = 0; i < (int)cache.size(); i++) {
+        if (cache[i].data) FrameBufferArena::GetShared().Release(cache[i].data, bufferSize);
+    }
+    cache.clear();
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        ImageSequenceVideo.h
+//
+// Author:      David Borland
+//
+// Description: Class for playing a sequence of numbered image files, e.g. PNG or JPEG
+//              frames written by a simulation, as a video.  Frames are decoded ahead of the
+//              playback position by tasks on the shared decode pool into a bounded cache.
+//              Sequences that fit in the cache are kept in memory once decoded.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef IMAGESEQUENCEVIDEO_H
+#define IMAGESEQUENCEVIDEO_H
+
+
+#include "VideoStream.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Forward declarations
+struct AVFrame;
+
+
+class ImageSequenceVideo : public VideoStream {
+public:
+    ImageSequenceVideo();
+    virtual ~ImageSequenceVideo();
+
+    virtual void Update();
+
+    virtual void Play();
+    virtual void Stop();
+
+    void SetLoop(bool doLoop);
+
+    // Frames per second.  Defaults to 30.
+    void SetFrameRate(double framesPerSecond);
+    double GetFrameRate() const;
+
+    // Memory used for decoded frames, set before Initialize().  Defaults to 512 MB.
+    void SetCacheSize(size_t bytes);
+
+    void Rewind();
+    void Jump(float seconds);
+
+    // Length of the sequence in seconds
+    double GetDuration() const;
+
+    int GetNumFrames() const;
+
+    // Whether the whole sequence fits in the cache
+    bool FullyCached() const;
+
+protected:
+    // The source is a directory, using its longest sequence, or one file of a sequence
+    std::vector<std::string> files;
+
+    double frameRate;
+    size_t cacheSize;
+
+    // Frames decoded ahead of the playback position
+    int readAhead;
+
+    struct CachedFrame {
+        unsigned char* data;
+        bool decoding;
+        bool failed;
+    };
+
+    // Written by decode tasks, guarded by cacheMutex
+    std::vector<CachedFrame> cache;
+    std::mutex cacheMutex;
+
+    std::atomic<int> tasksQueued;
+    std::atomic<bool> quit;
+    std::atomic<unsigned int> decodedFrames;
+
+    bool loop;
+
+    // Playback clock, in seconds.  The start is a time on the clock given by GetClockTime().
+    double playStart;
+    double playOffset;
+
+    virtual bool OpenStream();
+    virtual bool StartStream();
+    virtual Image::PixelFormat GetPixelFormat() const;
+    virtual const unsigned char* AcquireFrame(unsigned int& sequence, double& frameTime);
+    virtual unsigned int GetDecodedFrames() const;
+
+    virtual double GetPlaybackTime() const;
+    void Seek(double seconds);
+
+    // Frame count from the start of playback, including loops
+    int GetPlaybackFrame() const;
+    int GetFrameIndex(int playbackFrame) const;
+
+    // Find the files of the sequence, sorted by frame number
+    bool FindFiles();
+
+    // Queue decodes for the frames due next and free the others if the cache is full
+    void ScheduleDecode();
+
+    // Run on the decode pool
+    void DecodeTask(int index);
+    bool DecodeImage(const std::string& fileName, unsigned char* dest);
+
+    void CleanUp();
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,271 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        KeyframeIndex.cpp
+//
+// Author:      David Borland
+//
+// Description: Index of the keyframes in a video stream, so seeks can go straight to the 
+//              keyframe before the target.  Built from the container's index when it has
+//              one, otherwise by reading every packet, in which case it is cached to disk.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "KeyframeIndex.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+
+std::string KeyframeIndex::cacheDirectory;
+
+
+namespace {
+    const char cacheMagic[4] = { 'H', 'K', 'F', 'I' };
+    const int32_t cacheVersion = 1;
+}
+
+
+KeyframeIndex::KeyframeIndex() {
+}
+
+
+bool KeyframeIndex::Build(const std::string& fileName, int streamIndex, const std::atomic<bool>* cancel) {
+    keyframes.clear();
+
+    // Check the cache
+    int64_t size = 0;
+    int64_t modified = 0;
+    bool haveInfo = GetFileInfo(fileName, size, modified);
+
+    std::string cacheFileName = GetCacheFileName(fileName, streamIndex);
+    if (haveInfo && !cacheFileName.empty() && Load(cacheFileName, size, modified)) return true;
+
+
+    // Open the file separately from the player, so this can run while it plays
+    AVFormatContext* context = NULL;
+    if (avformat_open_input(&context, fileName.c_str(), NULL, NULL) != 0) {
+        std::cout << "KeyframeIndex::Build() : Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    if (avformat_find_stream_info(context, NULL) < 0 ||
+        streamIndex < 0 || streamIndex >= (int)context->nb_streams) {
+        std::cout << "KeyframeIndex::Build() : Invalid stream in " << fileName << std::endl;
+        avformat_close_input(&context);
+        return false;
+    }
+
+    AVStream* stream = context->streams[streamIndex];
+
+    double timeBase = av_q2d(stream->time_base);
+    double startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time * timeBase : 0.0;
+
+
+    // Use the container's index, e.g. the sync samples in MP4, if there is one
+    int numEntries = avformat_index_get_entries_count(stream);
+    for (int i = 0; i < numEntries; i++) {
+        const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+        if (!(entry->flags & AVINDEX_KEYFRAME)) continue;
+
+        Keyframe keyframe;
+        keyframe.timestamp = entry->timestamp;
+        keyframe.time = entry->timestamp * timeBase - startTime;
+        keyframe.position = entry->pos;
+        keyframes.push_back(keyframe);
+    }
+
+    bool scanned = false;
+
+    // Otherwise read every packet of the stream, without decoding
+    if (keyframes.size() < 2) {
+        keyframes.clear();
+
+        for (int i = 0; i < (int)context->nb_streams; i++) {
+            if (i != streamIndex) context->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        AVPacket* packet = av_packet_alloc();
+        while (packet && av_read_frame(context, packet) >= 0) {
+            if (packet->stream_index == streamIndex && (packet->flags & AV_PKT_FLAG_KEY)) {
+                int64_t timestamp = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+
+                if (timestamp != AV_NOPTS_VALUE) {
+                    Keyframe keyframe;
+                    keyframe.timestamp = timestamp;
+                    keyframe.time = timestamp * timeBase - startTime;
+                    keyframe.position = packet->pos;
+                    keyframes.push_back(keyframe);
+                }
+            }
+            av_packet_unref(packet);
+
+            if (cancel && *cancel) {
+                keyframes.clear();
+                break;
+            }
+        }
+        av_packet_free(&packet);
+
+        scanned = !keyframes.empty();
+    }
+
+    avformat_close_input(&context);
+
+
+    // Timestamps can be out of order in some containers
+    std::sort(keyframes.begin(), keyframes.end());
+
+    // Only worth caching if packets had to be read
+    if (scanned && haveInfo && !cacheFileName.empty()) Save(cacheFileName, size, modified);
+
+    return !keyframes.empty();
+}
+
+
+int KeyframeIndex::GetNumKeyframes() const {
+    return (int)keyframes.size();
+}
+
+bool KeyframeIndex::Empty() const {
+    return keyframes.empty();
+}
+
+
+int KeyframeIndex::Find(double seconds) const {
+    // First keyframe after the time
+    int low = 0;
+    int high = (int)keyframes.size();
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (keyframes[middle].time <= seconds) low = middle + 1;
+        else high = middle;
+    }
+
+    return low - 1;
+}
+
+
+double KeyframeIndex::GetTime(int index) const {
+    return keyframes[index].time;
+}
+
+int64_t KeyframeIndex::GetTimestamp(int index) const {
+    return keyframes[index].timestamp;
+}
+
+int64_t KeyframeIndex::GetPosition(int index) const {
+    return keyframes[index].position;
+}
+
+
+void KeyframeIndex::SetCacheDirectory(const std::string& directory) {
+    cacheDirectory = directory;
+}
+
+const std::string& KeyframeIndex::GetCacheDirectory() {
+    return cacheDirectory;
+}
+
+
+std::string KeyframeIndex::GetCacheFileName(const std::string& fileName, int streamIndex) const {
+    if (cacheDirectory.empty()) return "";
+
+    std::stringstream cacheFileName;
+    cacheFileName << cacheDirectory << "/" << std::hex << std::hash<std::string>()(fileName) 
+                  << std::dec << "_" << streamIndex << ".keyframes";
+
+    return cacheFileName.str();
+}
+
+bool KeyframeIndex::GetFileInfo(const std::string& fileName, int64_t& size, int64_t& modified) const {
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) return false;
+
+    size = (int64_t)info.st_size;
+    modified = (int64_t)info.st_mtime;
+
+    return true;
+}
+
+
+bool KeyframeIndex::Load(const std::string& cacheFileName, int64_t size, int64_t modified) {
+    std::ifstream file(cacheFileName.c_str(), std::ios::binary);
+    if (!file) return false;
+
+    char magic[4];
+    int32_t version;
+    int64_t cachedSize, cachedModified;
+    uint32_t count;
+
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&cachedSize, sizeof(cachedSize));
+    file.read((char*)&cachedModified, sizeof(cachedModified));
+    file.read((char*)&count, sizeof(count));
+
+    // Rebuild if the file has changed
+    if (!file || !std::equal(magic, magic + 4, cacheMagic) || version != cacheVersion ||
+        cachedSize != size || cachedModified != modified) {
+        return false;
+    }
+
+    // Check the count against what is left of the file before allocating for it
+    const size_t entrySize = sizeof(double) + sizeof(int64_t) * 2;
+
+    std::streampos start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff remaining = file.tellg() - start;
+    file.seekg(start);
+
+    if (!file || remaining < 0 || (uint64_t)count * entrySize > (uint64_t)remaining) {
+        std::cout << "KeyframeIndex::Load() : Invalid cache " << cacheFileName << std::endl;
+        return false;
+    }
+
+    keyframes.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        file.read((char*)&keyframes[i].time, sizeof(keyframes[i].time));
+        file.read((char*)&keyframes[i].timestamp, sizeof(keyframes[i].timestamp));
+        file.read((char*)&keyframes[i].position, sizeof(keyframes[i].position));
+    }
+
+    if (!file) {
+        keyframes.clear();
+        return false;
+    }
+
+    return !keyframes.empty();
+}
+
+bool KeyframeIndex::Save(const std::string& cacheFileName, int64_t size, int64_t modified) const {
+    std::ofstream file(cacheFileName.c_str(), std::ios::binary);
+    if (!file) {
+        std::cout << "KeyframeIndex::Save() : Could not write " << cacheFileName << std::endl;
+        return false;
+    }
+
+    uint32_t count = (uint32_t)keyframes.size();
+
+    file.write(cacheMagic, sizeof(cacheMagic));
+    file.write((const char*)&cacheVersion, sizeof(cacheVersion));
+    file.write((const char*)&size, sizeof(size));
+    file.write((const char*)&modified, sizeof(modified));
+    file.write((const char*)&count, sizeof(count));
+
+    for (uint32_t i = 0; i < count; i++) {
+        file.write((const char*)&keyframes[i].time, sizeof(keyframes[i].time));
+        file.write((const char*)&keyframes[i].timestamp, sizeof(keyframes[i].timestamp));
+        file.write((const char*)&keyframes[i].position, sizeof(keyframes[i].position));
+    }
+
+    return (bool)file;
+}
\ No newline at end of file
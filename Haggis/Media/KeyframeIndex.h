@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        KeyframeIndex.h
+//
+// Author:      David Borland
+//
+// Description: Index of the keyframes in a video stream, so seeks can go straight to the 
+//              keyframe before the target.  Built from the container's index when it has
+//              one, otherwise by reading every packet, in which case it is cached to disk.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+class KeyframeIndex {
+public:
+    KeyframeIndex();
+
+    // Load the index for the stream from the cache or build it.  Building stops early if 
+    // cancel is set.
+    bool Build(const std::string& fileName, int streamIndex, const std::atomic<bool>* cancel = NULL);
+
+    int GetNumKeyframes() const;
+    bool Empty() const;
+
+    // Index of the last keyframe at or before the time, or -1 if there is none
+    int Find(double seconds) const;
+
+    // Time in seconds from the start of the stream, timestamp in the stream's time base for
+    // av_seek_frame(), and byte position in the file, or -1 if not known
+    double GetTime(int index) const;
+    int64_t GetTimestamp(int index) const;
+    int64_t GetPosition(int index) const;
+
+    // Where indices built by reading the packets are saved.  Not cached if empty.
+    static void SetCacheDirectory(const std::string& directory);
+    static const std::string& GetCacheDirectory();
+
+private:
+    struct Keyframe {
+        double time;
+        int64_t timestamp;
+        int64_t position;
+
+        bool operator<(const Keyframe& other) const { return timestamp < other.timestamp; }
+    };
+
+    std::vector<Keyframe> keyframes;
+
+    static std::string cacheDirectory;
+
+    // Cache file for the stream, identified by the file's size and modification time
+    std::string GetCacheFileName(const std::string& fileName, int streamIndex) const;
+    bool GetFileInfo(const std::string& fileName, int64_t& size, int64_t& modified) const;
+
+    bool Load(const std::string& cacheFileName, int64_t size, int64_t modified);
+    bool Save(const std::string& cacheFileName, int64_t size, int64_t modified) const;
+};
+
+
+#endif
\ No newline at end of file
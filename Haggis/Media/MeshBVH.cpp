@@ -0,0 +1,838 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        MeshBVH.cpp
+//
+// Author:      David Borland
+//
+// Description: Bounding volume hierarchy of triangles, for picking and other ray queries
+//              without testing every triangle.  Nodes are split by the surface area
+//              heuristic, large subtrees are built in parallel, and the nodes and the
+//              triangles of each leaf are stored in flat arrays in the order they are visited.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "MeshBVH.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <mutex>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MESHBVH_SSE
+#include <xmmintrin.h>
+#endif
+
+
+namespace {
+    // Centroid bins per axis for choosing splits
+    const int numBins = 16;
+
+    // Cost of visiting a node, relative to testing a group of four triangles
+    const float traversalCost = 1.0f;
+
+    // Leaves are split past this size even if the heuristic says not to, and the depth is
+    // limited so queries can use a fixed size stack
+    const int maxLeafSize = 8;
+    const int maxDepth = 64;
+
+    // Both children of a node at least this big are built in parallel, and nodes at least
+    // this big are binned in parallel
+    const int parallelSize = 16384;
+    const int parallelBinSize = 65536;
+
+
+    struct BuildData {
+        // Six per triangle, as for nodes
+        std::vector<float> bounds;
+
+        // Twice the centroid, three per triangle
+        std::vector<float> centers;
+
+        // Triangles, with each node's triangles together
+        std::vector<int> references;
+    };
+
+    struct Bin {
+        float bounds[6];
+        int count;
+    };
+
+    // Built depth first, with the first child of a node following it and the second at
+    // first.  Leaves have count triangles from first.
+    struct BuildNode {
+        float bounds[6];
+        int first;
+        int count;
+    };
+
+
+    void EmptyBounds(float* bounds) {
+        bounds[0] = bounds[1] = bounds[2] = FLT_MAX;
+        bounds[3] = bounds[4] = bounds[5] = -FLT_MAX;
+    }
+
+    void GrowBounds(float* bounds, const float* other) {
+        for (int i = 0; i < 3; i++) {
+            bounds[i] = std::min(bounds[i], other[i]);
+            bounds[i + 3] = std::max(bounds[i + 3], other[i + 3]);
+        }
+    }
+
+    void GrowBoundsPoint(float* bounds, const float* point) {
+        for (int i = 0; i < 3; i++) {
+            bounds[i] = std::min(bounds[i], point[i]);
+            bounds[i + 3] = std::max(bounds[i + 3], point[i]);
+        }
+    }
+
+    // Triangles are tested four at a time
+    float GroupCost(int count) {
+        return (float)((count + 3) / 4);
+    }
+
+    // Half the surface area, which is all the heuristic needs
+    float HalfArea(const float* bounds) {
+        float dx = std::max(bounds[3] - bounds[0], 0.0f);
+        float dy = std::max(bounds[4] - bounds[1], 0.0f);
+        float dz = std::max(bounds[5] - bounds[2], 0.0f);
+
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+
+    // Run func(begin, end) over the range, in parallel if it is large
+    template <class Func>
+    void ForRange(int begin, int end, ThreadPool& pool, const Func& func) {
+        if (end - begin < parallelBinSize) {
+            func(begin, end);
+        }
+        else {
+            pool.ParallelFor(end - begin, parallelBinSize / 4, [&](int b, int e) {
+                func(begin + b, begin + e);
+            });
+        }
+    }
+
+
+    // Choose a split of the triangles from begin to end by binning their centers along each
+    // axis.  Returns false to make a leaf.  Otherwise the triangles are partitioned, with the
+    // first child's from begin to middle, and the children's bounds returned.
+    bool Split(BuildData& data, int begin, int end, const float* nodeBounds, int depth, ThreadPool& pool,
+               int& middle, float* firstBounds, float* secondBounds) {
+        int count = end - begin;
+        if (count <= 1) return false;
+
+        std::mutex mutex;
+
+        // Bounds of the centers
+        float centerBounds[6];
+        EmptyBounds(centerBounds);
+
+        ForRange(begin, end, pool, [&](int b, int e) {
+            float local[6];
+            EmptyBounds(local);
+
+            for (int i = b; i < e; i++) {
+                GrowBoundsPoint(local, &data.centers[data.references[i] * 3]);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            GrowBounds(centerBounds, local);
+        });
+
+        bool forceSplit = count > maxLeafSize;
+        bool canSplit = depth < maxDepth - 1;
+
+        int axis = -1;
+        int splitBin = 0;
+        float bestCost = GroupCost(count);
+
+        Bin bins[3][numBins];
+        float binScale[3];
+
+        for (int a = 0; a < 3; a++) {
+            float extent = centerBounds[a + 3] - centerBounds[a];
+            binScale[a] = extent > 0.0f ? numBins * 0.9999f / extent : 0.0f;
+
+            for (int i = 0; i < numBins; i++) {
+                EmptyBounds(bins[a][i].bounds);
+                bins[a][i].count = 0;
+            }
+        }
+
+        ForRange(begin, end, pool, [&](int b, int e) {
+            Bin local[3][numBins];
+            for (int a = 0; a < 3; a++) {
+                for (int i = 0; i < numBins; i++) {
+                    EmptyBounds(local[a][i].bounds);
+                    local[a][i].count = 0;
+                }
+            }
+
+            for (int i = b; i < e; i++) {
+                int triangle = data.references[i];
+                const float* center = &data.centers[triangle * 3];
+                const float* bounds = &data.bounds[triangle * 6];
+
+                for (int a = 0; a < 3; a++) {
+                    if (binScale[a] == 0.0f) continue;
+
+                    int bin = std::min((int)((center[a] - centerBounds[a]) * binScale[a]), numBins - 1);
+                    GrowBounds(local[a][bin].bounds, bounds);
+                    local[a][bin].count++;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int a = 0; a < 3; a++) {
+                for (int i = 0; i < numBins; i++) {
+                    GrowBounds(bins[a][i].bounds, local[a][i].bounds);
+                    bins[a][i].count += local[a][i].count;
+                }
+            }
+        });
+
+        // Sweep from the right for the second child's cost, then from the left
+        float nodeArea = HalfArea(nodeBounds);
+        float inverseArea = nodeArea > 0.0f ? 1.0f / nodeArea : 0.0f;
+        if (forceSplit) bestCost = FLT_MAX;
+
+        for (int a = 0; a < 3; a++) {
+            if (binScale[a] == 0.0f) continue;
+
+            float rightCosts[numBins];
+            float bounds[6];
+            EmptyBounds(bounds);
+            int rightCount = 0;
+
+            for (int i = numBins - 1; i > 0; i--) {
+                GrowBounds(bounds, bins[a][i].bounds);
+                rightCount += bins[a][i].count;
+                rightCosts[i] = rightCount > 0 ? HalfArea(bounds) * GroupCost(rightCount) : 0.0f;
+            }
+
+            EmptyBounds(bounds);
+            int leftCount = 0;
+
+            for (int i = 0; i < numBins - 1; i++) {
+                GrowBounds(bounds, bins[a][i].bounds);
+                leftCount += bins[a][i].count;
+                if (leftCount == 0 || leftCount == count) continue;
+
+                float cost = traversalCost + (HalfArea(bounds) * GroupCost(leftCount) + rightCosts[i + 1]) * inverseArea;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    axis = a;
+                    splitBin = i;
+                }
+            }
+        }
+
+        if (!canSplit || (axis < 0 && !forceSplit)) return false;
+
+        int* references = &data.references[0];
+
+        if (axis < 0) {
+            // All centers are the same, so split in half
+            middle = begin + count / 2;
+        }
+        else {
+            float low = centerBounds[axis];
+            float scale = binScale[axis];
+
+            middle = (int)(std::partition(references + begin, references + end, [&](int triangle) {
+                int bin = std::min((int)((data.centers[triangle * 3 + axis] - low) * scale), numBins - 1);
+                return bin <= splitBin;
+            }) - references);
+        }
+
+        EmptyBounds(firstBounds);
+        EmptyBounds(secondBounds);
+
+        if (axis >= 0) {
+            for (int i = 0; i < numBins; i++) {
+                GrowBounds(i <= splitBin ? firstBounds : secondBounds, bins[axis][i].bounds);
+            }
+        }
+        else {
+            for (int i = begin; i < end; i++) {
+                GrowBounds(i < middle ? firstBounds : secondBounds, &data.bounds[references[i] * 6]);
+            }
+        }
+
+        return true;
+    }
+
+
+    // Build the nodes over the triangles from begin to end, depth first from the root
+    void BuildSubtree(BuildData& data, int begin, int end, const float* bounds, int depth,
+                      std::vector<BuildNode>& nodes, ThreadPool& pool) {
+        // Nodes left to build.  Second children set their parent's first index.
+        struct Work {
+            int begin;
+            int end;
+            float bounds[6];
+            int depth;
+            int parent;
+        };
+
+        std::vector<Work> stack(1);
+        stack.back().begin = begin;
+        stack.back().end = end;
+        std::copy(bounds, bounds + 6, stack.back().bounds);
+        stack.back().depth = depth;
+        stack.back().parent = -1;
+
+        while (!stack.empty()) {
+            Work work = stack.back();
+            stack.pop_back();
+
+            int index = (int)nodes.size();
+            if (work.parent >= 0) nodes[work.parent].first = index;
+
+            BuildNode node;
+            std::copy(work.bounds, work.bounds + 6, node.bounds);
+            node.first = work.begin;
+            node.count = work.end - work.begin;
+
+            int middle = 0;
+            Work children[2];
+
+            if (!Split(data, work.begin, work.end, work.bounds, work.depth, pool, middle, children[0].bounds, children[1].bounds)) {
+                nodes.push_back(node);
+                continue;
+            }
+
+            node.first = -1;
+            node.count = 0;
+            nodes.push_back(node);
+
+            children[0].begin = work.begin;
+            children[0].end = middle;
+            children[1].begin = middle;
+            children[1].end = work.end;
+
+            for (int i = 0; i < 2; i++) {
+                children[i].depth = work.depth + 1;
+                children[i].parent = i == 0 ? -1 : index;
+            }
+
+            if (middle - work.begin >= parallelSize && work.end - middle >= parallelSize) {
+                // Build both children at once, then append them.  Their triangles are
+                // already in place, so only child indices move.
+                std::vector<BuildNode> subtrees[2];
+
+                pool.ParallelFor(2, 1, [&](int b, int e) {
+                    for (int i = b; i < e; i++) {
+                        BuildSubtree(data, children[i].begin, children[i].end, children[i].bounds, children[i].depth, subtrees[i], pool);
+                    }
+                });
+
+                for (int i = 0; i < 2; i++) {
+                    int offset = (int)nodes.size();
+                    if (i == 1) nodes[index].first = offset;
+
+                    for (int j = 0; j < (int)subtrees[i].size(); j++) {
+                        BuildNode child = subtrees[i][j];
+                        if (child.count == 0) child.first += offset;
+
+                        nodes.push_back(child);
+                    }
+                }
+            }
+            else {
+                // The first child is built next, so it follows its parent
+                stack.push_back(children[1]);
+                stack.push_back(children[0]);
+            }
+        }
+    }
+
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+MeshBVH::MeshBVH() {
+}
+
+
+void MeshBVH::Build(const std::vector<float>& positions, const std::vector<int>& triangleVertices,
+                    const std::vector<int>& triangleTags, ThreadPool& pool) {
+    Clear();
+
+    int numInput = (int)triangleTags.size();
+    int numVertices = (int)positions.size() / 3;
+
+    BuildData data;
+    data.bounds.resize(numInput * 6);
+    data.centers.resize(numInput * 3);
+
+    // Triangles with no area or bad indices have empty bounds
+    pool.ParallelFor(numInput, 4096, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float* bounds = &data.bounds[i * 6];
+            EmptyBounds(bounds);
+
+            const int* v = &triangleVertices[i * 3];
+            if (v[0] < 0 || v[0] >= numVertices || v[1] < 0 || v[1] >= numVertices || v[2] < 0 || v[2] >= numVertices) continue;
+
+            const float* p0 = &positions[v[0] * 3];
+            const float* p1 = &positions[v[1] * 3];
+            const float* p2 = &positions[v[2] * 3];
+
+            float ax = p1[0] - p0[0], ay = p1[1] - p0[1], az = p1[2] - p0[2];
+            float bx = p2[0] - p0[0], by = p2[1] - p0[1], bz = p2[2] - p0[2];
+
+            float nx = ay * bz - az * by;
+            float ny = az * bx - ax * bz;
+            float nz = ax * by - ay * bx;
+            if (nx == 0.0f && ny == 0.0f && nz == 0.0f) continue;
+
+            GrowBoundsPoint(bounds, p0);
+            GrowBoundsPoint(bounds, p1);
+            GrowBoundsPoint(bounds, p2);
+
+            float* center = &data.centers[i * 3];
+            for (int k = 0; k < 3; k++) {
+                center[k] = bounds[k] + bounds[k + 3];
+            }
+        }
+    });
+
+    float rootBounds[6];
+    EmptyBounds(rootBounds);
+
+    data.references.reserve(numInput);
+    for (int i = 0; i < numInput; i++) {
+        if (data.bounds[i * 6] > data.bounds[i * 6 + 3]) continue;
+
+        data.references.push_back(i);
+        GrowBounds(rootBounds, &data.bounds[i * 6]);
+    }
+
+    int numTriangles = (int)data.references.size();
+    if (numTriangles == 0) return;
+
+    std::vector<BuildNode> tree;
+    BuildSubtree(data, 0, numTriangles, rootBounds, 0, tree, pool);
+
+
+    // Each leaf's triangles in groups of four
+    std::vector<int> leaves;
+    std::vector<int> groupStarts(tree.size(), 0);
+    int numGroups = 0;
+
+    for (int i = 0; i < (int)tree.size(); i++) {
+        if (tree[i].count == 0) continue;
+
+        leaves.push_back(i);
+        groupStarts[i] = numGroups;
+        numGroups += (tree[i].count + 3) / 4;
+    }
+
+
+    // Collapse to four children per node, opening the child with the largest surface area
+    // until there are four, depth first so a node's first child node follows it
+    struct Collapse {
+        int buildNode;
+        int parent;
+        int slot;
+    };
+
+    std::vector<Collapse> stack(1);
+    stack.back().buildNode = 0;
+    stack.back().parent = -1;
+    stack.back().slot = 0;
+
+    while (!stack.empty()) {
+        Collapse work = stack.back();
+        stack.pop_back();
+
+        int index = (int)nodes.size();
+        if (work.parent >= 0) nodes[work.parent].children[work.slot] = index;
+
+        nodes.push_back(Node());
+
+        int children[4];
+        int numChildren = 0;
+
+        if (tree[work.buildNode].count > 0) {
+            // A single leaf
+            children[numChildren++] = work.buildNode;
+        }
+        else {
+            children[numChildren++] = work.buildNode + 1;
+            children[numChildren++] = tree[work.buildNode].first;
+
+            while (numChildren < 4) {
+                int largest = -1;
+                float largestArea = -1.0f;
+
+                for (int i = 0; i < numChildren; i++) {
+                    const BuildNode& child = tree[children[i]];
+                    if (child.count == 0 && HalfArea(child.bounds) > largestArea) {
+                        largest = i;
+                        largestArea = HalfArea(child.bounds);
+                    }
+                }
+
+                if (largest < 0) break;
+
+                int opened = children[largest];
+                children[largest] = opened + 1;
+                children[numChildren++] = tree[opened].first;
+            }
+        }
+
+        // Child nodes are built in order, after the node
+        int pushed = (int)stack.size();
+
+        for (int i = 0; i < 4; i++) {
+            Node& node = nodes[index];
+
+            if (i >= numChildren) {
+                float empty[6];
+                EmptyBounds(empty);
+
+                for (int k = 0; k < 6; k++) node.bounds[k][i] = empty[k];
+                node.children[i] = -1;
+                node.counts[i] = -1;
+
+                continue;
+            }
+
+            const BuildNode& child = tree[children[i]];
+            for (int k = 0; k < 6; k++) node.bounds[k][i] = child.bounds[k];
+
+            if (child.count > 0) {
+                node.children[i] = groupStarts[children[i]];
+                node.counts[i] = (child.count + 3) / 4;
+            }
+            else {
+                node.children[i] = -1;
+                node.counts[i] = 0;
+
+                Collapse next;
+                next.buildNode = children[i];
+                next.parent = index;
+                next.slot = i;
+                stack.insert(stack.begin() + pushed, next);
+            }
+        }
+    }
+
+
+    // Triangles in leaf order, with empty lanes left at zero so they are never hit
+    triangles.assign(numGroups * 36, 0.0f);
+    triangleIndices.assign(numGroups * 4, -1);
+    tags.assign(numGroups * 4, -1);
+
+    pool.ParallelFor((int)leaves.size(), 1024, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const BuildNode& leaf = tree[leaves[i]];
+            int group = groupStarts[leaves[i]];
+
+            for (int j = 0; j < leaf.count; j++) {
+                int triangle = data.references[leaf.first + j];
+                const int* v = &triangleVertices[triangle * 3];
+
+                const float* p0 = &positions[v[0] * 3];
+                const float* p1 = &positions[v[1] * 3];
+                const float* p2 = &positions[v[2] * 3];
+
+                float* t = &triangles[(group + j / 4) * 36 + j % 4];
+                for (int k = 0; k < 3; k++) {
+                    t[k * 4] = p0[k];
+                    t[(k + 3) * 4] = p1[k] - p0[k];
+                    t[(k + 6) * 4] = p2[k] - p0[k];
+                }
+
+                triangleIndices[group * 4 + j] = triangle;
+                tags[group * 4 + j] = triangleTags[triangle];
+            }
+        }
+    });
+}
+
+
+void MeshBVH::Clear() {
+    nodes.clear();
+    triangles.clear();
+    triangleIndices.clear();
+    tags.clear();
+}
+
+bool MeshBVH::Empty() const {
+    return nodes.empty();
+}
+
+
+int MeshBVH::NumNodes() const {
+    return (int)nodes.size();
+}
+
+int MeshBVH::NumTriangles() const {
+    return (int)(triangleIndices.size() - std::count(triangleIndices.begin(), triangleIndices.end(), -1));
+}
+
+
+size_t MeshBVH::GetMemoryUsage() const {
+    return nodes.capacity() * sizeof(Node) +
+           triangles.capacity() * sizeof(float) +
+           triangleIndices.capacity() * sizeof(int) +
+           tags.capacity() * sizeof(int);
+}
+
+
+bool MeshBVH::Intersect(const float origin[3], const float direction[3], float maxDistance, Hit& hit) const {
+    return Traverse<false>(origin, direction, maxDistance, hit);
+}
+
+bool MeshBVH::Occluded(const float origin[3], const float direction[3], float maxDistance) const {
+    Hit hit;
+    return Traverse<true>(origin, direction, maxDistance, hit);
+}
+
+
+template <bool anyHit>
+bool MeshBVH::Traverse(const float origin[3], const float direction[3], float maxDistance, Hit& hit) const {
+    if (nodes.empty()) return false;
+
+    // Zero components are made tiny so the slabs parallel to the ray give infinities rather
+    // than undefined values.  The ray enters each box through the near side of each slab.
+    float inverse[3];
+    int nearSide[3];
+    int farSide[3];
+
+    for (int i = 0; i < 3; i++) {
+        float d = direction[i];
+        if (fabsf(d) < 1e-30f) d = d < 0.0f ? -1e-30f : 1e-30f;
+
+        inverse[i] = 1.0f / d;
+        nearSide[i] = inverse[i] < 0.0f ? i + 3 : i;
+        farSide[i] = inverse[i] < 0.0f ? i : i + 3;
+    }
+
+#ifdef MESHBVH_SSE
+    __m128 originX = _mm_set1_ps(origin[0]);
+    __m128 originY = _mm_set1_ps(origin[1]);
+    __m128 originZ = _mm_set1_ps(origin[2]);
+    __m128 inverseX = _mm_set1_ps(inverse[0]);
+    __m128 inverseY = _mm_set1_ps(inverse[1]);
+    __m128 inverseZ = _mm_set1_ps(inverse[2]);
+#endif
+
+    float dx = direction[0], dy = direction[1], dz = direction[2];
+    float closest = maxDistance;
+    int found = -1;
+    float foundU = 0.0f;
+    float foundV = 0.0f;
+
+    // Nodes and leaves still to visit, with where the ray enters them.  Each node adds at
+    // most three.
+    struct Entry {
+        int index;
+        int count;
+        float distance;
+    };
+
+    Entry stack[maxDepth * 3];
+    int stackSize = 0;
+
+    Entry current;
+    current.index = 0;
+    current.count = 0;
+    current.distance = 0.0f;
+
+    while (true) {
+        if (current.count == 0) {
+            const Node& node = nodes[current.index];
+
+            float enter[4];
+            int hits;
+
+#ifdef MESHBVH_SSE
+            __m128 nearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[nearSide[0]]), originX), inverseX);
+            __m128 nearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[nearSide[1]]), originY), inverseY);
+            __m128 nearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[nearSide[2]]), originZ), inverseZ);
+            __m128 farX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[farSide[0]]), originX), inverseX);
+            __m128 farY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[farSide[1]]), originY), inverseY);
+            __m128 farZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[farSide[2]]), originZ), inverseZ);
+
+            __m128 near = _mm_max_ps(_mm_max_ps(nearX, nearY), _mm_max_ps(nearZ, _mm_setzero_ps()));
+            __m128 far = _mm_min_ps(_mm_min_ps(farX, farY), _mm_min_ps(farZ, _mm_set1_ps(closest)));
+
+            _mm_storeu_ps(enter, near);
+            hits = _mm_movemask_ps(_mm_cmple_ps(near, far));
+#else
+            hits = 0;
+            for (int i = 0; i < 4; i++) {
+                float near = 0.0f;
+                float far = closest;
+
+                for (int k = 0; k < 3; k++) {
+                    near = std::max(near, (node.bounds[nearSide[k]][i] - origin[k]) * inverse[k]);
+                    far = std::min(far, (node.bounds[farSide[k]][i] - origin[k]) * inverse[k]);
+                }
+
+                enter[i] = near;
+                if (near <= far) hits |= 1 << i;
+            }
+#endif
+
+            // Visit the nearest child next, and save the others farthest first
+            Entry children[4];
+            int numChildren = 0;
+
+            for (int i = 0; i < 4; i++) {
+                if (!(hits & (1 << i))) continue;
+
+                Entry child;
+                child.index = node.children[i];
+                child.count = node.counts[i];
+                child.distance = enter[i];
+
+                int j = numChildren++;
+                for (; j > 0 && children[j - 1].distance < child.distance; j--) {
+                    children[j] = children[j - 1];
+                }
+                children[j] = child;
+            }
+
+            if (numChildren > 0) {
+                for (int i = 0; i < numChildren - 1; i++) {
+                    stack[stackSize++] = children[i];
+                }
+
+                current = children[numChildren - 1];
+                continue;
+            }
+        }
+        else {
+            // Moller-Trumbore, with the edges stored, for four triangles at a time
+            const float* t = &triangles[current.index * 36];
+
+            for (int g = 0; g < current.count; g++, t += 36) {
+                float distances[4];
+                float us[4];
+                float vs[4];
+                int lanes;
+
+#ifdef MESHBVH_SSE
+                __m128 directionX = _mm_set1_ps(dx);
+                __m128 directionY = _mm_set1_ps(dy);
+                __m128 directionZ = _mm_set1_ps(dz);
+
+                __m128 edge1X = _mm_loadu_ps(t + 12), edge1Y = _mm_loadu_ps(t + 16), edge1Z = _mm_loadu_ps(t + 20);
+                __m128 edge2X = _mm_loadu_ps(t + 24), edge2Y = _mm_loadu_ps(t + 28), edge2Z = _mm_loadu_ps(t + 32);
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(directionY, edge2Z), _mm_mul_ps(directionZ, edge2Y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(directionZ, edge2X), _mm_mul_ps(directionX, edge2Z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(directionX, edge2Y), _mm_mul_ps(directionY, edge2X));
+
+                __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, px), _mm_mul_ps(edge1Y, py)), _mm_mul_ps(edge1Z, pz));
+                __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+                __m128 sx = _mm_sub_ps(originX, _mm_loadu_ps(t));
+                __m128 sy = _mm_sub_ps(originY, _mm_loadu_ps(t + 4));
+                __m128 sz = _mm_sub_ps(originZ, _mm_loadu_ps(t + 8));
+
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, edge1Z), _mm_mul_ps(sz, edge1Y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, edge1X), _mm_mul_ps(sx, edge1Z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, edge1Y), _mm_mul_ps(sy, edge1X));
+
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qx), _mm_mul_ps(directionY, qy)), _mm_mul_ps(directionZ, qz)), inverseDeterminant);
+                __m128 distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qx), _mm_mul_ps(edge2Y, qy)), _mm_mul_ps(edge2Z, qz)), inverseDeterminant);
+
+                // Empty lanes and rays parallel to a triangle give undefined values, which
+                // fail every comparison
+                __m128 zero = _mm_setzero_ps();
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+                                           _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+                __m128 between = _mm_and_ps(_mm_cmpgt_ps(distance, zero), _mm_cmplt_ps(distance, _mm_set1_ps(closest)));
+
+                lanes = _mm_movemask_ps(_mm_and_ps(inside, between));
+                if (lanes == 0) continue;
+
+                _mm_storeu_ps(distances, distance);
+                _mm_storeu_ps(us, u);
+                _mm_storeu_ps(vs, v);
+#else
+                lanes = 0;
+
+                for (int i = 0; i < 4; i++) {
+                    float edge1X = t[12 + i], edge1Y = t[16 + i], edge1Z = t[20 + i];
+                    float edge2X = t[24 + i], edge2Y = t[28 + i], edge2Z = t[32 + i];
+
+                    float px = dy * edge2Z - dz * edge2Y;
+                    float py = dz * edge2X - dx * edge2Z;
+                    float pz = dx * edge2Y - dy * edge2X;
+
+                    float determinant = edge1X * px + edge1Y * py + edge1Z * pz;
+                    if (determinant == 0.0f) continue;
+
+                    float inverseDeterminant = 1.0f / determinant;
+
+                    float sx = origin[0] - t[i];
+                    float sy = origin[1] - t[4 + i];
+                    float sz = origin[2] - t[8 + i];
+
+                    float u = (sx * px + sy * py + sz * pz) * inverseDeterminant;
+
+                    float qx = sy * edge1Z - sz * edge1Y;
+                    float qy = sz * edge1X - sx * edge1Z;
+                    float qz = sx * edge1Y - sy * edge1X;
+
+                    float v = (dx * qx + dy * qy + dz * qz) * inverseDeterminant;
+                    float distance = (edge2X * qx + edge2Y * qy + edge2Z * qz) * inverseDeterminant;
+
+                    if (u < 0.0f || v < 0.0f || u + v > 1.0f || distance <= 0.0f || distance >= closest) continue;
+
+                    distances[i] = distance;
+                    us[i] = u;
+                    vs[i] = v;
+                    lanes |= 1 << i;
+                }
+
+                if (lanes == 0) continue;
+#endif
+
+                if (anyHit) return true;
+
+                for (int i = 0; i < 4; i++) {
+                    if ((lanes & (1 << i)) && distances[i] < closest) {
+                        closest = distances[i];
+                        found = (current.index + g) * 4 + i;
+                        foundU = us[i];
+                        foundV = vs[i];
+                    }
+                }
+            }
+        }
+
+        // Next node or leaf the ray still reaches before the closest hit
+        do {
+            if (stackSize == 0) {
+                if (found < 0) return false;
+
+                hit.distance = closest;
+                hit.u = foundU;
+                hit.v = foundV;
+                hit.triangle = triangleIndices[found];
+                hit.tag = tags[found];
+
+                return true;
+            }
+
+            current = stack[--stackSize];
+        } while (current.distance > closest);
+    }
+}
\ No newline at end of file
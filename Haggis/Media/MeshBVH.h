@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        MeshBVH.h
+//
+// Author:      David Borland
+//
+// Description: Bounding volume hierarchy of triangles, for picking and other ray queries
+//              without testing every triangle.  Nodes are split by the surface area
+//              heuristic, with large subtrees built in parallel, then collapsed to four
+//              children each so a ray is tested against four boxes at once.  Nodes and the
+//              triangles of each leaf are stored in flat arrays in depth first order.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+
+#include <stddef.h>
+#include <vector>
+
+
+class ThreadPool;
+
+
+class MeshBVH {
+public:
+    MeshBVH();
+
+    // Build over triangles given as three indices each into the positions, three floats per
+    // vertex.  Tags, e.g. the face each triangle is part of, are returned by queries.
+    // Triangles with no area are left out.
+    void Build(const std::vector<float>& positions, const std::vector<int>& triangleVertices,
+               const std::vector<int>& triangleTags, ThreadPool& pool);
+
+    void Clear();
+    bool Empty() const;
+
+    int NumNodes() const;
+    int NumTriangles() const;
+
+    // Bytes allocated for the arrays
+    size_t GetMemoryUsage() const;
+
+    struct Hit {
+        float distance;     // Along the ray, in multiples of its direction
+        float u;            // Barycentric coordinates of the second and third vertices
+        float v;
+        int triangle;       // Index in the triangles given to Build()
+        int tag;
+    };
+
+    // Nearest triangle hit by the ray from its origin up to maxDistance.  The direction does
+    // not need to be unit length.  Triangles are hit from either side.
+    bool Intersect(const float origin[3], const float direction[3], float maxDistance, Hit& hit) const;
+
+    // Whether the ray hits any triangle up to maxDistance, stopping at the first found, e.g.
+    // for shadows and visibility between two points
+    bool Occluded(const float origin[3], const float direction[3], float maxDistance) const;
+
+private:
+    // Two cache lines.  Each node holds the bounds of up to four children, so a ray is tested
+    // against all of them at once.  Lower bounds of the children along each axis, then upper.
+    struct alignas(64) Node {
+        float bounds[6][4];
+        int children[4];    // Child nodes, or the first triangle of a leaf
+        int counts[4];      // Groups of triangles in a leaf, 0 for a child node, or -1 for none
+    };
+
+    std::vector<Node> nodes;
+
+    // Triangles in leaf order, in groups of four tested at once.  Each group has the first 
+    // vertex and the edges to the other two, with each of the nine values for all four 
+    // triangles together.  Indices and tags are -1 past the end of a leaf.
+    std::vector<float> triangles;
+    std::vector<int> triangleIndices;
+    std::vector<int> tags;
+
+    template <bool anyHit>
+    bool Traverse(const float origin[3], const float direction[3], float maxDistance, Hit& hit) const;
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,608 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        MeshSimplifier.cpp
+//
+// Author:      David Borland
+//
+// Description: Reduces a triangle mesh by quadric error edge collapse, moving each collapsed
+//              vertex onto a neighbour so the remaining triangles still index the original
+//              vertices and their attributes.  Collapses are made in passes, each choosing the
+//              cheaper direction to collapse every edge in parallel and making the cheaper half
+//              of those collapses that do not touch each other.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "MeshSimplifier.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+
+namespace {
+    const int quadricSize = 11;
+
+    // Border edges are held by a plane through them, perpendicular to their triangle, and
+    // weighted above the surface so outlines keep their shape
+    const float borderWeight = 10.0f;
+
+    // Collapses are ordered by the sign, exponent and top mantissa bits of their costs
+    const int costBits = 12;
+
+    // Vertices per block when gathering candidate collapses
+    const int blockSize = 4096;
+
+    // Twice the area over the sum of squared edges, which is about 0.29 for an equilateral
+    // triangle, below which collapses are not made
+    const float minQuality = 1e-3f;
+
+    // Cosine of the largest turn of a triangle's normal in one collapse
+    const float minTurnCosine = 0.25f;
+
+
+    void TriangleNormal(const float* p0, const float* p1, const float* p2, float normal[3]) {
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+        normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    float Dot(const float* a, const float* b) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Add the squared distance to the plane through the point, with the unnormalized normal
+    void AddPlane(float* q, const float normal[3], const float* point, float weight) {
+        float length = sqrtf(Dot(normal, normal));
+        if (length <= 0.0f) return;
+
+        float a = normal[0] / length;
+        float b = normal[1] / length;
+        float c = normal[2] / length;
+        float d = -(a * point[0] + b * point[1] + c * point[2]);
+
+        q[0] += weight * a * a;
+        q[1] += weight * a * b;
+        q[2] += weight * a * c;
+        q[3] += weight * a * d;
+        q[4] += weight * b * b;
+        q[5] += weight * b * c;
+        q[6] += weight * b * d;
+        q[7] += weight * c * c;
+        q[8] += weight * c * d;
+        q[9] += weight * d * d;
+        q[10] += weight;
+    }
+
+    float Evaluate(const float* q, const float* p) {
+        float x = p[0];
+        float y = p[1];
+        float z = p[2];
+
+        return q[0] * x * x + 2.0f * (q[1] * x * y + q[2] * x * z + q[3] * x) +
+               q[4] * y * y + 2.0f * (q[5] * y * z + q[6] * y) +
+               q[7] * z * z + 2.0f * q[8] * z +
+               q[9];
+    }
+
+    // Non-negative floats order the same as their bits
+    int CostKey(float cost) {
+        uint32_t bits;
+        memcpy(&bits, &cost, sizeof(bits));
+
+        return (int)(bits >> (32 - costBits));
+    }
+
+    struct Candidate {
+        int from;
+        int to;
+        float cost;
+    };
+
+    bool HasVertex(const MeshSimplifier::Corner* triangle, int vertex) {
+        return triangle[0].vertex == vertex || triangle[1].vertex == vertex || triangle[2].vertex == vertex;
+    }
+}
+
+
+MeshSimplifier::MeshSimplifier() {
+    extent = 1.0;
+    maxCost = 0.0f;
+}
+
+
+void MeshSimplifier::SetMesh(const std::vector<Vec3>& vertexPositions, const std::vector<Corner>& triangleCorners,
+                             const std::vector<int>& triangleTags, ThreadPool& pool) {
+    int numVertices = (int)vertexPositions.size();
+
+    // Scale into a unit cube
+    Vec3 minimum = numVertices > 0 ? vertexPositions[0] : Vec3(0.0, 0.0, 0.0);
+    Vec3 maximum = minimum;
+    for (int i = 1; i < numVertices; i++) {
+        const Vec3& p = vertexPositions[i];
+
+        minimum.Set(std::min(minimum.X(), p.X()), std::min(minimum.Y(), p.Y()), std::min(minimum.Z(), p.Z()));
+        maximum.Set(std::max(maximum.X(), p.X()), std::max(maximum.Y(), p.Y()), std::max(maximum.Z(), p.Z()));
+    }
+
+    Vec3 size = maximum - minimum;
+    extent = std::max(size.X(), std::max(size.Y(), size.Z()));
+    if (extent <= 0.0) extent = 1.0;
+
+    positions.resize(numVertices * 3);
+    for (int i = 0; i < numVertices; i++) {
+        Vec3 p = (vertexPositions[i] - minimum) * (1.0 / extent);
+
+        positions[i * 3 + 0] = (float)p.X();
+        positions[i * 3 + 1] = (float)p.Y();
+        positions[i * 3 + 2] = (float)p.Z();
+    }
+
+    // Leave out degenerate triangles
+    corners.clear();
+    tags.clear();
+
+    int numTriangles = (int)triangleCorners.size() / 3;
+    for (int i = 0; i < numTriangles; i++) {
+        const Corner* c = &triangleCorners[i * 3];
+
+        bool valid = true;
+        for (int j = 0; j < 3; j++) {
+            if (c[j].vertex < 0 || c[j].vertex >= numVertices) valid = false;
+        }
+
+        if (!valid || c[0].vertex == c[1].vertex || c[1].vertex == c[2].vertex || c[2].vertex == c[0].vertex) continue;
+
+        corners.insert(corners.end(), c, c + 3);
+        tags.push_back(triangleTags[i]);
+    }
+
+    maxCost = 0.0f;
+
+    BuildAdjacency();
+
+    // Quadrics from the triangles around each vertex, and whether it can move
+    quadrics.assign(numVertices * quadricSize, 0.0f);
+    kinds.assign(numVertices, Locked);
+
+    pool.ParallelFor(numVertices, 1024, [this](int begin, int end) {
+        std::vector<int> neighbours;
+
+        for (int v = begin; v < end; v++) {
+            const int* triangles = vertexTriangles.data() + triangleStarts[v];
+            int numTriangles = triangleStarts[v + 1] - triangleStarts[v];
+            if (numTriangles == 0) continue;
+
+            float* q = &quadrics[v * quadricSize];
+            const float* p = &positions[v * 3];
+
+            Corner first = { -1, -1, -1 };
+            int firstTag = tags[triangles[0]];
+            bool sameAttributes = true;
+
+            neighbours.clear();
+
+            for (int i = 0; i < numTriangles; i++) {
+                const Corner* c = &corners[triangles[i] * 3];
+
+                // Weighted by area
+                float normal[3];
+                TriangleNormal(&positions[c[0].vertex * 3], &positions[c[1].vertex * 3], &positions[c[2].vertex * 3], normal);
+                AddPlane(q, normal, p, sqrtf(Dot(normal, normal)) * 0.5f);
+
+                for (int j = 0; j < 3; j++) {
+                    if (c[j].vertex != v) {
+                        neighbours.push_back(c[j].vertex);
+                    }
+                    else if (first.vertex < 0) {
+                        first = c[j];
+                    }
+                    else if (c[j].textureCoord != first.textureCoord || c[j].normal != first.normal) {
+                        sameAttributes = false;
+                    }
+                }
+
+                if (tags[triangles[i]] != firstTag) sameAttributes = false;
+            }
+
+            // Edges of one triangle are on a border, and of more than two are non-manifold
+            std::sort(neighbours.begin(), neighbours.end());
+
+            int numBorderEdges = 0;
+            bool manifold = true;
+
+            for (int i = 0; i < (int)neighbours.size();) {
+                int u = neighbours[i];
+
+                int count = 1;
+                while (i + count < (int)neighbours.size() && neighbours[i + count] == u) count++;
+                i += count;
+
+                if (count > 2) {
+                    manifold = false;
+                }
+                else if (count == 1) {
+                    numBorderEdges++;
+
+                    for (int j = 0; j < numTriangles; j++) {
+                        const Corner* c = &corners[triangles[j] * 3];
+                        if (!HasVertex(c, u)) continue;
+
+                        float normal[3];
+                        TriangleNormal(&positions[c[0].vertex * 3], &positions[c[1].vertex * 3], &positions[c[2].vertex * 3], normal);
+
+                        const float* pu = &positions[u * 3];
+                        float edge[3] = { pu[0] - p[0], pu[1] - p[1], pu[2] - p[2] };
+
+                        float perpendicular[3] = { edge[1] * normal[2] - edge[2] * normal[1],
+                                                   edge[2] * normal[0] - edge[0] * normal[2],
+                                                   edge[0] * normal[1] - edge[1] * normal[0] };
+
+                        AddPlane(q, perpendicular, p, Dot(edge, edge) * borderWeight);
+
+                        break;
+                    }
+                }
+            }
+
+            if (!sameAttributes || !manifold) kinds[v] = Locked;
+            else if (numBorderEdges == 0) kinds[v] = Interior;
+            else if (numBorderEdges == 2) kinds[v] = Border;
+            else kinds[v] = Locked;
+        }
+    });
+}
+
+
+void MeshSimplifier::Simplify(int targetTriangles, ThreadPool& pool) {
+    int numVertices = (int)kinds.size();
+
+    // Vertices are split into blocks whose candidates are gathered in parallel
+    int numBlocks = (numVertices + blockSize - 1) / blockSize;
+    std::vector<std::vector<Candidate> > blockCandidates(numBlocks);
+
+    std::vector<Candidate> candidates;
+    std::vector<int> counts;
+    std::vector<int> order;
+    std::vector<unsigned char> touched;
+
+    int numTriangles = NumTriangles();
+
+    while (numTriangles > targetTriangles) {
+        BuildAdjacency();
+
+        // Each edge collapses in whichever direction is allowed and cheaper.  Border vertices
+        // only move along the border.
+        pool.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+            std::vector<int> neighbours;
+
+            for (int block = begin; block < end; block++) {
+                std::vector<Candidate>& blockList = blockCandidates[block];
+                blockList.clear();
+
+                int last = std::min((block + 1) * blockSize, numVertices);
+                for (int v = block * blockSize; v < last; v++) {
+                    // Neighbours once for each triangle on the edge to them
+                    neighbours.clear();
+                    for (int i = triangleStarts[v]; i < triangleStarts[v + 1]; i++) {
+                        const Corner* c = &corners[vertexTriangles[i] * 3];
+
+                        for (int j = 0; j < 3; j++) {
+                            if (c[j].vertex != v) neighbours.push_back(c[j].vertex);
+                        }
+                    }
+
+                    std::sort(neighbours.begin(), neighbours.end());
+
+                    for (int i = 0; i < (int)neighbours.size();) {
+                        int u = neighbours[i];
+
+                        int count = 1;
+                        while (i + count < (int)neighbours.size() && neighbours[i + count] == u) count++;
+                        i += count;
+
+                        // Each edge from its lower vertex
+                        if (u < v) continue;
+
+                        bool border = count == 1;
+                        bool fromV = kinds[v] == Interior || (kinds[v] == Border && border);
+                        bool fromU = kinds[u] == Interior || (kinds[u] == Border && border);
+
+                        Candidate candidate = { -1, -1, FLT_MAX };
+
+                        if (fromV) {
+                            candidate.from = v;
+                            candidate.to = u;
+                            candidate.cost = Cost(v, u);
+                        }
+
+                        if (fromU) {
+                            float cost = Cost(u, v);
+                            if (cost < candidate.cost) {
+                                candidate.from = u;
+                                candidate.to = v;
+                                candidate.cost = cost;
+                            }
+                        }
+
+                        if (candidate.from >= 0) blockList.push_back(candidate);
+                    }
+                }
+            }
+        });
+
+        candidates.clear();
+        for (int i = 0; i < numBlocks; i++) {
+            candidates.insert(candidates.end(), blockCandidates[i].begin(), blockCandidates[i].end());
+        }
+
+        int numCandidates = (int)candidates.size();
+        if (numCandidates == 0) break;
+
+        // Order by cost, approximately
+        counts.assign((1 << costBits) + 1, 0);
+        for (int i = 0; i < numCandidates; i++) {
+            counts[CostKey(candidates[i].cost) + 1]++;
+        }
+
+        for (int i = 1; i < (int)counts.size(); i++) {
+            counts[i] += counts[i - 1];
+        }
+
+        order.resize(numCandidates);
+        for (int i = 0; i < numCandidates; i++) {
+            order[counts[CostKey(candidates[i].cost)]++] = i;
+        }
+
+        // Collapses change the costs around them, so only make the cheaper half, trying the
+        // rest only if none of those are valid
+        touched.assign(numVertices, 0);
+
+        int limit = (numCandidates + 1) / 2;
+        int numCollapsed = 0;
+
+        for (int i = 0; i < numCandidates && numTriangles > targetTriangles; i++) {
+            if (i == limit) {
+                if (numCollapsed > 0) break;
+                limit = numCandidates;
+            }
+
+            const Candidate& candidate = candidates[order[i]];
+
+            if (touched[candidate.from] || touched[candidate.to]) continue;
+
+            int removed = Collapse(candidate.from, candidate.to, touched);
+            if (removed > 0) {
+                numTriangles -= removed;
+                numCollapsed++;
+
+                maxCost = std::max(maxCost, candidate.cost);
+            }
+        }
+
+        if (numCollapsed == 0) break;
+
+        // Drop the collapsed triangles
+        int count = 0;
+        for (int i = 0; i < (int)tags.size(); i++) {
+            if (corners[i * 3].vertex < 0) continue;
+
+            corners[count * 3 + 0] = corners[i * 3 + 0];
+            corners[count * 3 + 1] = corners[i * 3 + 1];
+            corners[count * 3 + 2] = corners[i * 3 + 2];
+            tags[count] = tags[i];
+
+            count++;
+        }
+
+        corners.resize(count * 3);
+        tags.resize(count);
+    }
+}
+
+
+int MeshSimplifier::NumTriangles() const {
+    return (int)tags.size();
+}
+
+double MeshSimplifier::GetError() const {
+    return sqrt((double)maxCost) * extent;
+}
+
+
+const std::vector<MeshSimplifier::Corner>& MeshSimplifier::GetCorners() const {
+    return corners;
+}
+
+const std::vector<int>& MeshSimplifier::GetTags() const {
+    return tags;
+}
+
+
+void MeshSimplifier::BuildAdjacency() {
+    int numVertices = (int)positions.size() / 3;
+
+    triangleStarts.assign(numVertices + 1, 0);
+    for (int i = 0; i < (int)corners.size(); i++) {
+        triangleStarts[corners[i].vertex + 1]++;
+    }
+
+    for (int i = 0; i < numVertices; i++) {
+        triangleStarts[i + 1] += triangleStarts[i];
+    }
+
+    // Fill using the starts, then shift them back
+    vertexTriangles.resize(corners.size());
+    for (int i = 0; i < (int)corners.size(); i++) {
+        vertexTriangles[triangleStarts[corners[i].vertex]++] = i / 3;
+    }
+
+    for (int i = numVertices; i > 0; i--) {
+        triangleStarts[i] = triangleStarts[i - 1];
+    }
+    triangleStarts[0] = 0;
+}
+
+
+float MeshSimplifier::Cost(int from, int to) const {
+    const float* qFrom = &quadrics[from * quadricSize];
+    const float* qTo = &quadrics[to * quadricSize];
+    const float* p = &positions[to * 3];
+
+    float weight = qFrom[10] + qTo[10];
+    if (weight <= 0.0f) return 0.0f;
+
+    float cost = (Evaluate(qFrom, p) + Evaluate(qTo, p)) / weight;
+
+    return cost > 0.0f ? cost : 0.0f;
+}
+
+
+int MeshSimplifier::Collapse(int from, int to, std::vector<unsigned char>& touched) {
+    const int* triangles = vertexTriangles.data() + triangleStarts[from];
+    int numTriangles = triangleStarts[from + 1] - triangleStarts[from];
+
+    // Triangles on the edge, which must agree on the attributes at the corner moved onto
+    Corner target = { to, -1, -1 };
+    int numShared = 0;
+
+    for (int i = 0; i < numTriangles; i++) {
+        const Corner* c = &corners[triangles[i] * 3];
+
+        for (int j = 0; j < 3; j++) {
+            if (c[j].vertex != to) continue;
+
+            if (numShared == 0) {
+                target = c[j];
+            }
+            else if (c[j].textureCoord != target.textureCoord || c[j].normal != target.normal) {
+                return 0;
+            }
+
+            numShared++;
+        }
+    }
+
+    if (numShared != (kinds[from] == Border ? 1 : 2)) return 0;
+
+    // Link condition: the only vertices next to both are those opposite the edge
+    GetRing(from, ring);
+    GetRing(to, otherRing);
+
+    int numCommon = 0;
+    for (int i = 0, j = 0; i < (int)ring.size() && j < (int)otherRing.size();) {
+        if (ring[i] < otherRing[j]) {
+            i++;
+        }
+        else if (otherRing[j] < ring[i]) {
+            j++;
+        }
+        else {
+            if (ring[i] != from && ring[i] != to) numCommon++;
+            i++;
+            j++;
+        }
+    }
+
+    if (numCommon != numShared) return 0;
+
+    // The triangles moved must not fold or turn sharply, or duplicate a triangle already
+    // there, as when collapsing a tetrahedron
+    const float* p = &positions[to * 3];
+    const int* toTriangles = vertexTriangles.data() + triangleStarts[to];
+    int numToTriangles = triangleStarts[to + 1] - triangleStarts[to];
+
+    for (int i = 0; i < numTriangles; i++) {
+        const Corner* c = &corners[triangles[i] * 3];
+        if (HasVertex(c, to)) continue;
+
+        const float* before[3];
+        const float* after[3];
+        int others[2];
+        int numOthers = 0;
+
+        for (int j = 0; j < 3; j++) {
+            before[j] = &positions[c[j].vertex * 3];
+            after[j] = c[j].vertex == from ? p : before[j];
+
+            if (c[j].vertex != from) others[numOthers++] = c[j].vertex;
+        }
+
+        float normalBefore[3];
+        float normalAfter[3];
+        TriangleNormal(before[0], before[1], before[2], normalBefore);
+        TriangleNormal(after[0], after[1], after[2], normalAfter);
+
+        float lengths = sqrtf(Dot(normalBefore, normalBefore) * Dot(normalAfter, normalAfter));
+        if (Dot(normalBefore, normalAfter) <= minTurnCosine * lengths) return 0;
+
+        // Nor become slivers, e.g. three vertices along a border
+        float edges = 0.0f;
+        for (int j = 0; j < 3; j++) {
+            const float* a = after[j];
+            const float* b = after[(j + 1) % 3];
+            float edge[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+
+            edges += Dot(edge, edge);
+        }
+
+        if (sqrtf(Dot(normalAfter, normalAfter)) <= minQuality * edges) return 0;
+
+        for (int j = 0; j < numToTriangles; j++) {
+            const Corner* other = &corners[toTriangles[j] * 3];
+            if (HasVertex(other, others[0]) && HasVertex(other, others[1])) return 0;
+        }
+    }
+
+    // Remove the triangles on the edge and move the rest
+    for (int i = 0; i < numTriangles; i++) {
+        Corner* c = &corners[triangles[i] * 3];
+
+        if (HasVertex(c, to)) {
+            c[0].vertex = c[1].vertex = c[2].vertex = -1;
+        }
+        else {
+            for (int j = 0; j < 3; j++) {
+                if (c[j].vertex == from) c[j] = target;
+            }
+        }
+    }
+
+    const float* qFrom = &quadrics[from * quadricSize];
+    float* qTo = &quadrics[to * quadricSize];
+    for (int i = 0; i < quadricSize; i++) {
+        qTo[i] += qFrom[i];
+    }
+
+    // Triangles around these have changed, so their adjacency is out of date until the next pass
+    touched[from] = 1;
+    touched[to] = 1;
+    for (int i = 0; i < (int)ring.size(); i++) {
+        touched[ring[i]] = 1;
+    }
+
+    return numShared;
+}
+
+
+void MeshSimplifier::GetRing(int vertex, std::vector<int>& vertices) const {
+    vertices.clear();
+
+    for (int i = triangleStarts[vertex]; i < triangleStarts[vertex + 1]; i++) {
+        const Corner* c = &corners[vertexTriangles[i] * 3];
+
+        for (int j = 0; j < 3; j++) {
+            if (c[j].vertex != vertex) vertices.push_back(c[j].vertex);
+        }
+    }
+
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        MeshSimplifier.h
+//
+// Author:      David Borland
+//
+// Description: Reduces a triangle mesh by quadric error edge collapse, moving each collapsed
+//              vertex onto a neighbour so the remaining triangles still index the original
+//              vertices and their attributes.  Collapses are made in passes, each choosing the
+//              cheaper direction to collapse every edge in parallel and making the cheaper half
+//              of those collapses that do not touch each other.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+
+#include "Vec3.h"
+
+#include <vector>
+
+
+class ThreadPool;
+
+
+class MeshSimplifier {
+public:
+    MeshSimplifier();
+
+    // A triangle corner, indexing a model's positions, texture coordinates and normals.
+    // Texture coordinates and normals can be -1 for none.
+    struct Corner {
+        int vertex;
+        int textureCoord;
+        int normal;
+    };
+
+    // Three corners and a tag, e.g. a material, per triangle.  Degenerate triangles are left
+    // out.  Vertices where corners differ in texture coordinate, normal or tag, on more than
+    // one border, or on an edge of more than two triangles are never moved, so seams,
+    // material boundaries and non-manifold parts keep their shape.
+    void SetMesh(const std::vector<Vec3>& positions, const std::vector<Corner>& triangleCorners,
+                 const std::vector<int>& triangleTags, ThreadPool& pool);
+
+    // Collapse edges, cheapest first, until no more than targetTriangles are left or no edge
+    // can be collapsed without folding triangles over or changing the topology.  Each call
+    // carries on from the last, for a chain of coarser meshes.
+    void Simplify(int targetTriangles, ThreadPool& pool);
+
+    int NumTriangles() const;
+
+    // Root mean square distance to the original surface around the worst collapse so far
+    double GetError() const;
+
+    // The triangles left, as for SetMesh()
+    const std::vector<Corner>& GetCorners() const;
+    const std::vector<int>& GetTags() const;
+
+private:
+    enum Kind {
+        Interior,       // Can collapse onto any neighbour
+        Border,         // Only collapses along a border edge
+        Locked          // Never moves
+    };
+
+    // Positions scaled into a unit cube for float precision, three per vertex
+    std::vector<float> positions;
+    double extent;
+
+    // Per vertex, the sum of squared distances to weighted planes as the upper triangle of a
+    // symmetric 4x4 matrix, then the total weight of the planes
+    std::vector<float> quadrics;
+    std::vector<unsigned char> kinds;
+
+    std::vector<Corner> corners;
+    std::vector<int> tags;
+
+    // Largest cost of any collapse made
+    float maxCost;
+
+    // Triangles around each vertex in compressed sparse row form, rebuilt each pass
+    std::vector<int> triangleStarts;
+    std::vector<int> vertexTriangles;
+
+    // Scratch space for collapsing
+    std::vector<int> ring;
+    std::vector<int> otherRing;
+
+    void BuildAdjacency();
+
+    float Cost(int from, int to) const;
+
+    // Check the collapse and make it if valid, marking the vertices it changes as touched.
+    // Returns the number of triangles removed, or 0 if not valid.
+    int Collapse(int from, int to, std::vector<unsigned char>& touched);
+
+    void GetRing(int vertex, std::vector<int>& vertices) const;
+};
+
+
+#endif
\ No newline at end of file
@@ -11,13 +11,41 @@
 
 #include "OBJObject.h"
 
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
 #include "Utilities.h"
 
-#include <IL/il.h>
-#include <IL/ilu.h>
-
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <float.h>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unordered_map>
+
+// Locale independent number parsing, where the standard library has it for floating point
+#if (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#if defined(__cpp_lib_to_chars)
+#define OBJOBJECT_FROM_CHARS
+#endif
+#endif
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OBJOBJECT_SSE
+#include <xmmintrin.h>
+#endif
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -43,12 +71,11 @@ Material::Material(const std::string& materialName) : name(materialName) {
 
     doSpecular = false;
 
-    hasTexture = false;
     textureScale.Set(1.0, 1.0, 1.0);
+    textureReady = false;
 }
 
 Material::~Material() {
-    glDeleteTextures(1, &texture); 
 }
 
 
@@ -87,73 +114,27 @@ void Material::SetDoSpecular(bool flag) {
 
 
 bool Material::LoadTexture(const std::string& fileName) {
-    ILuint image;
-    ilGenImages(1, &image);
-    ilBindImage(image);
-
-    if (!ilLoadImage(fileName.c_str())) {
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) {
         std::cout << "Material::LoadTexture() : Loading " << fileName.c_str() << " failed" << std::endl;
-
-        ilDeleteImages(1, &image);
-
-        return false;
-    }
-
-
-    // Get image info
-    int width = ilGetInteger(IL_IMAGE_WIDTH);
-    int height = ilGetInteger(IL_IMAGE_HEIGHT);
-    int ilPixelFormat = ilGetInteger(IL_IMAGE_FORMAT);
-
-
-    // Check the pixel format
-    if (ilPixelFormat == IL_LUMINANCE) {
-        ilConvertImage(IL_LUMINANCE, IL_UNSIGNED_BYTE);
-    }
-    else if (ilPixelFormat == IL_RGB) {
-        ilConvertImage(IL_RGB, IL_UNSIGNED_BYTE);
-
-        // Looks like non-alpha images are flipped in y?
-        iluFlipImage();
-    }
-    else if (ilPixelFormat == IL_RGBA) {
-        ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
-    }
-    else {
-        // Something ain't right...
-        std::cout << "Material::LoadTexture() : Invalid number of components" << std::endl;
-
-        ilDeleteImages(1, &image);   
-
         return false;
     }
 
+    texture = TextureCache::GetShared().Load(fileName);
+    textureReady = false;
 
-    // Create the texture
-    glGenTextures(1, &texture);    
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    return true;
+}
 
-    // Create the texture
-    if (ilPixelFormat == IL_LUMINANCE) {
-        gluBuild2DMipmaps(GL_TEXTURE_2D, GL_LUMINANCE, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, ilGetData());
-    }   
-    else if (ilPixelFormat == IL_RGB) {
-        gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, ilGetData());
-    }
-    else if (ilPixelFormat == IL_RGBA) {
-        gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, width, height, GL_RGBA, GL_UNSIGNED_BYTE, ilGetData());
-    }
+bool Material::UpdateTexture() {
+    if (!texture || textureReady) return false;
 
-    ilDeleteImages(1, &image);
+    // The texture may be shared, so only the first material to update it creates it
+    texture->Update();
 
-    hasTexture = true;
+    textureReady = texture->Ready();
 
-    return true;
+    return textureReady;
 }
 
 
@@ -180,9 +161,9 @@ void Material::SetupRender() {
         glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, black);
     }
 
-    if (hasTexture) {
+    if (texture && texture->Ready()) {
         glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindTexture(GL_TEXTURE_2D, texture->GetTexture());
     }
     else {
         glDisable(GL_TEXTURE_2D);
@@ -201,60 +182,59 @@ const Vec3& Material::GetTextureScale() {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 
-Face::Face() {
-    normal = Vec3(0.0, 1.0, 0.0);
-}
-
-Face::~Face() {
+FaceList::FaceList() {
+    Clear();
 }
 
 
-void Face::SetNormal(const Vec3& norm) {
-    normal = norm;
+int FaceList::NumFaces() const {
+    return (int)vertexStarts.size() - 1;
 }
 
-const Vec3& Face::GetNormal() {
-    return normal;
-}
 
+void FaceList::AddFace() {
+    normals.push_back(0.0f);
+    normals.push_back(1.0f);
+    normals.push_back(0.0f);
 
-int Face::NumVertices() {
-    return (int)vertexIndeces.size();
+    vertexStarts.push_back(vertexStarts.back());
+    textureCoordStarts.push_back(textureCoordStarts.back());
+    vertexNormalStarts.push_back(vertexNormalStarts.back());
 }
 
-int Face::GetVertexIndex(int i) {
-    return vertexIndeces[i];
+void FaceList::AddVertexIndex(int index) {
+    vertexIndices.push_back(index);
+    vertexStarts.back()++;
 }
 
-
-int Face::NumTextureCoords() {
-    return (int)textureCoordIndeces.size();
+void FaceList::AddTextureCoordIndex(int index) {
+    textureCoordIndices.push_back(index);
+    textureCoordStarts.back()++;
 }
 
-int Face::GetTextureCoordIndex(int i) {
-    return textureCoordIndeces[i];
+void FaceList::AddVertexNormalIndex(int index) {
+    vertexNormalIndices.push_back(index);
+    vertexNormalStarts.back()++;
 }
 
 
-int Face::NumVertexNormals() {
-    return (int)vertexNormalIndeces.size();
-}
-
-int Face::GetVertexNormalIndex(int i) {
-    return vertexNormalIndeces[i];
-}
+void FaceList::Clear() {
+    normals.clear();
 
+    vertexStarts.assign(1, 0);
+    textureCoordStarts.assign(1, 0);
+    vertexNormalStarts.assign(1, 0);
 
-void Face::AddVertexIndex(int index) {
-    vertexIndeces.push_back(index);
+    vertexIndices.clear();
+    textureCoordIndices.clear();
+    vertexNormalIndices.clear();
 }
 
-void Face::AddTextureCoordIndex(int index) {
-    textureCoordIndeces.push_back(index);
-}
 
-void Face::AddVertexNormalIndex(int index) {
-    vertexNormalIndeces.push_back(index);
+size_t FaceList::GetMemoryUsage() const {
+    return normals.capacity() * sizeof(float) +
+           (vertexStarts.capacity() + textureCoordStarts.capacity() + vertexNormalStarts.capacity() +
+            vertexIndices.capacity() + textureCoordIndices.capacity() + vertexNormalIndices.capacity()) * sizeof(int);
 }
 
 
@@ -262,6 +242,10 @@ void Face::AddVertexNormalIndex(int index) {
 
 
 SubGroup::SubGroup() {
+    faces = NULL;
+    firstFace = 0;
+    numFaces = 0;
+
     material = NULL;
 }
 
@@ -270,17 +254,22 @@ SubGroup::~SubGroup() {
 
 
 int SubGroup::NumFaces() {
-    return (int)faces.size();
+    return numFaces;
 }
 
-Face* SubGroup::GetFace(int i) {
-    return faces[i];
+Face SubGroup::GetFace(int i) {
+    return Face(faces, firstFace + i);
 }
 
 
-Face* SubGroup::AddFace() {
-    faces.push_back(new Face());
-    return faces.back();
+void SubGroup::SetFaces(FaceList* faceList, int first, int count) {
+    faces = faceList;
+    firstFace = first;
+    numFaces = count;
+}
+
+int SubGroup::GetFirstFace() {
+    return firstFace;
 }
 
 
@@ -336,908 +325,2949 @@ SubGroup* Group::AddSubGroup() {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 
-bool DepthGreaterThan(const FaceDepth& face1, const FaceDepth& face2) {
-    return face1.depth > face2.depth;
-}
+namespace {
+    // A token in a mapped file
+    struct Token {
+        const char* begin;
+        const char* end;
 
+        bool operator==(const char* s) const {
+            size_t length = strlen(s);
+            return (size_t)(end - begin) == length && memcmp(begin, s, length) == 0;
+        }
 
-///////////////////////////////////////////////////////////////////////////////////////////////
+        bool operator==(const std::string& s) const {
+            return (size_t)(end - begin) == s.size() && memcmp(begin, s.data(), s.size()) == 0;
+        }
 
+        std::string ToString() const {
+            return std::string(begin, end);
+        }
+    };
 
-bool OBJObject::initializedDevIL = false;
+    // Split on a delimiter, skipping empty tokens, as Utilities::Tokenize() does
+    void Tokenize(const char* begin, const char* end, char delimiter, std::vector<Token>& tokens) {
+        tokens.clear();
 
+        const char* p = begin;
+        while (p < end) {
+            while (p < end && *p == delimiter) p++;
+            if (p == end) break;
 
-OBJObject::OBJObject() : RenderObject() {
-    currentGroup = NULL;
-	currentSubGroup = NULL;
-    currentMaterial = NULL;
+            Token token;
+            token.begin = p;
+            while (p < end && *p != delimiter) p++;
+            token.end = p;
 
-    smoothShading = true;
-    wireFrame = false;
-    immediateMode = false;
-    cullFace = true;
+            tokens.push_back(token);
+        }
+    }
 
-    displayListCurrent = false;
+    // Split a face vertex on forward slashes, skipping empty fields.  Returns the number of 
+    // fields, storing the first three.
+    int SplitFaceVertex(const Token& token, Token* fields) {
+        int count = 0;
 
-    depthSort = false;
-}
+        const char* p = token.begin;
+        while (p < token.end) {
+            while (p < token.end && *p == '/') p++;
+            if (p == token.end) break;
 
-OBJObject::~OBJObject() {
-    for (int i = 0; i < (int)groups.size(); i++) {
-        delete groups[i];
-    }
+            const char* start = p;
+            while (p < token.end && *p != '/') p++;
 
-    for (int i = 0; i < (int)materials.size(); i++) {
-        delete materials[i];
+            if (count < 3) {
+                fields[count].begin = start;
+                fields[count].end = p;
+            }
+            count++;
+        }
+
+        return count;
     }
 
-    glDeleteLists(displayList, 1);
-}
+    // Parse numbers as atof() and atoi() would, without needing terminated strings
+    double ParseDouble(const Token& token) {
+        const char* begin = token.begin;
+        const char* end = token.end;
 
+        // Tabs and carriage returns are not token delimiters
+        while (begin < end && isspace((unsigned char)*begin)) begin++;
 
-bool OBJObject::LoadObject(const std::string& fileName) {
-    if (!initializedDevIL) {       
-       ilInit();
-       initializedDevIL = true;
-    }
+#ifdef OBJOBJECT_FROM_CHARS
+        const char* number = begin;
+        if (number < end && *number == '+' && number + 1 < end && number[1] != '-') number++;
 
+        double value = 0.0;
+        std::from_chars_result result = std::from_chars(number, end, value);
 
-	std::ifstream file(fileName.c_str());
-    if (file.fail()) {
-        std::cout << "OBJObject::LoadObject() : Couldn't open " << fileName.c_str() << std::endl;
-        return false;
+        if (result.ec == std::errc::invalid_argument) return 0.0;
+
+        // Leave hexadecimal and out of range values to strtod()
+        if (result.ec == std::errc() && 
+            (result.ptr == end || (*result.ptr != 'x' && *result.ptr != 'X'))) {
+            return value;
+        }
+#endif
+
+        char buffer[64];
+        size_t length = end - begin;
+        if (length >= sizeof(buffer)) return atof(std::string(begin, end).c_str());
+
+        memcpy(buffer, begin, length);
+        buffer[length] = '\0';
+
+        return strtod(buffer, NULL);
     }
 
-    std::cout << "OBJObject::LoadObject() : Loading " << fileName.c_str() << std::endl;
+    int ParseInt(const Token& token) {
+        const char* p = token.begin;
+        const char* end = token.end;
 
-    std::string mtlFileName;
+        while (p < end && isspace((unsigned char)*p)) p++;
 
-	std::string s;
-    std::vector<std::string> tokens;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
 
-    int numFaces = 0;
+        unsigned int value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
 
-	while (!file.eof()) {
-        getline(file, s);
-        tokens = Utilities::Tokenize(s, " \n");
+        return negative ? -(int)value : (int)value;
+    }
 
-        if (tokens.size() > 0) {
-		    if (tokens[0] == "#") {
-			    // Comment
-		    }
-		    else if (tokens[0] == "mtllib") {
-			    // Material library
-                mtlFileName = ResolveFileName(fileName, tokens[1]);
+    // Parsed contents of a newline aligned part of a file.  Chunks are parsed independently,
+    // so anything depending on earlier chunks is recorded to be applied in order.
+    struct OBJChunk {
+        const char* begin;
+        const char* end;
+
+        std::vector<Vec3> verts;
+        std::vector<Vec3> textureCoords;
+        std::vector<Vec3> vertexNormals;
+
+        // Relative indices are counted from the start of the chunk, and listed to be offset
+        // once the counts in earlier chunks are known
+        FaceList faces;
+
+        std::vector<int> relativeVertexIndices;
+        std::vector<int> relativeTextureCoordIndices;
+        std::vector<int> relativeVertexNormalIndices;
+
+        // Groups, materials, messages and runs of faces, in file order
+        struct Command {
+            enum Type {
+                Group,
+                UseMaterial,
+                MaterialLibrary,
+                Message,
+                Faces
+            };
+
+            Type type;
+            std::string text;
+            std::string line;
+            int numFaces;
+        };
+
+        std::vector<Command> commands;
+
+        void AddCommand(Command::Type type, const std::string& text = "", const char* lineStart = NULL, const char* lineEnd = NULL) {
+            Command command;
+            command.type = type;
+            command.text = text;
+            if (lineStart) command.line.assign(lineStart, lineEnd);
+            command.numFaces = 0;
+
+            commands.push_back(command);
+        }
 
-                if (!ParseMtl(mtlFileName)) {
-                    std::cout << "OBJObject::LoadObject() : Error loading " << tokens[1] << std::endl;
-                }
-		    }
-            else if (tokens[0] == "g") {
-                // Group               
-                if (tokens.size() == 1) {
-                    AddGroup("");
-                }
-                else if (tokens.size() == 2) {
-                    AddGroup(tokens[1]);
-                }
-                else {
-                    std::cout << "OBJObject::LoadObject() : Invalid group " << s << std::endl;
-                }
+        void AddMessage(const std::string& message, const char* lineStart, const char* lineEnd) {
+            AddCommand(Command::Message, message + std::string(lineStart, lineEnd));
+        }
+
+        void AddFace() {
+            if (commands.empty() || commands.back().type != Command::Faces) AddCommand(Command::Faces);
+            commands.back().numFaces++;
+
+            faces.AddFace();
+        }
+
+        // Resolve an index as if all the chunks before were empty
+        void AddIndex(int index, int count, std::vector<int>& indices, std::vector<int>& starts, std::vector<int>& relative) {
+            if (index < 1) {
+                relative.push_back((int)indices.size());
+                index += count;
             }
-            else if (tokens[0] == "v") {
-                if (tokens.size() == 4) {
-                    AddVertex(Vec3(atof(tokens[1].c_str()), 
-                                   atof(tokens[2].c_str()),
-                                   atof(tokens[3].c_str())));
-                }
-                else {
-                    std::cout << "OBJObject::LoadObject() : Invalid vertex : " << s << std::endl;
-                }
-            }           
-            else if (tokens[0] == "vt") {
-                if (tokens.size() == 3) {
-                    AddTextureCoord(Vec3(atof(tokens[1].c_str()), 
-                                           atof(tokens[2].c_str()),
-                                           0.0));
-                }
-                else if (tokens.size() == 4) {
-                    AddTextureCoord(Vec3(atof(tokens[1].c_str()), 
-                                           atof(tokens[2].c_str()),
-                                           atof(tokens[3].c_str())));
-                }
-                else {
-                    std::cout << "OBJObject::LoadObject() : Invalid texture vertex : " << s << std::endl;
-                }
-            }   
-            else if (tokens[0] == "vn") {
-                if (tokens.size() == 4) {
-                    AddVertexNormal(Vec3(atof(tokens[1].c_str()), 
-                                         atof(tokens[2].c_str()),
-                                         atof(tokens[3].c_str())));
-                }
-                else {
-                    std::cout << "OBJObject::LoadObject() : Invalid vertex normal : " << s << std::endl;
-                }
+            else {
+                index--;
             }
-            else if (tokens[0] == "usemtl") {
-                if (tokens.size() == 2) {
-                    std::string materialName = tokens[1];
-                    bool found = false;
-                    for (int i = 0; i < (int)materials.size(); i++) {
-                        if (materials[i]->GetName() == materialName) {
-                            if (!currentGroup) {
-                                AddGroup("default");
-                            }
-                            currentSubGroup = currentGroup->AddSubGroup();
-                            currentSubGroup->SetMaterial(materials[i]);
-                            found = true;
-                            break;
-                        }
+
+            indices.push_back(index);
+            starts.back()++;
+        }
+
+        void AddVertexIndex(int index) {
+            AddIndex(index, (int)verts.size(), faces.vertexIndices, faces.vertexStarts, relativeVertexIndices);
+        }
+
+        void AddTextureCoordIndex(int index) {
+            AddIndex(index, (int)textureCoords.size(), faces.textureCoordIndices, faces.textureCoordStarts, relativeTextureCoordIndices);
+        }
+
+        void AddVertexNormalIndex(int index) {
+            AddIndex(index, (int)vertexNormals.size(), faces.vertexNormalIndices, faces.vertexNormalStarts, relativeVertexNormalIndices);
+        }
+    };
+
+    void ParseChunk(OBJChunk& chunk) {
+        std::vector<Token> tokens;
+        Token vertexTokens[3];
+
+	    for (const char* lineStart = chunk.begin; lineStart <= chunk.end; ) {
+            const char* lineEnd = lineStart < chunk.end ? (const char*)memchr(lineStart, '\n', chunk.end - lineStart) : NULL;
+            if (!lineEnd) lineEnd = chunk.end;
+
+            Tokenize(lineStart, lineEnd, ' ', tokens);
+
+            if (tokens.size() > 0) {
+		        if (tokens[0] == "#") {
+			        // Comment
+		        }
+		        else if (tokens[0] == "mtllib") {
+			        // Material library
+                    if (tokens.size() >= 2) {
+                        chunk.AddCommand(OBJChunk::Command::MaterialLibrary, tokens[1].ToString());
+                    }
+		        }
+                else if (tokens[0] == "g") {
+                    // Group               
+                    if (tokens.size() == 1) {
+                        chunk.AddCommand(OBJChunk::Command::Group, "");
                     }
-                    if (!found) {
-                        std::cout << "OBJObject::LoadObject() : Could not find material : " << s << std::endl;
+                    else if (tokens.size() == 2) {
+                        chunk.AddCommand(OBJChunk::Command::Group, tokens[1].ToString());
+                    }
+                    else {
+                        chunk.AddMessage("OBJObject::LoadObject() : Invalid group ", lineStart, lineEnd);
                     }
                 }
-                else {
-                    std::cout << "OBJObject::LoadObject() : Invalid material : " << s << std::endl;
+                else if (tokens[0] == "v") {
+                    if (tokens.size() == 4) {
+                        chunk.verts.push_back(Vec3(ParseDouble(tokens[1]), 
+                                                   ParseDouble(tokens[2]),
+                                                   ParseDouble(tokens[3])));
+                    }
+                    else {
+                        chunk.AddMessage("OBJObject::LoadObject() : Invalid vertex : ", lineStart, lineEnd);
+                    }
+                }           
+                else if (tokens[0] == "vt") {
+                    if (tokens.size() == 3) {
+                        chunk.textureCoords.push_back(Vec3(ParseDouble(tokens[1]), 
+                                                           ParseDouble(tokens[2]),
+                                                           0.0));
+                    }
+                    else if (tokens.size() == 4) {
+                        chunk.textureCoords.push_back(Vec3(ParseDouble(tokens[1]), 
+                                                           ParseDouble(tokens[2]),
+                                                           ParseDouble(tokens[3])));
+                    }
+                    else {
+                        chunk.AddMessage("OBJObject::LoadObject() : Invalid texture vertex : ", lineStart, lineEnd);
+                    }
+                }   
+                else if (tokens[0] == "vn") {
+                    if (tokens.size() == 4) {
+                        chunk.vertexNormals.push_back(Vec3(ParseDouble(tokens[1]), 
+                                                           ParseDouble(tokens[2]),
+                                                           ParseDouble(tokens[3])));
+                    }
+                    else {
+                        chunk.AddMessage("OBJObject::LoadObject() : Invalid vertex normal : ", lineStart, lineEnd);
+                    }
                 }
-            }
-            else if (tokens[0] == "f") {
-                if (tokens.size() >= 4) {
-                    if (!currentGroup) {
-                        AddGroup("default");
+                else if (tokens[0] == "usemtl") {
+                    if (tokens.size() == 2) {
+                        chunk.AddCommand(OBJChunk::Command::UseMaterial, tokens[1].ToString(), lineStart, lineEnd);
+                    }
+                    else {
+                        chunk.AddMessage("OBJObject::LoadObject() : Invalid material : ", lineStart, lineEnd);
                     }
-                    Face* face = currentSubGroup->AddFace();
-                    numFaces++;
-                    for (int i = 1; i < (int)tokens.size(); i++) {
-                        // Count number of forward slashes
-                        size_t pos = -1;
-                        int count = 0;
-                        while ((pos = tokens[i].find("/", pos + 1)) != std::string::npos) count++;
+                }
+                else if (tokens[0] == "f") {
+                    if (tokens.size() >= 4) {
+                        chunk.AddFace();
+                        for (int i = 1; i < (int)tokens.size(); i++) {
+                            // Count number of forward slashes
+                            int count = (int)std::count(tokens[i].begin, tokens[i].end, '/');
     
-                        if (count > 0) {
-                            // Tokenize based on forward slashes
-                            std::vector<std::string> vertexTokens;
-                            vertexTokens = Utilities::Tokenize(tokens[i], "/");
-
-                            // Determine what information is here
-                            if (count == 1) {
-                                if (vertexTokens.size() == 2) {
-                                    int vertexIndex = atoi(vertexTokens[0].c_str());
-                                    int textureCoordIndex = atoi(vertexTokens[1].c_str());
-
-                                    if (vertexIndex < 1) vertexIndex += (int)verts.size();
-                                    else vertexIndex--;
-
-                                    if (textureCoordIndex < 1) textureCoordIndex += (int)textureCoords.size();
-                                    else textureCoordIndex--;
-
-                                    face->AddVertexIndex(vertexIndex);
-                                    face->AddTextureCoordIndex(textureCoordIndex);
-                                }
-                                else {
-                                    std::cout << "OBJObject::LoadObject() : Invalid face : " << s << std::endl;
-                                }
-                            }
-                            else if (count == 2) {
-                                if (vertexTokens.size() == 2) {  
-                                    int vertexIndex = atoi(vertexTokens[0].c_str());
-                                    int vertexNormalIndex = atoi(vertexTokens[1].c_str());
-
-                                    if (vertexIndex < 1) vertexIndex += (int)verts.size();
-                                    else vertexIndex--;
-
-                                    if (vertexNormalIndex < 1) vertexNormalIndex += (int)vertexNormals.size();
-                                    else vertexNormalIndex--;
-
-                                    face->AddVertexIndex(vertexIndex);
-                                    face->AddVertexNormalIndex(vertexNormalIndex);
+                            if (count > 0) {
+                                // Split on forward slashes, skipping empty fields
+                                int numVertexTokens = SplitFaceVertex(tokens[i], vertexTokens);
+
+                                // Determine what information is here
+                                if (count == 1) {
+                                    if (numVertexTokens == 2) {
+                                        chunk.AddVertexIndex(ParseInt(vertexTokens[0]));
+                                        chunk.AddTextureCoordIndex(ParseInt(vertexTokens[1]));
+                                    }
+                                    else {
+                                        chunk.AddMessage("OBJObject::LoadObject() : Invalid face : ", lineStart, lineEnd);
+                                    }
                                 }
-                                else if (vertexTokens.size() == 3) { 
-                                    int vertexIndex = atoi(vertexTokens[0].c_str());
-                                    int textureCoordIndex = atoi(vertexTokens[1].c_str());
-                                    int vertexNormalIndex = atoi(vertexTokens[2].c_str());
-
-                                    if (vertexIndex < 1) vertexIndex += (int)verts.size();
-                                    else vertexIndex--;
-                                                                        
-                                    if (textureCoordIndex < 1) textureCoordIndex += (int)textureCoords.size();
-                                    else textureCoordIndex--;
-
-                                    if (vertexNormalIndex < 1) vertexNormalIndex += (int)vertexNormals.size();
-                                    else vertexNormalIndex--;
-
-                                    face->AddVertexIndex(vertexIndex);
-                                    face->AddTextureCoordIndex(textureCoordIndex);
-                                    face->AddVertexNormalIndex(vertexNormalIndex);
+                                else if (count == 2) {
+                                    if (numVertexTokens == 2) {  
+                                        chunk.AddVertexIndex(ParseInt(vertexTokens[0]));
+                                        chunk.AddVertexNormalIndex(ParseInt(vertexTokens[1]));
+                                    }
+                                    else if (numVertexTokens == 3) { 
+                                        chunk.AddVertexIndex(ParseInt(vertexTokens[0]));
+                                        chunk.AddTextureCoordIndex(ParseInt(vertexTokens[1]));
+                                        chunk.AddVertexNormalIndex(ParseInt(vertexTokens[2]));
+                                    }
+                                    else {
+                                        chunk.AddMessage("OBJObject::LoadObject() : Invalid face : ", lineStart, lineEnd);
+                                    }
                                 }
                                 else {
-                                    std::cout << "OBJObject::LoadObject() : Invalid face : " << s << std::endl;
+                                    chunk.AddMessage("OBJObject::LoadObject() : Invalid face : ", lineStart, lineEnd);
                                 }
                             }
                             else {
-                                std::cout << "OBJObject::LoadObject() : Invalid face : " << s << std::endl;
+                                // No forward slashes, only vertex
+                                chunk.AddVertexIndex(ParseInt(tokens[i]));
                             }
                         }
-                        else {
-                            // No forward slashes, only vertexint vertexIndex = atoi(vertexTokens[0].c_str());
-                            int vertexIndex = atoi(tokens[i].c_str());
-
-                            if (vertexIndex < 1) vertexIndex += (int)verts.size();
-                            else vertexIndex--;
-
-                            face->AddVertexIndex(vertexIndex);
-                        }
                     }
-                }
-                else {
-                    std::cout << "OBJObject::LoadObject() : Invalid face: " << s << std::endl;
+                    else {
+                        chunk.AddMessage("OBJObject::LoadObject() : Invalid face: ", lineStart, lineEnd);
+                    }
                 }
             }
-        }
-	}
-
-    file.close();
-
-    std::cout << "OBJObject::LoadObject() : Number of faces = " << numFaces << std::endl;
-
-    // Calculate face normals
-    std::cout << "OBJObject::LoadObject() : Calculating face normals...";
-    CalculateFaceNormals();
-    std::cout << "done." << std::endl;
 
+            lineStart = lineEnd + 1;
+	    }
+    }
 
-    // If needed, calculate vertex normals
-    if ((int)vertexNormals.size() == 0) {
-        std::cout << "OBJObject::LoadObject() : Calculating vertex normals...";
-        CalculateVertexNormals();
-        std::cout << "done." << std::endl << std::endl;
+    // Offset the relative indices of a chunk
+    void ResolveIndices(OBJChunk& chunk, int vertexOffset, int textureCoordOffset, int vertexNormalOffset) {
+        for (int i = 0; i < (int)chunk.relativeVertexIndices.size(); i++) {
+            chunk.faces.vertexIndices[chunk.relativeVertexIndices[i]] += vertexOffset;
+        }
+        for (int i = 0; i < (int)chunk.relativeTextureCoordIndices.size(); i++) {
+            chunk.faces.textureCoordIndices[chunk.relativeTextureCoordIndices[i]] += textureCoordOffset;
+        }
+        for (int i = 0; i < (int)chunk.relativeVertexNormalIndices.size(); i++) {
+            chunk.faces.vertexNormalIndices[chunk.relativeVertexNormalIndices[i]] += vertexNormalOffset;
+        }
     }
 
-    // Make sure everone has a material
-    srand(1);
-    for (int i = 0; i < (int)groups.size(); i++) {
-        Group* group = groups[i];
-        for (int j = 0; j < group->NumSubGroups(); j++) {
-            SubGroup* subGroup = group->GetSubGroup(j);
-            if (!subGroup->GetMaterial()) {
-                Material* material = new Material(group->GetName());
-                materials.push_back(material); 
+    // Faces [first, first + count) of a list
+    struct FaceRun {
+        const FaceList* faces;
+        int first;
+        int count;
+    };
+
+    // Copy runs of faces one after another into a list
+    void GatherFaces(const std::vector<FaceRun>& runs, FaceList& faces, ThreadPool& pool) {
+        // Starts of the index arrays and their lists of indices, for each kind of index
+        std::vector<int> FaceList::* starts[3] = { &FaceList::vertexStarts, &FaceList::textureCoordStarts, &FaceList::vertexNormalStarts };
+        std::vector<int> FaceList::* indices[3] = { &FaceList::vertexIndices, &FaceList::textureCoordIndices, &FaceList::vertexNormalIndices };
+
+        // Where each run goes
+        int numRuns = (int)runs.size();
+        std::vector<int> faceOffsets(numRuns + 1, 0);
+        std::vector<int> indexOffsets[3];
+
+        for (int j = 0; j < 3; j++) {
+            indexOffsets[j].assign(numRuns + 1, 0);
+        }
 
-                float r = (float)rand() / (float)RAND_MAX;
-                float g = (float)rand() / (float)RAND_MAX;
-                float b = (float)rand() / (float)RAND_MAX;
+        for (int i = 0; i < numRuns; i++) {
+            const FaceRun& run = runs[i];
 
-                material->SetAmbient(r, g, b);
-                material->SetDiffuse(r, g, b);
-                material->SetSpecular(1.0f, 1.0f, 1.0f);
-                material->SetShininess(50.0f);
-                material->SetDoSpecular(true);
-                material->SetOpacity(1.0f);
+            faceOffsets[i + 1] = faceOffsets[i] + run.count;
 
-                subGroup->SetMaterial(material);
+            for (int j = 0; j < 3; j++) {
+                const std::vector<int>& runStarts = run.faces->*starts[j];
+                indexOffsets[j][i + 1] = indexOffsets[j][i] + runStarts[run.first + run.count] - runStarts[run.first];
             }
         }
-    }
 
-	return true;
-}
+        faces.normals.resize(faceOffsets[numRuns] * 3);
+        for (int j = 0; j < 3; j++) {
+            (faces.*starts[j]).resize(faceOffsets[numRuns] + 1);
+            (faces.*starts[j])[faceOffsets[numRuns]] = indexOffsets[j][numRuns];
+            (faces.*indices[j]).resize(indexOffsets[j][numRuns]);
+        }
 
+        pool.ParallelFor(numRuns, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const FaceRun& run = runs[i];
 
-double OBJObject::NormalizeBounds(double scaleBounds) {    
-    Vec3 min;
-    Vec3 max;
+                std::copy(run.faces->normals.begin() + run.first * 3, 
+                          run.faces->normals.begin() + (run.first + run.count) * 3, 
+                          faces.normals.begin() + faceOffsets[i] * 3);
 
-    if (verts.size() > 0) {
-        min = verts[0];
-        max = verts[0];
+                for (int j = 0; j < 3; j++) {
+                    const std::vector<int>& runStarts = run.faces->*starts[j];
+                    const std::vector<int>& runIndices = run.faces->*indices[j];
+                    int offset = indexOffsets[j][i] - runStarts[run.first];
+
+                    for (int k = 0; k < run.count; k++) {
+                        (faces.*starts[j])[faceOffsets[i] + k] = runStarts[run.first + k] + offset;
+                    }
+
+                    std::copy(runIndices.begin() + runStarts[run.first], 
+                              runIndices.begin() + runStarts[run.first + run.count], 
+                              (faces.*indices[j]).begin() + indexOffsets[j][i]);
+                }
+            }
+        });
     }
 
-    for (int i = 1; i < (int)verts.size(); i++) {
-        if (verts[i].X() < min.X()) min.X() = verts[i].X();
-        if (verts[i].Y() < min.Y()) min.Y() = verts[i].Y();
-        if (verts[i].Z() < min.Z()) min.Z() = verts[i].Z();
+    // Positions as floats, three per vertex, for calculating normals.  Relative to the first
+    // vertex, so models far from the origin keep their precision.
+    void GetFloatPositions(const std::vector<Vec3>& verts, std::vector<float>& positions, ThreadPool& pool) {
+        positions.resize(verts.size() * 3);
+        if (verts.empty()) return;
 
-        if (verts[i].X() > max.X()) max.X() = verts[i].X();
-        if (verts[i].Y() > max.Y()) max.Y() = verts[i].Y();
-        if (verts[i].Z() > max.Z()) max.Z() = verts[i].Z();
+        Vec3 origin = verts[0];
+
+        pool.ParallelFor((int)verts.size(), 16384, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                positions[i * 3] = (float)(verts[i].X() - origin.X());
+                positions[i * 3 + 1] = (float)(verts[i].Y() - origin.Y());
+                positions[i * 3 + 2] = (float)(verts[i].Z() - origin.Z());
+            }
+        });
     }
 
-    double x = max.X() - min.X();
-    double y = max.Y() - min.Y();
-    double z = max.Z() - min.Z();
+    // Unit normal of (p2 - p1) x (p0 - p1).  Left at zero for a triangle with no area, as 
+    // Vec3::Normalize() does.
+    void TriangleNormal(const float* p0, const float* p1, const float* p2, float* normal) {
+        float ax = p2[0] - p1[0], ay = p2[1] - p1[1], az = p2[2] - p1[2];
+        float bx = p0[0] - p1[0], by = p0[1] - p1[1], bz = p0[2] - p1[2];
 
-    double s = x > y ? x : y;
-    s = s > z ? s : z;
-    s = 1.0 / s;
-    s *= scaleBounds;
+        float nx = ay * bz - az * by;
+        float ny = az * bx - ax * bz;
+        float nz = ax * by - ay * bx;
 
-    Vec3 center(min.X() + x * 0.5,
-                min.Y() + y * 0.5,
-                min.Z() + z * 0.5);
+        float length = sqrtf(nx * nx + ny * ny + nz * nz);
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
 
-    for (int i = 0; i < (int)verts.size(); i++) {
-        verts[i] -= center;
-        verts[i] *= s;
+        normal[0] = nx * scale;
+        normal[1] = ny * scale;
+        normal[2] = nz * scale;
     }
 
-    displayListCurrent = false;
+    // Angle at p1 between the edges to p0 and p2, to within 0.0001 radians, which is plenty
+    // for a weight and several times faster than acosf()
+    float CornerAngle(const float* p0, const float* p1, const float* p2) {
+        float ax = p0[0] - p1[0], ay = p0[1] - p1[1], az = p0[2] - p1[2];
+        float bx = p2[0] - p1[0], by = p2[1] - p1[1], bz = p2[2] - p1[2];
 
+        float lengths = (ax * ax + ay * ay + az * az) * (bx * bx + by * by + bz * bz);
+        if (lengths <= 0.0f) return 0.0f;
 
-    std::cout << center << std::endl;
-    std::cout << s << std::endl;
+        float cosine = (ax * bx + ay * by + az * bz) / sqrtf(lengths);
+        float x = std::min(fabsf(cosine), 1.0f);
 
-    return s;
-}
+        // Abramowitz and Stegun 4.4.45
+        float angle = sqrtf(1.0f - x) * (1.5707288f + x * (-0.2121144f + x * (0.0742610f - 0.0187293f * x)));
 
+        return cosine < 0.0f ? 3.14159265f - angle : angle;
+    }
 
-void OBJObject::SmoothShadingOn() {
-    smoothShading = true;
-    displayListCurrent = false;
-}
+    // Normal of each face from its first three vertices
+    void CalculateNormals(FaceList& faces, const std::vector<float>& positions, ThreadPool& pool) {
+        int numFaces = faces.NumFaces();
+        const std::vector<int>& starts = faces.vertexStarts;
+        const std::vector<int>& indices = faces.vertexIndices;
+
+        faces.normals.resize(numFaces * 3);
+
+        pool.ParallelFor(numFaces, 4096, [&](int begin, int end) {
+            for (int i = begin; i < end;) {
+                const int* s = &starts[i];
+#ifdef OBJOBJECT_SSE
+                // Four triangles at a time, one in each lane
+                if (i + 4 <= end && s[1] - s[0] == 3 && s[2] - s[0] == 6 && s[3] - s[0] == 9 && s[4] - s[0] == 12) {
+                    const int* v = &indices[s[0]];
+                    __m128 x[3], y[3], z[3];
+
+                    for (int c = 0; c < 3; c++) {
+                        const float* p0 = &positions[v[c] * 3];
+                        const float* p1 = &positions[v[3 + c] * 3];
+                        const float* p2 = &positions[v[6 + c] * 3];
+                        const float* p3 = &positions[v[9 + c] * 3];
+
+                        x[c] = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+                        y[c] = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+                        z[c] = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+                    }
 
-void OBJObject::SmoothShadingOff() {
-    smoothShading = false;
-    displayListCurrent = false;
-}
+                    __m128 ax = _mm_sub_ps(x[2], x[1]), ay = _mm_sub_ps(y[2], y[1]), az = _mm_sub_ps(z[2], z[1]);
+                    __m128 bx = _mm_sub_ps(x[0], x[1]), by = _mm_sub_ps(y[0], y[1]), bz = _mm_sub_ps(z[0], z[1]);
 
+                    __m128 normal[3];
+                    normal[0] = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+                    normal[1] = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+                    normal[2] = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
 
-void OBJObject::WireFrameOn() {
-    wireFrame = true;
-    displayListCurrent = false;
-}
+                    __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], normal[0]), _mm_mul_ps(normal[1], normal[1])), 
+                                                _mm_mul_ps(normal[2], normal[2]));
 
-void OBJObject::WireFrameOff() {
-    wireFrame = false;
-    displayListCurrent = false;
-}
+                    // Zero where there is no area
+                    __m128 scale = _mm_and_ps(_mm_cmpgt_ps(length2, _mm_setzero_ps()), 
+                                              _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length2)));
 
+                    float lanes[3][4];
+                    for (int c = 0; c < 3; c++) {
+                        _mm_storeu_ps(lanes[c], _mm_mul_ps(normal[c], scale));
+                    }
 
-void OBJObject::ImmediateModeOn() {
-    immediateMode = true;
-}
+                    for (int k = 0; k < 4; k++) {
+                        for (int c = 0; c < 3; c++) {
+                            faces.normals[(i + k) * 3 + c] = lanes[c][k];
+                        }
+                    }
 
-void OBJObject::ImmediateModeOff() {
-    immediateMode = false;
+                    i += 4;
+                    continue;
+                }
+#endif
+                if (s[1] - s[0] >= 3) {
+                    const int* v = &indices[s[0]];
+                    TriangleNormal(&positions[v[0] * 3], &positions[v[1] * 3], &positions[v[2] * 3], &faces.normals[i * 3]);
+                }
+
+                i++;
+            }
+        });
+    }
+
+    // A face corner for welding vertices.  A corner has a vertex normal, or the normal of 
+    // its face.
+    struct Corner {
+        int vertex;
+        int textureCoord;
+        int normal;
+        int face;
+
+        bool operator==(const Corner& other) const {
+            return vertex == other.vertex && textureCoord == other.textureCoord && 
+                   normal == other.normal && face == other.face;
+        }
+    };
+
+    struct CornerHash {
+        size_t operator()(const Corner& corner) const {
+            return ((size_t)corner.vertex * 73856093) ^ ((size_t)corner.textureCoord * 19349663) ^ 
+                   ((size_t)corner.normal * 83492791) ^ ((size_t)corner.face * 50331653);
+        }
+    };
+
+    // Binary cache of a parsed model
+    const char cacheMagic[4] = { 'H', 'M', 'S', 'H' };
+    const int32_t cacheVersion = 5;
+
+    // Vertices are written as they are in memory
+    static_assert(sizeof(Vec3) == 3 * sizeof(double), "Vec3 must be three packed doubles");
+    static_assert(sizeof(int) == sizeof(int32_t), "Indices must be 32 bit");
+
+    void WriteCount(std::ofstream& file, size_t count) {
+        uint32_t value = (uint32_t)count;
+        file.write((const char*)&value, sizeof(value));
+    }
+
+    void WriteString(std::ofstream& file, const std::string& s) {
+        WriteCount(file, s.size());
+        file.write(s.data(), s.size());
+    }
+
+    template <class T> void WriteArray(std::ofstream& file, const std::vector<T>& array) {
+        WriteCount(file, array.size());
+        if (!array.empty()) file.write((const char*)&array[0], array.size() * sizeof(T));
+    }
+
+    // Starts run from 0 up to the number of indices, and indices are within the number of
+    // vertices, texture coordinates and vertex normals
+    bool ValidFaces(const FaceList& faces, const uint32_t numValues[3]) {
+        const std::vector<int>* starts[3] = { &faces.vertexStarts, &faces.textureCoordStarts, &faces.vertexNormalStarts };
+        const std::vector<int>* indices[3] = { &faces.vertexIndices, &faces.textureCoordIndices, &faces.vertexNormalIndices };
+
+        size_t numStarts = faces.vertexStarts.size();
+        if (numStarts == 0) return false;
+
+        for (int i = 0; i < 3; i++) {
+            const std::vector<int>& s = *starts[i];
+            if (s.size() != numStarts || s[0] != 0 || s.back() != (int)indices[i]->size()) return false;
+
+            for (size_t j = 0; j + 1 < numStarts; j++) {
+                if (s[j] > s[j + 1]) return false;
+            }
+
+            for (size_t j = 0; j < indices[i]->size(); j++) {
+                int index = (*indices[i])[j];
+                if (index < 0 || (uint32_t)index >= numValues[i]) return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Indices read from a cache, which may not be aligned, are within the number of values
+    bool ValidIndices(const char* data, uint32_t numIndices, uint32_t numValues) {
+        for (uint32_t i = 0; i < numIndices; i++) {
+            int32_t index;
+            memcpy(&index, data + i * sizeof(int32_t), sizeof(int32_t));
+            if (index < 0 || (uint32_t)index >= numValues) return false;
+        }
+
+        return true;
+    }
+
+    // Reads from a mapped cache, checking every read against the end
+    class CacheReader {
+    public:
+        CacheReader(const char* data, size_t size) : p(data), end(data + size), valid(data != NULL) {
+        }
+
+        bool Valid() const {
+            return valid;
+        }
+
+        // Returns the start of the bytes skipped, or NULL past the end
+        const char* Skip(size_t size) {
+            if (!valid || (size_t)(end - p) < size) {
+                valid = false;
+                return NULL;
+            }
+
+            const char* start = p;
+            p += size;
+            return start;
+        }
+
+        void Read(void* dest, size_t size) {
+            const char* source = Skip(size);
+            if (source) memcpy(dest, source, size);
+        }
+
+        template <class T> void Read(T& value) {
+            Read(&value, sizeof(T));
+        }
+
+        void Read(std::string& s) {
+            uint32_t length = ReadCount();
+            const char* source = Skip(length);
+            if (source) s.assign(source, length);
+        }
+
+        template <class T> void Read(std::vector<T>& array) {
+            uint32_t count = ReadCount();
+            const char* source = Skip((size_t)count * sizeof(T));
+
+            array.resize(source ? count : 0);
+            if (!array.empty()) memcpy(&array[0], source, array.size() * sizeof(T));
+        }
+
+        uint32_t ReadCount() {
+            uint32_t count = 0;
+            Read(count);
+
+            // No count can be more than the bytes left
+            if ((size_t)(end - p) < count) valid = false;
+
+            return valid ? count : 0;
+        }
+
+    private:
+        const char* p;
+        const char* end;
+        bool valid;
+    };
+
+
+    // Stable least significant digit radix sort of the values by key, smallest key first,
+    // 11 bits per pass.  Passes where every key has the same digit are skipped.
+    void RadixSort(std::vector<uint32_t>& keys, std::vector<int>& values,
+                   std::vector<uint32_t>& keyScratch, std::vector<int>& valueScratch) {
+        const int digitBits = 11;
+        const int numBuckets = 1 << digitBits;
+        const int numPasses = 3;
+        const uint32_t mask = numBuckets - 1;
+
+        int n = (int)keys.size();
+        if (n < 2) return;
+
+        keyScratch.resize(n);
+        valueScratch.resize(n);
+
+        // Count the digits of every pass at once
+        std::vector<int> counts(numBuckets * numPasses, 0);
+        for (int i = 0; i < n; i++) {
+            uint32_t key = keys[i];
+            for (int pass = 0; pass < numPasses; pass++) {
+                counts[pass * numBuckets + ((key >> (pass * digitBits)) & mask)]++;
+            }
+        }
+
+        for (int pass = 0; pass < numPasses; pass++) {
+            int* count = &counts[pass * numBuckets];
+            int shift = pass * digitBits;
+
+            if (count[(keys[0] >> shift) & mask] == n) continue;
+
+            // Start of each bucket
+            int start = 0;
+            for (int b = 0; b < numBuckets; b++) {
+                int bucketCount = count[b];
+                count[b] = start;
+                start += bucketCount;
+            }
+
+            for (int i = 0; i < n; i++) {
+                int j = count[(keys[i] >> shift) & mask]++;
+                keyScratch[j] = keys[i];
+                valueScratch[j] = values[i];
+            }
+
+            keys.swap(keyScratch);
+            values.swap(valueScratch);
+        }
+    }
 }
 
 
-void OBJObject::CullFaceOn() {
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+std::string OBJObject::cacheDirectory;
+
+
+OBJObject::OBJObject() : RenderObject() {
+    currentGroup = NULL;
+	currentSubGroup = NULL;
+    currentMaterial = NULL;
+
+    smoothShading = true;
+    angleWeightedNormals = false;
+    wireFrame = false;
+    immediateMode = false;
     cullFace = true;
+
+    displayListCurrent = false;
+
+    useBuffers = true;
+
+    depthSort = false;
+    depthsCurrent = false;
+    depthSortTolerance = 0.001;
+
+    useBSPTree = false;
+
+    numLevels = 0;
+    levelRatio = 0.5;
+    lodPixelError = 1.0;
+    levelsCurrent = false;
+    currentLevel = 0;
+
+    boundsRadius = 0.0;
+    boundsCurrent = false;
 }
 
-void OBJObject::CullFaceOff() {
-    cullFace = false;
+OBJObject::~OBJObject() {
+    for (int i = 0; i < (int)groups.size(); i++) {
+        delete groups[i];
+    }
+
+    for (int i = 0; i < (int)materials.size(); i++) {
+        delete materials[i];
+    }
+
+    glDeleteLists(displayList, 1);
+
+    DeleteBuffers(smoothBuffers);
+    DeleteBuffers(flatBuffers);
+
+    DeleteLevelsOfDetail();
 }
 
 
-void OBJObject::SetOpacity(float opacity) {
+bool OBJObject::LoadObject(const std::string& fileName) {
+    GeometryChanged();
+    DeleteLevelsOfDetail();
+
+    // Reload from the binary cache unless the file has changed since it was written
+    int64_t size = 0;
+    int64_t modified = 0;
+    bool haveInfo = GetFileInfo(fileName, size, modified);
+
+    std::string cacheFileName = GetCacheFileName(fileName);
+
+    // The cache holds the whole object, so is only written for a file loaded on its own.
+    // Reading one still appends to what is already loaded.
+    bool firstLoad = verts.empty() && groups.empty() && faceList.NumFaces() == 0 && materialLibraries.empty();
+
+    bool cached = haveInfo && ReadCache(fileName, cacheFileName, size, modified);
+    if (!cached && !ParseObject(fileName)) return false;
+
+    // Cache the tree with the model if it was not already
+    bool buildTree = useBSPTree && bspTree.Empty();
+    if (buildTree) BuildBSPTree();
+
+    // Likewise the levels of detail
+    bool buildLevels = numLevels > 0 && !levelsCurrent;
+    if (buildLevels) BuildLevelsOfDetail();
+
+    // Before any default materials are added, so only materials from the files are cached
+    if (haveInfo && firstLoad && (!cached || buildTree || buildLevels)) WriteCache(cacheFileName, size, modified);
+
+    std::cout << "OBJObject::LoadObject() : Face memory = " << faceList.GetMemoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    // Make sure everone has a material
+    srand(1);
     for (int i = 0; i < (int)groups.size(); i++) {
         Group* group = groups[i];
         for (int j = 0; j < group->NumSubGroups(); j++) {
-            group->GetSubGroup(j)->GetMaterial()->SetOpacity(opacity);
+            SubGroup* subGroup = group->GetSubGroup(j);
+            if (!subGroup->GetMaterial()) {
+                Material* material = new Material(group->GetName());
+                AddMaterial(material);
+
+                float r = (float)rand() / (float)RAND_MAX;
+                float g = (float)rand() / (float)RAND_MAX;
+                float b = (float)rand() / (float)RAND_MAX;
+
+                material->SetAmbient(r, g, b);
+                material->SetDiffuse(r, g, b);
+                material->SetSpecular(1.0f, 1.0f, 1.0f);
+                material->SetShininess(50.0f);
+                material->SetDoSpecular(true);
+                material->SetOpacity(1.0f);
+
+                subGroup->SetMaterial(material);
+            }
         }
     }
-    displayListCurrent = false;
+
+	return true;
 }
 
 
-void OBJObject::TranslatePoints(const Vec3& vec) {
-    for (int i = 0; i < (int)verts.size(); i++) {
-        verts[i] += vec;
+bool OBJObject::ParseObject(const std::string& fileName) {
+    MappedFile file;
+    if (!file.Open(fileName)) {
+        std::cout << "OBJObject::LoadObject() : Couldn't open " << fileName.c_str() << std::endl;
+        return false;
     }
-}
 
-void OBJObject::RotatePoints(const Quat& quat) {
-    for (int i = 0; i < (int)verts.size(); i++) {
-        verts[i] = quat * verts[i];
-    }
+    std::cout << "OBJObject::LoadObject() : Loading " << fileName.c_str() << std::endl;
 
-    for (int i = 0; i < (int)vertexNormals.size(); i++) {
-        vertexNormals[i] = quat * vertexNormals[i];
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    ThreadPool& pool = GetLoadPool();
+
+
+    // Split into chunks ending at newlines, several per thread to balance the load.  Tokens
+    // point into the file, and each chunk reuses one token list, so nothing is allocated per
+    // line.
+    const char* data = file.GetData();
+    const char* dataEnd = data + file.GetSize();
+
+    size_t chunkSize = file.GetSize() / (pool.NumThreads() * 4) + 1;
+    chunkSize = std::max(chunkSize, (size_t)(1 << 20));
+
+    std::vector<OBJChunk> chunks;
+    for (const char* chunkStart = data; ; ) {
+        const char* chunkEnd = dataEnd;
+        if ((size_t)(dataEnd - chunkStart) > chunkSize) {
+            chunkEnd = (const char*)memchr(chunkStart + chunkSize, '\n', dataEnd - chunkStart - chunkSize);
+            if (!chunkEnd) chunkEnd = dataEnd;
+        }
+
+        chunks.push_back(OBJChunk());
+        chunks.back().begin = chunkStart;
+        chunks.back().end = chunkEnd;
+
+        if (chunkEnd == dataEnd) break;
+        chunkStart = chunkEnd + 1;
     }
 
-    CalculateFaceNormals();
-}
+    pool.ParallelFor((int)chunks.size(), 1, [&chunks](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            ParseChunk(chunks[i]);
+        }
+    });
 
-void OBJObject::ScalePoints(double scaleValue) {
-    for (int i = 0; i < (int)verts.size(); i++) {
-        verts[i] *= scaleValue;
+
+    // Offsets of each chunk from the counts in the chunks before it
+    int numChunks = (int)chunks.size();
+    std::vector<int> vertexOffsets(numChunks + 1, 0);
+    std::vector<int> textureCoordOffsets(numChunks + 1, 0);
+    std::vector<int> vertexNormalOffsets(numChunks + 1, 0);
+
+    for (int i = 0; i < numChunks; i++) {
+        vertexOffsets[i + 1] = vertexOffsets[i] + (int)chunks[i].verts.size();
+        textureCoordOffsets[i + 1] = textureCoordOffsets[i] + (int)chunks[i].textureCoords.size();
+        vertexNormalOffsets[i + 1] = vertexNormalOffsets[i] + (int)chunks[i].vertexNormals.size();
     }
-}
 
-void OBJObject::ExpandPoints(double expansion) {
-	for (int i = 0; i < (int)verts.size(); i++) {
-        verts[i] += vertexNormals[i] * expansion;
-    }	
-}
+    int vertexStart = (int)verts.size();
+    int textureCoordStart = (int)textureCoords.size();
+    int vertexNormalStart = (int)vertexNormals.size();
 
+    verts.resize(vertexStart + vertexOffsets[numChunks]);
+    textureCoords.resize(textureCoordStart + textureCoordOffsets[numChunks]);
+    vertexNormals.resize(vertexNormalStart + vertexNormalOffsets[numChunks]);
 
-void OBJObject::SetCameraPosition(const Vec3& position) {
-    cameraPosition = position;
-}
+    pool.ParallelFor(numChunks, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            OBJChunk& chunk = chunks[i];
 
+            std::copy(chunk.verts.begin(), chunk.verts.end(), verts.begin() + vertexStart + vertexOffsets[i]);
+            std::copy(chunk.textureCoords.begin(), chunk.textureCoords.end(), textureCoords.begin() + textureCoordStart + textureCoordOffsets[i]);
+            std::copy(chunk.vertexNormals.begin(), chunk.vertexNormals.end(), vertexNormals.begin() + vertexNormalStart + vertexNormalOffsets[i]);
 
-void OBJObject::DepthSortOn() {
-    depthSort = true;
-}
+            ResolveIndices(chunk, vertexStart + vertexOffsets[i], textureCoordStart + textureCoordOffsets[i], vertexNormalStart + vertexNormalOffsets[i]);
+        }
+    });
 
-void OBJObject::DepthSortOff() {
-    depthSort = false;
-}
 
+    // Apply groups and materials in file order.  Faces are listed for their subgroups, and
+    // gathered once all the subgroups are known, so each subgroup's faces are together.
+    std::string mtlFileName;
+
+    int numFaces = 0;
 
-bool OBJObject::ParseMtl(const std::string& fileName) {
-	std::ifstream file(fileName.c_str());
-    if (file.fail()) {
-        std::cout << "OBJObject::ParseMtl() : Couldn't open " << fileName.c_str() << std::endl;
-        return false;
-    }
+    std::map<SubGroup*, std::vector<FaceRun> > subGroupRuns;
 
-    std::cout << "OBJObject::ParseMtl() : Loading " << fileName.c_str() << std::endl;
+    for (int i = 0; i < numChunks; i++) {
+        OBJChunk& chunk = chunks[i];
+        int face = 0;
 
-	std::string s;
-    std::vector<std::string> tokens;
+        for (int j = 0; j < (int)chunk.commands.size(); j++) {
+            const OBJChunk::Command& command = chunk.commands[j];
 
-	while (!file.eof()) {
-        getline(file, s);
-        tokens = Utilities::Tokenize(s, " \n");
+            switch (command.type) {
+            case OBJChunk::Command::MaterialLibrary :
+                materialLibraries.push_back(command.text);
+                mtlFileName = ResolveFileName(fileName, command.text);
 
-        if (tokens.size() > 0) {
-		    if (tokens[0] == "#") {
-			    // Comment
-		    }
-		    else if (tokens[0] == "newmtl") {
-			    // New material
-                if (tokens.size() == 2) {
-                    AddMaterial(tokens[1]);
+                if (!ParseMtl(mtlFileName)) {
+                    std::cout << "OBJObject::LoadObject() : Error loading " << command.text << std::endl;
                 }
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid material name : " << s << std::endl;
-                } 
-		    }
-            else if (tokens[0] == "Ka") {
-                // Ambient
-                if (tokens.size() == 4) {                    
-                    currentMaterial->SetAmbient((float)atof(tokens[1].c_str()),
-                                                (float)atof(tokens[2].c_str()),
-                                                (float)atof(tokens[3].c_str()));
-                }   
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid ambient color : " << s << std::endl;
+                break;
+
+            case OBJChunk::Command::Group :
+                AddGroup(command.text);
+                break;
+
+            case OBJChunk::Command::UseMaterial : {
+                Material* material = FindMaterial(command.text);
+                if (material) {
+                    if (!currentGroup) {
+                        AddGroup("default");
+                    }
+                    currentSubGroup = currentGroup->AddSubGroup();
+                    currentSubGroup->SetMaterial(material);
                 }
-            }
-            else if (tokens[0] == "Kd") {
-                // Diffuse
-                if (tokens.size() == 4) {                    
-                    currentMaterial->SetDiffuse((float)atof(tokens[1].c_str()),
-                                                (float)atof(tokens[2].c_str()),
-                                                (float)atof(tokens[3].c_str()));
-                }   
                 else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid diffuse color : " << s << std::endl;
+                    std::cout << "OBJObject::LoadObject() : Could not find material : " << command.line << std::endl;
                 }
+                break;
             }
-            else if (tokens[0] == "Ks") {
-                // Specular
-                if (tokens.size() == 4) {                    
-                    currentMaterial->SetSpecular((float)atof(tokens[1].c_str()),
-                                                 (float)atof(tokens[2].c_str()),
-                                                 (float)atof(tokens[3].c_str()));
-                }   
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid specular color : " << s << std::endl;
+
+            case OBJChunk::Command::Message :
+                std::cout << command.text << std::endl;
+                break;
+
+            case OBJChunk::Command::Faces :
+                if (!currentGroup) {
+                    AddGroup("default");
                 }
+                FaceRun run = { &chunk.faces, face, command.numFaces };
+                subGroupRuns[currentSubGroup].push_back(run);
+
+                face += command.numFaces;
+                numFaces += command.numFaces;
+                break;
             }
-            else if (tokens[0] == "d") {
-                // Opacity
+        }
+    }
+
+    // Faces already loaded stay ahead of the new faces in each subgroup
+    std::vector<FaceRun> runs;
+    int numGathered = 0;
+
+    for (int i = 0; i < (int)groups.size(); i++) {
+        Group* group = groups[i];
+        for (int j = 0; j < group->NumSubGroups(); j++) {
+            SubGroup* subGroup = group->GetSubGroup(j);
+            int first = numGathered;
+
+            FaceRun loaded = { &faceList, subGroup->GetFirstFace(), subGroup->NumFaces() };
+            if (loaded.count > 0) {
+                runs.push_back(loaded);
+                numGathered += loaded.count;
+            }
+
+            const std::vector<FaceRun>& newRuns = subGroupRuns[subGroup];
+            for (int k = 0; k < (int)newRuns.size(); k++) {
+                runs.push_back(newRuns[k]);
+                numGathered += newRuns[k].count;
+            }
+
+            subGroup->SetFaces(&faceList, first, numGathered - first);
+        }
+    }
+
+    FaceList faces;
+    GatherFaces(runs, faces, pool);
+    faceList = std::move(faces);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double megabytes = file.GetSize() / (1024.0 * 1024.0);
+
+    chunks.clear();
+    file.Close();
+
+    std::cout << "OBJObject::LoadObject() : Parsed " << megabytes << " MB in " << seconds << " s (" 
+              << (seconds > 0.0 ? megabytes / seconds : 0.0) << " MB/s) on " << pool.NumThreads() << " threads" << std::endl;
+
+    std::cout << "OBJObject::LoadObject() : Number of faces = " << numFaces << std::endl;
+
+    // Calculate face normals
+    std::cout << "OBJObject::LoadObject() : Calculating face normals...";
+    CalculateFaceNormals();
+    std::cout << "done." << std::endl;
+
+
+    // If needed, calculate vertex normals
+    if ((int)vertexNormals.size() == 0) {
+        std::cout << "OBJObject::LoadObject() : Calculating vertex normals...";
+        CalculateVertexNormals();
+        std::cout << "done." << std::endl << std::endl;
+    }
+
+    return true;
+}
+
+
+double OBJObject::NormalizeBounds(double scaleBounds) {    
+    Vec3 min;
+    Vec3 max;
+
+    if (verts.size() > 0) {
+        min = verts[0];
+        max = verts[0];
+    }
+
+    for (int i = 1; i < (int)verts.size(); i++) {
+        if (verts[i].X() < min.X()) min.X() = verts[i].X();
+        if (verts[i].Y() < min.Y()) min.Y() = verts[i].Y();
+        if (verts[i].Z() < min.Z()) min.Z() = verts[i].Z();
+
+        if (verts[i].X() > max.X()) max.X() = verts[i].X();
+        if (verts[i].Y() > max.Y()) max.Y() = verts[i].Y();
+        if (verts[i].Z() > max.Z()) max.Z() = verts[i].Z();
+    }
+
+    double x = max.X() - min.X();
+    double y = max.Y() - min.Y();
+    double z = max.Z() - min.Z();
+
+    double s = x > y ? x : y;
+    s = s > z ? s : z;
+    s = 1.0 / s;
+    s *= scaleBounds;
+
+    Vec3 center(min.X() + x * 0.5,
+                min.Y() + y * 0.5,
+                min.Z() + z * 0.5);
+
+    for (int i = 0; i < (int)verts.size(); i++) {
+        verts[i] -= center;
+        verts[i] *= s;
+    }
+
+    GeometryChanged();
+
+
+    std::cout << center << std::endl;
+    std::cout << s << std::endl;
+
+    return s;
+}
+
+
+void OBJObject::SmoothShadingOn() {
+    smoothShading = true;
+    displayListCurrent = false;
+}
+
+void OBJObject::SmoothShadingOff() {
+    smoothShading = false;
+    displayListCurrent = false;
+}
+
+void OBJObject::SetAngleWeightedNormals(bool weighted) {
+    angleWeightedNormals = weighted;
+}
+
+
+void OBJObject::WireFrameOn() {
+    wireFrame = true;
+    displayListCurrent = false;
+}
+
+void OBJObject::WireFrameOff() {
+    wireFrame = false;
+    displayListCurrent = false;
+}
+
+
+void OBJObject::ImmediateModeOn() {
+    immediateMode = true;
+}
+
+void OBJObject::ImmediateModeOff() {
+    immediateMode = false;
+}
+
+
+void OBJObject::CullFaceOn() {
+    cullFace = true;
+}
+
+void OBJObject::CullFaceOff() {
+    cullFace = false;
+}
+
+
+void OBJObject::SetOpacity(float opacity) {
+    for (int i = 0; i < (int)groups.size(); i++) {
+        Group* group = groups[i];
+        for (int j = 0; j < group->NumSubGroups(); j++) {
+            group->GetSubGroup(j)->GetMaterial()->SetOpacity(opacity);
+        }
+    }
+    displayListCurrent = false;
+}
+
+
+void OBJObject::TranslatePoints(const Vec3& vec) {
+    for (int i = 0; i < (int)verts.size(); i++) {
+        verts[i] += vec;
+    }
+
+    GeometryChanged();
+}
+
+void OBJObject::RotatePoints(const Quat& quat) {
+    for (int i = 0; i < (int)verts.size(); i++) {
+        verts[i] = quat * verts[i];
+    }
+
+    for (int i = 0; i < (int)vertexNormals.size(); i++) {
+        vertexNormals[i] = quat * vertexNormals[i];
+    }
+
+    CalculateFaceNormals();
+
+    GeometryChanged();
+}
+
+void OBJObject::ScalePoints(double scaleValue) {
+    for (int i = 0; i < (int)verts.size(); i++) {
+        verts[i] *= scaleValue;
+    }
+
+    GeometryChanged();
+}
+
+void OBJObject::ExpandPoints(double expansion) {
+	for (int i = 0; i < (int)verts.size(); i++) {
+        verts[i] += vertexNormals[i] * expansion;
+    }	
+
+    GeometryChanged();
+}
+
+
+void OBJObject::SetCameraPosition(const Vec3& position) {
+    cameraPosition = position;
+}
+
+
+void OBJObject::DepthSortOn() {
+    depthSort = true;
+}
+
+void OBJObject::DepthSortOff() {
+    depthSort = false;
+}
+
+void OBJObject::SetDepthSortTolerance(double tolerance) {
+    depthSortTolerance = tolerance;
+}
+
+void OBJObject::SetUseBSPTree(bool use) {
+    useBSPTree = use;
+}
+
+
+void OBJObject::SetLevelsOfDetail(int numLevels, double ratio) {
+    numLevels = std::max(numLevels, 0);
+    ratio = std::min(std::max(ratio, 0.01), 0.9);
+
+    if (numLevels == this->numLevels && ratio == levelRatio) return;
+
+    this->numLevels = numLevels;
+    levelRatio = ratio;
+
+    DeleteLevelsOfDetail();
+}
+
+void OBJObject::SetLevelOfDetailPixelError(double pixels) {
+    lodPixelError = pixels;
+}
+
+int OBJObject::NumLevelsOfDetail() const {
+    return (int)levels.size();
+}
+
+int OBJObject::GetLevelOfDetail() const {
+    return currentLevel;
+}
+
+
+bool OBJObject::Pick(const Vec3& rayOrigin, const Vec3& rayDirection, Vec3& point, Vec3& normal) {
+    if (scale == 0.0) return false;
+
+    if (bvh.Empty()) BuildBVH();
+
+    // Into object space, where distances along the ray, in multiples of its direction, are
+    // the same as in world space
+    Quat inverse = !quaternion;
+    Vec3 origin = (inverse * (rayOrigin - position)) * (1.0 / scale) - bvhOrigin;
+    Vec3 direction = (inverse * rayDirection) * (1.0 / scale);
+
+    float o[3] = { (float)origin.X(), (float)origin.Y(), (float)origin.Z() };
+    float d[3] = { (float)direction.X(), (float)direction.Y(), (float)direction.Z() };
+
+    MeshBVH::Hit hit;
+    if (!bvh.Intersect(o, d, FLT_MAX, hit)) return false;
+
+    point = rayOrigin + rayDirection * hit.distance;
+    normal = quaternion * Face(&faceList, hit.tag).GetNormal();
+
+    return true;
+}
+
+bool OBJObject::Occludes(const Vec3& start, const Vec3& end) {
+    if (scale == 0.0) return false;
+
+    if (bvh.Empty()) BuildBVH();
+
+    Quat inverse = !quaternion;
+    Vec3 origin = (inverse * (start - position)) * (1.0 / scale) - bvhOrigin;
+    Vec3 direction = (inverse * (end - start)) * (1.0 / scale);
+
+    float o[3] = { (float)origin.X(), (float)origin.Y(), (float)origin.Z() };
+    float d[3] = { (float)direction.X(), (float)direction.Y(), (float)direction.Z() };
+
+    return bvh.Occluded(o, d, 1.0f);
+}
+
+const MeshBVH& OBJObject::GetBVH(Vec3& origin) {
+    if (bvh.Empty()) BuildBVH();
+
+    origin = bvhOrigin;
+
+    return bvh;
+}
+
+
+bool OBJObject::ParseMtl(const std::string& fileName) {
+	std::ifstream file(fileName.c_str());
+    if (file.fail()) {
+        std::cout << "OBJObject::ParseMtl() : Couldn't open " << fileName.c_str() << std::endl;
+        return false;
+    }
+
+    std::cout << "OBJObject::ParseMtl() : Loading " << fileName.c_str() << std::endl;
+
+	std::string s;
+    std::vector<std::string> tokens;
+
+	while (!file.eof()) {
+        getline(file, s);
+        tokens = Utilities::Tokenize(s, " \n");
+
+        if (tokens.size() > 0) {
+		    if (tokens[0] == "#") {
+			    // Comment
+		    }
+		    else if (tokens[0] == "newmtl") {
+			    // New material
                 if (tokens.size() == 2) {
-                    currentMaterial->SetOpacity((float)atof(tokens[1].c_str()));
+                    AddMaterial(tokens[1]);
                 }
                 else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid opacity : " << s << std::endl;
-                }
+                    std::cout << "OBJObject::ParseMtl() : Invalid material name : " << s << std::endl;
+                } 
+		    }
+            else if (tokens[0] == "Ka") {
+                // Ambient
+                if (tokens.size() == 4) {                    
+                    currentMaterial->SetAmbient((float)atof(tokens[1].c_str()),
+                                                (float)atof(tokens[2].c_str()),
+                                                (float)atof(tokens[3].c_str()));
+                }   
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid ambient color : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "Kd") {
+                // Diffuse
+                if (tokens.size() == 4) {                    
+                    currentMaterial->SetDiffuse((float)atof(tokens[1].c_str()),
+                                                (float)atof(tokens[2].c_str()),
+                                                (float)atof(tokens[3].c_str()));
+                }   
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid diffuse color : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "Ks") {
+                // Specular
+                if (tokens.size() == 4) {                    
+                    currentMaterial->SetSpecular((float)atof(tokens[1].c_str()),
+                                                 (float)atof(tokens[2].c_str()),
+                                                 (float)atof(tokens[3].c_str()));
+                }   
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid specular color : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "d") {
+                // Opacity
+                if (tokens.size() == 2) {
+                    currentMaterial->SetOpacity((float)atof(tokens[1].c_str()));
+                }
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid opacity : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "Tr") {
+                // Opacity
+                if (tokens.size() == 2) {
+                    currentMaterial->SetOpacity((float)atof(tokens[1].c_str()));
+                }
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid opacity : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "Ns") {
+                // Shininess
+                if (tokens.size() == 2) {
+                    currentMaterial->SetShininess((float)atof(tokens[1].c_str()));
+                }
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid shininess : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "illum") {
+                // Illumination model (specular or not)
+                if (tokens.size() == 2) {
+                    int illumination = atoi(tokens[1].c_str());
+
+                    if (illumination == 1) {
+                        currentMaterial->SetDoSpecular(false);
+                    }
+                    else if (illumination == 2) {
+                        currentMaterial->SetDoSpecular(true);
+                    }
+                    else {
+                        std::cout << "OBJObject::ParseMtl() : Invalid illumination model : " << s << std::endl;
+                    }
+                }
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid illumination model : " << s << std::endl;
+                }
+            }
+            else if (tokens[0] == "map_Kd") {
+                // Texture map
+                if (tokens.size() == 2) {
+                    std::string textureFileName = ResolveFileName(fileName, tokens[1]);
+                    if (!currentMaterial->LoadTexture(textureFileName)) {
+                        std::cout << "OBJObject::ParseMtl() : Could not load texture : " << textureFileName << std::endl;
+                    }
+                }
+                else if (tokens.size() == 6) {
+                    if (tokens[1] == "-s") {
+                        std::string textureFileName = ResolveFileName(fileName, tokens[5]);
+                        if (!currentMaterial->LoadTexture(textureFileName)) {
+                            std::cout << "OBJObject::ParseMtl() : Could not load texture : " << textureFileName << std::endl;
+                        }
+
+                        currentMaterial->SetTextureScale(Vec3(atof(tokens[2].c_str()),
+                                                              atof(tokens[3].c_str()),
+                                                              atof(tokens[4].c_str())));                 
+                    }
+                    else {
+                        std::cout << "OBJObject::ParseMtl() : Invalid texture parameter: " << s << std::endl;
+                    }
+                }
+                else {
+                    std::cout << "OBJObject::ParseMtl() : Invalid texture : " << s << std::endl;
+                }
+            }
+        }
+    }
+
+    file.close();
+
+    return true;
+}
+
+
+std::string OBJObject::ResolveFileName(const std::string& parent, const std::string& child) {
+    std::string p = parent;
+    std::string c = child;
+
+    bool relative = false;
+    if (c[0] == '.' && (c[1] == '/' || c[1] == '\\')) {
+        c = c.substr(2);
+        relative = true;
+    }
+    else if (c.find('/') == std::string::npos && c.find('\\') == std::string::npos) {
+        relative = true;
+    }
+
+    if (relative) {
+        // Relative path
+        std::string path;
+
+        size_t found = p.rfind('/');
+        if (found != std::string::npos) {
+            path = p.substr(0, found + 1);
+        }
+        else {
+            found = p.rfind('\\');
+            if (found != std::string::npos) {
+                path = p.substr(0, found + 1);
+            }
+        }
+
+        c = path + c;
+    }
+
+    return c;
+}
+
+
+void OBJObject::AddGroup(const std::string& name) {
+    Group* group = FindGroup(name);
+    if (group) {
+        currentGroup = group;
+        return;
+    }
+
+    // Didn't find it, so add it
+    AddGroup(new Group(name));
+    currentGroup = groups.back();
+    currentSubGroup = currentGroup->AddSubGroup();
+}
+
+
+void OBJObject::AddMaterial(const std::string& name) {
+    Material* material = FindMaterial(name);
+    if (material) {
+        currentMaterial = material;
+        return;
+    }
+
+    // Didn't find it, so add it
+    AddMaterial(new Material(name));
+    currentMaterial = materials.back();
+}
+
+
+Group* OBJObject::FindGroup(const std::string& name) {
+    std::unordered_map<std::string, int>::const_iterator it = groupIndices.find(name);
+    return it != groupIndices.end() ? groups[it->second] : NULL;
+}
+
+Material* OBJObject::FindMaterial(const std::string& name) {
+    std::unordered_map<std::string, int>::const_iterator it = materialIndices.find(name);
+    return it != materialIndices.end() ? materials[it->second] : NULL;
+}
+
+
+void OBJObject::AddGroup(Group* group) {
+    // Keep the first of each name, as a search of the list would find
+    groupIndices.insert(std::make_pair(group->GetName(), (int)groups.size()));
+    groups.push_back(group);
+}
+
+void OBJObject::AddMaterial(Material* material) {
+    materialIndices.insert(std::make_pair(material->GetName(), (int)materials.size()));
+    materials.push_back(material);
+}
+
+
+void OBJObject::AddVertex(const Vec3& v) {
+    verts.push_back(v);
+}
+
+void OBJObject::AddTextureCoord(const Vec3& vt) {
+    textureCoords.push_back(vt);
+}
+
+void OBJObject::AddVertexNormal(const Vec3& vn) {
+    vertexNormals.push_back(vn);
+}
+
+
+void OBJObject::CalculateFaceNormals() {
+    int numFaces = faceList.NumFaces();
+    const std::vector<int>& starts = faceList.vertexStarts;
+
+    // Report faces that are too small
+    bool tooSmall = false;
+    for (int i = 0; i < numFaces && !tooSmall; i++) {
+        tooSmall = starts[i + 1] - starts[i] < 3;
+    }
+
+    for (int i = 0; i < (int)groups.size() && tooSmall; i++) {
+        Group* group = groups[i];
+        for (int j = 0; j < (int)group->NumSubGroups(); j++) {
+            SubGroup* subGroup = group->GetSubGroup(j);
+            for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
+                if (subGroup->GetFace(k).NumVertices() < 3) {
+                    std::cout << "OBJObject::CalculateFaceNormals() : group " << group->GetName() << ", subgroup " << j << ", face " << k << " has < 3 vertices." << std::endl;
+                }
+            }
+        }
+    }
+
+    // The normal of each face is that of its first three vertices, and likewise for the
+    // levels of detail, e.g. after rotating the points
+    std::vector<float> positions;
+    GetFloatPositions(verts, positions, GetLoadPool());
+
+    CalculateNormals(faceList, positions, GetLoadPool());
+
+    for (int i = 0; i < (int)levels.size(); i++) {
+        CalculateNormals(levels[i].faces, positions, GetLoadPool());
+    }
+}
+
+void OBJObject::CalculateVertexNormals() {
+    int numFaces = faceList.NumFaces();
+
+    // List the faces around each vertex in face order, so each vertex can be summed on its
+    // own and still add its face normals in the same order as a single pass over the faces
+    int numVerts = (int)verts.size();
+    std::vector<int> vertexFaceStarts(numVerts + 1, 0);
+
+    for (int i = 0; i < (int)faceList.vertexIndices.size(); i++) {
+        vertexFaceStarts[faceList.vertexIndices[i] + 1]++;
+    }
+
+    for (int i = 0; i < numVerts; i++) {
+        vertexFaceStarts[i + 1] += vertexFaceStarts[i];
+    }
+
+    std::vector<int> vertexFaces(vertexFaceStarts[numVerts]);
+    std::vector<int> next(vertexFaceStarts.begin(), vertexFaceStarts.end() - 1);
+
+    for (int i = 0; i < numFaces; i++) {
+        for (int j = faceList.vertexStarts[i]; j < faceList.vertexStarts[i + 1]; j++) {
+            vertexFaces[next[faceList.vertexIndices[j]]++] = i;
+        }
+    }
+
+    std::vector<float> positions;
+    if (angleWeightedNormals) GetFloatPositions(verts, positions, GetLoadPool());
+
+    vertexNormals.resize(verts.size());
+
+    GetLoadPool().ParallelFor(numVerts, 4096, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            // Add face normals, then normalize
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+
+            for (int j = vertexFaceStarts[i]; j < vertexFaceStarts[i + 1]; j++) {
+                int face = vertexFaces[j];
+                const float* normal = &faceList.normals[face * 3];
+
+                float weight = 1.0f;
+                if (angleWeightedNormals) {
+                    // Angle of the face's corner at this vertex
+                    const int* v = &faceList.vertexIndices[faceList.vertexStarts[face]];
+                    int n = faceList.vertexStarts[face + 1] - faceList.vertexStarts[face];
+
+                    int k = 0;
+                    while (v[k] != i) k++;
+
+                    weight = CornerAngle(&positions[v[(k + n - 1) % n] * 3], &positions[i * 3], &positions[v[(k + 1) % n] * 3]);
+                }
+
+                sum[0] += normal[0] * weight;
+                sum[1] += normal[1] * weight;
+                sum[2] += normal[2] * weight;
+            }
+
+            float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+            float scale = length > 0.0f ? 1.0f / length : 0.0f;
+
+            vertexNormals[i].Set(sum[0] * scale, sum[1] * scale, sum[2] * scale);
+        }
+    });
+
+    // Each vertex uses its own normal, after any normal indices the face already has
+    if (faceList.vertexNormalIndices.empty()) {
+        faceList.vertexNormalStarts = faceList.vertexStarts;
+        faceList.vertexNormalIndices = faceList.vertexIndices;
+    }
+    else {
+        std::vector<int> starts(numFaces + 1, 0);
+        std::vector<int> indices;
+        indices.reserve(faceList.vertexNormalIndices.size() + faceList.vertexIndices.size());
+
+        for (int i = 0; i < numFaces; i++) {
+            indices.insert(indices.end(), faceList.vertexNormalIndices.begin() + faceList.vertexNormalStarts[i], 
+                                          faceList.vertexNormalIndices.begin() + faceList.vertexNormalStarts[i + 1]);
+            indices.insert(indices.end(), faceList.vertexIndices.begin() + faceList.vertexStarts[i], 
+                                          faceList.vertexIndices.begin() + faceList.vertexStarts[i + 1]);
+            starts[i + 1] = (int)indices.size();
+        }
+
+        faceList.vertexNormalStarts.swap(starts);
+        faceList.vertexNormalIndices.swap(indices);
+    }
+}
+
+
+ThreadPool& OBJObject::GetLoadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+
+void OBJObject::SetCacheDirectory(const std::string& directory) {
+    cacheDirectory = directory;
+}
+
+const std::string& OBJObject::GetCacheDirectory() {
+    return cacheDirectory;
+}
+
+
+std::string OBJObject::GetCacheFileName(const std::string& fileName) const {
+    // Next to the model unless a directory is set
+    if (cacheDirectory.empty()) return fileName + ".hmesh";
+
+    std::stringstream cacheFileName;
+    cacheFileName << cacheDirectory << "/" << std::hex << std::hash<std::string>()(fileName) 
+                  << std::dec << ".hmesh";
+
+    return cacheFileName.str();
+}
+
+bool OBJObject::GetFileInfo(const std::string& fileName, int64_t& size, int64_t& modified) const {
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) return false;
+
+    size = (int64_t)info.st_size;
+    modified = (int64_t)info.st_mtime;
+
+    return true;
+}
+
+
+bool OBJObject::ReadCache(const std::string& fileName, const std::string& cacheFileName, int64_t size, int64_t modified) {
+    MappedFile file;
+    if (!file.Open(cacheFileName)) return false;
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    CacheReader reader(file.GetData(), file.GetSize());
+
+    char magic[4];
+    int32_t version = 0;
+    int64_t cachedSize = 0;
+    int64_t cachedModified = 0;
+    int32_t cachedWeighting = 0;
+
+    reader.Read(magic, sizeof(magic));
+    reader.Read(version);
+    reader.Read(cachedSize);
+    reader.Read(cachedModified);
+    reader.Read(cachedWeighting);
+
+    // Reparse if the file has changed, or calculated normals would be weighted differently
+    if (!reader.Valid() || !std::equal(magic, magic + 4, cacheMagic) || version != cacheVersion ||
+        cachedSize != size || cachedModified != modified || cachedWeighting != (angleWeightedNormals ? 1 : 0)) {
+        return false;
+    }
+
+
+    // Check the whole file before changing anything
+    std::vector<std::string> libraries(reader.ReadCount());
+    for (int i = 0; i < (int)libraries.size() && reader.Valid(); i++) {
+        reader.Read(libraries[i]);
+    }
+
+    uint32_t numVerts = reader.ReadCount();
+    const char* vertData = reader.Skip(numVerts * sizeof(Vec3));
+    uint32_t numTextureCoords = reader.ReadCount();
+    const char* textureCoordData = reader.Skip(numTextureCoords * sizeof(Vec3));
+    uint32_t numVertexNormals = reader.ReadCount();
+    const char* vertexNormalData = reader.Skip(numVertexNormals * sizeof(Vec3));
+
+    struct CachedSubGroup {
+        std::string material;
+        uint32_t numFaces;
+    };
+
+    struct CachedGroup {
+        std::string name;
+        std::vector<CachedSubGroup> subGroups;
+    };
+
+    std::vector<CachedGroup> cachedGroups(reader.ReadCount());
+    uint32_t groupFaces = 0;
+    for (int i = 0; i < (int)cachedGroups.size() && reader.Valid(); i++) {
+        reader.Read(cachedGroups[i].name);
+
+        cachedGroups[i].subGroups.resize(reader.ReadCount());
+        for (int j = 0; j < (int)cachedGroups[i].subGroups.size() && reader.Valid(); j++) {
+            reader.Read(cachedGroups[i].subGroups[j].material);
+            reader.Read(cachedGroups[i].subGroups[j].numFaces);
+            groupFaces += cachedGroups[i].subGroups[j].numFaces;
+        }
+    }
+
+    // Faces as stored in a FaceList
+    uint32_t numFaces = reader.ReadCount();
+    const char* faceNormalData = reader.Skip(numFaces * 3 * sizeof(float));
+
+    std::vector<int32_t> faceStarts[3];
+    uint32_t numIndices[3];
+    const char* indexData[3];
+    for (int i = 0; i < 3; i++) {
+        const char* startData = reader.Skip((numFaces + 1) * sizeof(int32_t));
+        numIndices[i] = reader.ReadCount();
+        indexData[i] = reader.Skip(numIndices[i] * sizeof(int32_t));
+
+        if (!reader.Valid()) break;
+
+        faceStarts[i].resize(numFaces + 1);
+        memcpy(&faceStarts[i][0], startData, faceStarts[i].size() * sizeof(int32_t));
+    }
+
+    // BSP tree, if one was built
+    BSPTree tree;
+    reader.Read(tree.nodes);
+    reader.Read(tree.polygonStarts);
+    reader.Read(tree.vertices);
+    reader.Read(tree.planes);
+    reader.Read(tree.tags);
+
+    // Levels of detail, if built, and the settings they were built with
+    int32_t cachedNumLevels = 0;
+    double cachedLevelRatio = 0.0;
+    reader.Read(cachedNumLevels);
+    reader.Read(cachedLevelRatio);
+
+    std::vector<LevelOfDetail> cachedLevels(reader.ReadCount());
+    for (int i = 0; i < (int)cachedLevels.size() && reader.Valid(); i++) {
+        LevelOfDetail& level = cachedLevels[i];
+
+        reader.Read(level.error);
+        reader.Read(level.subGroupStarts);
+        reader.Read(level.faces.vertexStarts);
+        reader.Read(level.faces.textureCoordStarts);
+        reader.Read(level.faces.vertexNormalStarts);
+        reader.Read(level.faces.vertexIndices);
+        reader.Read(level.faces.textureCoordIndices);
+        reader.Read(level.faces.vertexNormalIndices);
+    }
+
+    size_t numSubGroups = 0;
+    for (int i = 0; i < (int)cachedGroups.size(); i++) {
+        numSubGroups += cachedGroups[i].subGroups.size();
+    }
+
+    uint32_t numValues[3] = { numVerts, numTextureCoords, numVertexNormals };
+
+    bool valid = reader.Valid() && groupFaces == numFaces && (tree.Empty() || tree.Validate());
+    for (int i = 0; i < 3 && valid; i++) {
+        valid = faceStarts[i][0] == 0 && faceStarts[i][numFaces] == (int32_t)numIndices[i] &&
+                ValidIndices(indexData[i], numIndices[i], numValues[i]);
+        for (uint32_t j = 0; j < numFaces && valid; j++) {
+            valid = faceStarts[i][j] <= faceStarts[i][j + 1];
+        }
+    }
+
+    // Tags are the subgroup of each polygon and whether it has texture coordinates
+    for (size_t i = 0; i < tree.tags.size() && valid; i++) {
+        valid = tree.tags[i] >= 0 && (size_t)(tree.tags[i] / 2) < numSubGroups;
+    }
+
+    for (int i = 0; i < (int)cachedLevels.size() && valid; i++) {
+        const LevelOfDetail& level = cachedLevels[i];
+        const std::vector<int>& starts = level.subGroupStarts;
+
+        valid = ValidFaces(level.faces, numValues) && starts.size() == numSubGroups + 1 && 
+                starts[0] == 0 && starts.back() == level.faces.NumFaces();
+        for (size_t j = 0; j < numSubGroups && valid; j++) {
+            valid = starts[j] <= starts[j + 1];
+        }
+    }
+
+    if (!valid) {
+        std::cout << "OBJObject::ReadCache() : Invalid cache " << cacheFileName << std::endl;
+        return false;
+    }
+
+
+    // Materials are read from their files, so changes to them show up
+    for (int i = 0; i < (int)libraries.size(); i++) {
+        materialLibraries.push_back(libraries[i]);
+
+        if (!ParseMtl(ResolveFileName(fileName, libraries[i]))) {
+            std::cout << "OBJObject::LoadObject() : Error loading " << libraries[i] << std::endl;
+        }
+    }
+
+    int vertexStart = (int)verts.size();
+    int textureCoordStart = (int)textureCoords.size();
+    int vertexNormalStart = (int)vertexNormals.size();
+    int indexOffsets[3] = { vertexStart, textureCoordStart, vertexNormalStart };
+
+    verts.resize(vertexStart + numVerts);
+    textureCoords.resize(textureCoordStart + numTextureCoords);
+    vertexNormals.resize(vertexNormalStart + numVertexNormals);
+
+    if (numVerts > 0) memcpy(&verts[vertexStart], vertData, numVerts * sizeof(Vec3));
+    if (numTextureCoords > 0) memcpy(&textureCoords[textureCoordStart], textureCoordData, numTextureCoords * sizeof(Vec3));
+    if (numVertexNormals > 0) memcpy(&vertexNormals[vertexNormalStart], vertexNormalData, numVertexNormals * sizeof(Vec3));
+
+
+    // Faces, after any already loaded
+    int faceStart = faceList.NumFaces();
+
+    faceList.normals.resize((faceStart + numFaces) * 3);
+    if (numFaces > 0) memcpy(&faceList.normals[faceStart * 3], faceNormalData, numFaces * 3 * sizeof(float));
+
+    std::vector<int>* starts[3] = { &faceList.vertexStarts, &faceList.textureCoordStarts, &faceList.vertexNormalStarts };
+    std::vector<int>* indices[3] = { &faceList.vertexIndices, &faceList.textureCoordIndices, &faceList.vertexNormalIndices };
+
+    for (int j = 0; j < 3; j++) {
+        int indexStart = (int)indices[j]->size();
+        starts[j]->resize(faceStart + numFaces + 1);
+        indices[j]->resize(indexStart + numIndices[j]);
+
+        int* startDest = &(*starts[j])[faceStart];
+        int* indexDest = indices[j]->empty() ? NULL : &(*indices[j])[indexStart];
+        const int32_t* startSource = &faceStarts[j][0];
+        const char* indexSource = indexData[j];
+        int indexOffset = indexOffsets[j];
+
+        GetLoadPool().ParallelFor((int)numFaces + 1, 4096, [=](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                startDest[i] = startSource[i] + indexStart;
+            }
+        });
+
+        GetLoadPool().ParallelFor((int)numIndices[j], 65536, [=](int begin, int end) {
+            memcpy(indexDest + begin, indexSource + begin * sizeof(int32_t), (end - begin) * sizeof(int32_t));
+            for (int i = begin; i < end; i++) {
+                indexDest[i] += indexOffset;
+            }
+        });
+    }
+
+
+    // The tree is only of this model, so keep it if nothing was loaded before
+    if (faceStart == 0 && groups.empty()) {
+        std::swap(bspTree, tree);
+    }
+
+    // Likewise the levels of detail, if built with the same settings
+    if (faceStart == 0 && groups.empty() && numLevels > 0 && 
+        cachedNumLevels == numLevels && cachedLevelRatio == levelRatio) {
+        levels.swap(cachedLevels);
+        levelsCurrent = true;
+
+        std::vector<float> positions;
+        GetFloatPositions(verts, positions, GetLoadPool());
+
+        for (int i = 0; i < (int)levels.size(); i++) {
+            CalculateNormals(levels[i].faces, positions, GetLoadPool());
+        }
+    }
+
+
+    // Groups, with materials looked up by name
+    int face = faceStart;
+    for (int i = 0; i < (int)cachedGroups.size(); i++) {
+        AddGroup(new Group(cachedGroups[i].name));
+        currentGroup = groups.back();
+
+        for (int j = 0; j < (int)cachedGroups[i].subGroups.size(); j++) {
+            const CachedSubGroup& cachedSubGroup = cachedGroups[i].subGroups[j];
+
+            currentSubGroup = currentGroup->AddSubGroup();
+
+            if (!cachedSubGroup.material.empty()) {
+                currentSubGroup->SetMaterial(FindMaterial(cachedSubGroup.material));
+            }
+
+            currentSubGroup->SetFaces(&faceList, face, cachedSubGroup.numFaces);
+            face += cachedSubGroup.numFaces;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "OBJObject::LoadObject() : Loaded " << cacheFileName << " in " << seconds << " s" << std::endl;
+    std::cout << "OBJObject::LoadObject() : Number of faces = " << numFaces << std::endl;
+
+    return true;
+}
+
+bool OBJObject::WriteCache(const std::string& cacheFileName, int64_t size, int64_t modified) {
+    std::ofstream file(cacheFileName.c_str(), std::ios::binary);
+    if (!file) {
+        std::cout << "OBJObject::WriteCache() : Could not write " << cacheFileName << std::endl;
+        return false;
+    }
+
+    file.write(cacheMagic, sizeof(cacheMagic));
+    file.write((const char*)&cacheVersion, sizeof(cacheVersion));
+    file.write((const char*)&size, sizeof(size));
+    file.write((const char*)&modified, sizeof(modified));
+
+    int32_t weighting = angleWeightedNormals ? 1 : 0;
+    file.write((const char*)&weighting, sizeof(weighting));
+
+    WriteCount(file, materialLibraries.size());
+    for (int i = 0; i < (int)materialLibraries.size(); i++) {
+        WriteString(file, materialLibraries[i]);
+    }
+
+    WriteCount(file, verts.size());
+    if (!verts.empty()) file.write((const char*)&verts[0], verts.size() * sizeof(Vec3));
+    WriteCount(file, textureCoords.size());
+    if (!textureCoords.empty()) file.write((const char*)&textureCoords[0], textureCoords.size() * sizeof(Vec3));
+    WriteCount(file, vertexNormals.size());
+    if (!vertexNormals.empty()) file.write((const char*)&vertexNormals[0], vertexNormals.size() * sizeof(Vec3));
+
+
+    // Groups, then the faces of all subgroups in order
+    std::vector<FaceRun> runs;
+
+    WriteCount(file, groups.size());
+    for (int i = 0; i < (int)groups.size(); i++) {
+        Group* group = groups[i];
+        WriteString(file, group->GetName());
+
+        WriteCount(file, group->NumSubGroups());
+        for (int j = 0; j < group->NumSubGroups(); j++) {
+            SubGroup* subGroup = group->GetSubGroup(j);
+            WriteString(file, subGroup->GetMaterial() ? subGroup->GetMaterial()->GetName() : "");
+
+            WriteCount(file, subGroup->NumFaces());
+
+            FaceRun run = { &faceList, subGroup->GetFirstFace(), subGroup->NumFaces() };
+            runs.push_back(run);
+        }
+    }
+
+    FaceList faces;
+    GatherFaces(runs, faces, GetLoadPool());
+
+    WriteCount(file, faces.NumFaces());
+    if (faces.NumFaces() > 0) file.write((const char*)&faces.normals[0], faces.normals.size() * sizeof(float));
+
+    const std::vector<int>* starts[3] = { &faces.vertexStarts, &faces.textureCoordStarts, &faces.vertexNormalStarts };
+    const std::vector<int>* indices[3] = { &faces.vertexIndices, &faces.textureCoordIndices, &faces.vertexNormalIndices };
+
+    for (int i = 0; i < 3; i++) {
+        file.write((const char*)&(*starts[i])[0], starts[i]->size() * sizeof(int32_t));
+
+        WriteCount(file, indices[i]->size());
+        if (!indices[i]->empty()) file.write((const char*)&(*indices[i])[0], indices[i]->size() * sizeof(int32_t));
+    }
+
+    // BSP tree, or nothing
+    WriteArray(file, bspTree.nodes);
+    WriteArray(file, bspTree.polygonStarts);
+    WriteArray(file, bspTree.vertices);
+    WriteArray(file, bspTree.planes);
+    WriteArray(file, bspTree.tags);
+
+    // Levels of detail, or none
+    int32_t writtenLevels = levelsCurrent ? numLevels : 0;
+    file.write((const char*)&writtenLevels, sizeof(writtenLevels));
+    file.write((const char*)&levelRatio, sizeof(levelRatio));
+
+    int numWritten = levelsCurrent ? (int)levels.size() : 0;
+    WriteCount(file, numWritten);
+    for (int i = 0; i < numWritten; i++) {
+        const LevelOfDetail& level = levels[i];
+
+        file.write((const char*)&level.error, sizeof(level.error));
+        WriteArray(file, level.subGroupStarts);
+        WriteArray(file, level.faces.vertexStarts);
+        WriteArray(file, level.faces.textureCoordStarts);
+        WriteArray(file, level.faces.vertexNormalStarts);
+        WriteArray(file, level.faces.vertexIndices);
+        WriteArray(file, level.faces.textureCoordIndices);
+        WriteArray(file, level.faces.vertexNormalIndices);
+    }
+
+    if (!file) {
+        std::cout << "OBJObject::WriteCache() : Could not write " << cacheFileName << std::endl;
+        file.close();
+        remove(cacheFileName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void OBJObject::PreRender() {
+    // Create textures decoded since the last frame.  A display list compiled before then
+    // draws the materials untextured.
+    for (int i = 0; i < (int)materials.size(); i++) {
+        if (materials[i]->UpdateTexture()) displayListCurrent = false;
+    }
+
+    glEnable(GL_LIGHTING);
+
+    if (cullFace) glEnable(GL_CULL_FACE);
+    else glDisable(GL_CULL_FACE);
+}
+
+void OBJObject::DoRender() {
+    // Push the modelview matrix stack
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    // The BSP tree is walked in a new order each frame, so is drawn in immediate mode
+    bool drawImmediate = immediateMode || (depthSort && useBSPTree);
+
+    // Buffers unless drawing faces in depth order or in immediate mode
+    bool drawBuffers = useBuffers && !depthSort && !drawImmediate && GLEW_ARB_vertex_buffer_object;
+
+    // Coarser levels of detail as the model gets smaller on screen
+    if (drawBuffers && numLevels > 0 && !levelsCurrent) BuildLevelsOfDetail();
+    currentLevel = drawBuffers ? SelectLevelOfDetail() : 0;
+
+    GeometryBuffers& buffers = currentLevel == 0 ? (smoothShading ? smoothBuffers : flatBuffers) :
+                               smoothShading ? levels[currentLevel - 1].smoothBuffers : levels[currentLevel - 1].flatBuffers;
+
+    if (drawBuffers && !buffers.current && !BuildBuffers(buffers, smoothShading, currentLevel)) {
+        // Fall back to the display list from now on
+        useBuffers = false;
+        drawBuffers = false;
+        currentLevel = 0;
+    }
+
+    if (!drawBuffers && !drawImmediate && !displayListCurrent) {
+        // Need new display list
+        if (glIsList(displayList) == GL_TRUE) {
+            glDeleteLists(displayList, 1);
+        }
+
+        displayList = glGenLists(1);
+
+        glNewList(displayList, GL_COMPILE);
+        RenderGeometry();
+        glEndList();
+
+        displayListCurrent = true;
+    }
+
+
+    glTranslated(position.X(), position.Y(), position.Z());
+    double angle;
+    Vec3 axis;
+    quaternion.GetAngleAxis(angle, axis);    
+    glRotated(Quat::RadiansToDegrees(angle), axis.X(), axis.Y(), axis.Z());
+    glScaled(scale, scale, scale);
+
+
+    if (drawBuffers) {
+        DrawBuffers(buffers);
+    }
+    else if (!drawImmediate) {
+        glCallList(displayList);
+    }
+    else {
+        RenderGeometry();
+    }
+
+    // Pop the modelview matrix stack
+    glPopMatrix();
+}
+
+void OBJObject::PostRender() {
+    glDisable(GL_TEXTURE_2D);
+}
+
+
+void OBJObject::RenderGeometry() {
+    if (depthSort && useBSPTree) {
+        RenderBSPTree();
+    }
+    else if (depthSort) {    
+        SubGroup* subGroup = depths[0].subGroup;
+        subGroup->GetMaterial()->SetupRender();
+        glEnable(GL_BLEND);
+        for (int i = 0; i < (int)depths.size(); i++) { 
+            if (depths[i].subGroup != subGroup) {
+                subGroup = depths[i].subGroup;
+                subGroup->GetMaterial()->SetupRender();
             }
-            else if (tokens[0] == "Tr") {
-                // Opacity
-                if (tokens.size() == 2) {
-                    currentMaterial->SetOpacity((float)atof(tokens[1].c_str()));
-                }
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid opacity : " << s << std::endl;
-                }
+            Face face = depths[i].face;
+            if (wireFrame) {
+                glBegin(GL_LINES);
             }
-            else if (tokens[0] == "Ns") {
-                // Shininess
-                if (tokens.size() == 2) {
-                    currentMaterial->SetShininess((float)atof(tokens[1].c_str()));
+            else {
+                glBegin(GL_POLYGON);
+            }
+
+            // Face normal
+            if (!smoothShading || face.NumVertexNormals() == 0) {
+                glNormal3f((GLfloat)face.GetNormal().X(),
+                           (GLfloat)face.GetNormal().Y(),
+                           (GLfloat)face.GetNormal().Z());
+            }
+
+            // Draw each vertex
+            for (int v = 0; v < face.NumVertices(); v++) {
+                // Vertex normals
+                if (v < face.NumVertexNormals() && smoothShading) {
+                    int index = face.GetVertexNormalIndex(v);
+                    glNormal3f((GLfloat)vertexNormals[index].X(), 
+                               (GLfloat)vertexNormals[index].Y(), 
+                               (GLfloat)vertexNormals[index].Z());
                 }
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid shininess : " << s << std::endl;
+
+                // Texture coordinates
+                if (v < face.NumTextureCoords()) {
+                    int index = face.GetTextureCoordIndex(v);
+                    glTexCoord3f((GLfloat)(textureCoords[index].X() * subGroup->GetTextureScale().X()),
+                                 (GLfloat)(textureCoords[index].Y() * subGroup->GetTextureScale().Y()),
+                                 (GLfloat)(textureCoords[index].Z() * subGroup->GetTextureScale().Z()));
                 }
-            }
-            else if (tokens[0] == "illum") {
-                // Illumination model (specular or not)
-                if (tokens.size() == 2) {
-                    int illumination = atoi(tokens[1].c_str());
 
-                    if (illumination == 1) {
-                        currentMaterial->SetDoSpecular(false);
-                    }
-                    else if (illumination == 2) {
-                        currentMaterial->SetDoSpecular(true);
+                // Position
+                int index = face.GetVertexIndex(v);
+                glVertex3f((GLfloat)verts[index].X(), 
+                           (GLfloat)verts[index].Y(), 
+                           (GLfloat)verts[index].Z());
+            }
+            glEnd();
+        }
+    }
+    else {
+        for (int i = 0; i < (int)groups.size(); i++) {
+            Group* group = groups[i];
+            for (int j = 0; j < (int)group->NumSubGroups(); j++) {
+                SubGroup* subGroup = group->GetSubGroup(j);
+                subGroup->GetMaterial()->SetupRender();
+                for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
+                    Face face = subGroup->GetFace(k);
+                    if (wireFrame) {
+                        glBegin(GL_LINES);
                     }
                     else {
-                        std::cout << "OBJObject::ParseMtl() : Invalid illumination model : " << s << std::endl;
+                        glBegin(GL_POLYGON);
                     }
-                }
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid illumination model : " << s << std::endl;
+
+                    // Face normal
+                    if (!smoothShading || face.NumVertexNormals() == 0) {
+                        glNormal3f((GLfloat)face.GetNormal().X(),
+                                   (GLfloat)face.GetNormal().Y(),
+                                   (GLfloat)face.GetNormal().Z());
+                    }
+
+                    // Draw each vertex
+                    for (int v = 0; v < face.NumVertices(); v++) {
+                        // Vertex normals
+                        if (v < face.NumVertexNormals() && smoothShading) {
+                            int index = face.GetVertexNormalIndex(v);
+                            glNormal3f((GLfloat)vertexNormals[index].X(), 
+                                       (GLfloat)vertexNormals[index].Y(), 
+                                       (GLfloat)vertexNormals[index].Z());
+                        }
+
+                        // Texture coordinates
+                        if (v < face.NumTextureCoords()) {
+                            int index = face.GetTextureCoordIndex(v);
+                            glTexCoord3f((GLfloat)(textureCoords[index].X() * subGroup->GetTextureScale().X()),
+                                         (GLfloat)(textureCoords[index].Y() * subGroup->GetTextureScale().Y()),
+                                         (GLfloat)(textureCoords[index].Z() * subGroup->GetTextureScale().Z()));
+                        }
+
+                        // Position
+                        int index = face.GetVertexIndex(v);
+                        glVertex3f((GLfloat)verts[index].X(), 
+                                   (GLfloat)verts[index].Y(), 
+                                   (GLfloat)verts[index].Z());
+                    }
+                    glEnd();
                 }
             }
-            else if (tokens[0] == "map_Kd") {
-                // Texture map
-                if (tokens.size() == 2) {
-                    std::string textureFileName = ResolveFileName(fileName, tokens[1]);
-                    if (!currentMaterial->LoadTexture(textureFileName)) {
-                        std::cout << "OBJObject::ParseMtl() : Could not load texture : " << textureFileName << std::endl;
+        }
+    }
+}
+
+bool OBJObject::BuildBuffers(GeometryBuffers& buffers, bool smooth, int level) {
+    // Position, normal and texture coordinate
+    const int vertexSize = 9;
+
+    std::vector<GLfloat> vertexData;
+    std::vector<GLuint> indices;
+    std::vector<GLuint> edges;
+    std::vector<GLuint> corners;
+
+    std::unordered_map<Corner, GLuint, CornerHash> welded;
+
+    int numCorners = 0;
+
+    buffers.ranges.clear();
+
+    // Faces of the full model, or of a level of detail
+    FaceList* faces = level > 0 ? &levels[level - 1].faces : &faceList;
+    int subGroupIndex = 0;
+
+    for (int i = 0; i < (int)groups.size(); i++) {
+        Group* group = groups[i];
+        for (int j = 0; j < group->NumSubGroups(); j++, subGroupIndex++) {
+            SubGroup* subGroup = group->GetSubGroup(j);
+
+            int firstFace = subGroup->GetFirstFace();
+            int numFaces = subGroup->NumFaces();
+
+            if (level > 0) {
+                const std::vector<int>& starts = levels[level - 1].subGroupStarts;
+
+                firstFace = starts[subGroupIndex];
+                numFaces = starts[subGroupIndex + 1] - firstFace;
+            }
+
+            // Texture coordinates are scaled for each material, so only weld within a subgroup
+            Vec3 textureScale = subGroup->GetTextureScale();
+            welded.clear();
+            edges.clear();
+
+            BufferRange range;
+            range.triangleStart = (int)indices.size();
+            range.hasTextureCoords = false;
+
+            for (int k = 0; k < numFaces; k++) {
+                Face face(faces, firstFace + k);
+                int numVertices = face.NumVertices();
+
+                corners.resize(numVertices);
+                for (int v = 0; v < numVertices; v++) {
+                    Corner corner;
+                    corner.vertex = face.GetVertexIndex(v);
+                    corner.textureCoord = v < face.NumTextureCoords() ? face.GetTextureCoordIndex(v) : -1;
+                    if (corner.textureCoord >= (int)textureCoords.size()) corner.textureCoord = -1;
+
+                    // As in RenderGeometry(), faces without vertex normals use the face normal,
+                    // and vertices past the last vertex normal keep it
+                    corner.normal = -1;
+                    corner.face = -1;
+
+                    if (smooth && face.NumVertexNormals() > 0) {
+                        corner.normal = face.GetVertexNormalIndex(std::min(v, face.NumVertexNormals() - 1));
+                    }
+                    if (corner.normal < 0 || corner.normal >= (int)vertexNormals.size()) {
+                        corner.normal = -1;
+                        corner.face = face.GetIndex();
                     }
-                }
-                else if (tokens.size() == 6) {
-                    if (tokens[1] == "-s") {
-                        std::string textureFileName = ResolveFileName(fileName, tokens[5]);
-                        if (!currentMaterial->LoadTexture(textureFileName)) {
-                            std::cout << "OBJObject::ParseMtl() : Could not load texture : " << textureFileName << std::endl;
-                        }
 
-                        currentMaterial->SetTextureScale(Vec3(atof(tokens[2].c_str()),
-                                                              atof(tokens[3].c_str()),
-                                                              atof(tokens[4].c_str())));                 
+                    GLuint vertexIndex = (GLuint)(vertexData.size() / vertexSize);
+                    bool newVertex = true;
+
+                    // Flat shaded corners could only share a vertex within a face, so don't weld them
+                    if (smooth) {
+                        std::pair<std::unordered_map<Corner, GLuint, CornerHash>::iterator, bool> result = 
+                            welded.insert(std::make_pair(corner, vertexIndex));
+
+                        vertexIndex = result.first->second;
+                        newVertex = result.second;
                     }
-                    else {
-                        std::cout << "OBJObject::ParseMtl() : Invalid texture parameter: " << s << std::endl;
+
+                    if (newVertex) {
+                        const Vec3& position = verts[corner.vertex];
+                        Vec3 normal = corner.normal >= 0 ? vertexNormals[corner.normal] : face.GetNormal();
+                        Vec3 textureCoord;
+
+                        if (corner.textureCoord >= 0) {
+                            const Vec3& coord = textureCoords[corner.textureCoord];
+                            textureCoord.Set(coord.X() * textureScale.X(), coord.Y() * textureScale.Y(), coord.Z() * textureScale.Z());
+                            range.hasTextureCoords = true;
+                        }
+
+                        GLfloat data[vertexSize] = { (GLfloat)position.X(), (GLfloat)position.Y(), (GLfloat)position.Z(),
+                                                     (GLfloat)normal.X(), (GLfloat)normal.Y(), (GLfloat)normal.Z(),
+                                                     (GLfloat)textureCoord.X(), (GLfloat)textureCoord.Y(), (GLfloat)textureCoord.Z() };
+                        vertexData.insert(vertexData.end(), data, data + vertexSize);
                     }
+
+                    corners[v] = vertexIndex;
                 }
-                else {
-                    std::cout << "OBJObject::ParseMtl() : Invalid texture : " << s << std::endl;
+
+                numCorners += numVertices;
+
+                // Triangle fan, as GL_POLYGON draws a convex polygon
+                for (int v = 1; v + 1 < numVertices; v++) {
+                    indices.push_back(corners[0]);
+                    indices.push_back(corners[v]);
+                    indices.push_back(corners[v + 1]);
+                }
+
+                // Polygon edges
+                for (int v = 0; v < numVertices && numVertices > 1; v++) {
+                    edges.push_back(corners[v]);
+                    edges.push_back(corners[(v + 1) % numVertices]);
+                }
+            }
+
+            range.numTriangleIndices = (int)indices.size() - range.triangleStart;
+
+            range.edgeStart = (int)indices.size();
+            range.numEdgeIndices = (int)edges.size();
+            indices.insert(indices.end(), edges.begin(), edges.end());
+
+            buffers.ranges.push_back(range);
+        }
+    }
+
+
+    // Upload
+    if (buffers.vertexBuffer == 0) glGenBuffersARB(1, &buffers.vertexBuffer);
+    if (buffers.indexBuffer == 0) glGenBuffersARB(1, &buffers.indexBuffer);
+
+    while (glGetError() != GL_NO_ERROR);
+
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, buffers.vertexBuffer);
+    glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertexData.size() * sizeof(GLfloat), vertexData.empty() ? NULL : &vertexData[0], GL_STATIC_DRAW_ARB);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, buffers.indexBuffer);
+    glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indices.size() * sizeof(GLuint), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW_ARB);
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+
+    if (glGetError() != GL_NO_ERROR) {
+        std::cout << "OBJObject::BuildBuffers() : Could not create vertex and index buffers." << std::endl;
+        DeleteBuffers(buffers);
+        return false;
+    }
+
+    std::cout << "OBJObject::BuildBuffers() : Welded " << numCorners << " face vertices into " 
+              << vertexData.size() / vertexSize << " vertices for " << (smooth ? "smooth" : "flat") << " shading";
+    if (level > 0) std::cout << " at level of detail " << level;
+    std::cout << std::endl;
+
+    buffers.current = true;
+
+    return true;
+}
+
+void OBJObject::DrawBuffers(GeometryBuffers& buffers) {
+    const GLsizei stride = 9 * sizeof(GLfloat);
+
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, buffers.vertexBuffer);
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, buffers.indexBuffer);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    glVertexPointer(3, GL_FLOAT, stride, (const GLvoid*)0);
+    glNormalPointer(GL_FLOAT, stride, (const GLvoid*)(3 * sizeof(GLfloat)));
+    glTexCoordPointer(3, GL_FLOAT, stride, (const GLvoid*)(6 * sizeof(GLfloat)));
+
+    // One draw per subgroup
+    int range = 0;
+    for (int i = 0; i < (int)groups.size(); i++) {
+        Group* group = groups[i];
+        for (int j = 0; j < group->NumSubGroups(); j++) {
+            const BufferRange& subGroupRange = buffers.ranges[range++];
+
+            group->GetSubGroup(j)->GetMaterial()->SetupRender();
+
+            if (subGroupRange.hasTextureCoords) glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            else glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+            if (wireFrame) {
+                glDrawElements(GL_LINES, subGroupRange.numEdgeIndices, GL_UNSIGNED_INT, 
+                               (const GLvoid*)(subGroupRange.edgeStart * sizeof(GLuint)));
+            }
+            else {
+                glDrawElements(GL_TRIANGLES, subGroupRange.numTriangleIndices, GL_UNSIGNED_INT, 
+                               (const GLvoid*)(subGroupRange.triangleStart * sizeof(GLuint)));
+            }
+        }
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+}
+
+void OBJObject::DeleteBuffers(GeometryBuffers& buffers) {
+    if (buffers.vertexBuffer) glDeleteBuffersARB(1, &buffers.vertexBuffer);
+    if (buffers.indexBuffer) glDeleteBuffersARB(1, &buffers.indexBuffer);
+
+    buffers.vertexBuffer = 0;
+    buffers.indexBuffer = 0;
+    buffers.ranges.clear();
+    buffers.current = false;
+}
+
+void OBJObject::GeometryChanged() {
+    displayListCurrent = false;
+
+    smoothBuffers.current = false;
+    flatBuffers.current = false;
+
+    // The levels of detail index the vertices, so only their buffers change
+    for (int i = 0; i < (int)levels.size(); i++) {
+        levels[i].smoothBuffers.current = false;
+        levels[i].flatBuffers.current = false;
+    }
+
+    boundsCurrent = false;
+
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    depthsCurrent = false;
+
+    bspTree.Clear();
+    bspOrder.clear();
+    bvh.Clear();
+}
+
+
+void OBJObject::DepthSort() {
+    if (useBSPTree && bspTree.Empty()) BuildBSPTree();
+
+    if (useBSPTree) {
+        if (scale == 0.0) return;
+
+        // Walk the tree from the camera in object space
+        Vec3 camera = (!quaternion * (cameraPosition - position)) * (1.0 / scale);
+        float eye[3] = { (float)camera.X(), (float)camera.Y(), (float)camera.Z() };
+
+        bspTree.GetBackToFront(eye, bspOrder);
+
+        return;
+    }
+
+    if (depths.size() == 0) { 
+        for (int i = 0; i < (int)groups.size(); i++) {
+            Group* group = groups[i];
+            for (int j = 0; j < (int)group->NumSubGroups(); j++) {
+                SubGroup* subGroup = group->GetSubGroup(j);
+                for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
+                    FaceDepth depth;
+                    depth.face = subGroup->GetFace(k);
+                    depth.subGroup = subGroup;
+                    depth.depth = 0.0f;
+
+                    depths.push_back(depth);
                 }
             }
         }
+
+        depthsCurrent = false;
+    }
+
+    if (depths.size() == 0 || scale == 0.0) return;
+
+    if (centerX.size() == 0) CalculateFaceCenters();
+
+
+    // Move the camera into object space, which keeps the order of the distances to the faces
+    Vec3 camera = (!quaternion * (cameraPosition - position)) * (1.0 / scale);
+
+    // Keep the previous order while the camera has barely moved
+    if (depthsCurrent && camera.Distance(sortedCamera) <= depthSortTolerance * sortedCamera.Distance(modelCenter)) return;
+
+    sortedCamera = camera;
+    depthsCurrent = true;
+
+
+    // Squared distances by face index
+    int numFaces = (int)centerX.size();
+    faceDistances.resize(numFaces);
+
+    float cx = (float)camera.X();
+    float cy = (float)camera.Y();
+    float cz = (float)camera.Z();
+
+    int f = 0;
+#ifdef OBJOBJECT_SSE
+    __m128 cameraX = _mm_set1_ps(cx);
+    __m128 cameraY = _mm_set1_ps(cy);
+    __m128 cameraZ = _mm_set1_ps(cz);
+
+    for (; f + 4 <= numFaces; f += 4) {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(&centerX[f]), cameraX);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(&centerY[f]), cameraY);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(&centerZ[f]), cameraZ);
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        _mm_storeu_ps(&faceDistances[f], distance);
     }
+#endif
+    for (; f < numFaces; f++) {
+        float dx = centerX[f] - cx;
+        float dy = centerY[f] - cy;
+        float dz = centerZ[f] - cz;
 
-    file.close();
+        faceDistances[f] = dx * dx + dy * dy + dz * dz;
+    }
 
-    return true;
-}
 
+    // Farthest first.  Distances are not negative, so their bits sort as unsigned integers, 
+    // and inverting them sorts the largest first.  Starting from the previous order keeps 
+    // faces at equal distances in place.
+    int n = (int)depths.size();
+    sortKeys.resize(n);
+    sortOrder.resize(n);
 
-std::string OBJObject::ResolveFileName(const std::string& parent, const std::string& child) {
-    std::string p = parent;
-    std::string c = child;
+    for (int i = 0; i < n; i++) {
+        float distance = faceDistances[depths[i].face.GetIndex()];
+        depths[i].depth = distance;
 
-    bool relative = false;
-    if (c[0] == '.' && (c[1] == '/' || c[1] == '\\')) {
-        c = c.substr(2);
-        relative = true;
+        uint32_t bits;
+        memcpy(&bits, &distance, sizeof(bits));
+
+        sortKeys[i] = ~bits;
+        sortOrder[i] = i;
     }
-    else if (c.find('/') == std::string::npos && c.find('\\') == std::string::npos) {
-        relative = true;
+
+    RadixSort(sortKeys, sortOrder, keyScratch, orderScratch);
+
+    sortedDepths.resize(n);
+    for (int i = 0; i < n; i++) {
+        sortedDepths[i] = depths[sortOrder[i]];
     }
+    depths.swap(sortedDepths);
+}
 
-    if (relative) {
-        // Relative path
-        std::string path;
+void OBJObject::CalculateFaceCenters() {
+    int numFaces = faceList.NumFaces();
 
-        size_t found = p.rfind('/');
-        if (found != std::string::npos) {
-            path = p.substr(0, found + 1);
-        }
-        else {
-            found = p.rfind('\\');
-            if (found != std::string::npos) {
-                path = p.substr(0, found + 1);
+    centerX.resize(numFaces);
+    centerY.resize(numFaces);
+    centerZ.resize(numFaces);
+
+    GetLoadPool().ParallelFor(numFaces, 4096, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Face face(&faceList, i);
+
+            Vec3 center(0, 0, 0);
+            for (int v = 0; v < face.NumVertices(); v++) {
+                center += verts[face.GetVertexIndex(v)];
             }
+            if (face.NumVertices() > 0) center *= 1.0 / face.NumVertices();
+
+            centerX[i] = (float)center.X();
+            centerY[i] = (float)center.Y();
+            centerZ[i] = (float)center.Z();
         }
+    });
 
-        c = path + c;
+    // For the sort tolerance
+    modelCenter.Set(0, 0, 0);
+    for (int i = 0; i < numFaces; i++) {
+        modelCenter += Vec3(centerX[i], centerY[i], centerZ[i]);
     }
-
-    return c;
+    if (numFaces > 0) modelCenter *= 1.0 / numFaces;
 }
 
+void OBJObject::BuildBSPTree() {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-void OBJObject::AddGroup(const std::string& name) {
+    // Every face with its own copy of its vertices
+    std::vector<float> polygonVertices;
+    std::vector<int> starts(1, 0);
+    std::vector<int> tags;
+
+    int subGroupIndex = 0;
     for (int i = 0; i < (int)groups.size(); i++) {
-        if (name == groups[i]->GetName()) {
-            currentGroup = groups[i];
-            return;
+        Group* group = groups[i];
+        for (int j = 0; j < group->NumSubGroups(); j++, subGroupIndex++) {
+            SubGroup* subGroup = group->GetSubGroup(j);
+            for (int k = 0; k < subGroup->NumFaces(); k++) {
+                Face face = subGroup->GetFace(k);
+                Vec3 faceNormal = face.GetNormal();
+
+                for (int v = 0; v < face.NumVertices(); v++) {
+                    Vec3 position = verts[face.GetVertexIndex(v)];
+                    Vec3 normal = v < face.NumVertexNormals() ? vertexNormals[face.GetVertexNormalIndex(v)] : faceNormal;
+                    Vec3 textureCoord = v < face.NumTextureCoords() ? textureCoords[face.GetTextureCoordIndex(v)] : Vec3(0, 0, 0);
+
+                    float vertex[BSPTree::vertexSize] = {
+                        (float)position.X(), (float)position.Y(), (float)position.Z(),
+                        (float)normal.X(), (float)normal.Y(), (float)normal.Z(),
+                        (float)textureCoord.X(), (float)textureCoord.Y(), (float)textureCoord.Z()
+                    };
+                    polygonVertices.insert(polygonVertices.end(), vertex, vertex + BSPTree::vertexSize);
+                }
+
+                starts.push_back((int)polygonVertices.size() / BSPTree::vertexSize);
+                tags.push_back(subGroupIndex * 2 + (face.NumTextureCoords() > 0 ? 1 : 0));
+            }
         }
     }
 
-    // Didn't find it, so add it
-    groups.push_back(new Group(name));
-    currentGroup = groups.back();
-    currentSubGroup = currentGroup->AddSubGroup();
-}
+    bool built = bspTree.Build(polygonVertices, starts, tags, GetLoadPool());
 
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 
-void OBJObject::AddMaterial(const std::string& name) {
-    for (int i = 0; i < (int)materials.size(); i++) {
-        if (name == materials[i]->GetName()) {
-            currentMaterial = materials[i];
-            return;
-        }
+    if (!built) {
+        // Fall back to sorting by distance
+        std::cout << "OBJObject::BuildBSPTree() : Too many split faces after " << seconds 
+                  << " s, sorting by distance instead" << std::endl;
+
+        useBSPTree = false;
+        return;
     }
 
-    // Didn't find it, so add it
-    materials.push_back(new Material(name));
-    currentMaterial = materials.back();
+    std::cout << "OBJObject::BuildBSPTree() : " << bspTree.NumPolygons() << " polygons from " << tags.size() 
+              << " faces, " << bspTree.NumNodes() << " nodes, " << bspTree.GetMemoryUsage() / (1024.0 * 1024.0)
+              << " MB, in " << seconds << " s" << std::endl;
 }
 
+void OBJObject::RenderBSPTree() {
+    // Nothing to draw until DepthSort() has built the tree and ordered its polygons
+    if (bspTree.Empty() || bspOrder.empty()) return;
 
-void OBJObject::AddVertex(const Vec3& v) {
-    verts.push_back(v);
-}
+    std::vector<SubGroup*> subGroups;
+    for (int i = 0; i < (int)groups.size(); i++) {
+        for (int j = 0; j < groups[i]->NumSubGroups(); j++) {
+            subGroups.push_back(groups[i]->GetSubGroup(j));
+        }
+    }
 
-void OBJObject::AddTextureCoord(const Vec3& vt) {
-    textureCoords.push_back(vt);
-}
+    SubGroup* subGroup = NULL;
+    for (int i = 0; i < (int)bspOrder.size(); i++) {
+        int polygon = bspOrder[i];
+        int tag = bspTree.tags[polygon];
 
-void OBJObject::AddVertexNormal(const Vec3& vn) {
-    vertexNormals.push_back(vn);
-}
+        if (subGroups[tag / 2] != subGroup) {
+            bool first = subGroup == NULL;
 
+            subGroup = subGroups[tag / 2];
+            subGroup->GetMaterial()->SetupRender();
 
-void OBJObject::CalculateFaceNormals() {
-    for (int i = 0; i < (int)groups.size(); i++) {
-        Group* group = groups[i];
-        for (int j = 0; j < (int)group->NumSubGroups(); j++) {
-            SubGroup* subGroup = group->GetSubGroup(j);
-            for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                Face* face = subGroup->GetFace(k);
+            if (first) glEnable(GL_BLEND);
+        }
 
-                if (face->NumVertices() >= 3) {
-                    Vec3 p0, p1, p2;
-                    Vec3 v0, v1;
-                    Vec3 normal;
+        if (wireFrame) {
+            glBegin(GL_LINES);
+        }
+        else {
+            glBegin(GL_POLYGON);
+        }
 
-                    p0 = verts[face->GetVertexIndex(0)];
-                    p1 = verts[face->GetVertexIndex(1)];
-                    p2 = verts[face->GetVertexIndex(2)];
+        // Face normal
+        if (!smoothShading) {
+            glNormal3fv(&bspTree.planes[polygon * 4]);
+        }
 
-                    v0 = p0 - p1;
-                    v1 = p2 - p1;
+        Vec3 textureScale = subGroup->GetTextureScale();
 
-                    normal = v1 * v0;
-                    normal.Normalize();
+        for (int v = bspTree.polygonStarts[polygon]; v < bspTree.polygonStarts[polygon + 1]; v++) {
+            const float* vertex = &bspTree.vertices[v * BSPTree::vertexSize];
 
-                    face->SetNormal(normal);
-                }
-                else {
-                    std::cout << "OBJObject::CalculateFaceNormals() : group " << group->GetName() << ", subgroup " << j << ", face " << k << " has < 3 vertices." << std::endl;
-                }
+            if (smoothShading) {
+                glNormal3fv(vertex + 3);
+            }
+
+            if (tag & 1) {
+                glTexCoord3f((GLfloat)(vertex[6] * textureScale.X()),
+                             (GLfloat)(vertex[7] * textureScale.Y()),
+                             (GLfloat)(vertex[8] * textureScale.Z()));
             }
+
+            glVertex3fv(vertex);
         }
+        glEnd();
     }
 }
 
-void OBJObject::CalculateVertexNormals() {
-    vertexNormals.resize(verts.size());
+void OBJObject::BuildLevelsOfDetail() {
+    DeleteLevelsOfDetail();
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // Triangle fans of the faces, tagged with their subgroup counting through the groups
+    std::vector<MeshSimplifier::Corner> corners;
+    std::vector<int> tags;
+    int numSubGroups = 0;
 
     for (int i = 0; i < (int)groups.size(); i++) {
         Group* group = groups[i];
-        for (int j = 0; j < (int)group->NumSubGroups(); j++) {
+        for (int j = 0; j < group->NumSubGroups(); j++, numSubGroups++) {
             SubGroup* subGroup = group->GetSubGroup(j);
-            for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                Face* face = subGroup->GetFace(k);
 
-                for (int v = 0; v < (int)face->NumVertices(); v++) {
-                    // Add face normals, to be normalized later
-                    vertexNormals[face->GetVertexIndex(v)] += face->GetNormal();
+            for (int k = 0; k < subGroup->NumFaces(); k++) {
+                Face face = subGroup->GetFace(k);
+                int numVertices = face.NumVertices();
+
+                for (int v = 1; v + 1 < numVertices; v++) {
+                    int fan[3] = { 0, v, v + 1 };
+
+                    for (int c = 0; c < 3; c++) {
+                        int n = fan[c];
+
+                        // As in BuildBuffers()
+                        MeshSimplifier::Corner corner;
+                        corner.vertex = face.GetVertexIndex(n);
+                        corner.textureCoord = n < face.NumTextureCoords() ? face.GetTextureCoordIndex(n) : -1;
+                        corner.normal = face.NumVertexNormals() > 0 ? face.GetVertexNormalIndex(std::min(n, face.NumVertexNormals() - 1)) : -1;
+
+                        if (corner.textureCoord >= (int)textureCoords.size()) corner.textureCoord = -1;
+                        if (corner.normal >= (int)vertexNormals.size()) corner.normal = -1;
+
+                        corners.push_back(corner);
+                    }
 
-                    face->AddVertexNormalIndex(face->GetVertexIndex(v));
+                    tags.push_back(numSubGroups);
                 }
             }
         }
     }
 
-    for (int i = 0; i < (int)vertexNormals.size(); i++) {
-        vertexNormals[i].Normalize();
-    }
-}
+    UpdateBounds();
 
-void OBJObject::PreRender() {
-    glEnable(GL_LIGHTING);
+    MeshSimplifier simplifier;
+    simplifier.SetMesh(verts, corners, tags, GetLoadPool());
 
-    if (cullFace) glEnable(GL_CULL_FACE);
-    else glDisable(GL_CULL_FACE);
-}
+    std::vector<MeshSimplifier::Corner>().swap(corners);
+    std::vector<int>().swap(tags);
 
-void OBJObject::DoRender() {
-    // Push the modelview matrix stack
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
+    int numTriangles = simplifier.NumTriangles();
 
-    if (!immediateMode && !displayListCurrent) {
-        // Need new display list
-        if (glIsList(displayList) == GL_TRUE) {
-            glDeleteLists(displayList, 1);
+    for (int i = 0; i < numLevels; i++) {
+        simplifier.Simplify((int)(numTriangles * levelRatio), GetLoadPool());
+
+        // Stop once simplifying makes little difference
+        if (simplifier.NumTriangles() > numTriangles * 0.9) break;
+        numTriangles = simplifier.NumTriangles();
+
+        levels.push_back(LevelOfDetail());
+        LevelOfDetail& level = levels.back();
+
+        level.error = boundsRadius > 0.0 ? simplifier.GetError() / boundsRadius : 0.0;
+
+        // Triangles with each subgroup's together, in order
+        const std::vector<MeshSimplifier::Corner>& triangles = simplifier.GetCorners();
+        const std::vector<int>& triangleTags = simplifier.GetTags();
+
+        std::vector<int>& starts = level.subGroupStarts;
+        starts.assign(numSubGroups + 1, 0);
+        for (int j = 0; j < numTriangles; j++) {
+            starts[triangleTags[j] + 1]++;
         }
 
-        displayList = glGenLists(1);
+        for (int j = 0; j < numSubGroups; j++) {
+            starts[j + 1] += starts[j];
+        }
 
-        glNewList(displayList, GL_COMPILE);
-        RenderGeometry();
-        glEndList();
+        std::vector<int> next(starts.begin(), starts.end() - 1);
+        std::vector<int> order(numTriangles);
+        for (int j = 0; j < numTriangles; j++) {
+            order[next[triangleTags[j]]++] = j;
+        }
 
-        displayListCurrent = true;
-    }
+        // Texture coordinates and normals are kept where all three corners have them
+        FaceList& faces = level.faces;
+        faces.vertexIndices.reserve(numTriangles * 3);
 
+        for (int j = 0; j < numTriangles; j++) {
+            const MeshSimplifier::Corner* c = &triangles[order[j] * 3];
 
-    glTranslated(position.X(), position.Y(), position.Z());
-    double angle;
-    Vec3 axis;
-    quaternion.GetAngleAxis(angle, axis);    
-    glRotated(Quat::RadiansToDegrees(angle), axis.X(), axis.Y(), axis.Z());
-    glScaled(scale, scale, scale);
+            faces.AddFace();
+
+            for (int k = 0; k < 3; k++) {
+                faces.AddVertexIndex(c[k].vertex);
+            }
 
+            if (c[0].textureCoord >= 0 && c[1].textureCoord >= 0 && c[2].textureCoord >= 0) {
+                for (int k = 0; k < 3; k++) {
+                    faces.AddTextureCoordIndex(c[k].textureCoord);
+                }
+            }
 
-    if (!immediateMode) {
-        glCallList(displayList);
+            if (c[0].normal >= 0 && c[1].normal >= 0 && c[2].normal >= 0) {
+                for (int k = 0; k < 3; k++) {
+                    faces.AddVertexNormalIndex(c[k].normal);
+                }
+            }
+        }
     }
-    else {
-        RenderGeometry();
+
+    std::vector<float> positions;
+    GetFloatPositions(verts, positions, GetLoadPool());
+
+    for (int i = 0; i < (int)levels.size(); i++) {
+        CalculateNormals(levels[i].faces, positions, GetLoadPool());
     }
 
-    // Pop the modelview matrix stack
-    glPopMatrix();
+    levelsCurrent = true;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "OBJObject::BuildLevelsOfDetail() : Built " << levels.size() << " levels in " << seconds << " s" << std::endl;
+    for (int i = 0; i < (int)levels.size(); i++) {
+        std::cout << "OBJObject::BuildLevelsOfDetail() : Level " << i + 1 << " has " << levels[i].faces.NumFaces() 
+                  << " faces, error " << levels[i].error * boundsRadius << std::endl;
+    }
 }
 
-void OBJObject::PostRender() {
-    glDisable(GL_TEXTURE_2D);
+void OBJObject::DeleteLevelsOfDetail() {
+    for (int i = 0; i < (int)levels.size(); i++) {
+        DeleteBuffers(levels[i].smoothBuffers);
+        DeleteBuffers(levels[i].flatBuffers);
+    }
+
+    std::vector<LevelOfDetail>().swap(levels);
+
+    levelsCurrent = false;
+    currentLevel = 0;
 }
 
+int OBJObject::SelectLevelOfDetail() {
+    if (levels.empty()) return 0;
 
-void OBJObject::RenderGeometry() {
-    if (depthSort) {    
-        SubGroup* subGroup = depths[0].subGroup;
-        subGroup->GetMaterial()->SetupRender();
-        glEnable(GL_BLEND);
-        for (int i = 0; i < (int)depths.size(); i++) { 
-            if (depths[i].subGroup != subGroup) {
-                subGroup = depths[i].subGroup;
-                subGroup->GetMaterial()->SetupRender();
-            }
-            Face* face = depths[i].face;
-            if (wireFrame) {
-                glBegin(GL_LINES);
-            }
-            else {
-                glBegin(GL_POLYGON);
-            }
+    UpdateBounds();
 
-            // Face normal
-            if (!smoothShading || face->NumVertexNormals() == 0) {
-                glNormal3f((GLfloat)face->GetNormal().X(),
-                           (GLfloat)face->GetNormal().Y(),
-                           (GLfloat)face->GetNormal().Z());
-            }
+    GLdouble modelView[16];
+    GLdouble projection[16];
+    GLint viewport[4];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
 
-            // Draw each vertex
-            for (int v = 0; v < face->NumVertices(); v++) {
-                // Vertex normals
-                if (v < face->NumVertexNormals() && smoothShading) {
-                    int index = face->GetVertexNormalIndex(v);
-                    glNormal3f((GLfloat)vertexNormals[index].X(), 
-                               (GLfloat)vertexNormals[index].Y(), 
-                               (GLfloat)vertexNormals[index].Z());
-                }
+    // Pixels covered by the bounding radius, at unit depth for a perspective projection
+    Vec3 center = position + quaternion * (boundsCenter * scale);
+    double radius = boundsRadius * scale;
+    double pixels = radius * projection[5] * viewport[3] * 0.5;
 
-                // Texture coordinates
-                if (v < face->NumTextureCoords()) {
-                    int index = face->GetTextureCoordIndex(v);
-                    glTexCoord3f((GLfloat)(textureCoords[index].X() * subGroup->GetTextureScale().X()),
-                                 (GLfloat)(textureCoords[index].Y() * subGroup->GetTextureScale().Y()),
-                                 (GLfloat)(textureCoords[index].Z() * subGroup->GetTextureScale().Z()));
-                }
+    // At the nearest point of the bounding sphere, using all the detail once inside it
+    if (projection[11] != 0.0) {
+        double depth = -(modelView[2] * center.X() + modelView[6] * center.Y() + modelView[10] * center.Z() + modelView[14]) - radius;
+        if (depth <= 0.0) return 0;
 
-                // Position
-                int index = face->GetVertexIndex(v);
-                glVertex3f((GLfloat)verts[index].X(), 
-                           (GLfloat)verts[index].Y(), 
-                           (GLfloat)verts[index].Z());
-            }
-            glEnd();
-        }
+        pixels /= depth;
     }
-    else {
-        for (int i = 0; i < (int)groups.size(); i++) {
-            Group* group = groups[i];
-            for (int j = 0; j < (int)group->NumSubGroups(); j++) {
-                SubGroup* subGroup = group->GetSubGroup(j);
-                subGroup->GetMaterial()->SetupRender();
-                for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                    Face* face = subGroup->GetFace(k);
-                    if (wireFrame) {
-                        glBegin(GL_LINES);
-                    }
-                    else {
-                        glBegin(GL_POLYGON);
-                    }
 
-                    // Face normal
-                    if (!smoothShading || face->NumVertexNormals() == 0) {
-                        glNormal3f((GLfloat)face->GetNormal().X(),
-                                   (GLfloat)face->GetNormal().Y(),
-                                   (GLfloat)face->GetNormal().Z());
-                    }
+    // Coarsest level with an error of no more than the pixel error on screen
+    int level = 0;
+    while (level < (int)levels.size() && levels[level].error * pixels <= lodPixelError) {
+        level++;
+    }
 
-                    // Draw each vertex
-                    for (int v = 0; v < face->NumVertices(); v++) {
-                        // Vertex normals
-                        if (v < face->NumVertexNormals() && smoothShading) {
-                            int index = face->GetVertexNormalIndex(v);
-                            glNormal3f((GLfloat)vertexNormals[index].X(), 
-                                       (GLfloat)vertexNormals[index].Y(), 
-                                       (GLfloat)vertexNormals[index].Z());
-                        }
+    return level;
+}
 
-                        // Texture coordinates
-                        if (v < face->NumTextureCoords()) {
-                            int index = face->GetTextureCoordIndex(v);
-                            glTexCoord3f((GLfloat)(textureCoords[index].X() * subGroup->GetTextureScale().X()),
-                                         (GLfloat)(textureCoords[index].Y() * subGroup->GetTextureScale().Y()),
-                                         (GLfloat)(textureCoords[index].Z() * subGroup->GetTextureScale().Z()));
-                        }
+void OBJObject::UpdateBounds() {
+    if (boundsCurrent) return;
 
-                        // Position
-                        int index = face->GetVertexIndex(v);
-                        glVertex3f((GLfloat)verts[index].X(), 
-                                   (GLfloat)verts[index].Y(), 
-                                   (GLfloat)verts[index].Z());
-                    }
-                    glEnd();
-                }
-            }
-        }
+    // Center of the bounding box, and the distance to the farthest vertex from it
+    Vec3 min;
+    Vec3 max;
+
+    if (verts.size() > 0) {
+        min = verts[0];
+        max = verts[0];
     }
-}
 
-void OBJObject::DepthSort() {
-    if (depths.size() == 0) { 
-        for (int i = 0; i < (int)groups.size(); i++) {
-            Group* group = groups[i];
-            for (int j = 0; j < (int)group->NumSubGroups(); j++) {
-                SubGroup* subGroup = group->GetSubGroup(j);
-                for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                    FaceDepth depth;
-                    depth.face = subGroup->GetFace(k);
-                    depth.subGroup = subGroup;
+    for (int i = 1; i < (int)verts.size(); i++) {
+        min.Set(std::min(min.X(), verts[i].X()), std::min(min.Y(), verts[i].Y()), std::min(min.Z(), verts[i].Z()));
+        max.Set(std::max(max.X(), verts[i].X()), std::max(max.Y(), verts[i].Y()), std::max(max.Z(), verts[i].Z()));
+    }
 
-                    depths.push_back(depth);
-                }
-            }
-        }
+    boundsCenter = (min + max) * 0.5;
+
+    double radius2 = 0.0;
+    for (int i = 0; i < (int)verts.size(); i++) {
+        Vec3 offset = verts[i] - boundsCenter;
+        radius2 = std::max(radius2, offset.DotProduct(offset));
     }
 
-    for (int i = 0; i < (int)depths.size(); i++) {
-        Face* face = depths[i].face;
+    boundsRadius = sqrt(radius2);
+    boundsCurrent = true;
+}
+
+void OBJObject::BuildBVH() {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-        Vec3 center(0, 0, 0);
-        for (int v = 0; v < face->NumVertices(); v++) {
-            Vec3 pos = verts[face->GetVertexIndex(v)];
+    std::vector<float> positions;
+    GetFloatPositions(verts, positions, GetLoadPool());
+    bvhOrigin = verts.empty() ? Vec3(0.0, 0.0, 0.0) : verts[0];
 
-            pos *= scale;
-            pos = quaternion * pos;
-            pos += position;
+    // Triangle fans of the faces, as for drawing
+    int numFaces = faceList.NumFaces();
+    const std::vector<int>& starts = faceList.vertexStarts;
+    const std::vector<int>& indices = faceList.vertexIndices;
 
-            center += pos;
+    int numTriangles = 0;
+    for (int i = 0; i < numFaces; i++) {
+        numTriangles += std::max(starts[i + 1] - starts[i] - 2, 0);
+    }
+
+    std::vector<int> triangleVertices;
+    std::vector<int> tags;
+    triangleVertices.reserve(numTriangles * 3);
+    tags.reserve(numTriangles);
+
+    for (int i = 0; i < numFaces; i++) {
+        for (int v = starts[i] + 1; v + 1 < starts[i + 1]; v++) {
+            triangleVertices.push_back(indices[starts[i]]);
+            triangleVertices.push_back(indices[v]);
+            triangleVertices.push_back(indices[v + 1]);
+            tags.push_back(i);
         }
-        center *= 1.0 / face->NumVertices();
-        depths[i].depth = (float)center.Distance(cameraPosition);
-        depths[i].face = face;
     }
 
-    std::sort(depths.begin(), depths.end(), DepthGreaterThan);
+    bvh.Build(positions, triangleVertices, tags, GetLoadPool());
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "OBJObject::BuildBVH() : " << bvh.NumTriangles() << " triangles from " << numFaces
+              << " faces, " << bvh.NumNodes() << " nodes, " << bvh.GetMemoryUsage() / (1024.0 * 1024.0)
+              << " MB, in " << seconds << " s" << std::endl;
 }
\ No newline at end of file
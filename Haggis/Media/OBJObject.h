@@ -13,12 +13,21 @@
 #define OBJOBJECT_H
 
 
+#include "BSPTree.h"
+#include "MeshBVH.h"
 #include "RenderObject.h"
 
+#include <memory>
+#include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
+class Texture;
+class ThreadPool;
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -36,9 +45,16 @@ public:
 
     void SetDoSpecular(bool flag);
 
+    // Start decoding the texture in the background.  Returns false if the file does not
+    // exist.  The material is drawn untextured until UpdateTexture() creates the texture.
     bool LoadTexture(const std::string& fileName);
     void SetTextureScale(const Vec3& scale);
 
+    // Create the texture once decoded.  Call on the render thread outside of display list
+    // compilation.  Returns true the first time the texture is ready for this material,
+    // whether it was created by this call or by another material sharing it.
+    bool UpdateTexture();
+
     const std::string& GetName();
     const Vec3& GetTextureScale();
 
@@ -56,41 +72,80 @@ private:
 
     bool doSpecular;
 
-    GLuint texture;
-    bool hasTexture;
+    // Shared with other materials using the same file
+    std::shared_ptr<Texture> texture;
     Vec3 textureScale;
+
+    // Whether the texture was ready when UpdateTexture() last returned
+    bool textureReady;
 };
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 
+// Faces in compressed sparse row form.  The vertex indices of face i are vertexIndices from
+// vertexStarts[i] up to vertexStarts[i + 1], and likewise for texture coordinates and vertex
+// normals, so all faces share a few contiguous arrays instead of allocating their own.
+struct FaceList {
+    FaceList();
+
+    int NumFaces() const;
+
+    // Add an empty face, then add its indices
+    void AddFace();
+    void AddVertexIndex(int index);
+    void AddTextureCoordIndex(int index);
+    void AddVertexNormalIndex(int index);
+
+    void Clear();
+
+    // Bytes allocated for the arrays
+    size_t GetMemoryUsage() const;
+
+    // Three per face
+    std::vector<float> normals;
+
+    // One more than the number of faces
+    std::vector<int> vertexStarts;
+    std::vector<int> textureCoordStarts;
+    std::vector<int> vertexNormalStarts;
+
+    std::vector<int> vertexIndices;
+    std::vector<int> textureCoordIndices;
+    std::vector<int> vertexNormalIndices;
+};
+
+
+// A view of one face in a FaceList, cheap to copy
 class Face {
 public:
-    Face();
-    ~Face();
+    Face(FaceList* faceList = NULL, int faceIndex = 0) : faces(faceList), index(faceIndex) {}
 
-    void SetNormal(const Vec3& norm);
-    const Vec3& GetNormal();
+    void SetNormal(const Vec3& norm) {
+        faces->normals[index * 3] = (float)norm.X();
+        faces->normals[index * 3 + 1] = (float)norm.Y();
+        faces->normals[index * 3 + 2] = (float)norm.Z();
+    }
+    Vec3 GetNormal() const {
+        return Vec3(faces->normals[index * 3], faces->normals[index * 3 + 1], faces->normals[index * 3 + 2]);
+    }
 
-    int NumVertices();
-    int GetVertexIndex(int i);
+    int NumVertices() const { return faces->vertexStarts[index + 1] - faces->vertexStarts[index]; }
+    int GetVertexIndex(int i) const { return faces->vertexIndices[faces->vertexStarts[index] + i]; }
 
-    int NumTextureCoords();
-    int GetTextureCoordIndex(int i);
+    int NumTextureCoords() const { return faces->textureCoordStarts[index + 1] - faces->textureCoordStarts[index]; }
+    int GetTextureCoordIndex(int i) const { return faces->textureCoordIndices[faces->textureCoordStarts[index] + i]; }
 
-    int NumVertexNormals();
-    int GetVertexNormalIndex(int i);
+    int NumVertexNormals() const { return faces->vertexNormalStarts[index + 1] - faces->vertexNormalStarts[index]; }
+    int GetVertexNormalIndex(int i) const { return faces->vertexNormalIndices[faces->vertexNormalStarts[index] + i]; }
 
-    void AddVertexIndex(int index);
-    void AddTextureCoordIndex(int index);
-    void AddVertexNormalIndex(int index);
+    // Position in the face list
+    int GetIndex() const { return index; }
 
 private:
-    Vec3 normal;
-    std::vector<int> vertexIndeces;
-    std::vector<int> textureCoordIndeces;
-    std::vector<int> vertexNormalIndeces;
+    FaceList* faces;
+    int index;
 };
 
 
@@ -103,9 +158,11 @@ public:
     ~SubGroup();
 
     int NumFaces();
-    Face* GetFace(int i);
+    Face GetFace(int i);
 
-    Face* AddFace();
+    // The subgroup's faces are a range of the model's face list
+    void SetFaces(FaceList* faceList, int first, int count);
+    int GetFirstFace();
 
     void SetMaterial(Material* mat);
     Material* GetMaterial();
@@ -113,7 +170,10 @@ public:
     Vec3 GetTextureScale();
 
 private:
-    std::vector<Face*> faces;
+    FaceList* faces;
+    int firstFace;
+    int numFaces;
+
     Material* material;
 };
 
@@ -144,9 +204,9 @@ private:
 
 // For depth sorting
 struct FaceDepth {
-    Face* face;
+    Face face;
     SubGroup* subGroup;
-    float depth;
+    float depth;        // Squared distance from the camera to the face center, in object space
 };
 
 
@@ -158,13 +218,25 @@ public:
     OBJObject();
     virtual ~OBJObject();
 
+    // Models are cached in a binary file after the first load, and reloaded from it until
+    // the model file changes.  A file loaded into an object that already has a model is
+    // added to it, and is not cached.
     bool LoadObject(const std::string& fileName);
 
+    // Where cached models are saved.  If empty, they are saved next to the model.
+    static void SetCacheDirectory(const std::string& directory);
+    static const std::string& GetCacheDirectory();
+
     double NormalizeBounds(double scaleBounds = 1.0);
 
     void SmoothShadingOn();
     void SmoothShadingOff();
 
+    // Weight the faces around a vertex by their angle at it when calculating vertex normals
+    // for models without them, so normals do not lean towards more finely divided sides.  
+    // Set before LoadObject().  Off by default, giving each face the same weight.
+    void SetAngleWeightedNormals(bool weighted);
+
     void WireFrameOn();
     void WireFrameOff();
 
@@ -187,6 +259,46 @@ public:
     void DepthSortOff();
     void DepthSort();
 
+    // DepthSort() keeps the previous order until the camera has moved, relative to the 
+    // object, by more than this fraction of its distance from the model.  Defaults to 0.001.
+    void SetDepthSortTolerance(double tolerance);
+
+    // Order faces with a BSP tree instead, which is exact for intersecting and long faces,
+    // and only walks the tree for each camera position.  Set before LoadObject() so the
+    // tree is saved in the model cache and only built once per model.  Otherwise it is built
+    // by the next DepthSort(), and rebuilt after the points change.  Turned off if splitting
+    // would make the tree too large, as for many randomly intersecting faces.  The ordered
+    // faces are drawn in immediate mode each frame rather than from the display list.
+    void SetUseBSPTree(bool use);
+
+    // Build a chain of up to numLevels simplified copies of the model, each with about ratio
+    // times the faces of the one before, and draw the coarsest level whose simplification
+    // error covers no more than the pixel error on screen.  Set before LoadObject() so the
+    // levels are saved in the model cache and only built once per model.  Otherwise they are
+    // built by the next render.  Levels are only drawn from vertex buffers, so not when depth
+    // sorting or in immediate mode.
+    void SetLevelsOfDetail(int numLevels, double ratio = 0.5);
+
+    // Defaults to 1 pixel
+    void SetLevelOfDetailPixelError(double pixels);
+
+    // Levels built, not counting the full model, and the level last drawn, 0 for the full model
+    int NumLevelsOfDetail() const;
+    int GetLevelOfDetail() const;
+
+    // Nearest point where a ray in world space, e.g. from Interactor::GetPickRay(), hits the
+    // model, and the normal of the face hit.  The first query builds a bounding volume
+    // hierarchy of the faces, which is built again after the points change.
+    bool Pick(const Vec3& rayOrigin, const Vec3& rayDirection, Vec3& point, Vec3& normal);
+
+    // Whether the model blocks the line between two points in world space
+    bool Occludes(const Vec3& start, const Vec3& end);
+
+    // The hierarchy itself, for many queries at once, e.g. from worker threads.  Its
+    // positions are in object space relative to the origin returned, and hits are tagged
+    // with face indices.
+    const MeshBVH& GetBVH(Vec3& origin);
+
 protected:
     Group* currentGroup;
     SubGroup* currentSubGroup;
@@ -195,13 +307,24 @@ protected:
     std::vector<Group*> groups;
     std::vector<Material*> materials;
 
+    // Index of the first group and material with each name
+    std::unordered_map<std::string, int> groupIndices;
+    std::unordered_map<std::string, int> materialIndices;
+
     std::vector<Vec3> verts;
     std::vector<Vec3> textureCoords;
     std::vector<Vec3> vertexNormals;
 
-    static bool initializedDevIL;
+    // Faces of all subgroups, with each subgroup's faces together
+    FaceList faceList;
+
+    // Material libraries named by the model, for the cache
+    std::vector<std::string> materialLibraries;
+
+    static std::string cacheDirectory;
 
     bool smoothShading;
+    bool angleWeightedNormals;
     bool wireFrame;
     bool immediateMode;
     bool cullFace;
@@ -209,18 +332,121 @@ protected:
     GLuint displayList;
     bool displayListCurrent;
 
+    // Retained geometry in vertex and index buffer objects, used instead of the display list
+    // when available.  Faces are triangulated, and for smooth shading each distinct 
+    // combination of vertex, texture coordinate and normal is one vertex.  Smooth and flat
+    // shading each get their own buffers, built the first time they are drawn.
+    struct BufferRange {
+        int triangleStart;
+        int numTriangleIndices;
+        int edgeStart;
+        int numEdgeIndices;
+        bool hasTextureCoords;
+    };
+
+    struct GeometryBuffers {
+        GeometryBuffers() : vertexBuffer(0), indexBuffer(0), current(false) {}
+
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+
+        // One per subgroup, in order.  Polygon edges for wireframe follow the triangles.
+        std::vector<BufferRange> ranges;
+
+        bool current;
+    };
+
+    bool useBuffers;
+    GeometryBuffers smoothBuffers;
+    GeometryBuffers flatBuffers;
+
     Vec3 cameraPosition;   
 
     bool depthSort;
     std::vector<FaceDepth> depths;
 
+    // Face centers in object space by face index, so sorting only moves the camera into 
+    // object space instead of moving every face into world space
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    Vec3 modelCenter;
+
+    // Camera in object space at the last sort
+    Vec3 sortedCamera;
+    bool depthsCurrent;
+    double depthSortTolerance;
+
+    // Reused by each sort
+    std::vector<float> faceDistances;
+    std::vector<uint32_t> sortKeys;
+    std::vector<uint32_t> keyScratch;
+    std::vector<int> sortOrder;
+    std::vector<int> orderScratch;
+    std::vector<FaceDepth> sortedDepths;
+
+    // Tree polygons are tagged with the index of their subgroup, counting through the
+    // groups in order, times two, plus one if they have texture coordinates
+    bool useBSPTree;
+    BSPTree bspTree;
+    std::vector<int> bspOrder;
+
+    // Simplified faces, which index the model's vertices, texture coordinates and normals, 
+    // so per vertex values such as ambient occlusion hold for every level
+    struct LevelOfDetail {
+        FaceList faces;
+
+        // First face of each subgroup, counting through the groups in order, then the number
+        // of faces
+        std::vector<int> subGroupStarts;
+
+        // Largest simplification error, as a fraction of the model's bounding radius
+        double error;
+
+        GeometryBuffers smoothBuffers;
+        GeometryBuffers flatBuffers;
+    };
+
+    int numLevels;
+    double levelRatio;
+    double lodPixelError;
+    std::vector<LevelOfDetail> levels;
+    bool levelsCurrent;
+    int currentLevel;
+
+    // Bounding sphere of the vertices, for the size of the model on screen
+    Vec3 boundsCenter;
+    double boundsRadius;
+    bool boundsCurrent;
+
+    // Triangulated faces for ray queries, tagged with their face index.  Positions are 
+    // relative to the first vertex, for float precision far from the origin.
+    MeshBVH bvh;
+    Vec3 bvhOrigin;
+
+    bool ParseObject(const std::string& fileName);
     bool ParseMtl(const std::string& fileName);
 
+    // Cache file for the model, identified by the model file's size and modification time
+    std::string GetCacheFileName(const std::string& fileName) const;
+    bool GetFileInfo(const std::string& fileName, int64_t& size, int64_t& modified) const;
+
+    bool ReadCache(const std::string& fileName, const std::string& cacheFileName, int64_t size, int64_t modified);
+    bool WriteCache(const std::string& cacheFileName, int64_t size, int64_t modified);
+
     std::string ResolveFileName(const std::string& parent, const std::string& child);
 
     void AddGroup(const std::string& name);
     void AddMaterial(const std::string& name);
 
+    // Returns NULL if not found
+    Group* FindGroup(const std::string& name);
+    Material* FindMaterial(const std::string& name);
+
+    // Add to the list and the lookup by name
+    void AddGroup(Group* group);
+    void AddMaterial(Material* material);
+
     void AddVertex(const Vec3& position);
     void AddTextureCoord(const Vec3& coord);
     void AddVertexNormal(const Vec3& normal);
@@ -228,11 +454,37 @@ protected:
     void CalculateFaceNormals();
     void CalculateVertexNormals();
 
+    void CalculateFaceCenters();
+
+    void BuildBSPTree();
+
+    void BuildLevelsOfDetail();
+    void DeleteLevelsOfDetail();
+
+    // Coarsest level within the pixel error for the current OpenGL matrices and viewport
+    int SelectLevelOfDetail();
+
+    void UpdateBounds();
+
+    void BuildBVH();
+
+    // Workers for loading and computing normals
+    static ThreadPool& GetLoadPool();
+
     virtual void PreRender();
     virtual void DoRender();
     virtual void PostRender();
 
     virtual void RenderGeometry();
+    void RenderBSPTree();
+
+    // Level 0 is the full model, and higher levels index the levels of detail
+    bool BuildBuffers(GeometryBuffers& buffers, bool smooth, int level = 0);
+    void DrawBuffers(GeometryBuffers& buffers);
+    void DeleteBuffers(GeometryBuffers& buffers);
+
+    // The buffers, display list, face centers, bounds, BSP tree and BVH need rebuilding
+    void GeometryChanged();
 };
 
 
@@ -22,6 +22,9 @@ OBJObjectAO::OBJObjectAO() : OBJObject() {
 
     DepthSortOn();
 
+    // Occlusion is drawn per vertex by RenderGeometry()
+    useBuffers = false;
+
     noise = new PerlinNoise();
 
     dilateGeometry = false;
@@ -122,15 +125,15 @@ bool OBJObjectAO::LoadAO(const std::string& fileName) {
             for (int j = 0; j < (int)group->NumSubGroups(); j++) {
                 SubGroup* subGroup = group->GetSubGroup(j); 
                 for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                    Face* face = subGroup->GetFace(k);
-                    for (int v = 0; v < face->NumVertices(); v++) {
-                        int n = face->GetVertexIndex(v);
+                    Face face = subGroup->GetFace(k);
+                    for (int v = 0; v < face.NumVertices(); v++) {
+                        int n = face.GetVertexIndex(v);
                         for (int v2 = 0; v2 < 2; v2++) {
                             int n2;
-                            if (v2 == 0) n2 = v == face->NumVertices() - 1 ? face->GetVertexIndex(0) : 
-                                                                             face->GetVertexIndex(v + 1);
-                            else n2 = v == 0 ? face->GetVertexIndex(face->NumVertices() - 1) :
-                                               face->GetVertexIndex(v - 1);
+                            if (v2 == 0) n2 = v == face.NumVertices() - 1 ? face.GetVertexIndex(0) : 
+                                                                           face.GetVertexIndex(v + 1);
+                            else n2 = v == 0 ? face.GetVertexIndex(face.NumVertices() - 1) :
+                                               face.GetVertexIndex(v - 1);
 
                             double g = aoDiffusion[n2] - aoDiffusion[n];
                             double c = 1.0 / (1.0 + (g / K) * (g / K));
@@ -392,8 +395,8 @@ bool OBJObjectAO::SaveVTK(const std::string& outVTKFileName) {
             SubGroup* subGroup = group->GetSubGroup(j); 
             faceCount += subGroup->NumFaces();
             for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                Face* face = subGroup->GetFace(k);
-                faceVertCount += face->NumVertices() + 1;
+                Face face = subGroup->GetFace(k);
+                faceVertCount += face.NumVertices() + 1;
             }
         }
     }
@@ -403,11 +406,11 @@ bool OBJObjectAO::SaveVTK(const std::string& outVTKFileName) {
         for (int j = 0; j < (int)group->NumSubGroups(); j++) {
             SubGroup* subGroup = group->GetSubGroup(j);
             for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                Face* face = subGroup->GetFace(k);
-                outFile << face->NumVertices() << " ";
-                for (int v = 0; v < face->NumVertices(); v++) {
-                    outFile << face->GetVertexIndex(v);
-                    if (v == face->NumVertices() - 1) outFile << std::endl;
+                Face face = subGroup->GetFace(k);
+                outFile << face.NumVertices() << " ";
+                for (int v = 0; v < face.NumVertices(); v++) {
+                    outFile << face.GetVertexIndex(v);
+                    if (v == face.NumVertices() - 1) outFile << std::endl;
                     else outFile << " ";
                 }
             }
@@ -528,12 +531,12 @@ bool OBJObjectAO::SaveOBJMTL(const std::string& filePrefix) {
             for (int j = 0; j < (int)group->NumSubGroups(); j++) {
                 SubGroup* subGroup = group->GetSubGroup(j);
                 for (int k = 0; k < (int)subGroup->NumFaces(); k++) {
-                    Face* face = subGroup->GetFace(k);
-                    if (vertexColors[face->GetVertexIndex(0)] == colors[m]) {
+                    Face face = subGroup->GetFace(k);
+                    if (vertexColors[face.GetVertexIndex(0)] == colors[m]) {
                         objFile << "f ";
-                        for (int v = 0; v < face->NumVertices(); v++) {
-                            objFile << face->GetVertexIndex(v) + 1 << "//" << face->GetVertexIndex(v) + 1;
-                            if (v == face->NumVertices() - 1) objFile << std::endl;
+                        for (int v = 0; v < face.NumVertices(); v++) {
+                            objFile << face.GetVertexIndex(v) + 1 << "//" << face.GetVertexIndex(v) + 1;
+                            if (v == face.NumVertices() - 1) objFile << std::endl;
                             else objFile << " ";
                         } 
                     }
@@ -656,6 +659,8 @@ void OBJObjectAO::ExpandPoints(double expansion) {
 	for (int i = 0; i < (int)verts.size(); i++) {
         verts[i] += vertexNormals[i] * expansion * pow(1.0 - aoDiffusion[i], 1);
     }	
+
+    GeometryChanged();
 }
 
 
@@ -745,7 +750,7 @@ void OBJObjectAO::RenderGeometry() {
             glEnable(GL_TEXTURE_3D);
             glBindTexture(GL_TEXTURE_3D, texture3D);
         }
-        Face* face = depths[i].face;
+        Face face = depths[i].face;
         if (wireFrame) {
             glBegin(GL_LINES);
         }
@@ -754,25 +759,25 @@ void OBJObjectAO::RenderGeometry() {
         }
 
         // Face normal
-        if (!smoothShading || face->NumVertexNormals() == 0) {
-            glNormal3f((GLfloat)face->GetNormal().X(),
-                       (GLfloat)face->GetNormal().Y(),
-                       (GLfloat)face->GetNormal().Z());
+        if (!smoothShading || face.NumVertexNormals() == 0) {
+            glNormal3f((GLfloat)face.GetNormal().X(),
+                       (GLfloat)face.GetNormal().Y(),
+                       (GLfloat)face.GetNormal().Z());
         }
 
         // Draw each vertex
-        for (int v = 0; v < face->NumVertices(); v++) {
+        for (int v = 0; v < face.NumVertices(); v++) {
             // Vertex normals
-            if (v < face->NumVertexNormals() && smoothShading) {
-                int index = face->GetVertexNormalIndex(v);
+            if (v < face.NumVertexNormals() && smoothShading) {
+                int index = face.GetVertexNormalIndex(v);
                 glNormal3f((GLfloat)vertexNormals[index].X(), 
                            (GLfloat)vertexNormals[index].Y(), 
                            (GLfloat)vertexNormals[index].Z());
             }
 
             // Texture coordinates
-            if (v < face->NumTextureCoords()) {
-                int index = face->GetTextureCoordIndex(v);
+            if (v < face.NumTextureCoords()) {
+                int index = face.GetTextureCoordIndex(v);
                 glTexCoord3f((GLfloat)(textureCoords[index].X() * subGroup->GetTextureScale().X()),
                              (GLfloat)(textureCoords[index].Y() * subGroup->GetTextureScale().Y()),
                              (GLfloat)(textureCoords[index].Z() * subGroup->GetTextureScale().Z()));
@@ -787,17 +792,17 @@ void OBJObjectAO::RenderGeometry() {
             float ao;
             float red;
             if (diffusion) {
-                ao = aoDiffusion[face->GetVertexIndex(v)];
-                red = aoValues[face->GetVertexIndex(v)];
+                ao = aoDiffusion[face.GetVertexIndex(v)];
+                red = aoValues[face.GetVertexIndex(v)];
             }
             else {
-                ao = aoValues[face->GetVertexIndex(v)];
+                ao = aoValues[face.GetVertexIndex(v)];
                 red = ao;
             }
 */
 
-            float ao = aoValues[face->GetVertexIndex(v)];
-            float aoSmooth = aoDiffusion[face->GetVertexIndex(v)];
+            float ao = aoValues[face.GetVertexIndex(v)];
+            float aoSmooth = aoDiffusion[face.GetVertexIndex(v)];
 
             if (diffusion) {
                 glVertexAttrib1f(aoOpacityLocation, aoSmooth);
@@ -812,8 +817,8 @@ void OBJObjectAO::RenderGeometry() {
 //            glTexCoord3f(red, red, red);
 
             // Color 
-            if (face->GetVertexIndex(v) < (int)vertexColors.size()) {
-                Vec3 colorValue = vertexColors[face->GetVertexIndex(v)];
+            if (face.GetVertexIndex(v) < (int)vertexColors.size()) {
+                Vec3 colorValue = vertexColors[face.GetVertexIndex(v)];
 //                glColor4f((float)colorValue.X(), (float)colorValue.Y(), (float)colorValue.Z(), ao);
 //                glColor4f(red, (float)colorValue.Y(), (float)colorValue.Z(), ao);
                 glColor3f((float)colorValue.X(), (float)colorValue.Y(), (float)colorValue.Z());
@@ -824,7 +829,7 @@ void OBJObjectAO::RenderGeometry() {
             }
 
             // Position
-            int index = face->GetVertexIndex(v);
+            int index = face.GetVertexIndex(v);
             glVertex3f((GLfloat)verts[index].X(), 
                        (GLfloat)verts[index].Y(), 
                        (GLfloat)verts[index].Z());
@@ -856,15 +861,15 @@ void OBJObjectAO::RenderDilated() {
 
 
     for (int i = 0; i < (int)depths.size(); i++) {   
-        Face* face = depths[i].face;
+        Face face = depths[i].face;
     
-        std::vector<Vec3> dilatedVerts(face->NumVertices());
-        std::vector<Vec3> erodedVerts(face->NumVertices());
+        std::vector<Vec3> dilatedVerts(face.NumVertices());
+        std::vector<Vec3> erodedVerts(face.NumVertices());
 
         // Set up vertices
-        for (int v = 0; v < face->NumVertices(); v++) {
-            Vec3 vertex = verts[face->GetVertexIndex(v)];
-            Vec3 normal = vertexNormals[face->GetVertexNormalIndex(v)];
+        for (int v = 0; v < face.NumVertices(); v++) {
+            Vec3 vertex = verts[face.GetVertexIndex(v)];
+            Vec3 normal = vertexNormals[face.GetVertexNormalIndex(v)];
 
             dilatedVerts[v] = vertex + normal * dilation;
             erodedVerts[v] = vertex - normal * dilation;
@@ -873,8 +878,8 @@ void OBJObjectAO::RenderDilated() {
 /*
         // Draw original face
         glBegin(GL_POLYGON);
-        for (int v = 0; v < face->NumVertices(); v++) {
-            int index = face->GetVertexIndex(v);
+        for (int v = 0; v < face.NumVertices(); v++) {
+            int index = face.GetVertexIndex(v);
 
             // Ambient occlusion
             float ao = aoValues[index];
@@ -897,11 +902,11 @@ void OBJObjectAO::RenderDilated() {
 
         // Draw dilated wedges
         glBegin(GL_POLYGON);
-        for (int v = 0; v < face->NumVertices(); v++) {
-            int v2 = v == face->NumVertices() - 1 ? 0 : v + 1;
+        for (int v = 0; v < face.NumVertices(); v++) {
+            int v2 = v == face.NumVertices() - 1 ? 0 : v + 1;
 
-            int index1 = face->GetVertexIndex(v);
-            int index2 = face->GetVertexIndex(v2);
+            int index1 = face.GetVertexIndex(v);
+            int index2 = face.GetVertexIndex(v2);
 
             float ao;
             float aoSmooth;
@@ -964,7 +969,7 @@ void OBJObjectAO::RenderDilated() {
 //            glVertexAttrib1f(aoOpacityLocation, dilatedAO);
 //            glVertexAttrib1f(aoColorLocation, dilatedAO);
 
-            int index = face->GetVertexIndex(v);
+            int index = face.GetVertexIndex(v);
 
             // Ambient occlusion
             float ao = aoValues[index] + (1.0f - aoValues[index]) * dilatedAO;
@@ -987,11 +992,11 @@ void OBJObjectAO::RenderDilated() {
 
         // Draw eroded wedges
         glBegin(GL_POLYGON);
-        for (int v = 0; v < face->NumVertices(); v++) {
-            int v2 = v == face->NumVertices() - 1 ? 0 : v + 1;
+        for (int v = 0; v < face.NumVertices(); v++) {
+            int v2 = v == face.NumVertices() - 1 ? 0 : v + 1;
 
-            int index1 = face->GetVertexIndex(v);
-            int index2 = face->GetVertexIndex(v2);
+            int index1 = face.GetVertexIndex(v);
+            int index2 = face.GetVertexIndex(v2);
 
             float ao;
             float aoSmooth;
@@ -1054,7 +1059,7 @@ void OBJObjectAO::RenderDilated() {
 //            glVertexAttrib1f(aoOpacityLocation, dilatedAO);
 //            glVertexAttrib1f(aoColorLocation, dilatedAO);
 
-            int index = face->GetVertexIndex(v);
+            int index = face.GetVertexIndex(v);
 
             // Ambient occlusion
             float ao = aoValues[index] + (1.0f - aoValues[index]) * dilatedAO;
@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        TextureCache.cpp
+//
+// Author:      David Borland
+//
+// Description: Loads mipmapped textures for materials.  Images are decoded and their mipmaps
+//              built by tasks on a worker pool, and each file is only loaded once while any
+//              material uses it.  The OpenGL texture is created on the render thread once
+//              decoding has finished.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "TextureCache.h"
+
+#include "FFmpegVideoFile.h"
+
+#include <ThreadPool.h>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <iostream>
+
+
+namespace {
+    // Nearest power of two, as gluBuild2DMipmaps() scales to
+    int PowerOfTwo(int size) {
+        int power = 1;
+        while (power * 2 <= size) power *= 2;
+
+        return size - power > power * 2 - size ? power * 2 : power;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+Texture::Texture(const std::string& textureFileName)
+: fileName(textureFileName), state(Decoding) {
+    format = GL_RGB;
+    texture = 0;
+}
+
+Texture::~Texture() {
+    if (texture) glDeleteTextures(1, &texture);
+}
+
+
+bool Texture::Update() {
+    if (state.load(std::memory_order_acquire) != Decoded) return false;
+
+    // Skip levels larger than the implementation supports
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+
+    int first = 0;
+    while (first < (int)levels.size() - 1 && (widths[first] > maxSize || heights[first] > maxSize)) {
+        first++;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    // RGB rows are not padded to four bytes
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int i = first; i < (int)levels.size(); i++) {
+        glTexImage2D(GL_TEXTURE_2D, i - first, format, widths[i], heights[i], 0,
+                     format, GL_UNSIGNED_BYTE, &levels[i][0]);
+    }
+
+    glPopClientAttrib();
+
+    // OpenGL has its own copy now
+    std::vector<std::vector<unsigned char> >().swap(levels);
+
+    state.store(Uploaded, std::memory_order_release);
+
+    return true;
+}
+
+
+bool Texture::Ready() const {
+    return state.load(std::memory_order_acquire) == Uploaded;
+}
+
+bool Texture::Loading() const {
+    int current = state.load(std::memory_order_acquire);
+    return current == Decoding || current == Decoded;
+}
+
+
+GLuint Texture::GetTexture() const {
+    return texture;
+}
+
+const std::string& Texture::GetFileName() const {
+    return fileName;
+}
+
+
+void Texture::Decode() {
+    AVFrame* frame = FFmpegVideoFile::ReadImage(fileName);
+
+    bool converted = false;
+    if (frame) {
+        // Keep an alpha channel only if the image has one
+        const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+        bool alpha = descriptor && (descriptor->flags & AV_PIX_FMT_FLAG_ALPHA);
+        format = alpha ? GL_RGBA : GL_RGB;
+
+        int width = PowerOfTwo(frame->width);
+        int height = PowerOfTwo(frame->height);
+
+        widths.push_back(width);
+        heights.push_back(height);
+        levels.push_back(std::vector<unsigned char>(width * height * (alpha ? 4 : 3)));
+
+        // Scaled to the power of two size and flipped to bottom row first
+        SwsContext* context = NULL;
+        converted = FFmpegVideoFile::ConvertFrame(context, frame, alpha ? VideoStream::RGBA : VideoStream::RGB,
+                                                  width, height, &levels[0][0]);
+
+        sws_freeContext(context);
+        av_frame_free(&frame);
+    }
+
+    if (!converted) {
+        std::cout << "Texture::Decode() : Could not load " << fileName << std::endl;
+
+        std::vector<std::vector<unsigned char> >().swap(levels);
+        state.store(Failed, std::memory_order_release);
+
+        return;
+    }
+
+    BuildMipmaps();
+
+    state.store(Decoded, std::memory_order_release);
+}
+
+void Texture::BuildMipmaps() {
+    int components = format == GL_RGBA ? 4 : 3;
+
+    // Average 2x2 blocks down to a single pixel.  Sides are powers of two, so once one side
+    // reaches a single pixel, average pairs along the other.
+    while (widths.back() > 1 || heights.back() > 1) {
+        int width = widths.back();
+        int height = heights.back();
+
+        int levelWidth = std::max(width / 2, 1);
+        int levelHeight = std::max(height / 2, 1);
+
+        levels.push_back(std::vector<unsigned char>(levelWidth * levelHeight * components));
+        widths.push_back(levelWidth);
+        heights.push_back(levelHeight);
+
+        const unsigned char* source = &levels[levels.size() - 2][0];
+        unsigned char* dest = &levels.back()[0];
+
+        int stepX = width > 1 ? components : 0;
+        int stepY = height > 1 ? width * components : 0;
+
+        for (int y = 0; y < levelHeight; y++) {
+            const unsigned char* row = source + (height > 1 ? y * 2 : y) * width * components;
+
+            for (int x = 0; x < levelWidth; x++) {
+                const unsigned char* p = row + (width > 1 ? x * 2 : x) * components;
+
+                for (int c = 0; c < components; c++) {
+                    *dest++ = (unsigned char)((p[c] + p[c + stepX] + p[c + stepY] + p[c + stepX + stepY] + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TextureCache::TextureCache(int numThreads) {
+    pool = new ThreadPool(numThreads);
+}
+
+TextureCache::~TextureCache() {
+    delete pool;
+}
+
+
+std::shared_ptr<Texture> TextureCache::Load(const std::string& fileName) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::shared_ptr<Texture> texture = textures[fileName].lock();
+    if (texture) return texture;
+
+    // Forget textures no longer used by any material
+    for (std::map<std::string, std::weak_ptr<Texture> >::iterator it = textures.begin(); it != textures.end();) {
+        if (it->second.expired() && it->first != fileName) it = textures.erase(it);
+        else ++it;
+    }
+
+    texture.reset(new Texture(fileName));
+    textures[fileName] = texture;
+
+    // Skip decoding if no material uses the texture by the time the task runs
+    std::weak_ptr<Texture> queued = texture;
+    pool->Enqueue([queued]() {
+        std::shared_ptr<Texture> texture = queued.lock();
+        if (texture) texture->Decode();
+    });
+
+    return texture;
+}
+
+void TextureCache::Wait() {
+    pool->Wait();
+}
+
+
+TextureCache& TextureCache::GetShared() {
+    static TextureCache cache;
+    return cache;
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        TextureCache.h
+//
+// Author:      David Borland
+//
+// Description: Loads mipmapped textures for materials.  Images are decoded and their mipmaps
+//              built by tasks on a worker pool, and each file is only loaded once while any
+//              material uses it.  The OpenGL texture is created on the render thread once
+//              decoding has finished.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class ThreadPool;
+
+
+class Texture {
+public:
+    ~Texture();
+
+    // Create the OpenGL texture if decoding has finished.  Call on the render thread, but not
+    // while compiling a display list.  Returns true if the texture was created by this call.
+    bool Update();
+
+    // True once the OpenGL texture has been created
+    bool Ready() const;
+
+    // True while the image is still being decoded
+    bool Loading() const;
+
+    GLuint GetTexture() const;
+
+    const std::string& GetFileName() const;
+
+private:
+    friend class TextureCache;
+
+    Texture(const std::string& textureFileName);
+
+    enum State {
+        Decoding,
+        Decoded,
+        Uploaded,
+        Failed
+    };
+
+    std::string fileName;
+    std::atomic<int> state;
+
+    // Mipmap levels, largest first, as GL_RGB or GL_RGBA bytes.  Freed once uploaded.
+    GLenum format;
+    std::vector<int> widths;
+    std::vector<int> heights;
+    std::vector<std::vector<unsigned char> > levels;
+
+    GLuint texture;
+
+    // Run on the worker pool
+    void Decode();
+    void BuildMipmaps();
+
+    // Not copyable
+    Texture(const Texture&);
+    Texture& operator=(const Texture&);
+};
+
+
+class TextureCache {
+public:
+    // Use 0 threads to match the number of cores
+    TextureCache(int numThreads = 0);
+    ~TextureCache();
+
+    // Start loading the file, or share the texture already loaded from it
+    std::shared_ptr<Texture> Load(const std::string& fileName);
+
+    // Block until all queued images have been decoded
+    void Wait();
+
+    // Cache shared by all materials
+    static TextureCache& GetShared();
+
+private:
+    // Textures by file name, kept while in use
+    std::map<std::string, std::weak_ptr<Texture> > textures;
+    std::mutex mutex;
+
+    ThreadPool* pool;
+
+    // Not copyable
+    TextureCache(const TextureCache&);
+    TextureCache& operator=(const TextureCache&);
+};
+
+
+#endif
\ No newline at end of file
@@ -15,7 +15,7 @@
 
 
 
-VideoCapture::VideoCapture() : VideoStream() {
+VideoCapture::VideoCapture() : DirectShowVideoStream() {
     captureGraph = NULL;
     captureSource = NULL;
     dummyRenderer = NULL;
@@ -13,10 +13,10 @@
 #define VIDEOCAPTURE_H
 
 
-#include "VideoStream.h"
+#include "DirectShowVideoStream.h"
 
 
-class VideoCapture : public VideoStream {
+class VideoCapture : public DirectShowVideoStream {
 public:
     VideoCapture();
     virtual ~VideoCapture();
@@ -15,7 +15,7 @@
 
 
 
-VideoFile::VideoFile() : VideoStream() {
+VideoFile::VideoFile() : DirectShowVideoStream() {
     loop = false;
 }
 
@@ -39,7 +39,7 @@ void VideoFile::Update() {
         }   
     }
 
-    VideoStream::Update();
+    DirectShowVideoStream::Update();
 }
 
 
@@ -69,11 +69,13 @@ void VideoFile::Jump(float seconds) {
     mediaSeeking->GetCurrentPosition(&position);
     mediaSeeking->GetStopPosition(&stopPosition);
 
-    // Jump, converting from seconds to 100 nanoseconds
+    // Jump, converting from seconds to 100 nanoseconds.  Landing on the nearest keyframe
+    // avoids decoding forward to the exact position, which stalls on long-GOP files.
     position += LONGLONG(seconds * 1e7);
     if (position < 0) position = 0;
     if (position > stopPosition) position = stopPosition;
-    mediaSeeking->SetPositions(&position, AM_SEEKING_AbsolutePositioning, &stopPosition, AM_SEEKING_NoPositioning);
+    mediaSeeking->SetPositions(&position, AM_SEEKING_AbsolutePositioning | AM_SEEKING_SeekToKeyFrame, 
+                               &stopPosition, AM_SEEKING_NoPositioning);
 }
 
 
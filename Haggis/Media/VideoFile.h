@@ -13,10 +13,10 @@
 #define VIDEOFILE_H
 
 
-#include "VideoStream.h"
+#include "DirectShowVideoStream.h"
 
 
-class VideoFile : public VideoStream {
+class VideoFile : public DirectShowVideoStream {
 public:
     VideoFile();
 
@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        VideoFrameRing.cpp
+//
+// Author:      David Borland
+//
+// Description: Lock-free single producer, single consumer ring of decoded video frames.
+//              A decode thread fills frames and the render thread picks the newest one
+//              that is due.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "VideoFrameRing.h"
+
+#include "FrameBufferArena.h"
+
+
+VideoFrameRing::VideoFrameRing() : readIndex(0), writeIndex(0) {
+    frameSize = 0;
+    ownsFrames = true;
+}
+
+VideoFrameRing::~VideoFrameRing() {
+    Free();
+}
+
+
+void VideoFrameRing::Allocate(int numFrames, int size, unsigned char* const* frameBuffers) {
+    Free();
+
+    frameSize = size;
+    ownsFrames = frameBuffers == NULL;
+
+    if (ownsFrames) {
+        if (numFrames < 2) numFrames = 2;
+
+        for (int i = 0; i < numFrames; i++) {
+            frames.push_back(FrameBufferArena::GetShared().Acquire(frameSize));
+        }
+    }
+    else {
+        frames.assign(frameBuffers, frameBuffers + numFrames);
+    }
+    times.resize(numFrames, 0.0);
+    generations.resize(numFrames, 0);
+
+    readIndex = 0;
+    writeIndex = 0;
+}
+
+
+int VideoFrameRing::GetNumFrames() const {
+    return (int)frames.size();
+}
+
+int VideoFrameRing::GetFrameSize() const {
+    return frameSize;
+}
+
+
+unsigned char* VideoFrameRing::BeginWrite() {
+    if (frames.empty()) return NULL;
+
+    unsigned int write = writeIndex.load(std::memory_order_relaxed);
+    unsigned int read = readIndex.load(std::memory_order_acquire);
+
+    if (write - read >= frames.size()) return NULL;
+
+    return frames[write % frames.size()];
+}
+
+void VideoFrameRing::EndWrite(double time, int generation) {
+    unsigned int write = writeIndex.load(std::memory_order_relaxed);
+    unsigned int slot = write % frames.size();
+
+    times[slot] = time;
+    generations[slot] = generation;
+
+    // Publish the frame
+    writeIndex.store(write + 1, std::memory_order_release);
+}
+
+
+const unsigned char* VideoFrameRing::Acquire(double now, int generation, double maxLag, 
+                                             unsigned int* sequence, double* frameTime) {
+    if (frames.empty()) return NULL;
+
+    unsigned int read = readIndex.load(std::memory_order_relaxed);
+    unsigned int write = writeIndex.load(std::memory_order_acquire);
+
+    // Drop frames from before the last seek.  Generations only increase, so these are always
+    // at the front.
+    while (read != write && generations[read % frames.size()] != generation) {
+        read++;
+    }
+
+    // Find the first due frame that is not too late, or else the newest due frame
+    unsigned int latest = read;
+    bool found = false;
+    for (unsigned int i = read; i != write; i++) {
+        double time = times[i % frames.size()];
+        if (time > now) break;
+
+        latest = i;
+        found = true;
+
+        if (time >= now - maxLag) break;
+    }
+
+    // Everything before the chosen frame can be reused by the producer
+    readIndex.store(latest, std::memory_order_release);
+
+    if (!found) return NULL;
+
+    if (sequence) *sequence = latest + 1;
+    if (frameTime) *frameTime = times[latest % frames.size()];
+
+    return frames[latest % frames.size()];
+}
+
+void VideoFrameRing::Release() {
+    readIndex.store(readIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+bool VideoFrameRing::Empty() const {
+    return readIndex.load(std::memory_order_acquire) == writeIndex.load(std::memory_order_acquire);
+}
+
+bool VideoFrameRing::Full() const {
+    unsigned int read = readIndex.load(std::memory_order_acquire);
+    unsigned int write = writeIndex.load(std::memory_order_acquire);
+
+    return frames.empty() || write - read >= frames.size();
+}
+
+
+void VideoFrameRing::Free() {
+    if (ownsFrames) {
+        for (int i = 0; i < (int)frames.size(); i++) {
+            FrameBufferArena::GetShared().Release(frames[i], frameSize);
+        }
+    }
+    frames.clear();
+    times.clear();
+    generations.clear();
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        VideoFrameRing.h
+//
+// Author:      David Borland
+//
+// Description: Lock-free single producer, single consumer ring of decoded video frames.
+//              A decode thread fills frames and the render thread picks the newest one
+//              that is due.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef VIDEOFRAMERING_H
+#define VIDEOFRAMERING_H
+
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+
+class VideoFrameRing {
+public:
+    VideoFrameRing();
+    ~VideoFrameRing();
+
+    // If frame buffers are given, e.g. mapped pixel buffer objects, they are used instead of
+    // taking buffers from the shared FrameBufferArena and are not freed here
+    void Allocate(int numFrames, int frameSize, unsigned char* const* frameBuffers = NULL);
+
+    int GetNumFrames() const;
+    int GetFrameSize() const;
+
+    // Producer.  BeginWrite() returns NULL if the ring is full.
+    unsigned char* BeginWrite();
+    void EndWrite(double time, int generation);
+
+    // Consumer.  Returns the oldest frame of the given generation that is due, i.e. with a 
+    // time no later than now, but no more than maxLag seconds late.  If every due frame is 
+    // later than that, returns the newest due frame.  Frames before the one returned are 
+    // dropped.  With a maxLag of zero this always picks the newest due frame.  Returns NULL 
+    // if no frame is due yet.  Frames from an older generation, e.g. from before a seek, are
+    // dropped.  The sequence number counts frames written, starting at 1.
+    const unsigned char* Acquire(double now, int generation, double maxLag = 0.0,
+                                 unsigned int* sequence = NULL, double* frameTime = NULL);
+    void Release();
+
+    bool Empty() const;
+    bool Full() const;
+
+private:
+    std::vector<unsigned char*> frames;
+    std::vector<double> times;
+    std::vector<int> generations;
+
+    int frameSize;
+    bool ownsFrames;
+
+    // Free-running counters.  Slot is counter % number of frames.
+    std::atomic<unsigned int> readIndex;
+    std::atomic<unsigned int> writeIndex;
+
+    void Free();
+
+    // Not copyable
+    VideoFrameRing(const VideoFrameRing&);
+    VideoFrameRing& operator=(const VideoFrameRing&);
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,277 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        VideoPoster.cpp
+//
+// Author:      David Borland
+//
+// Description: Poster frame for a video, taken from the first keyframe that decodes, along
+//              with the video's dimensions and length.  Posters are saved in the cache
+//              directory shared with KeyframeIndex, so they only need decoding once.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "VideoPoster.h"
+
+#include "FFmpegVideoFile.h"
+#include "KeyframeIndex.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+
+namespace {
+    const char cacheMagic[4] = { 'H', 'V', 'P', 'F' };
+    const int32_t cacheVersion = 1;
+
+    // Give up on videos with no keyframe that decodes near the start
+    const int maxPackets = 1000;
+
+    bool GetFileInfo(const std::string& fileName, int64_t& size, int64_t& modified) {
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0) return false;
+
+        size = (int64_t)info.st_size;
+        modified = (int64_t)info.st_mtime;
+
+        return true;
+    }
+}
+
+
+VideoPoster::VideoPoster() {
+    videoWidth = 0;
+    videoHeight = 0;
+    duration = 0.0;
+
+    width = 0;
+    height = 0;
+}
+
+
+bool VideoPoster::Load(const std::string& fileName, int maxSize) {
+    // Check the cache
+    int64_t size = 0;
+    int64_t modified = 0;
+    bool haveInfo = GetFileInfo(fileName, size, modified);
+
+    std::string cacheFileName = GetCacheFileName(fileName, maxSize);
+    if (haveInfo && !cacheFileName.empty() && ReadCache(cacheFileName, size, modified, maxSize)) return true;
+
+    if (!Decode(fileName, maxSize)) return false;
+
+    if (haveInfo && !cacheFileName.empty()) WriteCache(cacheFileName, size, modified);
+
+    return true;
+}
+
+
+int VideoPoster::GetVideoWidth() const {
+    return videoWidth;
+}
+
+int VideoPoster::GetVideoHeight() const {
+    return videoHeight;
+}
+
+double VideoPoster::GetDuration() const {
+    return duration;
+}
+
+
+int VideoPoster::GetWidth() const {
+    return width;
+}
+
+int VideoPoster::GetHeight() const {
+    return height;
+}
+
+const std::vector<unsigned char>& VideoPoster::GetData() const {
+    return data;
+}
+
+
+bool VideoPoster::Decode(const std::string& fileName, int maxSize) {
+    AVFormatContext* formatContext = NULL;
+    if (avformat_open_input(&formatContext, fileName.c_str(), NULL, NULL) != 0) {
+        std::cout << "VideoPoster::Decode() : Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    // The container header is enough for most files.  Only probe the packets if not, as it
+    // decodes frames from every stream.
+    int streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (streamIndex < 0 || formatContext->streams[streamIndex]->codecpar->width <= 0) {
+        avformat_find_stream_info(formatContext, NULL);
+        streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    }
+
+    if (streamIndex < 0) {
+        std::cout << "VideoPoster::Decode() : No video stream in " << fileName << std::endl;
+        avformat_close_input(&formatContext);
+        return false;
+    }
+
+    AVStream* stream = formatContext->streams[streamIndex];
+
+    if (stream->duration != AV_NOPTS_VALUE) {
+        duration = stream->duration * av_q2d(stream->time_base);
+    }
+    else if (formatContext->duration != AV_NOPTS_VALUE) {
+        duration = (double)formatContext->duration / AV_TIME_BASE;
+    }
+
+    // Only read the video
+    for (int i = 0; i < (int)formatContext->nb_streams; i++) {
+        if (i != streamIndex) formatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+
+    // Decode keyframes only
+    AVCodecContext* codecContext = NULL;
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (codec) codecContext = avcodec_alloc_context3(codec);
+
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    bool decoded = false;
+
+    if (codecContext && frame && packet &&
+        avcodec_parameters_to_context(codecContext, stream->codecpar) >= 0) {
+        codecContext->thread_count = 1;
+        codecContext->skip_frame = AVDISCARD_NONKEY;
+
+        if (avcodec_open2(codecContext, codec, NULL) >= 0) {
+            for (int i = 0; i < maxPackets && !decoded && av_read_frame(formatContext, packet) >= 0; i++) {
+                if (packet->stream_index == streamIndex && (packet->flags & AV_PKT_FLAG_KEY)) {
+                    avcodec_send_packet(codecContext, packet);
+                    decoded = avcodec_receive_frame(codecContext, frame) == 0;
+                }
+                av_packet_unref(packet);
+            }
+
+            // Some decoders hold the first frame back until flushed
+            if (!decoded) {
+                avcodec_send_packet(codecContext, NULL);
+                decoded = avcodec_receive_frame(codecContext, frame) == 0;
+            }
+        }
+    }
+
+
+    if (decoded) {
+        videoWidth = stream->codecpar->width > 0 ? stream->codecpar->width : frame->width;
+        videoHeight = stream->codecpar->height > 0 ? stream->codecpar->height : frame->height;
+
+        // Fit the poster in the maximum size
+        double scale = std::min(1.0, (double)maxSize / std::max(frame->width, frame->height));
+        width = std::max(1, (int)(frame->width * scale + 0.5));
+        height = std::max(1, (int)(frame->height * scale + 0.5));
+
+        data.resize(width * height * 4);
+
+        SwsContext* swsContext = NULL;
+        decoded = FFmpegVideoFile::ConvertFrame(swsContext, frame, VideoStream::RGBA, width, height, &data[0]);
+        sws_freeContext(swsContext);
+    }
+
+    if (!decoded) {
+        std::cout << "VideoPoster::Decode() : No keyframe decoded in " << fileName << std::endl;
+    }
+
+    if (packet) av_packet_free(&packet);
+    if (frame) av_frame_free(&frame);
+    if (codecContext) avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+
+    return decoded;
+}
+
+
+std::string VideoPoster::GetCacheFileName(const std::string& fileName, int maxSize) const {
+    const std::string& cacheDirectory = KeyframeIndex::GetCacheDirectory();
+    if (cacheDirectory.empty()) return "";
+
+    std::stringstream cacheFileName;
+    cacheFileName << cacheDirectory << "/" << std::hex << std::hash<std::string>()(fileName)
+                  << std::dec << "_" << maxSize << ".poster";
+
+    return cacheFileName.str();
+}
+
+bool VideoPoster::ReadCache(const std::string& cacheFileName, int64_t size, int64_t modified, int maxSize) {
+    std::ifstream file(cacheFileName.c_str(), std::ios::binary);
+    if (!file) return false;
+
+    char magic[4];
+    int32_t version;
+    int64_t cachedSize, cachedModified;
+    int32_t sizes[4];
+    double cachedDuration;
+
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&cachedSize, sizeof(cachedSize));
+    file.read((char*)&cachedModified, sizeof(cachedModified));
+    file.read((char*)sizes, sizeof(sizes));
+    file.read((char*)&cachedDuration, sizeof(cachedDuration));
+
+    // Decode again if the file has changed
+    if (!file || !std::equal(magic, magic + 4, cacheMagic) || version != cacheVersion ||
+        cachedSize != size || cachedModified != modified || sizes[2] <= 0 || sizes[3] <= 0) {
+        return false;
+    }
+
+    // A poster is never larger than it was requested, so a bigger one is a corrupt cache
+    int largest = std::max(maxSize, 1);
+    if (sizes[2] > largest || sizes[3] > largest) {
+        std::cout << "VideoPoster::ReadCache() : Invalid cache " << cacheFileName << std::endl;
+        return false;
+    }
+
+    data.resize((size_t)sizes[2] * sizes[3] * 4);
+    file.read((char*)&data[0], data.size());
+    if (!file) {
+        data.clear();
+        return false;
+    }
+
+    videoWidth = sizes[0];
+    videoHeight = sizes[1];
+    width = sizes[2];
+    height = sizes[3];
+    duration = cachedDuration;
+
+    return true;
+}
+
+bool VideoPoster::WriteCache(const std::string& cacheFileName, int64_t size, int64_t modified) const {
+    std::ofstream file(cacheFileName.c_str(), std::ios::binary);
+    if (!file) {
+        std::cout << "VideoPoster::WriteCache() : Could not write " << cacheFileName << std::endl;
+        return false;
+    }
+
+    int32_t sizes[4] = { videoWidth, videoHeight, width, height };
+
+    file.write(cacheMagic, sizeof(cacheMagic));
+    file.write((const char*)&cacheVersion, sizeof(cacheVersion));
+    file.write((const char*)&size, sizeof(size));
+    file.write((const char*)&modified, sizeof(modified));
+    file.write((const char*)sizes, sizeof(sizes));
+    file.write((const char*)&duration, sizeof(duration));
+    file.write((const char*)&data[0], data.size());
+
+    return (bool)file;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        VideoPoster.h
+//
+// Author:      David Borland
+//
+// Description: Poster frame for a video, taken from the first keyframe that decodes, along
+//              with the video's dimensions and length.  Posters are saved in the cache
+//              directory shared with KeyframeIndex, so they only need decoding once.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef VIDEOPOSTER_H
+#define VIDEOPOSTER_H
+
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+class VideoPoster {
+public:
+    VideoPoster();
+
+    // Load the poster from the cache, or decode it and cache it.  The poster fits within
+    // maxSize pixels on its longer side.
+    bool Load(const std::string& fileName, int maxSize = 512);
+
+    // Size of the video itself and its length in seconds, or 0 if not known
+    int GetVideoWidth() const;
+    int GetVideoHeight() const;
+    double GetDuration() const;
+
+    // Poster size and pixels, RGBA, bottom row first
+    int GetWidth() const;
+    int GetHeight() const;
+    const std::vector<unsigned char>& GetData() const;
+
+private:
+    int videoWidth;
+    int videoHeight;
+    double duration;
+
+    int width;
+    int height;
+    std::vector<unsigned char> data;
+
+    bool Decode(const std::string& fileName, int maxSize);
+
+    // Cache file for the video and poster size, identified by the file's size and
+    // modification time
+    std::string GetCacheFileName(const std::string& fileName, int maxSize) const;
+    bool ReadCache(const std::string& cacheFileName, int64_t size, int64_t modified, int maxSize);
+    bool WriteCache(const std::string& cacheFileName, int64_t size, int64_t modified) const;
+};
+
+
+#endif
\ No newline at end of file
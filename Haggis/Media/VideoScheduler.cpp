@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        VideoScheduler.cpp
+//
+// Author:      David Borland
+//
+// Description: Presents frames for a set of video streams against one master clock, so 
+//              clips started together stay in sync.  Each stream shows the frame whose 
+//              presentation time is due, and late frames are dropped according to the drop 
+//              policy.  Streams are updated, and so queue their decoding, in order of how
+//              much of the view they cover.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "VideoScheduler.h"
+
+#include "VideoStream.h"
+
+#include <algorithm>
+
+
+namespace {
+    bool HigherPriority(const VideoStream* a, const VideoStream* b) {
+        return a->GetPriority() > b->GetPriority();
+    }
+}
+
+
+VideoScheduler::VideoScheduler() {
+    time = VideoStream::GetSystemTime();
+
+    dropPolicy = DropToLatest;
+    maxLag = 0.1;
+}
+
+VideoScheduler::~VideoScheduler() {
+    for (int i = 0; i < (int)streams.size(); i++) {
+        streams[i]->SetScheduler(NULL);
+    }
+}
+
+
+void VideoScheduler::AddStream(VideoStream* stream) {
+    if (std::find(streams.begin(), streams.end(), stream) != streams.end()) return;
+
+    streams.push_back(stream);
+
+    stream->SetScheduler(this);
+    ApplyDropPolicy(stream);
+}
+
+void VideoScheduler::RemoveStream(VideoStream* stream) {
+    std::vector<VideoStream*>::iterator it = std::find(streams.begin(), streams.end(), stream);
+    if (it == streams.end()) return;
+
+    stream->SetScheduler(NULL);
+    streams.erase(it);
+}
+
+
+void VideoScheduler::SetDropPolicy(DropPolicy policy, double maxLagSeconds) {
+    dropPolicy = policy;
+    maxLag = maxLagSeconds;
+
+    for (int i = 0; i < (int)streams.size(); i++) {
+        ApplyDropPolicy(streams[i]);
+    }
+}
+
+VideoScheduler::DropPolicy VideoScheduler::GetDropPolicy() const {
+    return dropPolicy;
+}
+
+
+void VideoScheduler::SetClock(std::function<double()> masterClock) {
+    clock = masterClock;
+    time = clock ? clock() : VideoStream::GetSystemTime();
+}
+
+
+void VideoScheduler::Update() {
+    // Every stream sees the same clock time for this update
+    time = clock ? clock() : VideoStream::GetSystemTime();
+
+    for (int i = 0; i < (int)streams.size(); i++) {
+        Image* image = streams[i]->GetImage();
+        if (image) streams[i]->SetPriority(image->GetVisibleFraction());
+    }
+
+    // Largest first, so their decode tasks are queued first
+    std::stable_sort(streams.begin(), streams.end(), HigherPriority);
+
+    for (int i = 0; i < (int)streams.size(); i++) {
+        streams[i]->Update();
+    }
+}
+
+
+double VideoScheduler::GetTime() const {
+    return time;
+}
+
+
+VideoScheduler::Stats VideoScheduler::GetStats() const {
+    Stats stats;
+    stats.streams = (int)streams.size();
+    stats.presented = stats.dropped = 0;
+    stats.meanDrift = stats.maxDrift = stats.skew = 0.0;
+
+    double minDrift = 0.0;
+    double maxCurrentDrift = 0.0;
+    int numDrift = 0;
+
+    for (int i = 0; i < (int)streams.size(); i++) {
+        VideoStream::FrameStats frameStats = streams[i]->GetFrameStats();
+
+        stats.presented += frameStats.uploaded;
+        stats.dropped += frameStats.dropped;
+        stats.maxDrift = std::max(stats.maxDrift, frameStats.maxDrift);
+
+        // Streams that don't report presentation times have negative drift
+        if (streams[i]->Stopped() || frameStats.drift < 0.0) continue;
+
+        stats.meanDrift += frameStats.drift;
+
+        if (numDrift == 0 || frameStats.drift < minDrift) minDrift = frameStats.drift;
+        if (numDrift == 0 || frameStats.drift > maxCurrentDrift) maxCurrentDrift = frameStats.drift;
+        numDrift++;
+    }
+
+    if (numDrift > 0) {
+        stats.meanDrift /= numDrift;
+        stats.skew = maxCurrentDrift - minDrift;
+    }
+
+    return stats;
+}
+
+void VideoScheduler::ResetStats() {
+    for (int i = 0; i < (int)streams.size(); i++) {
+        streams[i]->ResetFrameStats();
+    }
+}
+
+
+void VideoScheduler::ApplyDropPolicy(VideoStream* stream) {
+    stream->SetMaxLag(dropPolicy == DropToLatest ? 0.0 : maxLag);
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        VideoScheduler.h
+//
+// Author:      David Borland
+//
+// Description: Presents frames for a set of video streams against one master clock, so 
+//              clips started together stay in sync.  Each stream shows the frame whose 
+//              presentation time is due, and late frames are dropped according to the drop 
+//              policy.  Streams are updated, and so queue their decoding, in order of how
+//              much of the view they cover.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef VIDEOSCHEDULER_H
+#define VIDEOSCHEDULER_H
+
+
+#include <functional>
+#include <vector>
+
+
+class VideoStream;
+
+
+class VideoScheduler {
+public:
+    VideoScheduler();
+    ~VideoScheduler();
+
+    enum DropPolicy {
+        DropToLatest,           // Show the newest frame that is due, dropping any before it
+        DropWhenBehind          // Show every frame in order, unless more than the maximum
+                                //      lag behind the clock
+    };
+
+    // Streams are not deleted here
+    void AddStream(VideoStream* stream);
+    void RemoveStream(VideoStream* stream);
+
+    void SetDropPolicy(DropPolicy policy, double maxLagSeconds = 0.1);
+    DropPolicy GetDropPolicy() const;
+
+    // Master clock in seconds, e.g. AudioMixer::GetClockTime() to follow the audio.  The
+    // system time is used by default.  Set before adding streams.
+    void SetClock(std::function<double()> masterClock);
+
+    // Sample the master clock and present the due frame of every stream.  Streams rendering
+    // into an image get a priority from the image's visible fraction.
+    void Update();
+
+    // Master clock time, in seconds, as of the last Update()
+    double GetTime() const;
+
+    // Totals over all streams since the stats were reset.  Drift is how far the presented 
+    // frame is behind each stream's clock, and skew is the spread in drift between the 
+    // streams at the last update.
+    struct Stats {
+        int streams;
+        unsigned int presented;
+        unsigned int dropped;
+        double meanDrift;
+        double maxDrift;
+        double skew;
+    };
+
+    Stats GetStats() const;
+    void ResetStats();
+
+private:
+    std::vector<VideoStream*> streams;
+
+    std::function<double()> clock;
+    double time;
+
+    DropPolicy dropPolicy;
+    double maxLag;
+
+    void ApplyDropPolicy(VideoStream* stream);
+};
+
+
+#endif
\ No newline at end of file
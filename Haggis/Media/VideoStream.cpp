@@ -4,153 +4,144 @@
 //
 // Author:      David Borland
 //
-// Description: Abstract class for playing a video stream using DirectShow
+// Description: Abstract class for playing a video stream into an Image.  Subclasses provide
+//              the decoder.
 //
 /////////////////////////////////////////////////////////////////////////////////////////////// 
 
 
 #include "VideoStream.h"
 
+#include "VideoScheduler.h"
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <vector>
 
 
 VideoStream::VideoStream() {
-    filterGraph = NULL;
-    sampleGrabber = NULL;
-    sampleGrabberInterface = NULL;
-    nullRenderer = NULL;
-    mediaControl = NULL;
-    mediaSeeking = NULL;
-
     width = height = bufferSize = 0;
-    buffer = NULL;
 
     image = NULL;
 
     videoType = RGB;
 
     stopped = true;
+
+    scheduler = NULL;
+    maxLag = 0.0;
+    priority = 1.0f;
+    targetHeight = 0;
+
+    uploadedSequence = 0;
+    heldStreamBuffer = -1;
+
+    frameStats.decoded = frameStats.uploaded = frameStats.skipped = frameStats.dropped = 0;
+    frameStats.drift = -1.0;
+    frameStats.maxDrift = 0.0;
+    decodedAtReset = 0;
 }
 
 VideoStream::~VideoStream() {
-/*
-    // Clean up
-    IEnumFilters *pEnum = NULL;
-    HRESULT hr = filterGraph->EnumFilters(&pEnum);
-    if (SUCCEEDED(hr)) {
-        IBaseFilter *pFilter = NULL;
-        while (S_OK == pEnum->Next(1, &pFilter, NULL)) {
-            // Remove the filter.
-            filterGraph->RemoveFilter(pFilter);
-            // Reset the enumerator.
-            pEnum->Reset();
-            pFilter->Release();
-        }
-   }
-   pEnum->Release();
-*/
-
-    if (mediaSeeking) mediaSeeking->Release();
-    if (mediaControl) mediaControl->Release();
-    if (nullRenderer) nullRenderer->Release();
-    if (sampleGrabberInterface) sampleGrabberInterface->Release();
-    if (sampleGrabber) sampleGrabber->Release();
-    if (filterGraph) filterGraph->Release();
-
-    if (buffer) delete [] buffer;
 }
 
 
 bool VideoStream::Initialize(const std::string& sourceName, Image* renderImage, VideoType type) {
-    // It is assumed that COM has been initialized here...
     name = sourceName;
     image = renderImage;
     videoType = type;
 
-    // Create the filter graph manager
-    if (CoCreateInstance(CLSID_FilterGraph, NULL, CLSCTX_INPROC_SERVER, IID_IGraphBuilder, (void**)&filterGraph) != S_OK) {
-        std::cout << "VideoStream::Initialize() : Could not create filterGraph." << std::endl;
-        return false;
-    }
-
-    // Create the video stream
-    if (!CreateVideoStream()) return false;
-
-
-    // Add the sample grabber
-    if (!AddSampleGrabber()) return false;
-
-
-    // Add the null renderer
-    if (!AddNullRenderer()) return false;
-
-
-    // Insert the sample grabber and null renderer
-    if (!InsertFilters()) return false;
-
-
-    // Set the video dimensions
-    if (!SetDimensions()) return false;
-
-    if (videoType == RGB) {
-        bufferSize = width * height * 3;
-    }
-    else if (videoType == RGBA) {
-        bufferSize = width * height * 4;
-    }
-    else {
-        std::cout << "VideoCapture::Initialize() : Invalid videoType." << std::endl;
-        return false;
-    }
-    buffer = new unsigned char[bufferSize];
-
-
-    // Get a media control interface
-    if (filterGraph->QueryInterface(IID_IMediaControl, (void**)&mediaControl) != S_OK) {
-        std::cout << "VideoCapture::Initialize() : Could not create mediaControl interface." << std::endl;
+    if (videoType != RGB && videoType != RGBA && videoType != YUV420) {
+        std::cout << "VideoStream::Initialize() : Invalid videoType." << std::endl;
         return false;
     }
 
-    // Get a media seeking interface
-    if (filterGraph->QueryInterface(IID_IMediaSeeking, (void**)&mediaSeeking) != S_OK) {        
-        std::cout << "VideoCapture::Initialize() : Could not create mediaSeeking interface." << std::endl;
-        return false;
-    }
+    // Open the source
+    if (!OpenStream()) return false;
 
 
     // If there is an image, initialize it
     if (image) {
-        // Get the pixel format.  DirectShow uses BGR and BGRA.
-        Image::PixelFormat pixelFormat;
-        if (videoType == VideoStream::RGB) {
-            pixelFormat = Image::BGR;
-        }
-        else if (videoType == VideoStream::RGBA) {
-            pixelFormat = Image::BGRA;
-        }
-        else {
-            std::cout << "VideoCapture::Initialize() : Error. Invalid video type." << std::endl;
-            return false;
-        }
-
         // Create the image
-        if (!image->SetTextureInfo(width, height, pixelFormat, Image::TEXTURE_RECTANGLE_PBO)) {
-            std::cout << "VideoCapture::Initialize() : Error.  Could not create texture." << std::endl;
+        if (!image->SetTextureInfo(width, height, GetPixelFormat(), Image::TEXTURE_RECTANGLE_PBO)) {
+            std::cout << "VideoStream::Initialize() : Error.  Could not create texture." << std::endl;
             return false;
         }
-        if (!image->SetTextureData(buffer)) {
-            std::cout << "VideoCapture::Initialize() : Error.  Could not set texture data." << std::endl;
-            return false;
+
+        // Start with black until the first frame arrives, unless the image keeps showing what
+        // it had, e.g. a poster frame.  Black in YUV is 16 for luma and 128 for chroma.
+        if (!image->KeepingTexture()) {
+            std::vector<unsigned char> black(bufferSize, 0);
+            if (videoType == YUV420) {
+                std::fill(black.begin(), black.begin() + width * height, 16);
+                std::fill(black.begin() + width * height, black.end(), 128);
+            }
+            if (!image->SetTextureData(&black[0])) {
+                std::cout << "VideoStream::Initialize() : Error.  Could not set texture data." << std::endl;
+                return false;
+            }
         }
     }
 
 
-    return true;    
+    return StartStream();    
 }
 
 void VideoStream::Update() {
     if (!stopped && image) {
-        image->SetTextureData(GetBuffer());
+        // Give back the last frame once the GPU is done with it
+        if (heldStreamBuffer >= 0) {
+            if (!image->StreamBufferReady(heldStreamBuffer)) {
+                frameStats.skipped++;
+                return;
+            }
+
+            ReleaseFrame();
+            heldStreamBuffer = -1;
+        }
+
+        // Nothing to see
+        if (priority <= 0.0f) {
+            frameStats.skipped++;
+            return;
+        }
+
+        // Only upload frames that have not been uploaded yet
+        unsigned int sequence;
+        double frameTime;
+        const unsigned char* frame = AcquireFrame(sequence, frameTime);
+        if (frame) {
+            // Frames already in a pixel buffer object don't need to be copied
+            int streamBuffer = image->GetStreamBufferIndex(frame);
+            if (streamBuffer >= 0) {
+                image->UploadStreamBuffer(streamBuffer);
+                heldStreamBuffer = streamBuffer;
+            }
+            else {
+                image->SetTextureData(frame);
+                ReleaseFrame();
+            }
+
+            // Frames skipped over since the last upload
+            if (uploadedSequence > 0 && sequence > uploadedSequence + 1) {
+                frameStats.dropped += sequence - uploadedSequence - 1;
+            }
+
+            double playbackTime = GetPlaybackTime();
+            if (frameTime >= 0.0 && playbackTime >= 0.0) {
+                frameStats.drift = std::max(playbackTime - frameTime, 0.0);
+                frameStats.maxDrift = std::max(frameStats.maxDrift, frameStats.drift);
+            }
+
+            uploadedSequence = sequence;
+            frameStats.uploaded++;
+        }
+        else {
+            frameStats.skipped++;
+        }
     }
 }
 
@@ -177,203 +168,79 @@ VideoStream::VideoType VideoStream::GetVideoType() const {
 }
 
 
-const unsigned char* VideoStream::GetBuffer() {
-    sampleGrabberInterface->GetCurrentBuffer(&bufferSize, (long*)buffer);
-    return buffer;
-}
-
-
 const std::string& VideoStream::GetName() const {
     return name;
 }
 
 
-void VideoStream::Play() {
-    mediaControl->Run();
-    stopped = false;
-}
-
-
-void VideoStream::Stop() {
-    mediaControl->Stop();
-    stopped = true;
-}
-
-
 bool VideoStream::Stopped() {
     return stopped;
 }
 
 
-bool VideoStream::AddSampleGrabber() {
-    // Create the sample grabber
-    if (CoCreateInstance(CLSID_SampleGrabber, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&sampleGrabber) != S_OK) {
-        std::cout << "VideoStream::AddSampleGrabber() : Could not create sampleGrabber.\n";
-        return false;
-    }
-
-    // Query the sample grabber for the sample grabber interface
-    sampleGrabberInterface = NULL;
-    if (sampleGrabber->QueryInterface(IID_ISampleGrabber, (void**)&sampleGrabberInterface) != S_OK) {
-        std::cout << "VideoStream::AddSampleGrabber() : Could not create sampleGrabber interface.\n";   
-        return false;
-    }
-
-    // Specify the media type to process
-    AM_MEDIA_TYPE mt;
-    ZeroMemory(&mt, sizeof(AM_MEDIA_TYPE));
-    mt.majortype = MEDIATYPE_Video;
-    if (videoType == RGB) {
-        mt.subtype = MEDIASUBTYPE_RGB24;
-    }
-    else if (videoType == RGBA) {
-        mt.subtype = MEDIASUBTYPE_RGB32;
-    }
-    else {
-        std::cout << "VideoStream::AddSampleGrabber() : Invalid videoType." << std::endl;
-        return false;
-    }
-    mt.formattype = FORMAT_VideoInfo;
-    if (sampleGrabberInterface->SetMediaType(&mt) != S_OK) {
-        std::cout << "VideoStream::AddSampleGrabber() : Could not set sampleGrabber interface media type." << std::endl;
-        return false;
-    }
-
-    // Set working mode as continuous with a buffer
-    sampleGrabberInterface->SetOneShot(FALSE);
-    sampleGrabberInterface->SetBufferSamples(TRUE);    
-    
-    // Add the sample grabber to the filter graph
-    if (filterGraph->AddFilter(sampleGrabber, L"Sample Grabber") != S_OK) {
-        std::cout << "VideoStream::AddSampleGrabber() : Could not add sampleGrabber to filter graph." << std::endl;
-        return false;
-    }
-
-/*
-    // Set up the callback
-    sampleGrabberCB = new SampleGrabberCB();
-    sampleGrabberInterface->SetCallback(sampleGrabberCB, 0);
-*/
-
-    return true;
+void VideoStream::SetScheduler(VideoScheduler* videoScheduler) {
+    scheduler = videoScheduler;
 }
 
-
-bool VideoStream::AddNullRenderer() {
-    // Create a null renderer
-    nullRenderer = NULL;
-    if (CoCreateInstance(CLSID_NullRenderer, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&nullRenderer) != S_OK) {
-        std::cout << "VideoStream::AddNullRenderer() : Could not create nullRenderer." << std::endl;
-        return false;
-    }
-
-    // Add the null renderer to the filter graph
-    if (filterGraph->AddFilter(nullRenderer, L"Null Renderer") != S_OK) {
-        std::cout << "VideoStream::AddNullRenderer() : Could not add nullRenderer to filterGraph." << std::endl;
-        return false;
-    }
-
-    return true;
+double VideoStream::GetClockTime() const {
+    return scheduler ? scheduler->GetTime() : GetSystemTime();
 }
 
+double VideoStream::GetSystemTime() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-bool VideoStream::InsertFilters() {
-    // Locate default video renderer
-    IBaseFilter* videoRenderer = NULL;
-    filterGraph->FindFilterByName(L"Video Renderer", &videoRenderer);
-    if (videoRenderer) {
-        // Get input pin of video renderer.
-        IPin* ipin = GetPin(videoRenderer, PINDIR_INPUT);
-        IPin* opin = NULL;
-
-        // Find out who the renderer is connected to and disconnect from them
-        ipin->ConnectedTo(&opin);
-        ipin->Disconnect();
-        opin->Disconnect();
-
-        ipin->Release();
-
-        // Remove the default renderer from the graph		
-        filterGraph->RemoveFilter(videoRenderer);
-        videoRenderer->Release();
 
-        // See if the video renderer was originally connected to a color space converter
-        IBaseFilter* colorConverter = NULL;
-        filterGraph->FindFilterByName(L"Color Space Converter", &colorConverter);
+void VideoStream::SetMaxLag(double seconds) {
+    maxLag = seconds < 0.0 ? 0.0 : seconds;
+}
 
-        if (colorConverter) {
-	        opin->Release();
 
-	        // Remove the converter from the graph
-	        ipin = GetPin(colorConverter, PINDIR_INPUT);
+void VideoStream::SetPriority(float streamPriority) {
+    priority = streamPriority;
+}
 
-	        ipin->ConnectedTo(&opin);
-	        ipin->Disconnect();
-	        opin->Disconnect();
+float VideoStream::GetPriority() const {
+    return priority;
+}
 
-	        ipin->Release();
-        	
-	        filterGraph->RemoveFilter(colorConverter);
-	        colorConverter->Release();
-        }
 
-        // Get the input pin of the sample grabber
-        ipin = GetPin(sampleGrabber, PINDIR_INPUT);
+void VideoStream::SetTargetHeight(int pixels) {
+    targetHeight = pixels < 0 ? 0 : pixels;
+}
 
-        // Connect the filter that was originally connected to the default renderer to the sample grabber
-        filterGraph->Connect(opin, ipin);
-        ipin->Release();
-        opin->Release();
 
-        // Get output pin of sample grabber
-        opin = GetPin(sampleGrabber, PINDIR_OUTPUT);
+VideoStream::FrameStats VideoStream::GetFrameStats() const {
+    FrameStats stats = frameStats;
+    stats.decoded = GetDecodedFrames() - decodedAtReset;
+    return stats;
+}
 
-        // Get input pin of null renderer
-        ipin = GetPin(nullRenderer, PINDIR_INPUT);
+void VideoStream::ResetFrameStats() {
+    decodedAtReset = GetDecodedFrames();
+    frameStats.uploaded = 0;
+    frameStats.skipped = 0;
+    frameStats.dropped = 0;
+    frameStats.drift = -1.0;
+    frameStats.maxDrift = 0.0;
+}
 
-        // Connect them
-        filterGraph->Connect(opin, ipin);
-        ipin->Release();
-        opin->Release();
-    }
 
+bool VideoStream::StartStream() {
     return true;
 }
 
-IPin* VideoStream::GetPin(IBaseFilter* filter, PIN_DIRECTION pinDir) {
-    BOOL found = FALSE;
-    IEnumPins* enumPins;
-    IPin* pin;
-
-    if (filter->EnumPins(&enumPins) != S_OK) {
-        return NULL;
-    }
-
-    while (enumPins->Next(1, &pin, 0) == S_OK) {
-        PIN_DIRECTION thisPinDir;
-        pin->QueryDirection(&thisPinDir);
-        found = (pinDir == thisPinDir);
-        if (found) break;
-        pin->Release();
-    }
 
-    enumPins->Release();
-    return (found ? pin : NULL);  
+void VideoStream::ReleaseFrame() {
 }
 
 
-bool VideoStream::SetDimensions() {
-    AM_MEDIA_TYPE mediaType;
-    
-    if (sampleGrabberInterface->GetConnectedMediaType(&mediaType) != S_OK) {
-        std::cout << "VideoStream::SetDimensions() : Could not get connected media type." << std::endl;
-        return false;
-    }
-
-    VIDEOINFOHEADER* videoInfo = (VIDEOINFOHEADER*)mediaType.pbFormat;
+double VideoStream::GetPlaybackTime() const {
+    return -1.0;
+}
 
-    width = videoInfo->bmiHeader.biWidth;
-    height = videoInfo->bmiHeader.biHeight;
 
-    return true;
+ThreadPool& VideoStream::GetDecodePool() {
+    static ThreadPool pool;
+    return pool;
 }
\ No newline at end of file
@@ -4,7 +4,8 @@
 //
 // Author:      David Borland
 //
-// Description: Abstract class for playing a video stream using DirectShow
+// Description: Abstract class for playing a video stream into an Image.  Subclasses provide
+//              the decoder.
 //
 /////////////////////////////////////////////////////////////////////////////////////////////// 
 
@@ -15,48 +16,11 @@
 
 #include "Image.h"
 
-// Hack to deal with the fact that qedit.h is not included in recent versions of the Windows or DirectX SDK
-#pragma include_alias( "dxtrans.h", "qedit.h" )
-#define __IDxtCompositor_INTERFACE_DEFINED__
-#define __IDxtAlphaSetter_INTERFACE_DEFINED__
-#define __IDxtJpeg_INTERFACE_DEFINED__
-#define __IDxtKey_INTERFACE_DEFINED__
-#include "qedit.h"
-
-#include <DShow.h>
 #include <string>
 
 
-/*
-class SampleGrabberCB : public ISampleGrabberCB {
-public:
-    SampleGrabberCB() : ISampleGrabberCB() {}
-    ~SampleGrabberCB() {}
-
-
-    STDMETHODIMP SampleCB(double SampleTime, IMediaSample* pSample) { printf("Here\n"); 
-                                                                      BYTE* data;
-                                                                      pSample->GetPointer(&data);
-                                                                      return TRUE;}
-    STDMETHODIMP BufferCB(double SampleTime, BYTE* pBuffer, long BufferLen) { return FALSE; }
-
-
-    // Implement COM reference counting
-    STDMETHODIMP_(ULONG) AddRef() { return (++refCount); }
-    STDMETHODIMP_(ULONG) Release() { return (--refCount); }
-
-    // Implement COM querying
-    STDMETHODIMP QueryInterface(REFIID riid, void ** ppv) {
-        *ppv = this;
-        this->AddRef();
-        return S_OK;
-    }
-
-private:
-    ULONG refCount;
-};
-*/
-
+class ThreadPool;
+class VideoScheduler;
 
 
 class VideoStream {
@@ -66,7 +30,9 @@ public:
 
     enum VideoType {
         RGB,
-        RGBA
+        RGBA,
+        YUV420      // Planar 4:2:0, converted to RGB when rendered.  Less than half the 
+                    //      upload bandwidth of RGBA.
     };
 
     bool Initialize(const std::string& sourceName, Image* renderImage = NULL, VideoType type = RGB);
@@ -78,27 +44,52 @@ public:
     int GetWidth() const;
     int GetHeight() const;
     VideoType GetVideoType() const;  
-    
-    const unsigned char* GetBuffer();
 
     const std::string& GetName() const;
 
-    void Play();
-    void Stop();
+    virtual void Play() = 0;
+    virtual void Stop() = 0;
     
     bool Stopped();
 
-protected:
-    IGraphBuilder* filterGraph;
-    IBaseFilter* sampleGrabber;
-    ISampleGrabber* sampleGrabberInterface;
-    IBaseFilter* nullRenderer;
-    IMediaControl* mediaControl;
-    IMediaSeeking* mediaSeeking;
+    // Streams added to a scheduler run on its master clock, otherwise on the system clock
+    void SetScheduler(VideoScheduler* videoScheduler);
+    double GetClockTime() const;
+
+    static double GetSystemTime();
+
+    // Frames due more than this many seconds ago are dropped in favour of the newest due 
+    // frame.  Within it, frames are shown in order.  Zero always shows the newest due frame.
+    void SetMaxLag(double seconds);
+
+    // Decoding is scheduled in order of priority, e.g. the fraction of the screen covered.
+    // Streams with a priority of zero or less are offscreen.  They don't upload frames, and
+    // decoders pause.
+    void SetPriority(float streamPriority);
+    float GetPriority() const;
+
+    // Height in pixels the video is shown at.  Decoders can decode at a lower resolution, 
+    // no smaller than this.  Zero for full resolution.
+    void SetTargetHeight(int pixels);
+
+    // Frame counts since the stream was created or the stats were reset
+    struct FrameStats {
+        unsigned int decoded;       // Frames produced by the decoder
+        unsigned int uploaded;      // Frames copied to the texture
+        unsigned int skipped;       // Updates with no new frame to upload
+        unsigned int dropped;       // Frames decoded but never shown, including those 
+                                    //      discarded by seeks
+        double drift;               // Seconds the last frame shown was behind the stream
+                                    //      clock, or -1 if the decoder has no timestamps
+        double maxDrift;
+    };
+
+    FrameStats GetFrameStats() const;
+    void ResetFrameStats();
 
+protected:
     unsigned int width, height;
     long bufferSize;
-    unsigned char* buffer;
     
     VideoType videoType;
 
@@ -109,15 +100,44 @@ protected:
 
     bool stopped;
 
-    // Pure virtual function that must be implemented by base classes
-    virtual bool CreateVideoStream() = 0;
+    VideoScheduler* scheduler;
+    double maxLag;
+    float priority;
+    int targetHeight;
+
+    // Sequence number of the last frame uploaded.  Sequence numbers start at 1.
+    unsigned int uploadedSequence;
+
+    // A frame decoded straight into one of the image's stream buffers is held until the GPU
+    // has finished copying it to the texture
+    int heldStreamBuffer;
+
+    FrameStats frameStats;
+    unsigned int decodedAtReset;
+
+    // Open the source named by name and set width, height and bufferSize
+    virtual bool OpenStream() = 0;
+
+    // Called after the image texture has been created
+    virtual bool StartStream();
+
+    // Pixel format of the frames returned by AcquireFrame()
+    virtual Image::PixelFormat GetPixelFormat() const = 0;
+
+    // Get the frame to show now with its sequence number and presentation time, or NULL if 
+    // there is no frame newer than uploadedSequence.  The time is -1 if not known.  The frame 
+    // must stay valid until ReleaseFrame() is called.
+    virtual const unsigned char* AcquireFrame(unsigned int& sequence, double& frameTime) = 0;
+    virtual void ReleaseFrame();
+
+    // Position of the stream clock in seconds, or -1 if the decoder keeps its own clock
+    virtual double GetPlaybackTime() const;
 
-    bool AddSampleGrabber();
-    bool AddNullRenderer();
-    bool InsertFilters();
-    IPin* GetPin(IBaseFilter* filter, PIN_DIRECTION pinDir);
+    // Total number of frames produced by the decoder
+    virtual unsigned int GetDecodedFrames() const = 0;
 
-    bool SetDimensions();
+    // Worker threads shared by all decoders, one per core
+    static ThreadPool& GetDecodePool();
 };
 
 
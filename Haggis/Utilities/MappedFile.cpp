@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        MappedFile.cpp
+//
+// Author:      David Borland
+//
+// Description: Read-only memory mapping of a file
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile() {
+    data = NULL;
+    size = 0;
+
+#ifdef _WIN32
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+#else
+    file = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+
+bool MappedFile::Open(const std::string& fileName) {
+    Close();
+
+#ifdef _WIN32
+    file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        Close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+
+    // Can't map an empty file, but it is still valid
+    if (size == 0) return true;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        Close();
+        return false;
+    }
+
+    data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        Close();
+        return false;
+    }
+#else
+    file = open(fileName.c_str(), O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0) {
+        Close();
+        return false;
+    }
+    size = (size_t)fileStat.st_size;
+
+    // Can't map an empty file, but it is still valid
+    if (size == 0) return true;
+
+    void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (address == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    data = (const char*)address;
+
+    // Files are almost always read front to back
+    madvise(address, size, MADV_SEQUENTIAL);
+#endif
+
+    return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap((void*)data, size);
+    if (file >= 0) close(file);
+
+    file = -1;
+#endif
+
+    data = NULL;
+    size = 0;
+}
+
+
+bool MappedFile::IsOpen() const {
+#ifdef _WIN32
+    return file != INVALID_HANDLE_VALUE;
+#else
+    return file >= 0;
+#endif
+}
+
+
+const char* MappedFile::GetData() const {
+    return data;
+}
+
+size_t MappedFile::GetSize() const {
+    return size;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        MappedFile.h
+//
+// Author:      David Borland
+//
+// Description: Read-only memory mapping of a file
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+
+#include <string>
+
+
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const std::string& fileName);
+    void Close();
+
+    bool IsOpen() const;
+
+    const char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    const char* data;
+    size_t size;
+
+    // Platform file handles
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+
+    // Not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,209 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        ThreadPool.cpp
+//
+// Author:      David Borland
+//
+// Description: Fixed-size pool of worker threads for running independent tasks.  Each
+//              worker has its own queue and steals from the others when it runs out, so
+//              workers rarely contend for the same lock.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+
+namespace {
+    // The pool and queue of the worker running on this thread, if any
+    thread_local ThreadPool* currentPool = NULL;
+    thread_local int currentQueue = -1;
+}
+
+
+ThreadPool::ThreadPool(int numThreads) : nextQueue(0) {
+    queuedTasks = 0;
+    pendingTasks = 0;
+    stopping = false;
+
+    if (numThreads <= 0) {
+        numThreads = (int)std::thread::hardware_concurrency();
+        if (numThreads <= 0) numThreads = 1;
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskCondition.notify_all();
+
+    for (int i = 0; i < (int)threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+
+void ThreadPool::Enqueue(const std::function<void()>& task) {
+    int index;
+    if (currentPool == this) {
+        index = currentQueue;
+    }
+    else {
+        index = (int)(nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size());
+    }
+
+    // Count the task before a worker can take it, so the counts never go negative and Wait()
+    // can't return while it is queued
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queuedTasks++;
+        pendingTasks++;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(task);
+    }
+    taskCondition.notify_one();
+}
+
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (pendingTasks > 0) {
+        doneCondition.wait(lock);
+    }
+}
+
+
+void ThreadPool::ParallelFor(int count, int grainSize, const std::function<void(int, int)>& func) {
+    if (count <= 0) return;
+    if (grainSize < 1) grainSize = 1;
+
+    // Shared with the helper tasks, which may only start once the work is done
+    struct Range {
+        std::function<void(int, int)> func;
+        int count;
+        int grainSize;
+        int numRanges;
+
+        std::atomic<int> next;
+        std::atomic<int> done;
+
+        std::mutex mutex;
+        std::condition_variable doneCondition;
+    };
+
+    std::shared_ptr<Range> range = std::make_shared<Range>();
+    range->func = func;
+    range->count = count;
+    range->grainSize = grainSize;
+    range->numRanges = (count + grainSize - 1) / grainSize;
+    range->next = 0;
+    range->done = 0;
+
+    std::function<void()> run = [range]() {
+        while (true) {
+            int i = range->next.fetch_add(1);
+            if (i >= range->numRanges) return;
+
+            int begin = i * range->grainSize;
+            range->func(begin, std::min(begin + range->grainSize, range->count));
+
+            if (range->done.fetch_add(1) + 1 == range->numRanges) {
+                std::unique_lock<std::mutex> lock(range->mutex);
+                range->doneCondition.notify_all();
+            }
+        }
+    };
+
+    // The calling thread takes ranges too, so this finishes even if every worker is busy
+    int numHelpers = std::min(range->numRanges, NumThreads()) - 1;
+    for (int i = 0; i < numHelpers; i++) {
+        Enqueue(run);
+    }
+
+    run();
+
+    std::unique_lock<std::mutex> lock(range->mutex);
+    while (range->done < range->numRanges) {
+        range->doneCondition.wait(lock);
+    }
+}
+
+
+int ThreadPool::NumThreads() const {
+    return (int)threads.size();
+}
+
+
+void ThreadPool::WorkerLoop(int index) {
+    currentPool = this;
+    currentQueue = index;
+
+    while (true) {
+        std::function<void()> task;
+
+        if (!PopTask(index, task)) {
+            // Sleep until there is something to take
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping && queuedTasks <= 0) {
+                taskCondition.wait(lock);
+            }
+
+            if (stopping && queuedTasks <= 0) return;
+
+            continue;
+        }
+
+        task();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            pendingTasks--;
+            if (pendingTasks == 0) doneCondition.notify_all();
+        }
+    }
+}
+
+
+bool ThreadPool::PopTask(int index, std::function<void()>& task) {
+    int numQueues = (int)queues.size();
+
+    for (int i = 0; i < numQueues; i++) {
+        WorkerQueue& queue = *queues[(index + i) % numQueues];
+
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+
+        if (i == 0) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        else {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+
+        lock.unlock();
+
+        std::unique_lock<std::mutex> countLock(mutex);
+        queuedTasks--;
+
+        return true;
+    }
+
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Name:        ThreadPool.h
+//
+// Author:      David Borland
+//
+// Description: Fixed-size pool of worker threads for running independent tasks.  Each
+//              worker has its own queue and steals from the others when it runs out, so
+//              workers rarely contend for the same lock.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool {
+public:
+    // Use 0 threads to match the number of cores
+    ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    // Add a task.  Tasks added from outside the pool are spread over the workers' queues in
+    // turn, and tasks added by a task go to the current worker's queue.  Each worker runs 
+    // its own tasks in order.
+    void Enqueue(const std::function<void()>& task);
+
+    // Block until all queued tasks have finished
+    void Wait();
+
+    // Call func(begin, end) over ranges of about grainSize covering [0, count), on the
+    // workers and the calling thread, and return once every range has finished.  Can be
+    // called from a task.
+    void ParallelFor(int count, int grainSize, const std::function<void(int, int)>& func);
+
+    int NumThreads() const;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkerQueue> > queues;
+
+    // Queue for the next task added from outside the pool
+    std::atomic<unsigned int> nextQueue;
+
+    // Only used to put idle workers to sleep and to wait for tasks to finish
+    std::mutex mutex;
+    std::condition_variable taskCondition;
+    std::condition_variable doneCondition;
+
+    // Tasks queued, and tasks queued or running
+    int queuedTasks;
+    int pendingTasks;
+
+    bool stopping;
+
+    void WorkerLoop(int index);
+
+    // Take from the front of the worker's own queue, or else from the back of another's
+    bool PopTask(int index, std::function<void()>& task);
+};
+
+
+#endif
\ No newline at end of file